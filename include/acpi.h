@@ -0,0 +1,60 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * ACPI Table Definitions
+ *
+ * Only the tables needed to find the processors are parsed: the root
+ * system description pointer (RSDP), the root table (RSDT) and the
+ * multiple APIC description table (MADT).
+ */
+#ifndef ACPI_H
+#define ACPI_H
+
+// Maximum number of processors recorded from the MADT
+#ifndef ACPI_CPUS_MAX
+#define ACPI_CPUS_MAX       16
+#endif
+
+// Common header of every description table
+typedef struct acpi_header_t {
+    char signature[4];              // Table signature (e.g. "APIC")
+    unsigned int length;            // Length of the table including the header
+    unsigned char revision;
+    unsigned char checksum;         // All bytes of the table sum to zero
+    char oem_id[6];
+    char oem_table_id[8];
+    unsigned int oem_revision;
+    unsigned int creator_id;
+    unsigned int creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+// Interrupt controllers described by the MADT
+typedef struct acpi_madt_info_t {
+    unsigned int lapic_addr;                // Physical address of the local APICs
+    unsigned int ioapic_addr;               // Physical address of the first I/O APIC (0 if none)
+    int nr_cpus;                            // Number of usable processors
+    unsigned char apic_ids[ACPI_CPUS_MAX];  // Local APIC id of each processor
+} acpi_madt_info_t;
+
+/**
+ * Locates the ACPI tables
+ * @return -1 if no valid tables are found; 0 on success
+ */
+int acpi_init(void);
+
+/**
+ * Finds a description table by its signature
+ * @param signature - four character table signature
+ * @return pointer to the table or NULL if it is not present
+ */
+acpi_header_t *acpi_find_table(char *signature);
+
+/**
+ * Obtains the processors and interrupt controllers from the MADT
+ * @param info - receives the description
+ * @return -1 if there is no usable MADT; 0 on success
+ */
+int acpi_madt_parse(acpi_madt_info_t *info);
+
+#endif
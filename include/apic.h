@@ -0,0 +1,66 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Local APIC Definitions
+ *
+ * Each CPU's local APIC is used to send and receive inter-processor
+ * interrupts (IPIs). Device interrupts still arrive through the PIC,
+ * which the boot CPU's APIC passes through in virtual wire mode.
+ */
+#ifndef APIC_H
+#define APIC_H
+
+#include <spede/stdbool.h>
+
+/**
+ * Maps the local APICs and enables the boot CPU's
+ * @param addr - physical address of the local APICs
+ * @return -1 on error; 0 on success
+ */
+int apic_init(unsigned int addr);
+
+/**
+ * Enables the local APIC of the CPU that is running
+ * @param bsp - true on the boot CPU, which receives the PIC interrupts
+ */
+void apic_init_cpu(bool bsp);
+
+/**
+ * Returns the local APIC id of the CPU that is running
+ * @return APIC id
+ */
+int apic_id(void);
+
+/**
+ * Signals the end of an interrupt delivered by the local APIC
+ */
+void apic_eoi(void);
+
+/**
+ * Sends an interrupt to another CPU
+ * @param apic_id - APIC id of the target CPU
+ * @param vector - interrupt vector
+ */
+void apic_send_ipi(int apic_id, int vector);
+
+/**
+ * Sends an interrupt to every other CPU
+ * @param vector - interrupt vector
+ */
+void apic_broadcast_ipi(int vector);
+
+/**
+ * Resets a CPU into its wait-for-startup state
+ * @param apic_id - APIC id of the target CPU
+ */
+void apic_send_init(int apic_id);
+
+/**
+ * Starts a CPU that is waiting for startup in real mode
+ * @param apic_id - APIC id of the target CPU
+ * @param addr - physical address to start at (page aligned, below 1MB)
+ */
+void apic_send_startup(int apic_id, unsigned int addr);
+
+#endif
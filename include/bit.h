@@ -3,16 +3,52 @@
  * California State University, Sacramento
  *
  * Bit Utilities
+ *
+ * Single-word operations map directly onto the x86 bit instructions
+ * (bsf, bsr, bt, bts, btr, btc). Multi-word bitmaps are arrays of
+ * unsigned int, BIT_WORD_BITS bits per word, with bit 0 being the least
+ * significant bit of the first word.
  */
 #ifndef BIT_H
 #define BIT_H
 
+#include <spede/stdbool.h>
+
+#define BIT_WORD_BITS           32
+
+// Number of words needed to hold a bitmap of the given number of bits
+#define BITMAP_WORDS(bits)      (((bits) + BIT_WORD_BITS - 1) / BIT_WORD_BITS)
+
+// Declares a bitmap with the given number of bits
+#define BITMAP_DECLARE(name, bits) unsigned int name[BITMAP_WORDS(bits)]
+
+// Set when the CPU supports the popcnt instruction (see bit_init)
+extern bool bit_popcnt;
+
+/**
+ * Initializes the bit utilities
+ * Selects the population count implementation supported by the CPU
+ */
+void bit_init(void);
+
 /**
  * Counts the number of bits that are set
  * @param value - the integer value to count bits in
  * @return number of bits that are set
  */
-unsigned int bit_count(unsigned int value);
+static inline unsigned int bit_count(unsigned int value) {
+    if (bit_popcnt) {
+        unsigned int count;
+        asm("popcnt %1, %0" : "=r"(count) : "rm"(value) : "cc");
+        return count;
+    }
+
+    // SWAR: sum bits in pairs, then nibbles, then add the bytes together
+    value = value - ((value >> 1) & 0x55555555);
+    value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+    value = (value + (value >> 4)) & 0x0F0F0F0F;
+    return (value * 0x01010101) >> 24;
+}
 
 /**
  * Checks if the given bit is set
@@ -20,27 +56,237 @@ unsigned int bit_count(unsigned int value);
  * @param bit - which bit to check
  * @return 1 if set, 0 if not set
  */
-unsigned int bit_test(unsigned int value, int bit);
+static inline unsigned int bit_test(unsigned int value, int bit) {
+    unsigned char set;
+    asm("bt %2, %1\n\tsetc %0" : "=q"(set) : "r"(value), "Ir"(bit) : "cc");
+    return set;
+}
 
 /**
  * Sets the specified bit in the given integer value
  * @param value - the integer value to modify
  * @param bit - which bit to set
+ * @return the modified value
  */
-unsigned int bit_set(unsigned int value, int bit);
+static inline unsigned int bit_set(unsigned int value, int bit) {
+    asm("bts %1, %0" : "+r"(value) : "Ir"(bit) : "cc");
+    return value;
+}
 
 /**
  * Clears the specified bit in the given integer value
  * @param value - the integer value to modify
  * @param bit - which bit to clear
+ * @return the modified value
  */
-unsigned int bit_clear(unsigned int value, int bit);
+static inline unsigned int bit_clear(unsigned int value, int bit) {
+    asm("btr %1, %0" : "+r"(value) : "Ir"(bit) : "cc");
+    return value;
+}
 
 /**
  * Toggles the specified bit in the given integer value
  * @param value - the integer value to modify
  * @param bit - which bit to toggle
+ * @return the modified value
+ */
+static inline unsigned int bit_toggle(unsigned int value, int bit) {
+    asm("btc %1, %0" : "+r"(value) : "Ir"(bit) : "cc");
+    return value;
+}
+
+/**
+ * Finds the first (least significant) set bit
+ * @param value - the integer value to scan
+ * @return bit index, or -1 if no bits are set
+ */
+static inline int bit_ffs(unsigned int value) {
+    int bit;
+
+    if (value == 0) {
+        return -1;
+    }
+
+    asm("bsf %1, %0" : "=r"(bit) : "rm"(value) : "cc");
+    return bit;
+}
+
+/**
+ * Finds the last (most significant) set bit
+ * @param value - the integer value to scan
+ * @return bit index, or -1 if no bits are set
+ */
+static inline int bit_fls(unsigned int value) {
+    int bit;
+
+    if (value == 0) {
+        return -1;
+    }
+
+    asm("bsr %1, %0" : "=r"(bit) : "rm"(value) : "cc");
+    return bit;
+}
+
+/**
+ * Finds the first (least significant) cleared bit
+ * @param value - the integer value to scan
+ * @return bit index, or -1 if all bits are set
+ */
+static inline int bit_ffz(unsigned int value) {
+    return bit_ffs(~value);
+}
+
+/**
+ * Checks if the given bit is set in the bitmap
+ * @param map - pointer to the bitmap
+ * @param bit - which bit to check
+ * @return 1 if set, 0 if not set
+ */
+static inline unsigned int bitmap_test(const unsigned int *map, int bit) {
+    unsigned char set;
+    asm("bt %2, %1\n\tsetc %0" : "=q"(set) : "m"(*(const unsigned int (*)[])map), "r"(bit) : "cc");
+    return set;
+}
+
+/**
+ * Sets the given bit in the bitmap
+ * @param map - pointer to the bitmap
+ * @param bit - which bit to set
+ */
+static inline void bitmap_set(unsigned int *map, int bit) {
+    asm volatile("bts %1, %0" : "+m"(*(unsigned int (*)[])map) : "r"(bit) : "cc");
+}
+
+/**
+ * Clears the given bit in the bitmap
+ * @param map - pointer to the bitmap
+ * @param bit - which bit to clear
+ */
+static inline void bitmap_clear(unsigned int *map, int bit) {
+    asm volatile("btr %1, %0" : "+m"(*(unsigned int (*)[])map) : "r"(bit) : "cc");
+}
+
+/**
+ * Clears all bits in the bitmap
+ * @param map - pointer to the bitmap
+ * @param bits - number of bits in the bitmap
+ */
+static inline void bitmap_zero(unsigned int *map, int bits) {
+    for (int i = 0; i < BITMAP_WORDS(bits); i++) {
+        map[i] = 0;
+    }
+}
+
+/**
+ * Finds the first set bit in the bitmap
+ * @param map - pointer to the bitmap
+ * @param bits - number of bits in the bitmap
+ * @return bit index, or -1 if no bits are set
+ */
+static inline int bitmap_ffs(const unsigned int *map, int bits) {
+    for (int i = 0; i < BITMAP_WORDS(bits); i++) {
+        if (map[i] != 0) {
+            int bit = i * BIT_WORD_BITS + bit_ffs(map[i]);
+            return (bit < bits) ? bit : -1;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Finds the first cleared bit in the bitmap
+ * @param map - pointer to the bitmap
+ * @param bits - number of bits in the bitmap
+ * @return bit index, or -1 if all bits are set
+ */
+static inline int bitmap_ffz(const unsigned int *map, int bits) {
+    for (int i = 0; i < BITMAP_WORDS(bits); i++) {
+        if (map[i] != ~0U) {
+            int bit = i * BIT_WORD_BITS + bit_ffz(map[i]);
+            return (bit < bits) ? bit : -1;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Sets a range of bits in the bitmap
+ * @param map - pointer to the bitmap
+ * @param start - first bit to set
+ * @param count - number of bits to set
  */
-unsigned int bit_toggle(unsigned int value, int bit);
+static inline void bitmap_set_range(unsigned int *map, int start, int count) {
+    unsigned int *word = map + start / BIT_WORD_BITS;
+    int offset = start % BIT_WORD_BITS;
+
+    // Leading partial word
+    if (offset != 0 && count > 0) {
+        int n = (count < BIT_WORD_BITS - offset) ? count : BIT_WORD_BITS - offset;
+        *word++ |= ((n == BIT_WORD_BITS) ? ~0U : ((1U << n) - 1)) << offset;
+        count -= n;
+    }
+
+    // Whole words
+    for (; count >= BIT_WORD_BITS; count -= BIT_WORD_BITS) {
+        *word++ = ~0U;
+    }
+
+    // Trailing partial word
+    if (count > 0) {
+        *word |= (1U << count) - 1;
+    }
+}
+
+/**
+ * Clears a range of bits in the bitmap
+ * @param map - pointer to the bitmap
+ * @param start - first bit to clear
+ * @param count - number of bits to clear
+ */
+static inline void bitmap_clear_range(unsigned int *map, int start, int count) {
+    unsigned int *word = map + start / BIT_WORD_BITS;
+    int offset = start % BIT_WORD_BITS;
+
+    // Leading partial word
+    if (offset != 0 && count > 0) {
+        int n = (count < BIT_WORD_BITS - offset) ? count : BIT_WORD_BITS - offset;
+        *word++ &= ~(((n == BIT_WORD_BITS) ? ~0U : ((1U << n) - 1)) << offset);
+        count -= n;
+    }
+
+    // Whole words
+    for (; count >= BIT_WORD_BITS; count -= BIT_WORD_BITS) {
+        *word++ = 0;
+    }
+
+    // Trailing partial word
+    if (count > 0) {
+        *word &= ~((1U << count) - 1);
+    }
+}
+
+/**
+ * Counts the number of bits set in the bitmap
+ * @param map - pointer to the bitmap
+ * @param bits - number of bits in the bitmap
+ * @return number of bits that are set
+ */
+static inline int bitmap_weight(const unsigned int *map, int bits) {
+    int weight = 0;
+    int i;
+
+    for (i = 0; i < bits / BIT_WORD_BITS; i++) {
+        weight += bit_count(map[i]);
+    }
+
+    // Ignore any bits beyond the end of the bitmap in the last word
+    if (bits % BIT_WORD_BITS) {
+        weight += bit_count(map[i] & ((1U << (bits % BIT_WORD_BITS)) - 1));
+    }
+
+    return weight;
+}
 
 #endif
@@ -0,0 +1,328 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * CPU Definitions
+ */
+#ifndef CPU_H
+#define CPU_H
+
+// Control register bits
+#define CR0_MP          0x00000002  // Monitor coprocessor
+#define CR0_EM          0x00000004  // Emulate the FPU (no FPU/SSE instructions)
+#define CR0_TS          0x00000008  // Task switched (FPU/SSE instructions fault with #NM)
+#define CR0_NE          0x00000020  // Report FPU errors as exceptions
+#define CR0_WP          0x00010000  // Write protect (honor read-only pages in ring 0)
+#define CR0_PG          0x80000000  // Paging enable
+#define CR4_PSE         0x00000010  // Page size extensions (4MB pages)
+#define CR4_PGE         0x00000080  // Page global enable
+#define CR4_OSFXSR      0x00000200  // FXSAVE/FXRSTOR and SSE instructions enabled
+#define CR4_OSXMMEXCPT  0x00000400  // Unmasked SSE exceptions are delivered as #XM
+
+// EFLAGS bits
+#define EFLAGS_RESERVED 0x00000002  // Always set
+#define EFLAGS_TF       0x00000100  // Trap (single-step)
+#define EFLAGS_IF       0x00000200  // Interrupts enabled
+#define EFLAGS_DF       0x00000400  // Direction (string instructions count down)
+#define EFLAGS_NT       0x00004000  // Nested task (IRET returns to the previous task)
+#define EFLAGS_AC       0x00040000  // Alignment check
+
+// Model specific registers
+#define MSR_APIC_BASE   0x1B        // Local APIC base address and enable
+#define MSR_SYSENTER_CS  0x174     // Kernel code segment for SYSENTER
+#define MSR_SYSENTER_ESP 0x175     // Kernel stack pointer for SYSENTER
+#define MSR_SYSENTER_EIP 0x176     // Kernel entry point for SYSENTER
+#define MSR_PAT         0x277       // Page attribute table
+
+// Feature words (one per CPUID register that reports features)
+#define CPU_WORD_1_EDX          0   // Leaf 0x00000001, EDX
+#define CPU_WORD_1_ECX          1   // Leaf 0x00000001, ECX
+#define CPU_WORD_7_EBX          2   // Leaf 0x00000007, EBX
+#define CPU_WORD_EXT1_EDX       3   // Leaf 0x80000001, EDX
+#define CPU_WORD_EXT7_EDX       4   // Leaf 0x80000007, EDX
+#define CPU_WORD_KERNEL         5   // Features derived by the kernel
+#define CPU_WORDS               6
+
+// Builds a feature number from a feature word and bit
+#define CPU_FEATURE(word, bit)  ((word) * 32 + (bit))
+
+// Features (see cpu_has)
+#define CPU_FEATURE_FPU         CPU_FEATURE(CPU_WORD_1_EDX, 0)
+#define CPU_FEATURE_PSE         CPU_FEATURE(CPU_WORD_1_EDX, 3)
+#define CPU_FEATURE_TSC         CPU_FEATURE(CPU_WORD_1_EDX, 4)
+#define CPU_FEATURE_MSR         CPU_FEATURE(CPU_WORD_1_EDX, 5)
+#define CPU_FEATURE_APIC        CPU_FEATURE(CPU_WORD_1_EDX, 9)
+#define CPU_FEATURE_SYSENTER    CPU_FEATURE(CPU_WORD_1_EDX, 11)
+#define CPU_FEATURE_PGE         CPU_FEATURE(CPU_WORD_1_EDX, 13)
+#define CPU_FEATURE_PAT         CPU_FEATURE(CPU_WORD_1_EDX, 16)
+#define CPU_FEATURE_FXSR        CPU_FEATURE(CPU_WORD_1_EDX, 24)
+#define CPU_FEATURE_SSE         CPU_FEATURE(CPU_WORD_1_EDX, 25)
+#define CPU_FEATURE_SSE2        CPU_FEATURE(CPU_WORD_1_EDX, 26)
+#define CPU_FEATURE_SSE3        CPU_FEATURE(CPU_WORD_1_ECX, 0)
+#define CPU_FEATURE_MWAIT       CPU_FEATURE(CPU_WORD_1_ECX, 3)
+#define CPU_FEATURE_X2APIC      CPU_FEATURE(CPU_WORD_1_ECX, 21)
+#define CPU_FEATURE_POPCNT      CPU_FEATURE(CPU_WORD_1_ECX, 23)
+#define CPU_FEATURE_ERMS        CPU_FEATURE(CPU_WORD_7_EBX, 9)
+#define CPU_FEATURE_NX          CPU_FEATURE(CPU_WORD_EXT1_EDX, 20)
+#define CPU_FEATURE_RDTSCP      CPU_FEATURE(CPU_WORD_EXT1_EDX, 27)
+#define CPU_FEATURE_INVARIANT_TSC CPU_FEATURE(CPU_WORD_EXT7_EDX, 8)
+#define CPU_FEATURE_HLT         CPU_FEATURE(CPU_WORD_KERNEL, 0)
+
+#ifndef ASSEMBLER
+
+#include <spede/stdbool.h>
+
+// CPU identification and capabilities
+typedef struct cpu_info_t {
+    char vendor[13];                    // Vendor string (e.g. "GenuineIntel")
+    unsigned int max_leaf;              // Highest standard CPUID leaf
+    unsigned int max_ext_leaf;          // Highest extended CPUID leaf
+    unsigned int family;                // Family (including the extended family)
+    unsigned int model;                 // Model (including the extended model)
+    unsigned int stepping;              // Stepping
+    unsigned int features[CPU_WORDS];   // Feature words
+} cpu_info_t;
+
+// Capabilities of the boot CPU (see cpu_init)
+extern cpu_info_t cpu_info;
+
+/**
+ * Probes the CPU and records its identification and capabilities
+ */
+void cpu_init(void);
+
+/**
+ * Logs the CPU identification and supported features
+ */
+void cpu_dump(void);
+
+/**
+ * Checks whether the CPU supports a feature
+ * @param feature - feature number (CPU_FEATURE_*)
+ * @return true if the feature is supported
+ */
+static inline bool cpu_has(unsigned int feature) {
+    return (cpu_info.features[feature / 32] >> (feature % 32)) & 1;
+}
+
+/**
+ * Executes the CPUID instruction for the given leaf/subleaf
+ * @param leaf - value loaded into EAX
+ * @param subleaf - value loaded into ECX
+ * @param regs - receives EAX, EBX, ECX, EDX (in that order)
+ */
+static inline void cpu_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+    asm volatile("cpuid"
+                 : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+                 : "a"(leaf), "c"(subleaf));
+}
+
+/**
+ * Reads a model specific register
+ * @param msr - register number
+ * @return register value
+ */
+static inline unsigned long long cpu_rdmsr(unsigned int msr) {
+    unsigned long long val;
+    asm volatile("rdmsr" : "=A"(val) : "c"(msr));
+    return val;
+}
+
+/**
+ * Writes a model specific register
+ * @param msr - register number
+ * @param val - register value
+ */
+static inline void cpu_wrmsr(unsigned int msr, unsigned long long val) {
+    asm volatile("wrmsr" : : "c"(msr), "A"(val));
+}
+
+/**
+ * Reads control register 0
+ * @return register value
+ */
+static inline unsigned int cpu_get_cr0(void) {
+    unsigned int val;
+    asm volatile("mov %%cr0, %0" : "=r"(val));
+    return val;
+}
+
+/**
+ * Writes control register 0
+ * @param val - register value
+ */
+static inline void cpu_set_cr0(unsigned int val) {
+    asm volatile("mov %0, %%cr0" : : "r"(val) : "memory");
+}
+
+/**
+ * Reads control register 2 (page fault linear address)
+ * @return register value
+ */
+static inline unsigned int cpu_get_cr2(void) {
+    unsigned int val;
+    asm volatile("mov %%cr2, %0" : "=r"(val));
+    return val;
+}
+
+/**
+ * Reads control register 3 (page directory base)
+ * @return register value
+ */
+static inline unsigned int cpu_get_cr3(void) {
+    unsigned int val;
+    asm volatile("mov %%cr3, %0" : "=r"(val));
+    return val;
+}
+
+/**
+ * Writes control register 3 (page directory base)
+ * @param val - register value
+ */
+static inline void cpu_set_cr3(unsigned int val) {
+    asm volatile("mov %0, %%cr3" : : "r"(val) : "memory");
+}
+
+/**
+ * Reads control register 4
+ * @return register value
+ */
+static inline unsigned int cpu_get_cr4(void) {
+    unsigned int val;
+    asm volatile("mov %%cr4, %0" : "=r"(val));
+    return val;
+}
+
+/**
+ * Writes control register 4
+ * @param val - register value
+ */
+static inline void cpu_set_cr4(unsigned int val) {
+    asm volatile("mov %0, %%cr4" : : "r"(val) : "memory");
+}
+
+/**
+ * Reads the flags register
+ * @return EFLAGS value
+ */
+static inline unsigned int cpu_get_eflags(void) {
+    unsigned int val;
+    asm volatile("pushfl; popl %0" : "=r"(val) : : "memory");
+    return val;
+}
+
+/**
+ * Invalidates the TLB entry for the given address
+ * @param addr - linear address
+ */
+static inline void cpu_invlpg(unsigned int addr) {
+    asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+/**
+ * Writes back and invalidates the caches
+ */
+static inline void cpu_wbinvd(void) {
+    asm volatile("wbinvd" : : : "memory");
+}
+
+/**
+ * Halts the CPU until the next interrupt
+ */
+static inline void cpu_halt(void) {
+    asm volatile("hlt" : : : "memory");
+}
+
+/**
+ * Arms address monitoring for cpu_mwait
+ * @param addr - address to monitor for writes
+ */
+static inline void cpu_monitor(volatile void *addr) {
+    asm volatile("monitor" : : "a"(addr), "c"(0), "d"(0) : "memory");
+}
+
+/**
+ * Waits for a write to the monitored address or an interrupt
+ * @param hint - target C-state hint
+ */
+static inline void cpu_mwait(unsigned int hint) {
+    asm volatile("mwait" : : "a"(hint), "c"(0) : "memory");
+}
+
+/**
+ * Hints to the CPU that it is spinning on a lock
+ */
+static inline void cpu_pause(void) {
+    asm volatile("pause" : : : "memory");
+}
+
+/**
+ * Keeps the compiler from moving memory accesses across this point
+ */
+static inline void cpu_barrier(void) {
+    asm volatile("" : : : "memory");
+}
+
+/**
+ * Atomically adds to a value in memory
+ * @param ptr - pointer to the value
+ * @param val - value to add
+ * @return previous value
+ */
+static inline unsigned int cpu_xadd(volatile unsigned int *ptr, unsigned int val) {
+    asm volatile("lock xadd %0, %1" : "+r"(val), "+m"(*ptr) : : "memory");
+    return val;
+}
+
+/**
+ * Atomically replaces a value in memory if it still holds the expected one
+ * @param ptr - pointer to the value
+ * @param old - expected value
+ * @param val - new value
+ * @return previous value (equal to old on success)
+ */
+static inline unsigned int cpu_cmpxchg(volatile unsigned int *ptr, unsigned int old, unsigned int val) {
+    asm volatile("lock cmpxchg %2, %1" : "+a"(old), "+m"(*ptr) : "r"(val) : "memory");
+    return old;
+}
+
+/**
+ * Atomically replaces a 64-bit value in memory if it still holds the
+ * expected one
+ * @param ptr - pointer to the value
+ * @param old - expected value
+ * @param val - new value
+ * @return previous value (equal to old on success)
+ */
+static inline unsigned long long cpu_cmpxchg8b(volatile unsigned long long *ptr, unsigned long long old,
+                                               unsigned long long val) {
+    asm volatile("lock cmpxchg8b %1"
+                 : "+A"(old), "+m"(*ptr)
+                 : "b"((unsigned int)val), "c"((unsigned int)(val >> 32))
+                 : "memory");
+    return old;
+}
+
+/**
+ * Atomically exchanges a value in memory
+ * @param ptr - pointer to the value
+ * @param val - new value
+ * @return previous value
+ */
+static inline unsigned int cpu_xchg(volatile unsigned int *ptr, unsigned int val) {
+    asm volatile("xchg %0, %1" : "+r"(val), "+m"(*ptr) : : "memory");
+    return val;
+}
+
+/**
+ * Reads the time stamp counter
+ * @return number of cycles since reset
+ */
+static inline unsigned long long cpu_rdtsc(void) {
+    unsigned long long val;
+    asm volatile("rdtsc" : "=A"(val));
+    return val;
+}
+
+#endif
+#endif
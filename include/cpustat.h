@@ -0,0 +1,102 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * CPU Utilization Accounting Definitions
+ *
+ * The CPU is always in one of a few states (running a task, handling an
+ * interrupt, running timer callbacks or idling). Time is charged to the
+ * current state on every transition using the time stamp counter, or,
+ * without one, by sampling the interrupted state on every tick.
+ *
+ * Each CPU keeps its own statistics; the load averages count the
+ * runnable processes on all of them.
+ */
+#ifndef CPUSTAT_H
+#define CPUSTAT_H
+
+#include "smp.h"
+#include "timer.h"
+
+// Number of ticks over which utilization is reported
+#ifndef CPUSTAT_WINDOW
+#define CPUSTAT_WINDOW      TIMER_HZ
+#endif
+
+// Number of ticks between load average updates
+#ifndef CPUSTAT_LOAD_INTERVAL
+#define CPUSTAT_LOAD_INTERVAL (5 * TIMER_HZ)
+#endif
+
+// Load averages are fixed-point values with this many fractional bits
+#define CPUSTAT_FSHIFT      11
+#define CPUSTAT_FIXED_1     (1 << CPUSTAT_FSHIFT)
+
+// CPU states
+typedef enum cpustat_state_t {
+    CPUSTAT_TASK,               // Running a process
+    CPUSTAT_IRQ,                // Handling an interrupt
+    CPUSTAT_SOFTIRQ,            // Running deferred work (timer callbacks)
+    CPUSTAT_IDLE,               // Running the idle process
+    CPUSTAT_STATES
+} cpustat_state_t;
+
+// Utilization statistics for a CPU
+typedef struct cpustat_t {
+    cpustat_state_t state;                      // Current state
+    unsigned long long last;                    // Time stamp of the last transition
+    unsigned long long time[CPUSTAT_STATES];    // Time in each state (current window)
+    unsigned long long total[CPUSTAT_STATES];   // Time in each state since boot
+    int percent[CPUSTAT_STATES];                // Share of each state in the last window
+    int window_ticks;                           // Ticks elapsed in the current window
+} cpustat_t;
+
+// Statistics for each CPU
+extern cpustat_t cpustat[CPU_MAX];
+
+// 1, 5 and 15 minute load averages (fixed-point)
+extern unsigned int cpustat_loadavgs[3];
+
+/**
+ * Initializes utilization accounting
+ */
+void cpustat_init(void);
+
+/**
+ * Starts utilization accounting on an application processor
+ */
+void cpustat_init_cpu(void);
+
+/**
+ * Closes this CPU's utilization window when due (called on every tick)
+ */
+void cpustat_cpu_tick(void);
+
+/**
+ * Switches the CPU to a new state, charging the elapsed time to the
+ * previous state
+ * @param state - new state
+ * @return previous state
+ */
+cpustat_state_t cpustat_switch(cpustat_state_t state);
+
+/**
+ * Returns the share of the last window the CPUs were not idle (averaged
+ * over the CPUs)
+ * @return percentage (0-100)
+ */
+int cpustat_busy(void);
+
+/**
+ * Returns a load average as a percentage of one runnable process
+ * @param index - 0, 1 or 2 for the 1, 5 or 15 minute average
+ * @return load average multiplied by 100
+ */
+int cpustat_loadavg(int index);
+
+/**
+ * Dumps the utilization statistics
+ */
+void cpustat_dump(void);
+
+#endif
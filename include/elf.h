@@ -0,0 +1,87 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * ELF32 Loader Definitions
+ */
+#ifndef ELF_H
+#define ELF_H
+
+#include <spede/stddef.h>
+
+#include "vm.h"
+
+// ELF identification
+#define ELF_MAGIC           0x464C457F  // "\x7FELF" (little endian)
+#define ELF_CLASS_32        1
+#define ELF_DATA_LSB        1
+
+// ELF file types and machines
+#define ELF_TYPE_EXEC       2
+#define ELF_MACHINE_386     3
+
+// Program header types and flags
+#define ELF_PT_LOAD         1
+#define ELF_PF_X            0x1
+#define ELF_PF_W            0x2
+#define ELF_PF_R            0x4
+
+// ELF file header
+typedef struct elf_header_t {
+    unsigned int magic;         // ELF_MAGIC
+    unsigned char class;        // ELF_CLASS_32
+    unsigned char data;         // ELF_DATA_LSB
+    unsigned char version;
+    unsigned char pad[9];
+    unsigned short type;        // ELF_TYPE_EXEC
+    unsigned short machine;     // ELF_MACHINE_386
+    unsigned int version2;
+    unsigned int entry;         // Entry point
+    unsigned int phoff;         // Program header table offset
+    unsigned int shoff;         // Section header table offset
+    unsigned int flags;
+    unsigned short ehsize;      // Size of this header
+    unsigned short phentsize;   // Size of a program header
+    unsigned short phnum;       // Number of program headers
+    unsigned short shentsize;
+    unsigned short shnum;
+    unsigned short shstrndx;
+} elf_header_t;
+
+// ELF program header
+typedef struct elf_phdr_t {
+    unsigned int type;          // Segment type
+    unsigned int offset;        // Offset of the segment in the image
+    unsigned int vaddr;         // Virtual address of the segment
+    unsigned int paddr;
+    unsigned int filesz;        // Bytes of the segment in the image
+    unsigned int memsz;         // Bytes of the segment in memory
+    unsigned int flags;         // Segment flags
+    unsigned int align;
+} elf_phdr_t;
+
+/**
+ * Loads an ELF32 executable into an address space
+ *
+ * No pages are populated here; each loadable segment becomes an area
+ * backed by the image and is paged in on first access, with the part
+ * of the segment beyond the file data (.bss) zero-filled on demand.
+ * A zero-filled user stack area is also added.
+ *
+ * Every segment must lie in user space (USER_SPACE_BASE to
+ * USER_SPACE_END, see paging.h), below which the kernel identity maps
+ * physical memory. The usual i386 link address of 0x08048000 is in the
+ * kernel's part, so programs must be linked at 0x40000000 or above
+ * (e.g. with ld -Ttext-segment=0x40000000).
+ *
+ * The image must remain in memory for the lifetime of the address space.
+ *
+ * @param space - pointer to the address space
+ * @param image - pointer to the ELF image in memory
+ * @param size - size of the image in bytes
+ * @param entry - receives the program entry point
+ * @return -1 on error; 0 on success
+ */
+int elf_load(vm_space_t *space, char *image, size_t size, unsigned int *entry);
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Fiber Definitions
+ *
+ * A fiber is a function with its own (small) stack that runs until it
+ * chooses to yield, then continues from that point the next time it is
+ * resumed. Multi-step driver sequences can be written as straight-line
+ * code that yields while waiting, instead of as explicit state machines.
+ *
+ * Switching between fibers only saves the callee-saved registers and the
+ * stack pointer (see fiber_switch.S); everything else is already saved
+ * by the C calling convention. Fibers run inside whichever process
+ * resumes them and are preempted along with it.
+ */
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <spede/stddef.h>
+
+// Default fiber stack size
+#ifndef FIBER_STACK_SIZE
+#define FIBER_STACK_SIZE    1024
+#endif
+
+// Smallest fiber stack (interrupts push a trap frame onto it)
+#define FIBER_STACK_MIN     256
+
+#define FIBER_NAME_LEN      16
+
+// Fiber states
+typedef enum fiber_state_t {
+    FIBER_SUSPENDED,            // Created or yielded; waiting to be resumed
+    FIBER_RUNNING,              // Currently running
+    FIBER_DONE                  // Entry function returned
+} fiber_state_t;
+
+// Fiber control block
+typedef struct fiber_t {
+    void *sp;                   // Stack pointer saved when switched out
+    void *resume_sp;            // Stack pointer of the context that resumed it
+    struct fiber_t *parent;     // Fiber that resumed it (NULL for a process)
+    fiber_state_t state;        // Current state
+
+    void (*entry)(void *arg);   // Entry function
+    void *arg;                  // Argument for the entry function
+
+    char name[FIBER_NAME_LEN];  // Name of the fiber (and its stack)
+    int stack_id;               // Fiber stack
+    unsigned int switches;      // Number of times resumed
+} fiber_t;
+
+/**
+ * Initializes fiber support
+ */
+void fiber_init(void);
+
+/**
+ * Creates a suspended fiber
+ * @param entry - function the fiber runs
+ * @param arg - argument for the entry function
+ * @param name - name of the fiber
+ * @param stack_size - size of the fiber's stack (0 for the default)
+ * @return pointer to the fiber or NULL on error
+ */
+fiber_t *fiber_create(void (*entry)(void *arg), void *arg, char *name, size_t stack_size);
+
+/**
+ * Destroys a fiber that is not running
+ * @param fiber - pointer to the fiber
+ * @return -1 on error; 0 on success
+ */
+int fiber_destroy(fiber_t *fiber);
+
+/**
+ * Runs a fiber until it yields or returns
+ * @param fiber - pointer to the fiber
+ * @return 1 if the fiber yielded; 0 if it has finished; -1 on error
+ */
+int fiber_resume(fiber_t *fiber);
+
+/**
+ * Suspends the running fiber, returning to the context that resumed it
+ */
+void fiber_yield(void);
+
+/**
+ * Returns the running fiber
+ * @return pointer to the fiber or NULL if not running in a fiber
+ */
+fiber_t *fiber_current(void);
+
+/**
+ * Switches stacks, saving the callee-saved registers on the current one
+ * @param save_sp - receives the current stack pointer
+ * @param sp - stack pointer to switch to (saved by fiber_switch)
+ */
+void fiber_switch(void **save_sp, void *sp);
+
+/**
+ * Measures the cost of a fiber switch and logs it
+ */
+void fiber_benchmark(void);
+
+#endif
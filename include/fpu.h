@@ -0,0 +1,91 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * FPU/SSE State Management Definitions
+ *
+ * FPU state is switched lazily: the registers keep the state of the last
+ * process that used them (the owner) and CR0.TS is set whenever another
+ * process runs. The first FPU/SSE instruction such a process executes
+ * raises a device-not-available fault (#NM), which saves the owner's
+ * state and loads the faulting process's. Processes that never use the
+ * FPU never pay for a save or restore, and never get a save area.
+ *
+ * Each CPU has its own owner. A process whose state is still in one
+ * CPU's registers is not moved to another.
+ *
+ * Kernel code that uses the FPU/SSE registers (e.g. the SSE2 memory
+ * routines) brackets that use with fpu_kernel_begin/fpu_kernel_end.
+ */
+#ifndef FPU_H
+#define FPU_H
+
+#include <spede/stdbool.h>
+
+// Size of the FXSAVE area (FNSAVE uses the first 108 bytes)
+#define FPU_STATE_SIZE      512
+
+// Saved FPU/SSE registers
+typedef struct fpu_state_t {
+    unsigned char data[FPU_STATE_SIZE];
+} __attribute__((aligned(16))) fpu_state_t;
+
+struct proc_t;
+
+/**
+ * Initializes FPU state management
+ */
+void fpu_init(void);
+
+/**
+ * Prepares the FPU for the process being switched to: the registers are
+ * only made available if they already hold its state
+ * @param proc - pointer to the process
+ */
+void fpu_switch(struct proc_t *proc);
+
+/**
+ * Releases the FPU state of a process that is being destroyed
+ * @param proc - pointer to the process
+ */
+void fpu_release(struct proc_t *proc);
+
+/**
+ * Gives a forked process a copy of its parent's FPU state
+ * @param parent - pointer to the parent process
+ * @param child - pointer to the new process
+ * @return -1 on error; 0 on success
+ */
+int fpu_fork(struct proc_t *parent, struct proc_t *child);
+
+/**
+ * Makes the FPU/SSE registers available to kernel code, saving the state
+ * of the process that owns them
+ *
+ * Interrupts remain disabled until fpu_kernel_end so that no other code
+ * touches the registers in between.
+ *
+ * @return interrupt state to pass to fpu_kernel_end
+ */
+unsigned int fpu_kernel_begin(void);
+
+/**
+ * Ends kernel use of the FPU/SSE registers
+ * @param flags - value returned by fpu_kernel_begin
+ */
+void fpu_kernel_end(unsigned int flags);
+
+/**
+ * Checks whether a process's latest FPU state is only in the registers
+ * of a CPU (so it cannot run on another one until the state is saved)
+ * @param proc - pointer to the process
+ * @return true if a CPU holds the process's state
+ */
+bool fpu_live(struct proc_t *proc);
+
+/**
+ * Dumps the FPU switching statistics
+ */
+void fpu_dump(void);
+
+#endif
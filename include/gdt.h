@@ -0,0 +1,74 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Segmentation Definitions
+ *
+ * The kernel installs its own global descriptor table with flat kernel
+ * and user segments and a task state segment (TSS). The boot loader's
+ * descriptors are kept at the start of the table so that selectors it
+ * handed out remain valid.
+ *
+ * The kernel and user descriptors are laid out as SYSENTER/SYSEXIT
+ * expect: kernel code, kernel data, user code, user data.
+ *
+ * Each CPU has its own copy of the table, differing only in its TSS and
+ * the base of the per-CPU data segment (see smp.h), so the same
+ * selectors are valid on every CPU.
+ */
+#ifndef GDT_H
+#define GDT_H
+
+// Number of boot loader descriptors preserved
+#define GDT_BOOT_ENTRIES    8
+
+// Number of descriptors in the table
+#define GDT_ENTRIES         16
+
+// Segment selectors
+#define GDT_KERNEL_CS       (8 * 8)         // Kernel code
+#define GDT_KERNEL_DS       (9 * 8)         // Kernel data (and stack)
+#define GDT_USER_CS         (10 * 8 + 3)    // User code (RPL 3)
+#define GDT_USER_DS         (11 * 8 + 3)    // User data (RPL 3)
+#define GDT_TSS             (12 * 8)        // Task state segment
+#define GDT_PERCPU          (13 * 8)        // Per-CPU data (loaded in FS)
+
+// Offset of the ring 0 stack pointer in the TSS
+#define TSS_ESP0            4
+
+#ifndef ASSEMBLER
+
+/**
+ * Installs the kernel's descriptor table and task state segment and
+ * reloads the segment registers
+ */
+void gdt_init(void);
+
+/**
+ * Builds the descriptor table (a copy of the boot CPU's) and task state
+ * segment of an application processor, before it is started
+ * @param cpu - CPU index
+ */
+void gdt_init_cpu(int cpu);
+
+/**
+ * Loads a CPU's descriptor table and task state segment and reloads the
+ * segment registers (run on that CPU)
+ * @param cpu - CPU index
+ */
+void gdt_load_cpu(int cpu);
+
+/**
+ * Sets the stack this CPU switches to on a trap from user mode
+ * @param top - initial stack pointer (highest address of the stack)
+ */
+void gdt_set_kernel_stack(char *top);
+
+/**
+ * Returns this CPU's task state segment
+ * @return pointer to the TSS
+ */
+void *gdt_tss(void);
+
+#endif
+#endif
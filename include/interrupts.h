@@ -9,11 +9,73 @@
 
 #include <spede/machine/asmacros.h>
 
+#include "cpu.h"
+#include "smp.h"
+
 // IRQ Definitions
+#define IRQ_DEBUG      0x01    // CPU Exception 1 (Debug)
+#define IRQ_DEVICE_NA  0x07    // CPU Exception 7 (Device Not Available)
+#define IRQ_GPF        0x0D    // CPU Exception 13 (General Protection Fault)
+#define IRQ_PAGE_FAULT 0x0E    // CPU Exception 14 (Page Fault)
 #define IRQ_TIMER    0x20      // PIC IRQ 0 (Timer)
 #define IRQ_KEYBOARD 0x21      // PIC IRQ 1 (Keyboard)
+#define IRQ_IPI_TICK      0x40 // Inter-processor interrupt (Timer tick)
+#define IRQ_IPI_RESCHED   0x41 // Inter-processor interrupt (Reschedule)
+#define IRQ_APIC_SPURIOUS 0x4F // Local APIC spurious interrupt
+#define IRQ_YIELD    0x7F      // Software interrupt (Reschedule)
+#define IRQ_SYSCALL  0x80      // Software interrupt (System call)
+
+// Trap frame offsets (for assembly)
+#define TRAP_FRAME_IRQ      48
+#define TRAP_FRAME_ERROR    52
+
+// Error code marking a system call that entered through SYSENTER; such
+// frames return through SYSEXIT
+#define TRAP_ERROR_SYSENTER 1
 
 #ifndef ASSEMBLER
+
+// Trap frame
+// Describes the state saved on the stack when an interrupt occurs
+typedef struct trap_frame_t {
+    // Registers saved by the ISR entry (pusha)
+    unsigned int edi;
+    unsigned int esi;
+    unsigned int ebp;
+    unsigned int esp;           // Value before pusha (not restored)
+    unsigned int ebx;
+    unsigned int edx;
+    unsigned int ecx;
+    unsigned int eax;
+
+    // Segment registers saved by the ISR entry
+    unsigned int gs;
+    unsigned int fs;
+    unsigned int es;
+    unsigned int ds;
+
+    unsigned int irq;           // IRQ number
+    unsigned int error;         // Error code (0 if the CPU does not push one)
+
+    // Registers saved by the CPU
+    unsigned int eip;
+    unsigned int cs;
+    unsigned int eflags;
+
+    // Saved by the CPU only on a trap from user mode
+    unsigned int user_esp;
+    unsigned int user_ss;
+} trap_frame_t;
+
+/**
+ * Checks whether a trap frame was saved while running in user mode
+ * @param frame - pointer to the trap frame
+ * @return true if the trap came from user mode
+ */
+static inline bool trap_from_user(trap_frame_t *frame) {
+    return (frame->cs & 3) != 0;
+}
+
 /**
  * General interrupt enablement
  */
@@ -38,10 +100,60 @@ void interrupts_disable(void);
 void interrupts_irq_register(int irq, void (*entry)(), void (*handler)());
 
 /**
- * Interrupt service routine handler
+ * Registers an ISR that user mode may also raise with the INT instruction
  * @param irq - IRQ number
+ * @param entry - function pointer to be registered in the IDT
+ * @param handler - function pointer to be called when the specified IRQ occurs
+ */
+void interrupts_irq_register_user(int irq, void (*entry)(), void (*handler)());
+
+/**
+ * Disables interrupts with the CPU, returning the previous state
+ *
+ * With more than one CPU running, this also takes the kernel lock, so the
+ * section is protected from the other CPUs as well. The lock is taken
+ * whether or not interrupts were already disabled (it counts how deeply
+ * the CPU holding it has taken it), since code holding an _irqsave
+ * spinlock runs with interrupts disabled but without the kernel lock.
+ * @return previous EFLAGS value (for interrupts_restore)
+ */
+static inline unsigned int interrupts_save(void) {
+    unsigned int flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+
+    if (smp_active) {
+        kernel_lock();
+    }
+
+    return flags;
+}
+
+/**
+ * Restores the interrupt state saved by interrupts_save
+ * @param flags - EFLAGS value returned by interrupts_save
+ */
+static inline void interrupts_restore(unsigned int flags) {
+    if (smp_active) {
+        kernel_unlock();
+    }
+
+    if (flags & EFLAGS_IF) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+/**
+ * Interrupt service routine handler
+ * @param frame - trap frame saved by the ISR entry
+ * @return trap frame to resume (a different process after a switch)
+ */
+trap_frame_t *interrupts_irq_handler(trap_frame_t *frame);
+
+/**
+ * Returns the trap frame of the interrupt currently being handled
+ * @return pointer to the trap frame or NULL if not handling an interrupt
  */
-void interrupts_irq_handler(int irq);
+trap_frame_t *interrupts_get_frame(void);
 
 /**
  * Enables the specified IRQ in the PIC
@@ -71,8 +183,18 @@ void pic_irq_dismiss(int irq);
 
 __BEGIN_DECLS
 
+extern void isr_entry_debug();
+extern void isr_entry_device_na();
+extern void isr_entry_gpf();
 extern void isr_entry_timer();
 extern void isr_entry_keyboard();
+extern void isr_entry_page_fault();
+extern void isr_entry_yield();
+extern void isr_entry_syscall();
+extern void sysenter_entry();
+extern void isr_entry_ipi_tick();
+extern void isr_entry_ipi_resched();
+extern void isr_entry_apic_spurious();
 
 __END_DECLS
 #endif
@@ -0,0 +1,157 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Message Passing (IPC) Definitions
+ *
+ * A port is a mailbox owned by the process that created it; any process
+ * may send to it, only the owner receives from it. Messages are a tag
+ * and two words, small enough that a system call carries a whole message
+ * in registers and the kernel copies it straight from the sender to the
+ * receiver without buffering it.
+ *
+ * ipc_send blocks until the message has been received, ipc_call also
+ * waits for the receiver's ipc_reply, and ipc_send_async queues the
+ * message on the port and returns at once. A process that blocks on its
+ * partner (a client calling a waiting server, or a server replying and
+ * waiting for the next request) switches straight to it with
+ * scheduler_handoff instead of going through the run queue.
+ *
+ * A message tagged IPC_TAG_PAGES carries the address and number of pages
+ * in its two words. Between user processes the pages are unmapped from
+ * the sender and mapped into the receive window the receiver set up with
+ * ipc_window, so large payloads are never copied; the words the receiver
+ * sees are its window address and the page count. Kernel threads share
+ * one address space and pass the pointer through unchanged.
+ */
+#ifndef IPC_H
+#define IPC_H
+
+#include <spede/stdbool.h>
+
+// Maximum number of ports
+#ifndef IPC_PORTS_MAX
+#define IPC_PORTS_MAX       32
+#endif
+
+// Asynchronous messages each port can hold
+#ifndef IPC_QUEUE_SIZE
+#define IPC_QUEUE_SIZE      16
+#endif
+
+// Words in a message (besides the tag)
+#define IPC_MSG_WORDS       2
+
+// Set in a message tag when the words are a page address and count
+#define IPC_TAG_PAGES       0x80000000
+
+// Operation a process is blocked in
+#define IPC_STATE_NONE      0   // Not blocked in IPC
+#define IPC_STATE_SEND      1   // Waiting for a receiver (ipc_send)
+#define IPC_STATE_CALL      2   // Waiting for a receiver (ipc_call)
+#define IPC_STATE_REPLY     3   // Received; waiting for the reply (ipc_call)
+#define IPC_STATE_RECEIVE   4   // Waiting for a message (ipc_receive)
+
+struct proc_t;
+
+// Message
+typedef struct ipc_msg_t {
+    int sender;                         // Process id of the sender (set by the kernel)
+    unsigned int tag;                   // Message type (meaning defined by the port), plus IPC_TAG_PAGES
+    unsigned int data[IPC_MSG_WORDS];   // Message words
+} ipc_msg_t;
+
+/**
+ * Initializes message passing and registers its system calls
+ */
+void ipc_init(void);
+
+/**
+ * Creates a port owned by the running process
+ * @return port id or -1 on error
+ */
+int ipc_port_create(void);
+
+/**
+ * Destroys a port; processes blocked on it fail with -1
+ * @param port - port id
+ * @return -1 on error; 0 on success
+ */
+int ipc_port_destroy(int port);
+
+/**
+ * Sets the address range pages sent to the running process are mapped at
+ * @param addr - start of the window (page aligned, in a writable area)
+ * @param pages - size of the window in pages (0 to refuse pages)
+ * @return -1 on error; 0 on success
+ */
+int ipc_window(unsigned int addr, int pages);
+
+/**
+ * Sends a message and blocks until it has been received
+ * @param port - port id
+ * @param msg - pointer to the message
+ * @return -1 on error; 0 on success
+ */
+int ipc_send(int port, ipc_msg_t *msg);
+
+/**
+ * Queues a message on a port without blocking
+ * @param port - port id
+ * @param msg - pointer to the message (may not carry pages)
+ * @return -1 on error (including a full queue); 0 on success
+ */
+int ipc_send_async(int port, ipc_msg_t *msg);
+
+/**
+ * Sends a message and blocks until the receiver replies
+ * @param port - port id
+ * @param msg - pointer to the message; receives the reply
+ * @return -1 on error; 0 on success
+ */
+int ipc_call(int port, ipc_msg_t *msg);
+
+/**
+ * Receives the next message sent to a port owned by the running process,
+ * blocking until there is one
+ * @param port - port id
+ * @param msg - pointer to the message to fill in
+ * @return -1 on error; 0 on success
+ */
+int ipc_receive(int port, ipc_msg_t *msg);
+
+/**
+ * Replies to the caller whose message the running process received last
+ * @param msg - pointer to the reply
+ * @return -1 on error (e.g. the caller is gone); 0 on success
+ */
+int ipc_reply(ipc_msg_t *msg);
+
+/**
+ * Replies to the last caller and receives the next message, switching
+ * straight to the caller if there is no message yet
+ * @param port - port id
+ * @param msg - pointer to the reply; receives the next message
+ * @return -1 on error; 0 on success
+ */
+int ipc_reply_wait(int port, ipc_msg_t *msg);
+
+/**
+ * Releases the ports and pending operations of a process that is being
+ * destroyed
+ * @param proc - pointer to the process
+ */
+void ipc_proc_exit(struct proc_t *proc);
+
+/**
+ * Measures the cost of an IPC round trip between two kernel threads and
+ * logs it
+ */
+void ipc_benchmark(void);
+
+/**
+ * Dumps the ports
+ */
+void ipc_dump(void);
+
+#endif
@@ -63,8 +63,11 @@ unsigned int keyboard_poll(void);
 
 /**
  * Blocks until a keyboard character has been entered
- * @return decoded character entered by the keyboard or KEY_NULL
- *         for any character that cannot be decoded
+ *
+ * The caller sleeps until the keyboard IRQ queues a key in the active
+ * TTY's input buffer; only the idle process polls the keyboard instead.
+ *
+ * @return decoded character entered by the keyboard
  */
 unsigned int keyboard_getc(void);
 
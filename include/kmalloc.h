@@ -0,0 +1,118 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Memory Allocator
+ *
+ * Objects are allocated from slab caches. Each cache carves blocks from
+ * the page allocator into equal sized objects and tracks its slabs on
+ * partial, full and empty lists. A small magazine of recently freed
+ * objects is kept per cache so that hot objects are reused in constant
+ * time without touching the slab lists.
+ */
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+#include <spede/stddef.h>
+
+// Maximum number of slab caches
+#ifndef KMEM_CACHES_MAX
+#define KMEM_CACHES_MAX     32
+#endif
+
+// Number of recently freed objects kept per cache for fast reuse
+#ifndef KMEM_MAGAZINE_SIZE
+#define KMEM_MAGAZINE_SIZE  8
+#endif
+
+// Number of empty slabs retained per cache before returning pages
+#ifndef KMEM_EMPTY_MAX
+#define KMEM_EMPTY_MAX      1
+#endif
+
+// Alignment of all objects
+#define KMEM_ALIGN          8
+
+struct kmem_cache_t;
+
+// Slab header; stored at the start of each slab
+typedef struct slab_t {
+    struct slab_t *next;            // Next slab in the cache list
+    struct slab_t *prev;            // Previous slab in the cache list
+    struct kmem_cache_t *cache;     // Cache that owns the slab
+    void *free;                     // Intrusive list of free objects
+    int in_use;                     // Number of allocated objects
+} slab_t;
+
+// Slab cache data structure
+typedef struct kmem_cache_t {
+    char *name;                     // Name of the cache (for diagnostics)
+    size_t size;                    // Object size
+    int order;                      // Each slab is 2^order pages
+    int per_slab;                   // Number of objects per slab
+
+    slab_t *partial;                // Slabs with some objects allocated
+    slab_t *full;                   // Slabs with all objects allocated
+    slab_t *empty;                  // Slabs with no objects allocated
+    int empty_count;                // Number of slabs on the empty list
+
+    void *magazine[KMEM_MAGAZINE_SIZE]; // Recently freed objects
+    int magazine_count;             // Number of objects in the magazine
+
+    unsigned int allocs;            // Number of allocations
+    unsigned int frees;             // Number of frees
+    int slabs;                      // Number of slabs owned by the cache
+} kmem_cache_t;
+
+/**
+ * Initializes the kernel memory allocator and the general purpose
+ * size-class caches
+ */
+void kmalloc_init(void);
+
+/**
+ * Creates a cache for objects of the given size
+ * @param name - name of the cache
+ * @param size - size of each object
+ * @return pointer to the cache or NULL on error
+ */
+kmem_cache_t *kmem_cache_create(char *name, size_t size);
+
+/**
+ * Allocates an object from the cache
+ * @param cache - pointer to the cache
+ * @return pointer to the object or NULL if no memory is available
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache);
+
+/**
+ * Returns an object to the cache
+ * @param cache - pointer to the cache
+ * @param obj - pointer to the object
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+/**
+ * Allocates memory from the kernel heap
+ *
+ * Requests are served from the smallest size-class cache that fits;
+ * requests larger than the largest class are served directly from the
+ * page allocator.
+ *
+ * @param size - number of bytes to allocate
+ * @return pointer to the memory or NULL if no memory is available
+ */
+void *kmalloc(size_t size);
+
+/**
+ * Frees memory allocated by kmalloc or kmem_cache_alloc
+ * @param ptr - pointer to the memory
+ */
+void kfree(void *ptr);
+
+/**
+ * Displays the statistics of every cache on the host console
+ */
+void kmalloc_dump(void);
+
+#endif
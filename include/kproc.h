@@ -0,0 +1,211 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Process Definitions
+ *
+ * Every process has its own kernel stack. When a process is interrupted
+ * its state is saved as a trap frame on that stack; resuming a process
+ * is a matter of returning from the interrupt through its trap frame.
+ */
+#ifndef KPROC_H
+#define KPROC_H
+
+#include "fiber.h"
+#include "fpu.h"
+#include "interrupts.h"
+#include "ipc.h"
+#include "smp.h"
+#include "vm.h"
+
+// Maximum number of processes
+#ifndef PROC_MAX
+#define PROC_MAX            32
+#endif
+
+// Size of each process's kernel stack
+#ifndef PROC_STACK_SIZE
+#define PROC_STACK_SIZE     (8 * 1024)
+#endif
+
+#define PROC_NAME_LEN       32
+
+// Scheduling priorities (0 is the highest)
+#define PROC_PRIORITIES     32
+#define PROC_PRIORITY_DEFAULT 16
+
+struct mutex_t;
+struct task_deque_t;
+struct wait_queue_t;
+
+// Process states
+typedef enum proc_state_t {
+    PROC_STATE_NONE,            // Not yet scheduled
+    PROC_STATE_READY,           // Waiting in the run queue
+    PROC_STATE_RUNNING,         // Currently running
+    PROC_STATE_WAITING,         // Blocked until woken up (see scheduler_block)
+    PROC_STATE_EXITED           // Terminated; destroyed once switched away from
+} proc_state_t;
+
+// Process control block
+typedef struct proc_t {
+    int pid;                        // Process id
+    char name[PROC_NAME_LEN];       // Process name
+    proc_state_t state;             // Current state
+    void (*entry)(void);            // Entry point
+
+    int start_time;                 // Tick the process was created
+    int cpu_time;                   // Ticks spent running
+    int quantum;                    // Ticks remaining in the current time slice
+
+    int base_priority;              // Priority assigned to the process
+    int priority;                   // Effective priority (base adjusted by boost)
+    int boost;                      // Interactivity bonus (negative for CPU hogs)
+    int inherited_priority;         // Priority lent by waiters on held mutexes (PROC_PRIORITIES if none)
+    struct proc_t *run_next;        // Next process at the same priority
+    struct proc_t *run_prev;        // Previous process at the same priority
+    void *run_array;                // Priority array holding the process (NULL if none)
+
+    int edf_runtime;                // EDF budget per period in ticks (0 if not EDF, see scheduler.h)
+    int edf_period;                 // EDF period in ticks
+    int edf_deadline;               // EDF deadline in ticks, relative to each release
+    int edf_util;                   // Share of the CPU reserved by admission control
+    int edf_budget;                 // Ticks left to run until the next replenishment
+    int edf_release;                // Tick the current job was released at
+    int edf_due;                    // Tick the current job is due by (absolute deadline)
+    struct proc_t *edf_next;        // Next process in the EDF list
+    struct proc_t **edf_list;       // EDF list holding the process (NULL if none)
+    unsigned int edf_misses;        // Jobs completed after their deadline
+    unsigned int edf_overruns;      // Jobs throttled for using up their budget
+
+    struct wait_queue_t *wait_queue; // Wait queue holding the process (NULL if none)
+    struct proc_t *wait_next;       // Next process in the wait queue
+    int wake_tick;                  // Tick to wake up at when sleeping
+
+    int stack_id;                   // Kernel stack (-1 for the boot stack)
+    char *kstack_top;               // Top of the kernel stack (traps from user mode enter here)
+    trap_frame_t *frame;            // Trap frame saved when switched out
+    vm_space_t *space;              // Address space (NULL for kernel threads)
+    fpu_state_t *fpu;               // Saved FPU/SSE state (NULL until first used)
+    fiber_t *fiber;                 // Fiber running in the process (NULL if none)
+
+    int cpu;                        // CPU the process runs (or last ran) on
+    int lock_depth;                 // Kernel lock depth saved when switched out (see smp.h)
+    ipc_msg_t ipc_msg;              // Message in transit while blocked in IPC
+    int ipc_state;                  // IPC operation the process is blocked in (IPC_STATE_*)
+    int ipc_port;                   // Port of that operation
+    int ipc_status;                 // Result of the operation once it completes
+    unsigned int ipc_window;        // Address pages sent to the process are mapped at
+    int ipc_window_pages;           // Size of the receive window in pages
+    struct proc_t *ipc_client;      // Caller awaiting this process's reply (see ipc_reply)
+    int ipc_client_pid;             // Process id of that caller
+    struct mutex_t *mutex_wait;     // Mutex the process is blocked on (NULL if none)
+    struct mutex_t *mutexes;        // Contended mutexes the process holds (see mutex.h)
+    struct task_deque_t *task_deque; // Work-stealing deque the process owns (see task.h)
+} proc_t;
+
+// Process that is currently running on this CPU
+#define active_proc (this_cpu()->current)
+
+// Process that runs when no other process is ready on this CPU
+#define idle_proc (this_cpu()->idle)
+
+/**
+ * Checks whether a process is the idle process of its CPU
+ * @param proc - pointer to the process
+ * @return true for an idle process
+ */
+static inline bool kproc_is_idle(proc_t *proc) {
+    return proc == cpu_table[proc->cpu].idle;
+}
+
+/**
+ * Initializes process management; the code that is currently running
+ * becomes the idle process
+ */
+void kproc_init(void);
+
+/**
+ * Makes the code running on an application processor its idle process
+ * @param stack_id - stack the code is running on
+ */
+void kproc_init_cpu(int stack_id);
+
+/**
+ * Creates a kernel thread and makes it ready to run
+ * @param entry - function the thread runs
+ * @param name - name of the thread
+ * @return process id or -1 on error
+ */
+int kproc_create(void (*entry)(void), char *name);
+
+/**
+ * Creates a user process that starts at the given address
+ * @param space - address space of the process (owned by the process
+ *                once created)
+ * @param entry - user mode entry point
+ * @param name - name of the process
+ * @return process id or -1 on error
+ */
+int kproc_create_user(vm_space_t *space, unsigned int entry, char *name);
+
+/**
+ * Creates a user process from an ELF executable
+ * @param image - pointer to the ELF image (must remain in memory)
+ * @param size - size of the image in bytes
+ * @param name - name of the process
+ * @return process id or -1 on error
+ */
+int kproc_create_elf(char *image, size_t size, char *name);
+
+/**
+ * Duplicates the running user process
+ *
+ * The child shares the parent's pages copy-on-write and resumes from a
+ * copy of the parent's trap frame, returning 0 from the system call.
+ *
+ * @param frame - trap frame of the system call made by the parent
+ * @return process id of the child or -1 on error
+ */
+int kproc_fork(trap_frame_t *frame);
+
+/**
+ * Destroys a process
+ *
+ * The running process cannot free its own stack; it is marked as exited
+ * and destroyed after the scheduler switches away from it.
+ *
+ * @param proc - pointer to the process
+ * @return -1 on error; 0 on success
+ */
+int kproc_destroy(proc_t *proc);
+
+/**
+ * Terminates the running process
+ */
+void kproc_exit(void);
+
+/**
+ * Runs the idle process: halts the CPU until there is work to do
+ */
+void kproc_idle(void);
+
+/**
+ * Obtains the process with the given id
+ * @param pid - process id
+ * @return pointer to the process or NULL if it does not exist
+ */
+proc_t *pid_to_proc(int pid);
+
+/**
+ * Returns the running process
+ * @return pointer to the process
+ */
+proc_t *kproc_current(void);
+
+/**
+ * Dumps the process table
+ */
+void kproc_dump(void);
+
+#endif
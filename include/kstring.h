@@ -0,0 +1,108 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Memory Copy/Fill Definitions
+ *
+ * Several implementations of each routine are provided (string
+ * instructions, enhanced rep movsb/stosb and SSE2); the fastest one the
+ * CPU supports is selected at boot. Until then the rep movsd/stosd
+ * implementation, which every CPU supports, is used.
+ */
+#ifndef KSTRING_H
+#define KSTRING_H
+
+#include <spede/stdbool.h>
+#include <spede/stddef.h>
+
+// Smallest size handled with SSE2 (smaller sizes use string instructions)
+#ifndef KSTRING_SSE2_MIN
+#define KSTRING_SSE2_MIN    256
+#endif
+
+// Smallest size copied/filled with non-temporal stores (bypassing the cache)
+#ifndef KSTRING_NT_MIN
+#define KSTRING_NT_MIN      (256 * 1024)
+#endif
+
+// Set of memory routines
+typedef struct kstring_impl_t {
+    char *name;                 // Name of the implementation
+    bool supported;             // Set when the CPU supports the implementation
+    void *(*memcpy)(void *dst, const void *src, size_t n);
+    void *(*memmove)(void *dst, const void *src, size_t n);
+    void *(*memset)(void *dst, int c, size_t n);
+    void *(*memset16)(void *dst, unsigned short val, size_t count);
+    void *(*memset32)(void *dst, unsigned int val, size_t count);
+} kstring_impl_t;
+
+// Implementation currently in use
+extern kstring_impl_t *kstring_impl;
+
+/**
+ * Detects the supported implementations and selects the fastest
+ */
+void kstring_init(void);
+
+/**
+ * Copies memory (the regions must not overlap)
+ * @param dst - destination
+ * @param src - source
+ * @param n - number of bytes
+ * @return dst
+ */
+static inline void *kmemcpy(void *dst, const void *src, size_t n) {
+    return kstring_impl->memcpy(dst, src, n);
+}
+
+/**
+ * Copies memory (the regions may overlap)
+ * @param dst - destination
+ * @param src - source
+ * @param n - number of bytes
+ * @return dst
+ */
+static inline void *kmemmove(void *dst, const void *src, size_t n) {
+    return kstring_impl->memmove(dst, src, n);
+}
+
+/**
+ * Fills memory with a byte value
+ * @param dst - destination
+ * @param c - byte value
+ * @param n - number of bytes
+ * @return dst
+ */
+static inline void *kmemset(void *dst, int c, size_t n) {
+    return kstring_impl->memset(dst, c, n);
+}
+
+/**
+ * Fills memory with a 16-bit value
+ * @param dst - destination (2-byte aligned)
+ * @param val - value
+ * @param count - number of values
+ * @return dst
+ */
+static inline void *kmemset16(void *dst, unsigned short val, size_t count) {
+    return kstring_impl->memset16(dst, val, count);
+}
+
+/**
+ * Fills memory with a 32-bit value
+ * @param dst - destination (4-byte aligned)
+ * @param val - value
+ * @param count - number of values
+ * @return dst
+ */
+static inline void *kmemset32(void *dst, unsigned int val, size_t count) {
+    return kstring_impl->memset32(dst, val, count);
+}
+
+/**
+ * Measures the throughput of every supported implementation for a range
+ * of sizes and logs it relative to the SPEDE library routines
+ */
+void kstring_benchmark(void);
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Multiboot Information Definitions
+ */
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#ifndef ASSEMBLER
+
+// Multiboot information flags
+#define MULTIBOOT_INFO_MEMORY   0x001   // mem_lower/mem_upper are valid
+#define MULTIBOOT_INFO_MMAP     0x040   // mmap_length/mmap_addr are valid
+
+// Memory map entry types
+#define MULTIBOOT_MEMORY_AVAILABLE  1
+
+// Multiboot information structure (as handed over by the boot loader)
+typedef struct multiboot_info_t {
+    unsigned int flags;         // Indicates which fields are valid
+    unsigned int mem_lower;     // KB of memory below 1MB
+    unsigned int mem_upper;     // KB of memory above 1MB
+    unsigned int boot_device;
+    unsigned int cmdline;
+    unsigned int mods_count;
+    unsigned int mods_addr;
+    unsigned int syms[4];
+    unsigned int mmap_length;   // Size of the memory map in bytes
+    unsigned int mmap_addr;     // Address of the first memory map entry
+} multiboot_info_t;
+
+// Multiboot memory map entry
+//
+// 'size' does not include itself; the next entry is at
+// (char *)entry + entry->size + sizeof(entry->size)
+typedef struct multiboot_mmap_t {
+    unsigned int size;          // Size of the entry (excluding this field)
+    unsigned long long addr;    // Start address of the region
+    unsigned long long len;     // Length of the region
+    unsigned int type;          // Type of memory region
+} __attribute__((packed)) multiboot_mmap_t;
+
+#endif
+#endif
@@ -0,0 +1,150 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Mutex, Semaphore and Condition Variable Definitions
+ *
+ * Sleeping locks for kernel threads: a process that cannot take one is
+ * blocked instead of spinning, so they may protect long sections. They
+ * cannot be used in interrupt handlers (semaphore_up and
+ * semaphore_try_down excepted).
+ *
+ * An uncontended mutex is taken and released with a single atomic
+ * compare-and-exchange on its owner word. When the owner is running on
+ * another CPU it will likely release the mutex soon, so a waiter spins
+ * for a while before going to sleep.
+ *
+ * Mutexes use priority inheritance: while a process waits, the owner
+ * (and whatever the owner itself waits for) runs at no lower than the
+ * waiter's priority, so a low priority holder cannot be kept off the CPU
+ * by medium priority work. A released mutex is handed straight to the
+ * highest priority waiter.
+ */
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include <spede/stdbool.h>
+
+#include "wait.h"
+
+// Number of times a waiter checks a mutex whose owner is running on
+// another CPU before sleeping
+#ifndef MUTEX_SPIN_MAX
+#define MUTEX_SPIN_MAX      1000
+#endif
+
+// Longest chain of mutex owners a priority is passed along
+#ifndef MUTEX_CHAIN_MAX
+#define MUTEX_CHAIN_MAX     8
+#endif
+
+// Set in mutex_t.owner while processes wait for the mutex
+#define MUTEX_WAITERS       0x1
+
+// Sleeping mutex
+typedef struct mutex_t {
+    volatile unsigned int owner;    // Owning process, plus MUTEX_WAITERS (0 if free)
+    wait_queue_t waiters;           // Processes waiting for the mutex
+    struct mutex_t *next;           // Next contended mutex held by the owner
+    char *name;                     // Name of the mutex (for diagnostics)
+    unsigned int contended;         // Acquisitions that had to wait
+    unsigned int spun;              // Contended acquisitions that did not have to sleep
+} mutex_t;
+
+// Counting semaphore
+typedef struct semaphore_t {
+    volatile unsigned int count;    // Number of available units
+    wait_queue_t waiters;           // Processes waiting for a unit
+} semaphore_t;
+
+// Condition variable
+typedef struct condvar_t {
+    wait_queue_t waiters;           // Processes waiting for the condition
+} condvar_t;
+
+/**
+ * Initializes a mutex (unlocked)
+ * @param mutex - pointer to the mutex
+ * @param name - name of the mutex (for diagnostics)
+ */
+void mutex_init(mutex_t *mutex, char *name);
+
+/**
+ * Acquires a mutex, blocking until it is available
+ * @param mutex - pointer to the mutex
+ */
+void mutex_lock(mutex_t *mutex);
+
+/**
+ * Acquires a mutex if it is available
+ * @param mutex - pointer to the mutex
+ * @return true if the mutex was acquired
+ */
+bool mutex_trylock(mutex_t *mutex);
+
+/**
+ * Releases a mutex held by the running process
+ * @param mutex - pointer to the mutex
+ */
+void mutex_unlock(mutex_t *mutex);
+
+/**
+ * Checks whether the running process holds a mutex
+ * @param mutex - pointer to the mutex
+ * @return true if held by the running process
+ */
+bool mutex_held(mutex_t *mutex);
+
+/**
+ * Initializes a semaphore
+ * @param sem - pointer to the semaphore
+ * @param count - initial number of units
+ */
+void semaphore_init(semaphore_t *sem, int count);
+
+/**
+ * Takes a unit from a semaphore, blocking until one is available
+ * @param sem - pointer to the semaphore
+ */
+void semaphore_down(semaphore_t *sem);
+
+/**
+ * Takes a unit from a semaphore if one is available
+ * @param sem - pointer to the semaphore
+ * @return true if a unit was taken
+ */
+bool semaphore_try_down(semaphore_t *sem);
+
+/**
+ * Returns a unit to a semaphore, waking a waiter
+ * @param sem - pointer to the semaphore
+ */
+void semaphore_up(semaphore_t *sem);
+
+/**
+ * Initializes a condition variable
+ * @param cv - pointer to the condition variable
+ */
+void condvar_init(condvar_t *cv);
+
+/**
+ * Releases a mutex, waits until the condition variable is signaled and
+ * reacquires the mutex; callers re-check their condition in a loop
+ * @param cv - pointer to the condition variable
+ * @param mutex - pointer to the mutex (held by the running process)
+ */
+void condvar_wait(condvar_t *cv, mutex_t *mutex);
+
+/**
+ * Wakes one process waiting on a condition variable
+ * @param cv - pointer to the condition variable
+ */
+void condvar_signal(condvar_t *cv);
+
+/**
+ * Wakes every process waiting on a condition variable
+ * @param cv - pointer to the condition variable
+ */
+void condvar_broadcast(condvar_t *cv);
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Physical Page Frame Allocator
+ *
+ * Physical memory is managed with a binary buddy system. Blocks of
+ * 2^order pages are kept on one free list per order; allocation splits
+ * larger blocks and freeing coalesces a block with its buddy.
+ */
+#ifndef PAGE_H
+#define PAGE_H
+
+#define PAGE_SHIFT          12
+#define PAGE_SIZE           (1 << PAGE_SHIFT)
+
+// Largest block order: 2^10 pages = 4MB
+#define PAGE_ORDER_MAX      10
+
+// Order recorded for a page that is not the head of a block
+#define PAGE_ORDER_NONE     0xffff
+
+// Physical memory at or above this address is not managed; the kernel
+// identity maps everything below it (see paging.h)
+#define PAGE_MEM_LIMIT      0x40000000
+
+#ifndef ASSEMBLER
+
+#include "multiboot.h"
+
+#define PAGE_ALIGN_DOWN(addr)   ((unsigned int)(addr) & ~(PAGE_SIZE - 1))
+#define PAGE_ALIGN_UP(addr)     (((unsigned int)(addr) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+// Page flags
+#define PAGE_FLAG_RESERVED  0x01    // Page is not managed by the allocator
+#define PAGE_FLAG_FREE      0x02    // Page is the head of a free block
+
+// Page frame descriptor; one per physical page
+typedef struct page_t {
+    struct page_t *next;        // Next block in the free list
+    struct page_t *prev;        // Previous block in the free list
+    unsigned short flags;       // Page flags
+    unsigned short order;       // Order of the block (valid for block heads)
+    int refcount;               // Number of references to the page
+    void *slab;                 // Slab that owns the page (if any)
+} page_t;
+
+/**
+ * Adds a region of usable physical memory
+ *
+ * Regions must be added before page_init() is called. Any part of the
+ * region below the end of the kernel image or at or above PAGE_MEM_LIMIT
+ * is ignored.
+ *
+ * @param base - physical start address of the region
+ * @param size - size of the region in bytes
+ * @return -1 on error; 0 on success
+ */
+int page_region_add(unsigned int base, unsigned int size);
+
+/**
+ * Adds the usable physical memory described by the boot loader
+ * @param mbi - pointer to the multiboot information structure
+ * @return -1 on error; 0 on success
+ */
+int page_region_add_multiboot(multiboot_info_t *mbi);
+
+/**
+ * Initializes the page allocator
+ *
+ * If no regions have been added, the amount of installed memory is
+ * obtained from the BIOS configuration (CMOS).
+ */
+void page_init(void);
+
+/**
+ * Allocates a block of 2^order physically contiguous pages
+ * @param order - order of the block to allocate
+ * @return address of the block or NULL if no memory is available
+ */
+void *page_alloc(int order);
+
+/**
+ * Frees a block of 2^order pages
+ * @param addr - address of the block
+ * @param order - order of the block (as passed to page_alloc)
+ */
+void page_free(void *addr, int order);
+
+/**
+ * Adds a reference to an allocated page
+ * @param addr - address of the page
+ */
+void page_ref(void *addr);
+
+/**
+ * Drops a reference to an allocated page, freeing it when the last
+ * reference is dropped
+ * @param addr - address of the page
+ * @return number of references remaining
+ */
+int page_unref(void *addr);
+
+/**
+ * Returns the number of references to an allocated page
+ * @param addr - address of the page
+ * @return number of references
+ */
+int page_refcount(void *addr);
+
+/**
+ * Obtains the page frame descriptor for the given address
+ * @param addr - physical address
+ * @return pointer to the page descriptor or NULL if not managed
+ */
+page_t *page_get(void *addr);
+
+/**
+ * Obtains the physical address of the given page frame descriptor
+ * @param page - pointer to the page descriptor
+ * @return physical address of the page
+ */
+void *page_addr(page_t *page);
+
+/**
+ * Returns the number of free blocks of the given order
+ * @param order - block order
+ * @return number of free blocks
+ */
+int page_free_count(int order);
+
+/**
+ * Returns the total number of free pages
+ * @return number of free pages
+ */
+int page_free_pages(void);
+
+/**
+ * Returns the address one past the end of physical memory
+ * @return end of physical memory
+ */
+unsigned int page_mem_end(void);
+
+/**
+ * Displays the per-order free counts on the host console
+ */
+void page_dump(void);
+
+#endif
+#endif
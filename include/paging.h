@@ -0,0 +1,141 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Paging Definitions
+ *
+ * Virtual address space layout:
+ *   0x00000000 - 0x3FFFFFFF  Kernel: identity mapped physical memory (except
+ *                            the first page, so NULL dereferences fault)
+ *   0x40000000 - 0xBFFFFFFF  User space (per address space)
+ *   0xC0000000 - 0xFFFFFFFF  Kernel: identity mapped device memory (MMIO)
+ */
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "page.h"
+
+// Address space layout
+#define KERNEL_SPACE_END    PAGE_MEM_LIMIT
+#define USER_SPACE_BASE     KERNEL_SPACE_END
+#define USER_SPACE_END      0xC0000000
+#define MMIO_SPACE_BASE     USER_SPACE_END
+
+// Size of the region mapped by one page directory entry
+#define PDE_SIZE            (1 << 22)
+#define PDE_ENTRIES         1024
+#define PTE_ENTRIES         1024
+
+// Page directory/table entry flags
+#define PTE_PRESENT         0x001   // Page is present
+#define PTE_WRITE           0x002   // Page is writable
+#define PTE_USER            0x004   // Page is accessible from user mode
+#define PTE_PWT             0x008   // Page write-through (PAT index bit 0)
+#define PTE_PCD             0x010   // Page cache disable (PAT index bit 1)
+#define PTE_ACCESSED        0x020   // Page has been accessed
+#define PTE_DIRTY           0x040   // Page has been written
+#define PTE_PS              0x080   // Page directory entry maps a 4MB page
+#define PTE_GLOBAL          0x100   // Mapping is global (not flushed on CR3 load)
+#define PTE_COW             0x200   // Available to software: copy-on-write page
+
+// Cache type selectors (see paging_init for the PAT layout)
+#define PTE_CACHE_WC        PTE_PWT             // Write-combining (PAT entry 1)
+#define PTE_CACHE_UC        (PTE_PCD | PTE_PWT) // Uncacheable (PAT entry 3)
+
+#define PTE_FLAGS_MASK      0xFFF
+#define PTE_ADDR(pte)       ((pte) & ~PTE_FLAGS_MASK)
+
+#define PDE_INDEX(vaddr)    ((unsigned int)(vaddr) >> 22)
+#define PTE_INDEX(vaddr)    (((unsigned int)(vaddr) >> PAGE_SHIFT) & (PTE_ENTRIES - 1))
+
+#ifndef ASSEMBLER
+
+#include <spede/stdbool.h>
+
+typedef unsigned int pte_t;
+typedef unsigned int pde_t;
+
+// Kernel page directory
+extern pde_t *kernel_pd;
+
+/**
+ * Initializes paging
+ *  - Identity maps physical memory (with 4MB pages when supported)
+ *  - Programs the PAT so that the VGA text buffer is write-combining
+ *  - Enables paging
+ */
+void paging_init(void);
+
+/**
+ * Creates a new page directory sharing the kernel mappings
+ * @return pointer to the page directory or NULL if no memory is available
+ */
+pde_t *paging_pd_create(void);
+
+/**
+ * Frees a page directory and its page tables (not the mapped pages)
+ * @param pd - pointer to the page directory
+ */
+void paging_pd_destroy(pde_t *pd);
+
+/**
+ * Obtains the page table entry for a virtual address
+ * @param pd - pointer to the page directory
+ * @param vaddr - virtual address
+ * @param create - allocate the page table if it does not exist
+ * @return pointer to the page table entry or NULL
+ */
+pte_t *paging_lookup(pde_t *pd, unsigned int vaddr, bool create);
+
+/**
+ * Maps a 4KB page
+ * @param pd - pointer to the page directory
+ * @param vaddr - virtual address
+ * @param paddr - physical address
+ * @param flags - page table entry flags
+ * @return -1 on error; 0 on success
+ */
+int paging_map(pde_t *pd, unsigned int vaddr, unsigned int paddr, unsigned int flags);
+
+/**
+ * Unmaps a 4KB page
+ * @param pd - pointer to the page directory
+ * @param vaddr - virtual address
+ * @return the page table entry that was removed (0 if none)
+ */
+pte_t paging_unmap(pde_t *pd, unsigned int vaddr);
+
+/**
+ * Maps device memory into the kernel address space
+ *
+ * Memory below KERNEL_SPACE_END is already identity mapped and only has its
+ * cache type changed; memory at or above MMIO_SPACE_BASE is identity
+ * mapped on request. A linear framebuffer should be mapped write-combining.
+ *
+ * @param paddr - physical address
+ * @param size - size of the region in bytes
+ * @param wc - true for write-combining, false for uncacheable
+ * @return virtual address of the region or NULL on error
+ */
+void *paging_map_mmio(unsigned int paddr, unsigned int size, bool wc);
+
+/**
+ * Switches to the given page directory
+ * @param pd - pointer to the page directory
+ */
+void paging_switch(pde_t *pd);
+
+/**
+ * Returns the current page directory
+ * @return pointer to the page directory
+ */
+pde_t *paging_current(void);
+
+/**
+ * Flushes the TLB entry for the given address on this CPU
+ * @param vaddr - virtual address
+ */
+void paging_flush(unsigned int vaddr);
+
+#endif
+#endif
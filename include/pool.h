@@ -0,0 +1,129 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Fixed-size object pool allocator
+ *
+ * A pool is a statically sized array of objects. Free objects are chained
+ * through their own storage (an intrusive free list) so allocating and
+ * freeing are O(1) and need no extra bookkeeping memory beyond one bit per
+ * object to track which slots are in use.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <spede/stdbool.h>
+#include <spede/stddef.h>
+
+#include "bit.h"
+
+// Collect per-pool allocation statistics
+#ifndef POOL_STATS
+#define POOL_STATS 1
+#endif
+
+// Poison objects on free and verify the poison on allocation
+#ifndef POOL_DEBUG
+#define POOL_DEBUG 0
+#endif
+
+#define POOL_POISON_FREE    0x6b    // Pattern written over freed objects
+#define POOL_POISON_ALLOC   0xa5    // Pattern written over new objects
+
+// Pool data structure
+typedef struct pool_t {
+    char *name;                 // Name of the pool (for diagnostics)
+    char *storage;              // Object storage
+    size_t obj_size;            // Size of each object slot
+    int count;                  // Number of object slots
+    unsigned int *map;          // Bitmap of allocated slots
+    void *free_list;            // Intrusive list of freed slots
+    int next_unused;            // First slot that has never been allocated
+
+#if POOL_STATS
+    int in_use;                 // Number of objects currently allocated
+    int peak;                   // Highest number of objects allocated at once
+    unsigned int allocs;        // Number of successful allocations
+    unsigned int frees;         // Number of successful frees
+    unsigned int failures;      // Number of failed allocations
+#endif
+} pool_t;
+
+/**
+ * Defines a pool named 'name' holding 'count' objects of 'type'
+ *
+ * Each slot is a union of the object and the free list link so a slot is
+ * always large enough (and aligned) to hold the link while it is free.
+ *
+ * @param name - name of the pool_t variable to define
+ * @param type - object type stored in the pool
+ * @param count - number of objects in the pool
+ */
+#define POOL_DEFINE(_name, _type, _count)                                   \
+    static union { _type obj; void *next; } _name##_storage[(_count)];      \
+    static BITMAP_DECLARE(_name##_map, (_count));                           \
+    pool_t _name = {                                                        \
+        .name = #_name,                                                     \
+        .storage = (char *)_name##_storage,                                 \
+        .obj_size = sizeof(_name##_storage[0]),                             \
+        .count = (_count),                                                  \
+        .map = _name##_map,                                                 \
+    }
+
+/**
+ * Resets the pool so that all objects are free
+ * @param pool - pointer to the pool
+ * @return -1 on error; 0 on success
+ */
+int pool_init(pool_t *pool);
+
+/**
+ * Allocates an object from the pool
+ * @param pool - pointer to the pool
+ * @return pointer to the object or NULL if the pool is exhausted
+ */
+void *pool_alloc(pool_t *pool);
+
+/**
+ * Returns an object to the pool
+ * @param pool - pointer to the pool
+ * @param obj - pointer to the object
+ * @return -1 on error; 0 on success
+ */
+int pool_free(pool_t *pool, void *obj);
+
+/**
+ * Obtains the index of an object within the pool
+ * @param pool - pointer to the pool
+ * @param obj - pointer to the object
+ * @return index of the object or -1 if the object is not part of the pool
+ */
+int pool_index(pool_t *pool, void *obj);
+
+/**
+ * Obtains an allocated object by its index within the pool
+ * @param pool - pointer to the pool
+ * @param index - index of the object
+ * @return pointer to the object or NULL if the index is not allocated
+ */
+void *pool_get(pool_t *pool, int index);
+
+/**
+ * Finds the next allocated object index at or after the given index
+ *
+ * Allows iterating over allocated objects:
+ *   for (i = pool_next(pool, 0); i >= 0; i = pool_next(pool, i + 1))
+ *
+ * @param pool - pointer to the pool
+ * @param index - index to start searching from
+ * @return index of the next allocated object or -1 if there are none
+ */
+int pool_next(pool_t *pool, int index);
+
+/**
+ * Displays the pool statistics on the host console
+ * @param pool - pointer to the pool
+ */
+void pool_stats_dump(pool_t *pool);
+
+#endif
@@ -15,21 +15,45 @@
 #define RINGBUF_SIZE 1024
 #endif
 
+// Ring buffer control structure
+//
+// The data storage is provided by the caller so that a buffer may be sized
+// at runtime. The capacity must be a power of two so that the head and tail
+// can be wrapped with a mask instead of a compare or a divide.
 typedef struct ringbuf_t {
-    int head;                   // Head of the buffer
-    int tail;                   // Tail of the buffer
-    int size;                   // Current size of the buffer
-    char data[RINGBUF_SIZE];   // Data in buffer
+    size_t head;                // Head of the buffer (next byte to read)
+    size_t tail;                // Tail of the buffer (next byte to write)
+    size_t size;                // Current size of the buffer
+    size_t mask;                // Capacity - 1
+    char *data;                 // Data in buffer
 } ringbuf_t;
 
+// Convenience wrapper for a ring buffer with RINGBUF_SIZE bytes of
+// embedded storage
+typedef struct ringbuf_fixed_t {
+    ringbuf_t ring;             // Ring buffer control structure
+    char data[RINGBUF_SIZE];    // Data in buffer
+} ringbuf_fixed_t;
+
 /**
- * Initializes an empty ring buffer
+ * Initializes an empty ring buffer using the embedded storage
  * Sets the empty data to 0
  *
- * @param  buf - pointer to the ring buffer data structure
+ * @param  buf - pointer to the fixed-size ring buffer data structure
  * @return -1 on error; 0 on success
  */
-int ringbuf_init(ringbuf_t *buf);
+int ringbuf_init(ringbuf_fixed_t *buf);
+
+/**
+ * Initializes an empty ring buffer backed by caller-provided storage
+ * Sets the empty data to 0
+ *
+ * @param  buf      - pointer to the ring buffer data structure
+ * @param  mem      - pointer to the storage for the buffer data
+ * @param  capacity - size of the storage in bytes (must be a power of two)
+ * @return -1 on error; 0 on success
+ */
+int ringbuf_init_mem(ringbuf_t *buf, char *mem, size_t capacity);
 
 /**
  * Writes a byte to the buffer
@@ -58,6 +82,17 @@ int ringbuf_read(ringbuf_t *buf, char *byte);
  */
 int ringbuf_write_mem(ringbuf_t *buf, char *mem, size_t size);
 
+/**
+ * Copies multiple bytes to the buffer, discarding the oldest data to make
+ * room when the buffer would overflow (e.g. for a trace buffer)
+ * @param buf - pointer to the ring buffer structure
+ * @param mem - pointer to the memory location to copy from
+ * @param size - number of bytes to copy; only the last capacity bytes
+ *               are kept if more are given
+ * @return -1 on error, 0 on success
+ */
+int ringbuf_write_mem_overwrite(ringbuf_t *buf, char *mem, size_t size);
+
 /**
  * Copies multiple bytes from the buffer to the specified memory
  * @param buf - pointer to the ring buffer structure
@@ -75,6 +110,13 @@ int ringbuf_read_mem(ringbuf_t *buf, char *mem, size_t size);
  */
 int ringbuf_flush(ringbuf_t *buf);
 
+/**
+ * Returns the capacity of the buffer
+ * @param buf - pointer to the ring buffer structure
+ * @return number of bytes the buffer can hold
+ */
+size_t ringbuf_capacity(ringbuf_t *buf);
+
 /**
  * Indicates if the buffer is empty
  * @param buf - pointer to the ring buffer structure
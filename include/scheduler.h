@@ -0,0 +1,219 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Scheduler Definitions
+ *
+ * Priority round-robin scheduling: ready processes wait in one FIFO per
+ * priority level and each runs for at most one time slice before the
+ * timer preempts it. A bitmap of non-empty levels makes picking the next
+ * process a single bit scan, however many processes are ready.
+ *
+ * Processes that use up their time slice move to an "expired" set of
+ * levels that only runs once every active process has had its turn, so
+ * CPU-bound processes cannot starve lower priorities. Processes that
+ * block and wake up earn a priority boost (and CPU-bound ones lose it),
+ * keeping interactive processes responsive under load.
+ *
+ * Switches happen when the outermost interrupt returns, by resuming a
+ * different process's trap frame.
+ *
+ * Each CPU has its own run queue. New processes start on the least
+ * loaded CPU and woken processes return to the CPU they last ran on.
+ * Every few ticks (every tick while idle) a CPU pulls processes from the
+ * busiest one when the loads differ by two or more.
+ *
+ * Periodic real-time processes can instead join the earliest deadline
+ * first (EDF) class with scheduler_set_edf, declaring the runtime they
+ * need in every period and the deadline (relative to the start of the
+ * period) it must be done by. Ready EDF processes always run before the
+ * priority levels, the one with the earliest deadline first.
+ *
+ * EDF processes stay on the CPU they were admitted to. Admission control
+ * only accepts a process if the sum of runtime/deadline over the CPU's
+ * EDF processes stays within SCHEDULER_EDF_UTIL_MAX, so every admitted
+ * process meets its deadlines and the priority levels keep the rest.
+ *
+ * Each EDF process is a constant bandwidth server (CBS): the ticks it
+ * runs are charged against its budget, and one that uses up the budget
+ * is throttled until its next period, so a misbehaving process cannot
+ * take more than it reserved. A process that wakes up from a wait keeps
+ * its deadline only if its remaining budget fits in the time left before
+ * it; otherwise it starts a new period. A process ends each job with
+ * scheduler_edf_yield, sleeping until its next period.
+ */
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <spede/stdbool.h>
+
+#include "interrupts.h"
+#include "kproc.h"
+
+// Number of timer ticks each process may run before being preempted
+#ifndef SCHEDULER_TIMESLICE
+#define SCHEDULER_TIMESLICE 10
+#endif
+
+// Largest priority boost (or penalty) applied to a process
+#ifndef SCHEDULER_BOOST_MAX
+#define SCHEDULER_BOOST_MAX 5
+#endif
+
+// Boost at which a process is considered interactive; interactive
+// processes stay in the active set when their time slice expires
+#ifndef SCHEDULER_INTERACTIVE
+#define SCHEDULER_INTERACTIVE 2
+#endif
+
+// Number of timer ticks between load balancing passes on a busy CPU
+#ifndef SCHEDULER_BALANCE_INTERVAL
+#define SCHEDULER_BALANCE_INTERVAL 20
+#endif
+
+// Largest share of each CPU (in thousandths) that EDF processes may reserve
+#ifndef SCHEDULER_EDF_UTIL_MAX
+#define SCHEDULER_EDF_UTIL_MAX 900
+#endif
+
+// Scale of EDF utilization (the whole CPU)
+#define SCHEDULER_EDF_UTIL_SCALE 1000
+
+// Longest EDF period in milliseconds
+#ifndef SCHEDULER_EDF_PERIOD_MAX
+#define SCHEDULER_EDF_PERIOD_MAX 60000
+#endif
+
+#if PROC_PRIORITIES > 32
+#error "PROC_PRIORITIES must fit in the priority bitmap (32 levels)"
+#endif
+
+/**
+ * Initializes the scheduler
+ */
+void scheduler_init(void);
+
+/**
+ * Adds a process to the run queue
+ * @param proc - pointer to the process
+ */
+void scheduler_add(proc_t *proc);
+
+/**
+ * Adds a process that has finished waiting to the run queue, boosting
+ * its priority and preempting the running process if it now ranks higher
+ * @param proc - pointer to the process
+ */
+void scheduler_wakeup(proc_t *proc);
+
+/**
+ * Sets the base priority of a process
+ * @param proc - pointer to the process
+ * @param priority - priority (0 is the highest)
+ * @return -1 on error; 0 on success
+ */
+int scheduler_set_priority(proc_t *proc, int priority);
+
+/**
+ * Lends a process a priority (e.g. while it holds a lock that a higher
+ * priority process waits for); the process runs at the higher of its
+ * own and the inherited priority
+ * @param proc - pointer to the process
+ * @param priority - inherited priority (PROC_PRIORITIES for none)
+ */
+void scheduler_inherit_priority(proc_t *proc, int priority);
+
+/**
+ * Moves a process into the earliest deadline first class, or back to the
+ * priority levels with a runtime of 0
+ *
+ * The process is admitted to its own CPU if there is room, or else (if it
+ * is not running) to the least loaded CPU that has room. Its first period
+ * starts right away.
+ * @param proc - pointer to the process
+ * @param runtime - time it runs in each period in milliseconds (0 to leave the class)
+ * @param period - period in milliseconds
+ * @param deadline - deadline relative to the start of each period in
+ *                   milliseconds (runtime <= deadline <= period)
+ * @return -1 on error or if no CPU can take the process; 0 on success
+ */
+int scheduler_set_edf(proc_t *proc, int runtime, int period, int deadline);
+
+/**
+ * Ends the current job of the running EDF process, which sleeps until
+ * its next period starts (other processes simply yield)
+ */
+void scheduler_edf_yield(void);
+
+/**
+ * Removes a process from the run queue
+ * @param proc - pointer to the process
+ */
+void scheduler_remove(proc_t *proc);
+
+/**
+ * Switches directly to a process that was just unblocked once the
+ * current interrupt returns, without going through the run queue
+ *
+ * Meant for a process that is about to block waiting for the one it hands
+ * over to (e.g. an IPC call switching to the server that receives it).
+ * The process runs on this CPU with the rest of its time slice; one that
+ * cannot move here is woken up normally instead.
+ * @param proc - pointer to the process
+ */
+void scheduler_handoff(proc_t *proc);
+
+/**
+ * Returns the number of runnable processes (ready or running, excluding
+ * the idle process)
+ * @return number of processes
+ */
+int scheduler_nr_running(void);
+
+/**
+ * Blocks the running process until scheduler_wakeup is called for it
+ *
+ * Callers check their wait condition with interrupts disabled and keep
+ * them disabled until this call, so a wakeup cannot be missed in between.
+ * Inside an interrupt handler (e.g. a system call) the process is only
+ * switched out once the handler returns, so this returns immediately.
+ */
+void scheduler_block(void);
+
+/**
+ * Requests a reschedule when the current interrupt returns
+ */
+void scheduler_resched(void);
+
+/**
+ * Requests a reschedule on the given CPU
+ * @param cpu - CPU index
+ */
+void scheduler_resched_cpu(int cpu);
+
+/**
+ * Charges a timer tick to this CPU's running process, preempting it when
+ * its time slice (or EDF budget) runs out, and starts the periods of
+ * throttled EDF processes that are due
+ */
+void scheduler_tick(void);
+
+/**
+ * Dumps the run queue of each CPU
+ */
+void scheduler_dump(void);
+
+/**
+ * Gives up the remainder of the running process's time slice
+ */
+void scheduler_yield(void);
+
+/**
+ * Selects the process to resume when the outermost interrupt returns
+ *
+ * @param frame - trap frame of the interrupted process
+ * @return trap frame of the process to resume
+ */
+trap_frame_t *scheduler_run(trap_frame_t *frame);
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Symmetric Multiprocessing Definitions
+ *
+ * The processors listed in the ACPI MADT are started with the
+ * INIT-SIPI-SIPI sequence: each begins in real mode in a small
+ * trampoline copied below 1MB, which enters protected mode with paging
+ * and calls into the kernel on its own stack.
+ *
+ * Every CPU has its own descriptor table, TSS, interrupt stack, idle
+ * process and run queue. Its per-CPU data (cpu_t) is the base of a
+ * segment loaded in FS, so this_cpu() is a single load. Only the boot
+ * CPU receives device and timer interrupts; it forwards each timer tick
+ * to the others with an IPI.
+ *
+ * Kernel data is protected by one recursive kernel lock, taken by every
+ * interrupts_save section and while handling an interrupt. A process
+ * that is switched out while holding it gives it up and takes it back
+ * when it is resumed (on whichever CPU that is).
+ */
+#ifndef SMP_H
+#define SMP_H
+
+// Maximum number of CPUs
+#ifndef CPU_MAX
+#define CPU_MAX             8
+#endif
+
+// Physical address the application processors start at (page aligned,
+// below 1MB and never managed by the page allocator)
+#define SMP_TRAMPOLINE      0x8000
+
+// Offsets in cpu_t (for assembly)
+#define CPU_SELF            0
+#define CPU_IRQ_STACK       4
+#define CPU_IRQ_STACK_TOP   8
+
+#ifndef ASSEMBLER
+
+#include <spede/stdbool.h>
+
+struct proc_t;
+struct trap_frame_t;
+
+// Per-CPU data
+typedef struct cpu_t {
+    struct cpu_t *self;             // This structure (read through the per-CPU segment)
+    char *irq_stack;                // Bottom of the interrupt stack
+    char *irq_stack_top;            // Top of the interrupt stack
+    int id;                         // Index in cpu_table (0 is the boot CPU)
+    int apic_id;                    // Local APIC id
+    volatile bool online;           // Set once the CPU has initialized
+    struct proc_t *current;         // Process running on the CPU
+    struct proc_t *idle;            // Process run when nothing else is ready
+    struct trap_frame_t *frame;     // Trap frame of the interrupt being handled
+    unsigned int ipis;              // Inter-processor interrupts received
+} cpu_t;
+
+// Data for each CPU
+extern cpu_t cpu_table[CPU_MAX];
+
+// Number of CPUs that have been started
+extern int smp_nr_cpus;
+
+// Set once the application processors may run (see smp_start)
+extern volatile bool smp_active;
+
+/**
+ * Returns the data of the CPU that is running
+ * @return pointer to the per-CPU data
+ */
+static inline cpu_t *this_cpu(void) {
+    cpu_t *cpu;
+    asm volatile("mov %%fs:%c1, %0" : "=r"(cpu) : "i"(CPU_SELF));
+    return cpu;
+}
+
+/**
+ * Initializes the boot CPU's per-CPU data
+ */
+void smp_init_bsp(void);
+
+/**
+ * Finds and starts the application processors; they wait in their idle
+ * process until smp_start is called
+ */
+void smp_init(void);
+
+/**
+ * Lets the application processors begin scheduling processes
+ */
+void smp_start(void);
+
+/**
+ * Acquires the kernel lock (recursively on the same CPU)
+ */
+void kernel_lock(void);
+
+/**
+ * Releases one level of the kernel lock
+ */
+void kernel_unlock(void);
+
+/**
+ * Hands the CPU's hold on the kernel lock from one process to another
+ * when switching between them
+ * @param prev - process being switched out
+ * @param next - process being switched to
+ */
+void kernel_lock_switch(struct proc_t *prev, struct proc_t *next);
+
+/**
+ * Requests that another CPU reschedule
+ * @param cpu - CPU index
+ */
+void smp_resched_cpu(int cpu);
+
+/**
+ * Dumps the state of each CPU
+ */
+void smp_dump(void);
+
+#endif
+#endif
@@ -0,0 +1,171 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Spinlock Definitions
+ *
+ * Ticket spinlocks hand the lock out in the order CPUs asked for it, so
+ * no waiter starves. Reader-writer spinlocks let any number of readers
+ * in at once; a waiting writer stops new readers from entering.
+ *
+ * The _irqsave variants also disable interrupts on the local CPU, without
+ * taking the kernel lock, and must be used for any lock an interrupt
+ * handler takes. Spinlocks nest inside the kernel lock (see smp.h), never
+ * the other way around: code holding a spinlock must not call anything
+ * that may take the kernel lock (interrupts_save, which includes the page
+ * and slab allocators) or block.
+ *
+ * With SPINLOCK_DEBUG (for debug builds), every lock records how often it
+ * was taken and contended, the cycles spent spinning for it and its
+ * longest hold time; spinlock_dump reports them by name.
+ */
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <spede/stdbool.h>
+
+// Collect per-lock contention statistics (enable for debug builds)
+#ifndef SPINLOCK_DEBUG
+#define SPINLOCK_DEBUG 0
+#endif
+
+// Per-lock statistics
+typedef struct lock_stats_t {
+    char *name;                     // Name of the lock (for diagnostics)
+    char *type;                     // "spin" or "rw"
+    volatile unsigned int acquired; // Number of acquisitions
+    volatile unsigned int contended; // Acquisitions that had to wait
+    volatile unsigned long long spin_cycles; // Cycles spent waiting
+    unsigned long long hold_start;  // Time stamp of the last exclusive acquisition
+    unsigned long long max_hold;    // Longest exclusive hold (cycles)
+    struct lock_stats_t *next;      // Next lock in the registry
+} lock_stats_t;
+
+// Ticket spinlock
+typedef struct spinlock_t {
+    volatile unsigned int next;     // Next ticket to hand out
+    volatile unsigned int owner;    // Ticket currently holding the lock
+#if SPINLOCK_DEBUG
+    lock_stats_t stats;
+#endif
+} spinlock_t;
+
+// Reader-writer spinlock
+typedef struct rwlock_t {
+    volatile unsigned int value;    // Number of readers, plus RWLOCK_WRITER
+#if SPINLOCK_DEBUG
+    lock_stats_t stats;
+#endif
+} rwlock_t;
+
+// Set in rwlock_t.value while a writer holds (or is waiting for) the lock
+#define RWLOCK_WRITER       0x80000000
+
+/**
+ * Initializes a spinlock (unlocked)
+ * @param lock - pointer to the lock
+ * @param name - name of the lock (for statistics)
+ */
+void spinlock_init(spinlock_t *lock, char *name);
+
+/**
+ * Acquires a spinlock, spinning until it is available
+ * @param lock - pointer to the lock
+ */
+void spinlock_acquire(spinlock_t *lock);
+
+/**
+ * Releases a spinlock
+ * @param lock - pointer to the lock
+ */
+void spinlock_release(spinlock_t *lock);
+
+/**
+ * Disables interrupts on this CPU and acquires a spinlock
+ * @param lock - pointer to the lock
+ * @return previous EFLAGS value (for spinlock_release_irqrestore)
+ */
+unsigned int spinlock_acquire_irqsave(spinlock_t *lock);
+
+/**
+ * Releases a spinlock and restores the interrupt state
+ * @param lock - pointer to the lock
+ * @param flags - value returned by spinlock_acquire_irqsave
+ */
+void spinlock_release_irqrestore(spinlock_t *lock, unsigned int flags);
+
+/**
+ * Checks whether a spinlock is held (by any CPU)
+ * @param lock - pointer to the lock
+ * @return true if held
+ */
+bool spinlock_held(spinlock_t *lock);
+
+/**
+ * Initializes a reader-writer lock (unlocked)
+ * @param lock - pointer to the lock
+ * @param name - name of the lock (for statistics)
+ */
+void rwlock_init(rwlock_t *lock, char *name);
+
+/**
+ * Acquires a reader-writer lock for reading
+ * @param lock - pointer to the lock
+ */
+void rwlock_read_acquire(rwlock_t *lock);
+
+/**
+ * Releases a read hold on a reader-writer lock
+ * @param lock - pointer to the lock
+ */
+void rwlock_read_release(rwlock_t *lock);
+
+/**
+ * Acquires a reader-writer lock for writing
+ * @param lock - pointer to the lock
+ */
+void rwlock_write_acquire(rwlock_t *lock);
+
+/**
+ * Releases a write hold on a reader-writer lock
+ * @param lock - pointer to the lock
+ */
+void rwlock_write_release(rwlock_t *lock);
+
+/**
+ * Disables interrupts on this CPU and acquires a reader-writer lock for
+ * reading
+ * @param lock - pointer to the lock
+ * @return previous EFLAGS value (for rwlock_read_release_irqrestore)
+ */
+unsigned int rwlock_read_acquire_irqsave(rwlock_t *lock);
+
+/**
+ * Releases a read hold and restores the interrupt state
+ * @param lock - pointer to the lock
+ * @param flags - value returned by rwlock_read_acquire_irqsave
+ */
+void rwlock_read_release_irqrestore(rwlock_t *lock, unsigned int flags);
+
+/**
+ * Disables interrupts on this CPU and acquires a reader-writer lock for
+ * writing
+ * @param lock - pointer to the lock
+ * @return previous EFLAGS value (for rwlock_write_release_irqrestore)
+ */
+unsigned int rwlock_write_acquire_irqsave(rwlock_t *lock);
+
+/**
+ * Releases a write hold and restores the interrupt state
+ * @param lock - pointer to the lock
+ * @param flags - value returned by rwlock_write_acquire_irqsave
+ */
+void rwlock_write_release_irqrestore(rwlock_t *lock, unsigned int flags);
+
+/**
+ * Dumps the statistics of the locks with the given name
+ * @param name - lock name (NULL for every lock)
+ */
+void spinlock_dump(char *name);
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Stack Usage Measurement Definitions
+ *
+ * Stacks are painted with a known pattern before they are used. The
+ * deepest point a stack has reached (its high-water mark) is found by
+ * scanning up from the bottom for the first word that is no longer the
+ * pattern, so stacks can be sized from measured usage.
+ */
+#ifndef STACK_H
+#define STACK_H
+
+// Size of the stack the kernel boots on
+#ifndef STACK_BOOT_SIZE
+#define STACK_BOOT_SIZE     (16 * 1024)
+#endif
+
+// Size of the stack interrupt handlers run on
+#ifndef STACK_IRQ_SIZE
+#define STACK_IRQ_SIZE      (8 * 1024)
+#endif
+
+#ifndef ASSEMBLER
+
+#include <spede/stdbool.h>
+#include <spede/stddef.h>
+
+// Maximum number of stacks that can be tracked
+#ifndef STACKS_MAX
+#define STACKS_MAX          64
+#endif
+
+#define STACK_PAINT         0x5354434B  // Pattern painted over unused stack ("STCK")
+
+// Tracked stack
+typedef struct stack_info_t {
+    char *name;                 // Name of the stack (for diagnostics)
+    char *base;                 // Lowest address of the stack
+    size_t size;                // Size of the stack in bytes
+    bool owned;                 // Set when the memory was allocated by stack_alloc
+} stack_info_t;
+
+// Stack the kernel boots on
+extern char stack_boot[STACK_BOOT_SIZE];
+
+// Stack interrupt handlers run on
+extern char stack_irq[STACK_IRQ_SIZE];
+
+/**
+ * Initializes stack tracking and registers the boot and interrupt stacks
+ */
+void stack_init(void);
+
+/**
+ * Paints a stack with the fill pattern
+ * @param base - lowest address of the stack
+ * @param size - size of the stack in bytes
+ */
+void stack_paint(char *base, size_t size);
+
+/**
+ * Calls a function on a different stack
+ * @param top - initial stack pointer (highest address of the stack)
+ * @param fn - function to call
+ */
+void stack_call(char *top, void (*fn)(void));
+
+/**
+ * Registers a stack so that its usage is tracked
+ *
+ * The stack is not painted; stacks that are already in use must only
+ * be painted below the current stack pointer.
+ *
+ * @param name - name of the stack
+ * @param base - lowest address of the stack
+ * @param size - size of the stack in bytes
+ * @return stack id or -1 on error
+ */
+int stack_register(char *name, char *base, size_t size);
+
+/**
+ * Stops tracking a stack
+ * @param id - stack id
+ */
+void stack_unregister(int id);
+
+/**
+ * Allocates, paints and registers a new stack
+ * @param name - name of the stack
+ * @param size - size of the stack in bytes
+ * @return stack id or -1 on error
+ */
+int stack_alloc(char *name, size_t size);
+
+/**
+ * Unregisters a stack, freeing it if it was allocated by stack_alloc
+ * @param id - stack id
+ */
+void stack_free(int id);
+
+/**
+ * Returns the tracked stack for the given id
+ * @param id - stack id
+ * @return pointer to the stack or NULL if the id is invalid
+ */
+stack_info_t *stack_get(int id);
+
+/**
+ * Returns the deepest usage of a stack since it was painted
+ * @param id - stack id
+ * @return number of bytes used or -1 if the id is invalid
+ */
+int stack_high_water(int id);
+
+/**
+ * Dumps the size and deepest usage of every tracked stack
+ */
+void stack_dump(void);
+
+#endif
+#endif
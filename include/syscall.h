@@ -0,0 +1,104 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * System Call Definitions
+ *
+ * User processes enter the kernel either with "int $0x80" or, on CPUs
+ * that support it, with the much cheaper SYSENTER instruction. Both
+ * entries build the same trap frame and dispatch through one table.
+ *
+ * Calling convention (both entries):
+ *   EAX - system call number; receives the return value
+ *   EBX, ESI, EDI - arguments
+ *
+ * SYSENTER saves no user state, so the caller also passes its stack
+ * pointer in ECX and the address to return to in EDX; the kernel
+ * returns there with SYSEXIT (leaving ECX and EDX unchanged).
+ *
+ * The message passing calls (SYS_IPC_*) carry a whole message in
+ * registers: the tag in ESI and the words in EDI and EBP, with the port
+ * in EBX. Calls that receive a message return it in the same registers,
+ * with the sender's process id in EBX.
+ *
+ * A new process starts with the entry method it should use in EAX
+ * (SYSCALL_ENTRY_*), selected from CPUID by the kernel.
+ */
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+// System call numbers
+#define SYS_NULL            0   // Does nothing (measures the entry/exit cost)
+#define SYS_EXIT            1   // Terminates the process
+#define SYS_GETPID          2   // Returns the process id
+#define SYS_YIELD           3   // Gives up the rest of the time slice
+#define SYS_PUTC            4   // Writes a character to the console
+#define SYS_FORK            5   // Duplicates the process (returns 0 in the child)
+#define SYS_TICKS           6   // Returns the number of timer ticks since boot
+#define SYS_BENCHMARK       7   // Reports a benchmark result (see syscall_benchmark)
+#define SYS_SLEEP           8   // Sleeps for a number of milliseconds
+#define SYS_IPC_PORT_CREATE 9   // Creates a port (see ipc.h)
+#define SYS_IPC_PORT_DESTROY 10 // Destroys a port
+#define SYS_IPC_WINDOW      11  // Sets the window pages are received in
+#define SYS_IPC_SEND        12  // Sends a message and waits until it is received
+#define SYS_IPC_SEND_ASYNC  13  // Queues a message without waiting
+#define SYS_IPC_CALL        14  // Sends a message and waits for the reply
+#define SYS_IPC_RECEIVE     15  // Waits for a message
+#define SYS_IPC_REPLY       16  // Replies to the last caller
+#define SYS_IPC_REPLY_WAIT  17  // Replies to the last caller and waits for a message
+
+// Size of the system call table
+#define SYSCALL_MAX         32
+
+// System call entry methods
+#define SYSCALL_ENTRY_INT       0   // int $0x80
+#define SYSCALL_ENTRY_SYSENTER  1   // SYSENTER/SYSEXIT
+
+// Number of calls timed per entry method by the benchmark
+#ifndef SYSCALL_BENCHMARK_REPS
+#define SYSCALL_BENCHMARK_REPS  10000
+#endif
+
+#ifndef ASSEMBLER
+
+// System call handler; receives EBX, ESI and EDI and returns EAX
+typedef int (*syscall_t)(unsigned int arg1, unsigned int arg2, unsigned int arg3);
+
+/**
+ * Initializes the system call table and entry points
+ */
+void syscall_init(void);
+
+/**
+ * Sets up the SYSENTER entry point on the CPU that is running
+ */
+void syscall_init_cpu(void);
+
+/**
+ * Adds a system call to the table
+ * @param nr - system call number
+ * @param name - name of the system call (for statistics)
+ * @param handler - function implementing the system call
+ * @return -1 on error; 0 on success
+ */
+int syscall_register(int nr, char *name, syscall_t handler);
+
+/**
+ * Returns the entry method user processes should use
+ * @return SYSCALL_ENTRY_SYSENTER or SYSCALL_ENTRY_INT
+ */
+int syscall_entry_method(void);
+
+/**
+ * Starts a user process that times null system calls through each
+ * supported entry method; the results are logged when it runs
+ */
+void syscall_benchmark(void);
+
+/**
+ * Dumps the number of calls made to each system call
+ */
+void syscall_dump(void);
+
+#endif
+#endif
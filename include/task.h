@@ -0,0 +1,98 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Task Pool (Parallel For) Definitions
+ *
+ * parallel_for splits a range of indexes into chunks that run on every
+ * CPU. Each CPU has a worker process with a Chase-Lev work-stealing
+ * deque: the owner pushes and pops tasks at the bottom without locking,
+ * and idle workers steal from the top of other deques with a single
+ * compare-and-exchange.
+ *
+ * A task covering a range larger than the grain forks off its upper half
+ * (pushing it where thieves can find it) and keeps the lower half, until
+ * it is small enough to run. The caller of parallel_for runs the first
+ * task itself and then joins: it keeps running and stealing tasks while
+ * there are any, then sleeps until the last chunk of its range finishes.
+ * A caller that is not a worker borrows a deque for the duration of the
+ * call.
+ *
+ * Until the workers run (before the application processors are started)
+ * the caller simply does all of the work itself.
+ */
+#ifndef TASK_H
+#define TASK_H
+
+#include <spede/stdbool.h>
+
+#include "smp.h"
+
+// Tasks each deque can hold (power of two); a task that cannot be
+// pushed runs in the task that would have forked it
+#ifndef TASK_DEQUE_SIZE
+#define TASK_DEQUE_SIZE     64
+#endif
+
+// Deques that callers other than the workers can borrow at once
+#ifndef TASK_CALLERS_MAX
+#define TASK_CALLERS_MAX    4
+#endif
+
+// Total number of deques (one per worker, then the callers')
+#define TASK_DEQUES         (CPU_MAX + TASK_CALLERS_MAX)
+
+/**
+ * Function run on each chunk of a parallel_for range
+ * @param begin - first index of the chunk
+ * @param end - end of the chunk (exclusive)
+ * @param ctx - context passed to parallel_for
+ */
+typedef void (*parallel_fn_t)(int begin, int end, void *ctx);
+
+struct task_job_t;
+
+// Chunk of a parallel_for range
+typedef struct task_t {
+    struct task_job_t *job;         // parallel_for call the chunk belongs to
+    int begin;                      // First index
+    int end;                        // End index (exclusive)
+} task_t;
+
+// Work-stealing deque
+typedef struct task_deque_t {
+    volatile unsigned int top;      // Next task to steal
+    volatile unsigned int bottom;   // Next free slot (owner side)
+    task_t tasks[TASK_DEQUE_SIZE];  // Ring of tasks
+    unsigned int executed;          // Tasks run by the owner
+    unsigned int stolen;            // Tasks the owner stole from other deques
+} task_deque_t;
+
+/**
+ * Initializes the task pool and starts a worker for each CPU
+ */
+void task_init(void);
+
+/**
+ * Runs fn over [begin, end) in chunks of at most grain indexes, spread
+ * over every CPU, and returns once all of them are done
+ * @param begin - first index
+ * @param end - end index (exclusive)
+ * @param grain - largest chunk to run without splitting it (at least 1)
+ * @param fn - function run on each chunk
+ * @param ctx - context passed to fn
+ */
+void parallel_for(int begin, int end, int grain, parallel_fn_t fn, void *ctx);
+
+/**
+ * Measures how fast a large buffer is cleared with parallel_for compared
+ * to a single CPU and logs it
+ */
+void task_benchmark(void);
+
+/**
+ * Dumps the state of each deque
+ */
+void task_dump(void);
+
+#endif
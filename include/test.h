@@ -7,20 +7,60 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include <spede/stdio.h>
+
+#include "cpustat.h"
+#include "fiber.h"
+#include "interrupts.h"
+#include "ipc.h"
 #include "timer.h"
 #include "kernel.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "scheduler.h"
+#include "syscall.h"
+#include "task.h"
 #include "vga.h"
+#include "wait.h"
+
+// Run the benchmarks during initialization
+#ifndef TEST_BENCHMARK
+#define TEST_BENCHMARK 0
+#endif
+
+// Number of cells in the utilization meter
+#define TEST_METER_CELLS 8
+
+// Period of the console refresh process in milliseconds; the timer is
+// updated every period and the utilization meter every other one
+#define TEST_CONSOLE_PERIOD 250
+
+// Time the console refresh process may run in each period in milliseconds
+#define TEST_CONSOLE_RUNTIME 20
 
 /**
- * Displays a "spinner" to show activity at the top-right corner of the
- * VGA output
+ * Displays a CPU utilization meter to the left of the timer at the top
+ * of the VGA output
  */
-void test_spinner(void) {
-    static char spin[] = { '|', '/', '-', '\\' };
-    static int count = 0;
+void test_meter(void) {
+    int busy = cpustat_busy();
+    int filled = (busy * TEST_METER_CELLS + 50) / 100;
+    int x = 73 - TEST_METER_CELLS - 6;
+    int fg = VGA_COLOR_GREEN;
+    char pct[5];
 
-    vga_putc_at(VGA_WIDTH-1, 0, VGA_COLOR_BLACK, VGA_COLOR_GREEN,
-                spin[count++ % sizeof(spin)]);
+    if (busy >= 90) {
+        fg = VGA_COLOR_RED;
+    } else if (busy >= 60) {
+        fg = VGA_COLOR_YELLOW;
+    }
+
+    for (int i = 0; i < TEST_METER_CELLS; i++) {
+        vga_putc_at(x + i, 0, VGA_COLOR_BLACK, fg, i < filled ? '#' : '.');
+    }
+
+    snprintf(pct, sizeof(pct), "%3d%%", busy);
+    vga_puts_at(x + TEST_METER_CELLS + 1, 0, VGA_COLOR_BLACK, fg, pct);
 }
 
 /**
@@ -32,16 +72,62 @@ void test_timer(void) {
     vga_printf("%5d", timer_get_ticks() / 100);
 }
 
+/**
+ * Console refresh process: updates the timer and utilization meter once
+ * per period as an EDF process (or by sleeping if it cannot be admitted)
+ */
+void test_console(void) {
+    bool edf = scheduler_set_edf(active_proc, TEST_CONSOLE_RUNTIME, TEST_CONSOLE_PERIOD,
+                                 TEST_CONSOLE_PERIOD) == 0;
+    unsigned int flags;
+
+    for (int n = 0; ; n++) {
+        // Keep other output from moving the cursor during the update
+        flags = interrupts_save();
+
+        test_timer();
+
+        if (n % 2 == 0) {
+            test_meter();
+        }
+
+        interrupts_restore(flags);
+
+        if (edf) {
+            scheduler_edf_yield();
+        } else {
+            sleep_ms(TEST_CONSOLE_PERIOD);
+        }
+    }
+}
+
 /**
  * Initializes all tests
  */
 void test_init(void) {
     kernel_log_info("Initializing test functions");
 
-    // Register the spinner to update at a rate of 10 times per second
-    timer_callback_register(&test_spinner, 10, -1);
+    // Update the timer 4 times per second and the utilization meter twice
+    // per second from a periodic process instead of the timer interrupt
+    if (kproc_create(test_console, "test_console") < 0) {
+        kernel_log_error("test: unable to start the console refresh process");
+    }
+
+    if (TEST_BENCHMARK) {
+        // Compare the memory copy/fill implementations
+        kstring_benchmark();
+
+        // Measure the fiber switch cost
+        fiber_benchmark();
+
+        // Compare the int 0x80 and SYSENTER system call cost
+        syscall_benchmark();
+
+        // Measure the IPC call/reply round trip cost
+        ipc_benchmark();
 
-    // Register the timer to update at a rate of 4 times per second
-    timer_callback_register(&test_timer, 24, -1);
+        // Compare clearing a large buffer on one CPU and on all of them
+        task_benchmark();
+    }
 }
 #endif
@@ -11,8 +11,17 @@
 #define TIMERS_MAX 32
 #endif
 
+// Timer interrupt frequency (ticks per second)
+#ifndef TIMER_HZ
+#define TIMER_HZ 100
+#endif
+
 /**
  * Registers a new callback to be called at the specified interval
+ *
+ * Callbacks run inside the timer interrupt; slow jobs should queue work
+ * (see workqueue.h) instead of running in the callback.
+ *
  * @param func_ptr - function pointer to be called
  * @param interval - number of ticks before the callback is performed
  * @param repeat   - Indicate how many intervals to repeat (-1 should repeat forever)
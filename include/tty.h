@@ -7,6 +7,9 @@
 #ifndef TTY_H
 #define TTY_H
 
+#include "ringbuf.h"
+#include "wait.h"
+
 #ifndef TTY_MAX
 #define TTY_MAX         10  // Maximum number of TTYs to support
 #endif
@@ -20,6 +23,10 @@
 
 #define TTY_BUF_SIZE (TTY_WIDTH * (TTY_HEIGHT + TTY_SCROLLBACK))
 
+#ifndef TTY_INPUT_SIZE
+#define TTY_INPUT_SIZE  64  // Size of the input buffer (must be a power of two)
+#endif
+
 
 // TTY data structure
 // Describes the virtual TTY
@@ -37,6 +44,10 @@ typedef struct tty_t {
     int pos_y;                  // current y position in the screen
 
     int pos_scroll;             // Current scrollback position in the buffer
+
+    ringbuf_t input;            // Input buffer
+    char input_data[TTY_INPUT_SIZE]; // Storage for the input buffer
+    wait_queue_t input_wait;    // Processes waiting for input
 } tty_t;
 
 /**
@@ -56,6 +67,19 @@ void tty_select(int tty);
  */
 void tty_update(char c);
 
+/**
+ * Adds a character to the active TTY's input buffer, waking a reader
+ * @param c - character
+ * @return -1 if the buffer is full or no TTY is active; 0 on success
+ */
+int tty_input(char c);
+
+/**
+ * Blocks until the active TTY has input and reads one character
+ * @return character read
+ */
+char tty_getc(void);
+
 /**
  * Scrolls the TTY up one line into the scrollback buffer
  * If the buffer is at the top, it will not scroll up further
@@ -0,0 +1,150 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Virtual Memory (Address Space) Definitions
+ *
+ * An address space is a page directory plus a list of areas describing
+ * what each range of user addresses should contain. Pages are populated
+ * lazily by the page fault handler: the first access to a page allocates
+ * it and fills it from the area's backing data (or zeros).
+ *
+ * Forked address spaces share their pages copy-on-write: both sides map
+ * each page read-only with PTE_COW set, and the first write fault copies
+ * the page (or simply makes it writable once it is no longer shared).
+ */
+#ifndef VM_H
+#define VM_H
+
+#include "paging.h"
+
+// Area permission flags
+#define VM_READ             0x1
+#define VM_WRITE            0x2
+#define VM_EXEC             0x4
+
+// User stack placement
+#define VM_STACK_TOP        USER_SPACE_END
+#ifndef VM_STACK_SIZE
+#define VM_STACK_SIZE       (64 * 1024)
+#endif
+
+// Page fault error code bits
+#define VM_FAULT_PRESENT    0x1     // Fault on a present page (protection)
+#define VM_FAULT_WRITE      0x2     // Fault caused by a write
+#define VM_FAULT_USER       0x4     // Fault occurred in user mode
+
+// Address space area
+//
+// Pages in [start, end) are filled from 'data' for addresses in
+// [data_start, data_end); everything else in the area is zero-filled.
+typedef struct vm_area_t {
+    struct vm_area_t *next;     // Next area in the address space
+    unsigned int start;         // Start address (page aligned)
+    unsigned int end;           // End address (page aligned, exclusive)
+    unsigned int flags;         // Permission flags
+    char *data;                 // Backing data for data_start
+    unsigned int data_start;    // First address backed by data
+    unsigned int data_end;      // End of the addresses backed by data
+} vm_area_t;
+
+// Address space
+typedef struct vm_space_t {
+    pde_t *pd;                  // Page directory
+    vm_area_t *areas;           // List of areas
+    int resident;               // Number of resident pages
+    unsigned int faults;        // Number of pages populated on demand
+    unsigned int cow_faults;    // Number of copy-on-write faults resolved
+} vm_space_t;
+
+/**
+ * Initializes the virtual memory subsystem and registers the page fault
+ * handler
+ */
+void vm_init(void);
+
+/**
+ * Creates an empty address space
+ * @return pointer to the address space or NULL if no memory is available
+ */
+vm_space_t *vm_space_create(void);
+
+/**
+ * Destroys an address space, freeing all of its resident pages
+ * @param space - pointer to the address space
+ */
+void vm_space_destroy(vm_space_t *space);
+
+/**
+ * Creates a copy-on-write duplicate of an address space
+ *
+ * Only the page tables are walked: every resident page is shared with
+ * the new address space and write protected in both, so the cost is
+ * proportional to the number of page tables rather than the size of
+ * the address space.
+ *
+ * @param parent - pointer to the address space to duplicate
+ * @return pointer to the new address space or NULL if no memory is available
+ */
+vm_space_t *vm_space_fork(vm_space_t *parent);
+
+/**
+ * Adds an area to the address space
+ * @param space - pointer to the address space
+ * @param start - start address
+ * @param end - end address (exclusive)
+ * @param flags - permission flags
+ * @param data - backing data for data_start (NULL for zero-filled)
+ * @param data_start - first address backed by data
+ * @param data_end - end of the addresses backed by data
+ * @return -1 on error; 0 on success
+ */
+int vm_area_add(vm_space_t *space, unsigned int start, unsigned int end, unsigned int flags,
+                char *data, unsigned int data_start, unsigned int data_end);
+
+/**
+ * Finds the area containing the given address
+ * @param space - pointer to the address space
+ * @param addr - virtual address
+ * @return pointer to the area or NULL if the address is not mapped
+ */
+vm_area_t *vm_area_find(vm_space_t *space, unsigned int addr);
+
+/**
+ * Handles a page fault in the given address space
+ * @param space - pointer to the address space
+ * @param addr - faulting address
+ * @param error - page fault error code
+ * @return -1 if the access is invalid; 0 if the fault was resolved
+ */
+int vm_fault(vm_space_t *space, unsigned int addr, unsigned int error);
+
+/**
+ * Moves pages from one address space to another without copying them
+ *
+ * Each source page is populated (and made private if it is shared
+ * copy-on-write), unmapped and mapped writable at the destination in
+ * place of whatever was there. The source range reads as freshly filled
+ * pages afterwards. Both ranges must lie in writable areas.
+ * @param src - pointer to the source address space
+ * @param saddr - first source address (page aligned)
+ * @param dst - pointer to the destination address space
+ * @param daddr - first destination address (page aligned)
+ * @param pages - number of pages
+ * @return -1 on error; 0 on success
+ */
+int vm_page_move(vm_space_t *src, unsigned int saddr, vm_space_t *dst, unsigned int daddr, int pages);
+
+/**
+ * Switches to the given address space
+ * @param space - pointer to the address space (NULL for the kernel)
+ */
+void vm_switch(vm_space_t *space);
+
+/**
+ * Returns the current address space
+ * @return pointer to the address space or NULL for the kernel
+ */
+vm_space_t *vm_current(void);
+
+#endif
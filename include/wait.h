@@ -0,0 +1,107 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Wait Queue Definitions
+ *
+ * A wait queue holds the processes blocked until some event happens
+ * (e.g. input arriving). Waiters check their condition with interrupts
+ * disabled and only then sleep, and whatever makes the condition true
+ * calls wake_up or wake_up_all afterwards, so a wakeup is never lost.
+ * A woken process re-checks the condition, since another process may
+ * have consumed the event first.
+ *
+ * Sleeping processes wait on a list ordered by wakeup tick that the
+ * timer checks once per tick.
+ *
+ * In a system call the running process cannot block in place: it only
+ * stops running once the call returns. wait_event is for kernel
+ * threads; system calls use wait_sleep/sleep_until once and return.
+ */
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <spede/stdbool.h>
+
+#include "interrupts.h"
+#include "kproc.h"
+
+// Queue of waiting processes
+typedef struct wait_queue_t {
+    proc_t *head;               // First process to wake
+    proc_t *tail;               // Last process to wake
+} wait_queue_t;
+
+/**
+ * Blocks the running process until the condition is true
+ * @param wq - pointer to the wait queue
+ * @param cond - condition, evaluated with interrupts disabled
+ */
+#define wait_event(wq, cond)                                            \
+    do {                                                                \
+        unsigned int __flags = interrupts_save();                       \
+        while (!(cond)) {                                               \
+            wait_sleep(wq);                                             \
+        }                                                               \
+        interrupts_restore(__flags);                                    \
+    } while (0)
+
+/**
+ * Initializes wait queues and the sleep timer
+ */
+void wait_init(void);
+
+/**
+ * Initializes a wait queue
+ * @param wq - pointer to the wait queue
+ */
+void wait_queue_init(wait_queue_t *wq);
+
+/**
+ * Blocks the running process on a wait queue until it is woken up
+ * (must be called with interrupts disabled)
+ * @param wq - pointer to the wait queue
+ */
+void wait_sleep(wait_queue_t *wq);
+
+/**
+ * Adds a blocked process to the end of a wait queue without blocking the
+ * running process (must be called with interrupts disabled)
+ * @param wq - pointer to the wait queue
+ * @param proc - pointer to the process
+ */
+void wait_enqueue(wait_queue_t *wq, proc_t *proc);
+
+/**
+ * Wakes the process that has waited longest on a wait queue
+ * @param wq - pointer to the wait queue
+ * @return number of processes woken
+ */
+int wake_up(wait_queue_t *wq);
+
+/**
+ * Wakes every process waiting on a wait queue
+ * @param wq - pointer to the wait queue
+ * @return number of processes woken
+ */
+int wake_up_all(wait_queue_t *wq);
+
+/**
+ * Removes a process from the wait queue or sleep list holding it
+ * @param proc - pointer to the process
+ */
+void wait_remove(proc_t *proc);
+
+/**
+ * Blocks the running process until the given tick
+ * @param tick - timer tick to wake up at
+ */
+void sleep_until(int tick);
+
+/**
+ * Blocks the running process for at least the given time
+ * @param ms - time in milliseconds (rounded up to whole ticks)
+ */
+void sleep_ms(unsigned int ms);
+
+#endif
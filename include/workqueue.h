@@ -0,0 +1,125 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Work Queue Definitions
+ *
+ * A work queue runs deferred jobs in kernel threads (workers) instead of
+ * interrupt context, so a slow job can be preempted and does not add to
+ * interrupt latency. Jobs are described by work items, which callers
+ * usually embed in their own data structures; a work item is queued at
+ * most once at a time and may be queued again once its function starts.
+ */
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <spede/stdbool.h>
+
+#include "kproc.h"
+
+// Maximum number of work queues
+#ifndef WORKQUEUE_MAX
+#define WORKQUEUE_MAX           8
+#endif
+
+// Maximum number of workers per queue
+#ifndef WORKQUEUE_WORKERS_MAX
+#define WORKQUEUE_WORKERS_MAX   4
+#endif
+
+// Maximum number of processes waiting in flush_workqueue per queue
+#ifndef WORKQUEUE_FLUSHERS_MAX
+#define WORKQUEUE_FLUSHERS_MAX  8
+#endif
+
+#define WORKQUEUE_NAME_LEN      16
+
+struct work_t;
+
+// Function run for a work item
+typedef void (*work_func_t)(struct work_t *work);
+
+// Work item
+typedef struct work_t {
+    work_func_t func;               // Function to run
+    void *data;                     // Caller data for the function
+    struct work_t *next;            // Next item in the queue
+    unsigned int seq;               // Position in the queue (for flushing)
+    bool pending;                   // Queued but not yet started
+} work_t;
+
+// Work queue
+typedef struct workqueue_t {
+    char name[WORKQUEUE_NAME_LEN];  // Name of the queue (workers are named after it)
+    work_t *head;                   // First queued item
+    work_t *tail;                   // Last queued item
+
+    int nr_workers;                             // Number of workers
+    proc_t *workers[WORKQUEUE_WORKERS_MAX];     // Worker threads
+    unsigned int running[WORKQUEUE_WORKERS_MAX]; // Sequence of the item each worker runs (0 if none)
+
+    int nr_flushers;                            // Number of waiting flushers
+    proc_t *flushers[WORKQUEUE_FLUSHERS_MAX];   // Processes waiting for items to complete
+    unsigned int flush_seq[WORKQUEUE_FLUSHERS_MAX]; // Sequence each flusher waits for
+
+    unsigned int next_seq;          // Sequence assigned to the next queued item
+    unsigned int queued;            // Number of items queued
+    unsigned int completed;         // Number of items run
+} workqueue_t;
+
+// General purpose queue for jobs that do not need their own workers
+extern workqueue_t *system_wq;
+
+/**
+ * Initializes work queues and creates the system work queue
+ */
+void workqueue_init(void);
+
+/**
+ * Initializes a work item
+ * @param work - pointer to the work item
+ * @param func - function to run
+ * @param data - caller data for the function
+ */
+void work_init(work_t *work, work_func_t func, void *data);
+
+/**
+ * Creates a work queue and its workers
+ * @param name - name of the queue
+ * @param nr_workers - number of workers (1 runs items strictly in order)
+ * @return pointer to the queue or NULL on error
+ */
+workqueue_t *workqueue_create(char *name, int nr_workers);
+
+/**
+ * Queues a work item to run in a worker
+ * @param wq - pointer to the queue
+ * @param work - pointer to the work item
+ * @return 1 if queued; 0 if it was already pending; -1 on error
+ */
+int queue_work(workqueue_t *wq, work_t *work);
+
+/**
+ * Queues a work item on the system work queue
+ * @param work - pointer to the work item
+ * @return 1 if queued; 0 if it was already pending; -1 on error
+ */
+int schedule_work(work_t *work);
+
+/**
+ * Waits until every item queued before the call has run
+ *
+ * Must be called from a process other than the idle process or one of
+ * the queue's workers.
+ *
+ * @param wq - pointer to the queue
+ * @return -1 on error; 0 on success
+ */
+int flush_workqueue(workqueue_t *wq);
+
+/**
+ * Dumps the work queue statistics
+ */
+void workqueue_dump(void);
+
+#endif
@@ -0,0 +1,269 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * ACPI Table Implementation
+ */
+#include <spede/stdbool.h>
+#include <spede/string.h>
+
+#include "acpi.h"
+#include "kernel.h"
+#include "kstring.h"
+#include "paging.h"
+
+// Where the BIOS may place the RSDP: the first KB of the extended BIOS
+// data area (whose segment is stored at 0x40E) and the BIOS ROM
+#define ACPI_EBDA_PTR           0x40E
+#define ACPI_EBDA_SIZE          1024
+#define ACPI_BIOS_START         0xE0000
+#define ACPI_BIOS_END           0x100000
+
+// MADT entry types
+#define ACPI_MADT_LAPIC         0       // Processor local APIC
+#define ACPI_MADT_IOAPIC        1       // I/O APIC
+
+// Processor local APIC flags
+#define ACPI_LAPIC_ENABLED      0x1     // Processor is usable
+
+// Root system description pointer
+typedef struct acpi_rsdp_t {
+    char signature[8];              // "RSD PTR "
+    unsigned char checksum;         // First 20 bytes sum to zero
+    char oem_id[6];
+    unsigned char revision;
+    unsigned int rsdt;              // Physical address of the RSDT
+} __attribute__((packed)) acpi_rsdp_t;
+
+// Multiple APIC description table
+typedef struct acpi_madt_t {
+    acpi_header_t header;
+    unsigned int lapic_addr;        // Physical address of the local APICs
+    unsigned int flags;
+    unsigned char entries[];        // Variable length entries
+} __attribute__((packed)) acpi_madt_t;
+
+// Header of each MADT entry
+typedef struct acpi_madt_entry_t {
+    unsigned char type;
+    unsigned char length;
+} __attribute__((packed)) acpi_madt_entry_t;
+
+// MADT processor local APIC entry
+typedef struct acpi_madt_lapic_t {
+    acpi_madt_entry_t entry;
+    unsigned char acpi_id;
+    unsigned char apic_id;
+    unsigned int flags;
+} __attribute__((packed)) acpi_madt_lapic_t;
+
+// MADT I/O APIC entry
+typedef struct acpi_madt_ioapic_t {
+    acpi_madt_entry_t entry;
+    unsigned char id;
+    unsigned char reserved;
+    unsigned int addr;
+    unsigned int gsi_base;
+} __attribute__((packed)) acpi_madt_ioapic_t;
+
+// Root system description table (NULL if not found)
+acpi_header_t *acpi_rsdt = NULL;
+
+/**
+ * Checks that the bytes of a structure sum to zero
+ * @param data - pointer to the structure
+ * @param size - size in bytes
+ * @return true if the checksum is valid
+ */
+static bool acpi_checksum(void *data, unsigned int size) {
+    unsigned char *bytes = data;
+    unsigned char sum = 0;
+
+    for (unsigned int i = 0; i < size; i++) {
+        sum += bytes[i];
+    }
+
+    return sum == 0;
+}
+
+/**
+ * Checks that a table lies in identity mapped memory and is valid
+ * @param table - physical address of the table
+ * @return true if the table can be used
+ */
+static bool acpi_table_valid(acpi_header_t *table) {
+    unsigned int addr = (unsigned int)table;
+
+    if (addr == 0 || addr >= KERNEL_SPACE_END - sizeof(acpi_header_t)) {
+        return false;
+    }
+
+    if (table->length < sizeof(acpi_header_t) || table->length > KERNEL_SPACE_END - addr) {
+        return false;
+    }
+
+    return acpi_checksum(table, table->length);
+}
+
+/**
+ * Searches a memory range for the RSDP (which is 16-byte aligned)
+ * @param start - start of the range
+ * @param end - end of the range
+ * @return pointer to the RSDP or NULL if not found
+ */
+static acpi_rsdp_t *acpi_rsdp_search(unsigned int start, unsigned int end) {
+    for (unsigned int addr = start; addr + sizeof(acpi_rsdp_t) <= end; addr += 16) {
+        acpi_rsdp_t *rsdp = (acpi_rsdp_t *)addr;
+
+        if (strncmp(rsdp->signature, "RSD PTR ", 8) == 0
+            && acpi_checksum(rsdp, sizeof(acpi_rsdp_t))) {
+            return rsdp;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Reads the address of the extended BIOS data area from the BIOS data
+ * area, which is in the first page (left unmapped to catch NULL pointer
+ * dereferences, so it is mapped just for the read)
+ * @return physical address of the EBDA or 0 if there is none
+ */
+static unsigned int acpi_ebda(void) {
+    unsigned int ebda;
+
+    if (paging_map(kernel_pd, 0, 0, PTE_PRESENT) != 0) {
+        return 0;
+    }
+
+    ebda = *(volatile unsigned short *)ACPI_EBDA_PTR << 4;
+
+    // Another page directory may be current, so always flush
+    paging_unmap(kernel_pd, 0);
+    paging_flush(0);
+
+    return ebda;
+}
+
+/**
+ * Locates the ACPI tables
+ * @return -1 if no valid tables are found; 0 on success
+ */
+int acpi_init(void) {
+    unsigned int ebda = acpi_ebda();
+    acpi_rsdp_t *rsdp = NULL;
+
+    kernel_log_info("Initializing ACPI");
+
+    acpi_rsdt = NULL;
+
+    if (ebda) {
+        rsdp = acpi_rsdp_search(ebda, ebda + ACPI_EBDA_SIZE);
+    }
+
+    if (!rsdp) {
+        rsdp = acpi_rsdp_search(ACPI_BIOS_START, ACPI_BIOS_END);
+    }
+
+    if (!rsdp) {
+        kernel_log_warn("acpi: no RSDP found");
+        return -1;
+    }
+
+    // The tables are read in place, so they must be identity mapped
+    if (!acpi_table_valid((acpi_header_t *)rsdp->rsdt)) {
+        kernel_log_warn("acpi: RSDT at 0x%08x is not usable", rsdp->rsdt);
+        return -1;
+    }
+
+    acpi_rsdt = (acpi_header_t *)rsdp->rsdt;
+
+    kernel_log_info("acpi: RSDT at 0x%08x", rsdp->rsdt);
+
+    return 0;
+}
+
+/**
+ * Finds a description table by its signature
+ * @param signature - four character table signature
+ * @return pointer to the table or NULL if it is not present
+ */
+acpi_header_t *acpi_find_table(char *signature) {
+    unsigned int *entries;
+    int count;
+
+    if (!acpi_rsdt) {
+        return NULL;
+    }
+
+    entries = (unsigned int *)(acpi_rsdt + 1);
+    count = (acpi_rsdt->length - sizeof(acpi_header_t)) / sizeof(unsigned int);
+
+    for (int i = 0; i < count; i++) {
+        acpi_header_t *table = (acpi_header_t *)entries[i];
+
+        if (acpi_table_valid(table) && strncmp(table->signature, signature, 4) == 0) {
+            return table;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Obtains the processors and interrupt controllers from the MADT
+ * @param info - receives the description
+ * @return -1 if there is no usable MADT; 0 on success
+ */
+int acpi_madt_parse(acpi_madt_info_t *info) {
+    acpi_madt_t *madt = (acpi_madt_t *)acpi_find_table("APIC");
+    unsigned char *ptr;
+    unsigned char *end;
+
+    if (!info) {
+        return -1;
+    }
+
+    kmemset(info, 0, sizeof(acpi_madt_info_t));
+
+    if (!madt) {
+        kernel_log_warn("acpi: no MADT found");
+        return -1;
+    }
+
+    info->lapic_addr = madt->lapic_addr;
+
+    ptr = madt->entries;
+    end = (unsigned char *)madt + madt->header.length;
+
+    while (ptr + sizeof(acpi_madt_entry_t) <= end) {
+        acpi_madt_entry_t *entry = (acpi_madt_entry_t *)ptr;
+
+        if (entry->length < sizeof(acpi_madt_entry_t) || ptr + entry->length > end) {
+            kernel_log_warn("acpi: malformed MADT entry");
+            break;
+        }
+
+        if (entry->type == ACPI_MADT_LAPIC) {
+            acpi_madt_lapic_t *lapic = (acpi_madt_lapic_t *)entry;
+
+            // Disabled processors cannot be started
+            if (!(lapic->flags & ACPI_LAPIC_ENABLED)) {
+                kernel_log_debug("acpi: processor with APIC id %d is disabled", lapic->apic_id);
+            } else if (info->nr_cpus >= ACPI_CPUS_MAX) {
+                kernel_log_warn("acpi: ignoring processor with APIC id %d", lapic->apic_id);
+            } else {
+                info->apic_ids[info->nr_cpus++] = lapic->apic_id;
+            }
+        } else if (entry->type == ACPI_MADT_IOAPIC && !info->ioapic_addr) {
+            info->ioapic_addr = ((acpi_madt_ioapic_t *)entry)->addr;
+        }
+
+        ptr += entry->length;
+    }
+
+    kernel_log_info("acpi: %d processors, local APIC at 0x%08x", info->nr_cpus, info->lapic_addr);
+
+    return info->nr_cpus > 0 ? 0 : -1;
+}
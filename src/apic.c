@@ -0,0 +1,189 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Local APIC Implementation
+ */
+#include <spede/stddef.h>
+
+#include "apic.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "paging.h"
+
+// Register offsets
+#define APIC_REG_ID         0x020   // Local APIC id (bits 24-31)
+#define APIC_REG_TPR        0x080   // Task priority
+#define APIC_REG_EOI        0x0B0   // End of interrupt
+#define APIC_REG_SVR        0x0F0   // Spurious interrupt vector
+#define APIC_REG_ESR        0x280   // Error status
+#define APIC_REG_ICR_LOW    0x300   // Interrupt command (low word; writing sends)
+#define APIC_REG_ICR_HIGH   0x310   // Interrupt command (destination)
+#define APIC_REG_LVT_TIMER  0x320   // Local vector table: timer
+#define APIC_REG_LVT_LINT0  0x350   // Local vector table: LINT0 (PIC output)
+#define APIC_REG_LVT_LINT1  0x360   // Local vector table: LINT1 (NMI)
+#define APIC_REG_LVT_ERROR  0x370   // Local vector table: errors
+
+// Spurious interrupt vector register bits
+#define APIC_SVR_ENABLE     0x100   // Software enable
+
+// Local vector table bits
+#define APIC_LVT_MASKED     0x10000 // Interrupt is masked
+#define APIC_LVT_NMI        0x400   // Deliver as NMI
+#define APIC_LVT_EXTINT     0x700   // Deliver the PIC's interrupt as-is
+
+// Interrupt command register bits
+#define APIC_ICR_INIT       0x500   // INIT delivery mode
+#define APIC_ICR_STARTUP    0x600   // Startup delivery mode
+#define APIC_ICR_PENDING    0x1000  // Delivery status: still being sent
+#define APIC_ICR_ASSERT     0x4000  // Level assert
+#define APIC_ICR_LEVEL      0x8000  // Level triggered
+#define APIC_ICR_OTHERS     0xC0000 // Destination shorthand: all excluding self
+
+// Base address register bits (MSR_APIC_BASE)
+#define APIC_BASE_ENABLE    0x800   // Global enable
+
+// Mapped local APIC registers (every CPU sees its own at the same address)
+volatile unsigned int *apic_regs = NULL;
+
+/**
+ * Reads a local APIC register
+ * @param reg - register offset
+ * @return register value
+ */
+static inline unsigned int apic_read(unsigned int reg) {
+    return apic_regs[reg / 4];
+}
+
+/**
+ * Writes a local APIC register
+ * @param reg - register offset
+ * @param val - register value
+ */
+static inline void apic_write(unsigned int reg, unsigned int val) {
+    apic_regs[reg / 4] = val;
+}
+
+/**
+ * Sends an interrupt command and waits for it to be accepted
+ * @param apic_id - APIC id of the target CPU (ignored with a shorthand)
+ * @param cmd - low word of the interrupt command
+ */
+static void apic_send(int apic_id, unsigned int cmd) {
+    unsigned int flags = interrupts_save();
+
+    apic_write(APIC_REG_ICR_HIGH, (unsigned int)apic_id << 24);
+    apic_write(APIC_REG_ICR_LOW, cmd);
+
+    while (apic_read(APIC_REG_ICR_LOW) & APIC_ICR_PENDING) {
+        cpu_pause();
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Maps the local APICs and enables the boot CPU's
+ * @param addr - physical address of the local APICs
+ * @return -1 on error; 0 on success
+ */
+int apic_init(unsigned int addr) {
+    kernel_log_info("Initializing local APIC");
+
+    if (!cpu_has(CPU_FEATURE_APIC) || !cpu_has(CPU_FEATURE_MSR)) {
+        kernel_log_warn("apic: no local APIC");
+        return -1;
+    }
+
+    apic_regs = paging_map_mmio(addr, PAGE_SIZE, false);
+    if (!apic_regs) {
+        kernel_log_error("apic: unable to map the local APIC at 0x%08x", addr);
+        return -1;
+    }
+
+    apic_init_cpu(true);
+
+    kernel_log_info("apic: boot CPU has APIC id %d", apic_id());
+
+    return 0;
+}
+
+/**
+ * Enables the local APIC of the CPU that is running
+ * @param bsp - true on the boot CPU, which receives the PIC interrupts
+ */
+void apic_init_cpu(bool bsp) {
+    // Make sure the APIC has not been hardware disabled
+    cpu_wrmsr(MSR_APIC_BASE, cpu_rdmsr(MSR_APIC_BASE) | APIC_BASE_ENABLE);
+
+    // Only the boot CPU passes on PIC interrupts (virtual wire mode)
+    apic_write(APIC_REG_LVT_LINT0, bsp ? APIC_LVT_EXTINT : APIC_LVT_MASKED);
+    apic_write(APIC_REG_LVT_LINT1, bsp ? APIC_LVT_NMI : APIC_LVT_MASKED);
+    apic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED);
+    apic_write(APIC_REG_LVT_ERROR, APIC_LVT_MASKED);
+
+    // Clear any errors recorded before the APIC was enabled
+    apic_write(APIC_REG_ESR, 0);
+    apic_write(APIC_REG_ESR, 0);
+
+    // Accept every interrupt priority
+    apic_write(APIC_REG_TPR, 0);
+
+    apic_write(APIC_REG_SVR, APIC_SVR_ENABLE | IRQ_APIC_SPURIOUS);
+
+    // Acknowledge anything left pending
+    apic_eoi();
+}
+
+/**
+ * Returns the local APIC id of the CPU that is running
+ * @return APIC id
+ */
+int apic_id(void) {
+    return apic_read(APIC_REG_ID) >> 24;
+}
+
+/**
+ * Signals the end of an interrupt delivered by the local APIC
+ */
+void apic_eoi(void) {
+    apic_write(APIC_REG_EOI, 0);
+}
+
+/**
+ * Sends an interrupt to another CPU
+ * @param apic_id - APIC id of the target CPU
+ * @param vector - interrupt vector
+ */
+void apic_send_ipi(int apic_id, int vector) {
+    apic_send(apic_id, vector);
+}
+
+/**
+ * Sends an interrupt to every other CPU
+ * @param vector - interrupt vector
+ */
+void apic_broadcast_ipi(int vector) {
+    apic_send(0, APIC_ICR_OTHERS | vector);
+}
+
+/**
+ * Resets a CPU into its wait-for-startup state
+ * @param apic_id - APIC id of the target CPU
+ */
+void apic_send_init(int apic_id) {
+    apic_send(apic_id, APIC_ICR_INIT | APIC_ICR_ASSERT | APIC_ICR_LEVEL);
+
+    // Older APICs also need the level to be deasserted
+    apic_send(apic_id, APIC_ICR_INIT | APIC_ICR_LEVEL);
+}
+
+/**
+ * Starts a CPU that is waiting for startup in real mode
+ * @param apic_id - APIC id of the target CPU
+ * @param addr - physical address to start at (page aligned, below 1MB)
+ */
+void apic_send_startup(int apic_id, unsigned int addr) {
+    apic_send(apic_id, APIC_ICR_STARTUP | (addr >> 12));
+}
@@ -0,0 +1,123 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * CPU Feature Detection
+ */
+#include "cpu.h"
+#include "kernel.h"
+#include "kstring.h"
+
+// Extended CPUID leaves
+#define CPUID_EXT_BASE      0x80000000
+#define CPUID_EXT_FEATURES  0x80000001
+#define CPUID_EXT_POWER     0x80000007
+
+// Capabilities of the boot CPU
+cpu_info_t cpu_info;
+
+// Feature names (for diagnostics)
+static struct {
+    unsigned int feature;
+    char *name;
+} cpu_feature_names[] = {
+    { CPU_FEATURE_FPU,              "fpu" },
+    { CPU_FEATURE_PSE,              "pse" },
+    { CPU_FEATURE_TSC,              "tsc" },
+    { CPU_FEATURE_MSR,              "msr" },
+    { CPU_FEATURE_APIC,             "apic" },
+    { CPU_FEATURE_SYSENTER,         "sysenter" },
+    { CPU_FEATURE_PGE,              "pge" },
+    { CPU_FEATURE_PAT,              "pat" },
+    { CPU_FEATURE_FXSR,             "fxsr" },
+    { CPU_FEATURE_SSE,              "sse" },
+    { CPU_FEATURE_SSE2,             "sse2" },
+    { CPU_FEATURE_SSE3,             "sse3" },
+    { CPU_FEATURE_MWAIT,            "mwait" },
+    { CPU_FEATURE_X2APIC,           "x2apic" },
+    { CPU_FEATURE_POPCNT,           "popcnt" },
+    { CPU_FEATURE_ERMS,             "erms" },
+    { CPU_FEATURE_NX,               "nx" },
+    { CPU_FEATURE_RDTSCP,           "rdtscp" },
+    { CPU_FEATURE_INVARIANT_TSC,    "invariant_tsc" },
+    { CPU_FEATURE_HLT,              "hlt" },
+};
+
+/**
+ * Probes the CPU and records its identification and capabilities
+ */
+void cpu_init(void) {
+    unsigned int regs[4];
+
+    kernel_log_info("Initializing CPU features");
+
+    kmemset(&cpu_info, 0, sizeof(cpu_info));
+
+    // Vendor string is held in EBX, EDX, ECX (in that order)
+    cpu_cpuid(0, 0, regs);
+    cpu_info.max_leaf = regs[0];
+    kmemcpy(&cpu_info.vendor[0], &regs[1], 4);
+    kmemcpy(&cpu_info.vendor[4], &regs[3], 4);
+    kmemcpy(&cpu_info.vendor[8], &regs[2], 4);
+
+    if (cpu_info.max_leaf >= 1) {
+        cpu_cpuid(1, 0, regs);
+        cpu_info.family = (regs[0] >> 8) & 0xf;
+        cpu_info.model = (regs[0] >> 4) & 0xf;
+        cpu_info.stepping = regs[0] & 0xf;
+
+        // The extended family/model only apply to newer families
+        if (cpu_info.family == 0xf) {
+            cpu_info.family += (regs[0] >> 20) & 0xff;
+        }
+
+        if (cpu_info.family >= 0x6) {
+            cpu_info.model += ((regs[0] >> 16) & 0xf) << 4;
+        }
+
+        cpu_info.features[CPU_WORD_1_EDX] = regs[3];
+        cpu_info.features[CPU_WORD_1_ECX] = regs[2];
+    }
+
+    if (cpu_info.max_leaf >= 7) {
+        cpu_cpuid(7, 0, regs);
+        cpu_info.features[CPU_WORD_7_EBX] = regs[1];
+    }
+
+    cpu_cpuid(CPUID_EXT_BASE, 0, regs);
+    cpu_info.max_ext_leaf = (regs[0] > CPUID_EXT_BASE) ? regs[0] : 0;
+
+    if (cpu_info.max_ext_leaf >= CPUID_EXT_FEATURES) {
+        cpu_cpuid(CPUID_EXT_FEATURES, 0, regs);
+        cpu_info.features[CPU_WORD_EXT1_EDX] = regs[3];
+    }
+
+    if (cpu_info.max_ext_leaf >= CPUID_EXT_POWER) {
+        cpu_cpuid(CPUID_EXT_POWER, 0, regs);
+        cpu_info.features[CPU_WORD_EXT7_EDX] = regs[3];
+    }
+
+    // Early Pentium Pro processors report SYSENTER without supporting it
+    if (cpu_info.family == 6 && cpu_info.model < 3 && cpu_info.stepping < 3) {
+        cpu_info.features[CPU_WORD_1_EDX] &= ~(1U << (CPU_FEATURE_SYSENTER % 32));
+    }
+
+    // Every CPU the kernel runs on can halt until the next interrupt
+    cpu_info.features[CPU_WORD_KERNEL] |= 1U << (CPU_FEATURE_HLT % 32);
+
+    cpu_dump();
+}
+
+/**
+ * Logs the CPU identification and supported features
+ */
+void cpu_dump(void) {
+    kernel_log_info("cpu: %s family 0x%x model 0x%x stepping %d",
+                    cpu_info.vendor, cpu_info.family, cpu_info.model, cpu_info.stepping);
+
+    for (unsigned int i = 0; i < sizeof(cpu_feature_names) / sizeof(cpu_feature_names[0]); i++) {
+        if (cpu_has(cpu_feature_names[i].feature)) {
+            kernel_log_debug("cpu: supports %s", cpu_feature_names[i].name);
+        }
+    }
+}
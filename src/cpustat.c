@@ -0,0 +1,212 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * CPU Utilization Accounting Implementation
+ */
+#include <spede/stdbool.h>
+
+#include "cpu.h"
+#include "cpustat.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "timer.h"
+
+// Load average decay factors for a 5 second interval, in fixed-point:
+// 2^FSHIFT / e^(5s / 1min), 2^FSHIFT / e^(5s / 5min), 2^FSHIFT / e^(5s / 15min)
+static const unsigned int cpustat_load_exp[3] = { 1884, 2014, 2037 };
+
+// Statistics for each CPU
+cpustat_t cpustat[CPU_MAX];
+
+// 1, 5 and 15 minute load averages (fixed-point)
+unsigned int cpustat_loadavgs[3];
+
+// Set when time is measured with the time stamp counter
+bool cpustat_tsc = false;
+
+// Ticks since the last load average update
+int cpustat_load_ticks = 0;
+
+/**
+ * Computes a percentage without 64-bit division
+ * @param part - part of the whole
+ * @param whole - the whole
+ * @return percentage (0-100)
+ */
+static int cpustat_percent(unsigned long long part, unsigned long long whole) {
+    // Scale both down until the multiplication fits in 32 bits
+    while (whole > 0xFFFFFF) {
+        part >>= 1;
+        whole >>= 1;
+    }
+
+    if (whole == 0) {
+        return 0;
+    }
+
+    return (unsigned int)part * 100 / (unsigned int)whole;
+}
+
+/**
+ * Updates the load averages from the number of runnable processes
+ */
+static void cpustat_update_load(void) {
+    unsigned int active = scheduler_nr_running() * CPUSTAT_FIXED_1;
+
+    for (int i = 0; i < 3; i++) {
+        unsigned int exp = cpustat_load_exp[i];
+
+        cpustat_loadavgs[i] = (cpustat_loadavgs[i] * exp + active * (CPUSTAT_FIXED_1 - exp))
+                              >> CPUSTAT_FSHIFT;
+    }
+}
+
+/**
+ * Closes this CPU's utilization window when due (called on every tick)
+ */
+void cpustat_cpu_tick(void) {
+    cpustat_t *stat = &cpustat[this_cpu()->id];
+    unsigned long long sum = 0;
+
+    // Without a time stamp counter, charge the whole tick to whatever the
+    // timer interrupted (interrupts do not nest, so a task or idle)
+    if (!cpustat_tsc) {
+        stat->time[active_proc == idle_proc ? CPUSTAT_IDLE : CPUSTAT_TASK]++;
+    }
+
+    if (++stat->window_ticks >= CPUSTAT_WINDOW) {
+        for (int i = 0; i < CPUSTAT_STATES; i++) {
+            sum += stat->time[i];
+        }
+
+        for (int i = 0; i < CPUSTAT_STATES; i++) {
+            stat->percent[i] = cpustat_percent(stat->time[i], sum);
+            stat->total[i] += stat->time[i];
+            stat->time[i] = 0;
+        }
+
+        stat->window_ticks = 0;
+    }
+}
+
+/**
+ * Timer callback: closes the utilization window and updates the load
+ * averages when due
+ */
+static void cpustat_tick(void) {
+    cpustat_cpu_tick();
+
+    if (++cpustat_load_ticks >= CPUSTAT_LOAD_INTERVAL) {
+        cpustat_update_load();
+        cpustat_load_ticks = 0;
+    }
+}
+
+/**
+ * Initializes utilization accounting
+ */
+void cpustat_init(void) {
+    kernel_log_info("Initializing CPU utilization accounting");
+
+    kmemset(cpustat, 0, sizeof(cpustat));
+    kmemset(cpustat_loadavgs, 0, sizeof(cpustat_loadavgs));
+
+    cpustat_tsc = cpu_has(CPU_FEATURE_TSC);
+    cpustat_load_ticks = 0;
+
+    cpustat_init_cpu();
+
+    timer_callback_register(cpustat_tick, 1, -1);
+}
+
+/**
+ * Starts utilization accounting on an application processor
+ */
+void cpustat_init_cpu(void) {
+    cpustat_t *stat = &cpustat[this_cpu()->id];
+
+    stat->state = CPUSTAT_TASK;
+    if (cpustat_tsc) {
+        stat->last = cpu_rdtsc();
+    }
+}
+
+/**
+ * Switches the CPU to a new state, charging the elapsed time to the
+ * previous state
+ * @param state - new state
+ * @return previous state
+ */
+cpustat_state_t cpustat_switch(cpustat_state_t state) {
+    cpustat_t *stat = &cpustat[this_cpu()->id];
+    cpustat_state_t prev = stat->state;
+
+    if (cpustat_tsc) {
+        unsigned long long now = cpu_rdtsc();
+
+        stat->time[prev] += now - stat->last;
+        stat->last = now;
+    }
+
+    stat->state = state;
+
+    return prev;
+}
+
+/**
+ * Returns the share of the last window the CPUs were not idle (averaged
+ * over the CPUs)
+ * @return percentage (0-100)
+ */
+int cpustat_busy(void) {
+    int idle = 0;
+
+    for (int i = 0; i < smp_nr_cpus; i++) {
+        idle += cpustat[i].percent[CPUSTAT_IDLE];
+    }
+
+    return 100 - idle / smp_nr_cpus;
+}
+
+/**
+ * Returns a load average as a percentage of one runnable process
+ * @param index - 0, 1 or 2 for the 1, 5 or 15 minute average
+ * @return load average multiplied by 100
+ */
+int cpustat_loadavg(int index) {
+    if (index < 0 || index > 2) {
+        return -1;
+    }
+
+    return (cpustat_loadavgs[index] * 100 + CPUSTAT_FIXED_1 / 2) >> CPUSTAT_FSHIFT;
+}
+
+/**
+ * Dumps the utilization statistics
+ */
+void cpustat_dump(void) {
+    static char *names[CPUSTAT_STATES] = { "task", "irq", "softirq", "idle" };
+
+    for (int cpu = 0; cpu < smp_nr_cpus; cpu++) {
+        cpustat_t *stat = &cpustat[cpu];
+        unsigned long long sum = 0;
+
+        for (int i = 0; i < CPUSTAT_STATES; i++) {
+            sum += stat->total[i];
+        }
+
+        for (int i = 0; i < CPUSTAT_STATES; i++) {
+            kernel_log_info("cpustat: CPU %d %-8s %3d%% (%3d%% since boot)", cpu, names[i],
+                            stat->percent[i], cpustat_percent(stat->total[i], sum));
+        }
+    }
+
+    kernel_log_info("cpustat: load average %d.%02d %d.%02d %d.%02d",
+                    cpustat_loadavg(0) / 100, cpustat_loadavg(0) % 100,
+                    cpustat_loadavg(1) / 100, cpustat_loadavg(1) % 100,
+                    cpustat_loadavg(2) / 100, cpustat_loadavg(2) % 100);
+}
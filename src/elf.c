@@ -0,0 +1,119 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * ELF32 Loader
+ */
+#include "elf.h"
+#include "kernel.h"
+
+/**
+ * Validates the ELF header of an image
+ * @param hdr - pointer to the ELF header
+ * @param size - size of the image in bytes
+ * @return -1 on error; 0 on success
+ */
+static int elf_validate(elf_header_t *hdr, size_t size) {
+    if (size < sizeof(elf_header_t) || hdr->magic != ELF_MAGIC) {
+        kernel_log_error("elf: invalid image");
+        return -1;
+    }
+
+    if (hdr->class != ELF_CLASS_32 || hdr->data != ELF_DATA_LSB
+        || hdr->type != ELF_TYPE_EXEC || hdr->machine != ELF_MACHINE_386) {
+        kernel_log_error("elf: unsupported image (class=%d data=%d type=%d machine=%d)",
+                         hdr->class, hdr->data, hdr->type, hdr->machine);
+        return -1;
+    }
+
+    if (hdr->phentsize != sizeof(elf_phdr_t)
+        || hdr->phoff > size || hdr->phnum * sizeof(elf_phdr_t) > size - hdr->phoff) {
+        kernel_log_error("elf: invalid program header table");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Loads an ELF32 executable into an address space
+ *
+ * Segments must lie in user space, so programs are linked at
+ * USER_SPACE_BASE (0x40000000) or above rather than at 0x08048000.
+ *
+ * @param space - pointer to the address space
+ * @param image - pointer to the ELF image in memory
+ * @param size - size of the image in bytes
+ * @param entry - receives the program entry point
+ * @return -1 on error; 0 on success
+ */
+int elf_load(vm_space_t *space, char *image, size_t size, unsigned int *entry) {
+    elf_header_t *hdr = (elf_header_t *)image;
+    elf_phdr_t *phdr;
+
+    if (!space || !image || !entry) {
+        return -1;
+    }
+
+    if (elf_validate(hdr, size) != 0) {
+        return -1;
+    }
+
+    phdr = (elf_phdr_t *)(image + hdr->phoff);
+
+    for (int i = 0; i < hdr->phnum; i++, phdr++) {
+        unsigned int flags = VM_READ;
+
+        if (phdr->type != ELF_PT_LOAD || phdr->memsz == 0) {
+            continue;
+        }
+
+        if (phdr->filesz > phdr->memsz || phdr->offset > size
+            || phdr->filesz > size - phdr->offset
+            || phdr->vaddr + phdr->memsz < phdr->vaddr) {
+            kernel_log_error("elf: invalid segment %d", i);
+            return -1;
+        }
+
+        if (phdr->vaddr < USER_SPACE_BASE || phdr->vaddr + phdr->memsz > USER_SPACE_END) {
+            kernel_log_error("elf: segment %d at 0x%08x is outside user space (link at 0x%08x or above)",
+                             i, phdr->vaddr, USER_SPACE_BASE);
+            return -1;
+        }
+
+        if (phdr->flags & ELF_PF_W) {
+            flags |= VM_WRITE;
+        }
+
+        if (phdr->flags & ELF_PF_X) {
+            flags |= VM_EXEC;
+        }
+
+        // The segment is paged in from the image on demand; the tail past
+        // the file data (.bss) is zero-filled when first touched
+        if (vm_area_add(space, phdr->vaddr, phdr->vaddr + phdr->memsz, flags,
+                        image + phdr->offset, phdr->vaddr,
+                        phdr->vaddr + phdr->filesz) != 0) {
+            return -1;
+        }
+
+        kernel_log_debug("elf: segment 0x%08x-0x%08x (file %d bytes) flags=%c%c%c",
+                         phdr->vaddr, phdr->vaddr + phdr->memsz, phdr->filesz,
+                         (flags & VM_READ) ? 'r' : '-', (flags & VM_WRITE) ? 'w' : '-',
+                         (flags & VM_EXEC) ? 'x' : '-');
+    }
+
+    if (vm_area_add(space, VM_STACK_TOP - VM_STACK_SIZE, VM_STACK_TOP,
+                    VM_READ | VM_WRITE, NULL, 0, 0) != 0) {
+        return -1;
+    }
+
+    if (!vm_area_find(space, hdr->entry)) {
+        kernel_log_error("elf: entry point 0x%08x is not in a loadable segment", hdr->entry);
+        return -1;
+    }
+
+    *entry = hdr->entry;
+
+    return 0;
+}
@@ -0,0 +1,246 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Fiber Implementation
+ */
+#include <spede/string.h>
+
+#include "cpu.h"
+#include "fiber.h"
+#include "kernel.h"
+#include "kmalloc.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "stack.h"
+
+// Number of round trips measured by fiber_benchmark
+#define FIBER_BENCHMARK_REPS 10000
+
+// Fiber control blocks
+kmem_cache_t *fiber_cache = NULL;
+
+// Fiber running before process management is initialized
+fiber_t *fiber_early = NULL;
+
+/**
+ * Returns where the running fiber is recorded for the current context
+ * @return pointer to the running fiber slot
+ */
+static fiber_t **fiber_slot(void) {
+    return active_proc ? &active_proc->fiber : &fiber_early;
+}
+
+/**
+ * Switches from the running fiber back to the context that resumed it
+ * @param fiber - pointer to the running fiber
+ */
+static void fiber_leave(fiber_t *fiber) {
+    *fiber_slot() = fiber->parent;
+    fiber_switch(&fiber->sp, fiber->resume_sp);
+}
+
+/**
+ * First code run by every fiber (reached through fiber_switch's return):
+ * runs the entry function and leaves the fiber for good when it returns
+ */
+static void fiber_start(void) {
+    fiber_t *fiber = fiber_current();
+
+    fiber->entry(fiber->arg);
+
+    fiber->state = FIBER_DONE;
+    fiber_leave(fiber);
+
+    kernel_panic("fiber: finished fiber %s resumed", fiber->name);
+}
+
+/**
+ * Initializes fiber support
+ */
+void fiber_init(void) {
+    kernel_log_info("Initializing fibers");
+
+    fiber_early = NULL;
+
+    fiber_cache = kmem_cache_create("fiber", sizeof(fiber_t));
+    if (!fiber_cache) {
+        kernel_panic("fiber: unable to create the fiber cache");
+    }
+}
+
+/**
+ * Creates a suspended fiber
+ * @param entry - function the fiber runs
+ * @param arg - argument for the entry function
+ * @param name - name of the fiber
+ * @param stack_size - size of the fiber's stack (0 for the default)
+ * @return pointer to the fiber or NULL on error
+ */
+fiber_t *fiber_create(void (*entry)(void *arg), void *arg, char *name, size_t stack_size) {
+    stack_info_t *stack;
+    unsigned int *sp;
+    fiber_t *fiber;
+
+    if (!entry || !name) {
+        return NULL;
+    }
+
+    if (stack_size == 0) {
+        stack_size = FIBER_STACK_SIZE;
+    }
+
+    if (stack_size < FIBER_STACK_MIN) {
+        kernel_log_error("fiber: stack for %s is too small (%d bytes)", name, stack_size);
+        return NULL;
+    }
+
+    fiber = kmem_cache_alloc(fiber_cache);
+    if (!fiber) {
+        kernel_log_error("fiber: unable to allocate fiber %s", name);
+        return NULL;
+    }
+
+    kmemset(fiber, 0, sizeof(fiber_t));
+    strncpy(fiber->name, name, FIBER_NAME_LEN - 1);
+    fiber->entry = entry;
+    fiber->arg = arg;
+    fiber->state = FIBER_SUSPENDED;
+
+    // Stacks come from kmalloc, so sizes below a page use the small
+    // size classes instead of whole pages
+    fiber->stack_id = stack_alloc(fiber->name, stack_size);
+    if (fiber->stack_id < 0) {
+        kmem_cache_free(fiber_cache, fiber);
+        return NULL;
+    }
+
+    // Lay out the stack as if fiber_switch had been called from the start
+    // of fiber_start: zeroed registers below its return address, and a
+    // dummy return address for fiber_start itself
+    stack = stack_get(fiber->stack_id);
+    sp = (unsigned int *)((unsigned int)(stack->base + stack->size) & ~15U);
+
+    *--sp = 0;                              // fiber_start's return address
+    *--sp = (unsigned int)fiber_start;      // fiber_switch's return address
+    *--sp = 0;                              // ebp
+    *--sp = 0;                              // ebx
+    *--sp = 0;                              // esi
+    *--sp = 0;                              // edi
+
+    fiber->sp = sp;
+
+    return fiber;
+}
+
+/**
+ * Destroys a fiber that is not running
+ * @param fiber - pointer to the fiber
+ * @return -1 on error; 0 on success
+ */
+int fiber_destroy(fiber_t *fiber) {
+    if (!fiber) {
+        return -1;
+    }
+
+    if (fiber->state == FIBER_RUNNING) {
+        kernel_log_error("fiber: cannot destroy running fiber %s", fiber->name);
+        return -1;
+    }
+
+    stack_free(fiber->stack_id);
+    kmem_cache_free(fiber_cache, fiber);
+
+    return 0;
+}
+
+/**
+ * Runs a fiber until it yields or returns
+ * @param fiber - pointer to the fiber
+ * @return 1 if the fiber yielded; 0 if it has finished; -1 on error
+ */
+int fiber_resume(fiber_t *fiber) {
+    fiber_t **slot = fiber_slot();
+
+    if (!fiber || fiber->state != FIBER_SUSPENDED) {
+        return -1;
+    }
+
+    fiber->parent = *slot;
+    fiber->state = FIBER_RUNNING;
+    fiber->switches++;
+    *slot = fiber;
+
+    fiber_switch(&fiber->resume_sp, fiber->sp);
+
+    // Back here once the fiber yields or returns
+    if (fiber->state == FIBER_DONE) {
+        return 0;
+    }
+
+    fiber->state = FIBER_SUSPENDED;
+
+    return 1;
+}
+
+/**
+ * Suspends the running fiber, returning to the context that resumed it
+ */
+void fiber_yield(void) {
+    fiber_t *fiber = fiber_current();
+
+    if (!fiber) {
+        return;
+    }
+
+    fiber_leave(fiber);
+}
+
+/**
+ * Returns the running fiber
+ * @return pointer to the fiber or NULL if not running in a fiber
+ */
+fiber_t *fiber_current(void) {
+    return *fiber_slot();
+}
+
+/**
+ * Benchmark fiber: yields forever
+ * @param arg - unused
+ */
+static void fiber_benchmark_loop(void *arg) {
+    (void)arg;
+
+    while (1) {
+        fiber_yield();
+    }
+}
+
+/**
+ * Measures the cost of a fiber switch and logs it
+ */
+void fiber_benchmark(void) {
+    fiber_t *fiber = fiber_create(fiber_benchmark_loop, NULL, "benchmark", FIBER_STACK_MIN);
+    unsigned long long cycles;
+    unsigned int switches;
+
+    if (!fiber) {
+        kernel_log_error("fiber: unable to create the benchmark fiber");
+        return;
+    }
+
+    // Warm up, then time resume/yield round trips (two switches each)
+    fiber_resume(fiber);
+
+    cycles = cpu_rdtsc();
+    for (int i = 0; i < FIBER_BENCHMARK_REPS; i++) {
+        fiber_resume(fiber);
+    }
+    cycles = cpu_rdtsc() - cycles;
+
+    switches = 2 * FIBER_BENCHMARK_REPS;
+    kernel_log_info("fiber: %u switches, %u cycles per switch (including resume/yield)", switches,
+                    cycles > 0xFFFFFFFFULL ? 0xFFFFFFFF / switches : (unsigned int)cycles / switches);
+
+    fiber_destroy(fiber);
+}
@@ -0,0 +1,288 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * FPU/SSE State Management Implementation
+ */
+#include <spede/stdbool.h>
+
+#include "cpu.h"
+#include "fpu.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "pool.h"
+#include "smp.h"
+
+// Save areas, allocated the first time a process uses the FPU
+POOL_DEFINE(fpu_pool, fpu_state_t, PROC_MAX);
+
+// Process whose state is loaded in each CPU's FPU registers (NULL if none)
+proc_t *fpu_owner[CPU_MAX];
+
+// State loaded for a process's first FPU instruction
+fpu_state_t fpu_initial;
+
+// Set when the CPU has an FPU
+bool fpu_present = false;
+
+// Set when state is saved with FXSAVE (including SSE) instead of FNSAVE
+bool fpu_fxsr = false;
+
+// Statistics
+unsigned int fpu_traps = 0;         // Device-not-available faults taken
+unsigned int fpu_saves = 0;         // States saved
+unsigned int fpu_restores = 0;      // States restored
+unsigned int fpu_kernel_uses = 0;   // Kernel uses of the registers
+
+/**
+ * Clears CR0.TS so that FPU/SSE instructions execute
+ */
+static inline void fpu_clts(void) {
+    asm volatile("clts" : : : "memory");
+}
+
+/**
+ * Sets CR0.TS so that the next FPU/SSE instruction faults
+ */
+static inline void fpu_stts(void) {
+    cpu_set_cr0(cpu_get_cr0() | CR0_TS);
+}
+
+/**
+ * Saves the FPU registers
+ * @param state - save area
+ */
+static void fpu_save(fpu_state_t *state) {
+    if (fpu_fxsr) {
+        asm volatile("fxsave %0" : "=m"(*state));
+    } else {
+        // FNSAVE also reinitializes the FPU
+        asm volatile("fnsave %0; fwait" : "=m"(*state));
+    }
+
+    fpu_saves++;
+}
+
+/**
+ * Loads the FPU registers
+ * @param state - save area
+ */
+static void fpu_restore(fpu_state_t *state) {
+    if (fpu_fxsr) {
+        asm volatile("fxrstor %0" : : "m"(*state));
+    } else {
+        asm volatile("frstor %0" : : "m"(*state));
+    }
+
+    fpu_restores++;
+}
+
+/**
+ * Device-not-available (#NM) handler: hands the FPU to the running
+ * process
+ */
+static void fpu_device_na_handler(void) {
+    proc_t **owner = &fpu_owner[this_cpu()->id];
+    proc_t *proc = active_proc;
+
+    fpu_traps++;
+    fpu_clts();
+
+    if (!proc || proc == *owner) {
+        return;
+    }
+
+    if (*owner) {
+        fpu_save((*owner)->fpu);
+    }
+
+    if (!proc->fpu) {
+        proc->fpu = pool_alloc(&fpu_pool);
+        if (!proc->fpu) {
+            kernel_panic("fpu: unable to allocate state for process %d", proc->pid);
+            return;
+        }
+
+        kmemcpy(proc->fpu, &fpu_initial, sizeof(fpu_state_t));
+    }
+
+    fpu_restore(proc->fpu);
+    *owner = proc;
+}
+
+/**
+ * Initializes FPU state management
+ */
+void fpu_init(void) {
+    kernel_log_info("Initializing FPU state management");
+
+    pool_init(&fpu_pool);
+    kmemset(fpu_owner, 0, sizeof(fpu_owner));
+
+    fpu_present = cpu_has(CPU_FEATURE_FPU);
+    if (!fpu_present) {
+        kernel_log_warn("fpu: no FPU present");
+        return;
+    }
+
+    fpu_fxsr = cpu_has(CPU_FEATURE_FXSR);
+    if (fpu_fxsr) {
+        cpu_set_cr4(cpu_get_cr4() | CR4_OSFXSR);
+    }
+
+    // Report FPU errors as exceptions and have WAIT honor CR0.TS
+    cpu_set_cr0((cpu_get_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+
+    // Capture a clean state to give each process on its first use
+    asm volatile("fninit");
+    fpu_save(&fpu_initial);
+    fpu_saves = 0;
+
+    interrupts_irq_register(IRQ_DEVICE_NA, isr_entry_device_na, fpu_device_na_handler);
+
+    // No process owns the registers yet
+    fpu_stts();
+
+    kernel_log_info("fpu: lazy switching using %s", fpu_fxsr ? "FXSAVE" : "FNSAVE");
+}
+
+/**
+ * Prepares the FPU for the process being switched to: the registers are
+ * only made available if they already hold its state
+ * @param proc - pointer to the process
+ */
+void fpu_switch(proc_t *proc) {
+    if (!fpu_present) {
+        return;
+    }
+
+    if (proc == fpu_owner[this_cpu()->id]) {
+        fpu_clts();
+    } else {
+        fpu_stts();
+    }
+}
+
+/**
+ * Releases the FPU state of a process that is being destroyed
+ * @param proc - pointer to the process
+ */
+void fpu_release(proc_t *proc) {
+    unsigned int flags = interrupts_save();
+
+    // The state may still be loaded on any CPU the process ran on
+    for (int i = 0; i < CPU_MAX; i++) {
+        if (fpu_owner[i] == proc) {
+            fpu_owner[i] = NULL;
+        }
+    }
+
+    if (proc->fpu) {
+        pool_free(&fpu_pool, proc->fpu);
+        proc->fpu = NULL;
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Gives a forked process a copy of its parent's FPU state
+ * @param parent - pointer to the parent process
+ * @param child - pointer to the new process
+ * @return -1 on error; 0 on success
+ */
+int fpu_fork(proc_t *parent, proc_t *child) {
+    unsigned int flags;
+
+    // A process that never used the FPU has no state to copy
+    if (!parent->fpu) {
+        return 0;
+    }
+
+    child->fpu = pool_alloc(&fpu_pool);
+    if (!child->fpu) {
+        return -1;
+    }
+
+    flags = interrupts_save();
+
+    // The parent's latest state may only be in the registers; saving it
+    // gives up ownership (FNSAVE reinitializes the FPU)
+    if (fpu_owner[this_cpu()->id] == parent) {
+        fpu_clts();
+        fpu_save(parent->fpu);
+        fpu_owner[this_cpu()->id] = NULL;
+        fpu_stts();
+    }
+
+    kmemcpy(child->fpu, parent->fpu, sizeof(fpu_state_t));
+
+    interrupts_restore(flags);
+
+    return 0;
+}
+
+/**
+ * Makes the FPU/SSE registers available to kernel code, saving the state
+ * of the process that owns them
+ * @return interrupt state to pass to fpu_kernel_end
+ */
+unsigned int fpu_kernel_begin(void) {
+    unsigned int flags = interrupts_save();
+    proc_t **owner = &fpu_owner[this_cpu()->id];
+
+    fpu_kernel_uses++;
+    fpu_clts();
+
+    // The owner's state is still in the registers even if CR0.TS is set
+    if (*owner) {
+        fpu_save((*owner)->fpu);
+        *owner = NULL;
+    }
+
+    return flags;
+}
+
+/**
+ * Ends kernel use of the FPU/SSE registers
+ * @param flags - value returned by fpu_kernel_begin
+ */
+void fpu_kernel_end(unsigned int flags) {
+    // The registers now hold nobody's state; the next process to use them
+    // faults and restores its own
+    if (fpu_present) {
+        fpu_stts();
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Checks whether a process's latest FPU state is only in the registers
+ * of a CPU (so it cannot run on another one until the state is saved)
+ * @param proc - pointer to the process
+ * @return true if a CPU holds the process's state
+ */
+bool fpu_live(proc_t *proc) {
+    for (int i = 0; i < smp_nr_cpus; i++) {
+        if (fpu_owner[i] == proc) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Dumps the FPU switching statistics
+ */
+void fpu_dump(void) {
+    kernel_log_info("fpu: %u traps, %u saves, %u restores, %u kernel uses",
+                    fpu_traps, fpu_saves, fpu_restores, fpu_kernel_uses);
+
+    for (int i = 0; i < smp_nr_cpus; i++) {
+        kernel_log_info("fpu: CPU %d owner %d", i, fpu_owner[i] ? fpu_owner[i]->pid : -1);
+    }
+}
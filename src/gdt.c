@@ -0,0 +1,189 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Segmentation Implementation
+ */
+#include "gdt.h"
+#include "kernel.h"
+#include "kstring.h"
+#include "smp.h"
+
+// Descriptor access bytes
+#define GDT_ACCESS_KERNEL_CODE  0x9A    // Present, ring 0, code, readable
+#define GDT_ACCESS_KERNEL_DATA  0x92    // Present, ring 0, data, writable
+#define GDT_ACCESS_USER_CODE    0xFA    // Present, ring 3, code, readable
+#define GDT_ACCESS_USER_DATA    0xF2    // Present, ring 3, data, writable
+#define GDT_ACCESS_TSS          0x89    // Present, ring 0, available 32-bit TSS
+
+// Descriptor flags
+#define GDT_FLAGS_FLAT          0xC     // 4KB granularity, 32-bit
+
+// Segment descriptor
+typedef struct gdt_entry_t {
+    unsigned short limit_low;       // Limit bits 0-15
+    unsigned short base_low;        // Base bits 0-15
+    unsigned char base_mid;         // Base bits 16-23
+    unsigned char access;           // Access byte
+    unsigned char limit_flags;      // Limit bits 16-19 and flags
+    unsigned char base_high;        // Base bits 24-31
+} __attribute__((packed)) gdt_entry_t;
+
+// Operand of LGDT/SGDT
+typedef struct gdt_ptr_t {
+    unsigned short limit;           // Size of the table minus one
+    unsigned int base;              // Address of the table
+} __attribute__((packed)) gdt_ptr_t;
+
+// Task state segment (only the ring 0 stack and I/O map base are used)
+typedef struct tss_t {
+    unsigned int prev;
+    unsigned int esp0;              // Stack pointer loaded on a trap from user mode
+    unsigned int ss0;               // Stack segment loaded on a trap from user mode
+    unsigned int unused[22];
+    unsigned short trap;
+    unsigned short iomap;           // Offset of the I/O permission map
+} __attribute__((packed)) tss_t;
+
+// Global descriptor table of each CPU
+gdt_entry_t gdt[CPU_MAX][GDT_ENTRIES] __attribute__((aligned(8)));
+
+// Task state segment of a CPU and the stack below it. SYSENTER enters
+// with the stack pointer at the TSS; a debug trap taken there (see
+// isr_entry_debug in context.S) pushes its frame onto this stack
+typedef struct tss_area_t {
+    unsigned int trap_stack[8];     // Room for a debug trap frame
+    tss_t tss;                      // Task state segment
+} __attribute__((packed)) tss_area_t;
+
+// Task state segment of each CPU
+tss_area_t tss_area[CPU_MAX] __attribute__((aligned(16)));
+
+/**
+ * Fills a descriptor
+ * @param table - descriptor table
+ * @param selector - segment selector
+ * @param base - base address
+ * @param limit - limit (in units given by the flags)
+ * @param access - access byte
+ * @param flags - granularity/size flags
+ */
+static void gdt_set(gdt_entry_t *table, unsigned int selector, unsigned int base,
+                    unsigned int limit, unsigned char access, unsigned char flags) {
+    gdt_entry_t *entry = &table[selector >> 3];
+
+    entry->limit_low = limit & 0xFFFF;
+    entry->base_low = base & 0xFFFF;
+    entry->base_mid = (base >> 16) & 0xFF;
+    entry->access = access;
+    entry->limit_flags = ((limit >> 16) & 0xF) | (flags << 4);
+    entry->base_high = (base >> 24) & 0xFF;
+}
+
+/**
+ * Fills in a CPU's TSS and per-CPU descriptors
+ * @param cpu - CPU index
+ */
+static void gdt_prepare(int cpu) {
+    // Traps from user mode switch to the stack in the TSS; there is no
+    // I/O permission map, so user mode cannot access ports
+    kmemset(&tss_area[cpu], 0, sizeof(tss_area_t));
+    tss_area[cpu].tss.ss0 = GDT_KERNEL_DS;
+    tss_area[cpu].tss.esp0 = (unsigned int)cpu_table[cpu].irq_stack_top;
+    tss_area[cpu].tss.iomap = sizeof(tss_t);
+
+    gdt_set(gdt[cpu], GDT_TSS, (unsigned int)&tss_area[cpu].tss, sizeof(tss_t) - 1, GDT_ACCESS_TSS, 0);
+    gdt_set(gdt[cpu], GDT_PERCPU, (unsigned int)&cpu_table[cpu], sizeof(cpu_t) - 1,
+            GDT_ACCESS_KERNEL_DATA, 0);
+}
+
+/**
+ * Loads a CPU's descriptor table and task state segment and reloads the
+ * segment registers (run on that CPU)
+ * @param cpu - CPU index
+ */
+void gdt_load_cpu(int cpu) {
+    gdt_ptr_t ptr;
+
+    ptr.limit = sizeof(gdt[cpu]) - 1;
+    ptr.base = (unsigned int)gdt[cpu];
+
+    asm volatile("lgdt %0\n\t"
+                 "ljmp %1, $1f\n"
+                 "1:\n\t"
+                 "mov %2, %%ax\n\t"
+                 "mov %%ax, %%ds\n\t"
+                 "mov %%ax, %%es\n\t"
+                 "mov %%ax, %%gs\n\t"
+                 "mov %%ax, %%ss\n\t"
+                 "mov %3, %%ax\n\t"
+                 "mov %%ax, %%fs"
+                 :
+                 : "m"(ptr), "i"(GDT_KERNEL_CS), "i"(GDT_KERNEL_DS), "i"(GDT_PERCPU)
+                 : "eax", "memory");
+
+    asm volatile("ltr %w0" : : "r"(GDT_TSS));
+}
+
+/**
+ * Installs the kernel's descriptor table and task state segment and
+ * reloads the segment registers
+ */
+void gdt_init(void) {
+    gdt_ptr_t ptr;
+    unsigned int count;
+
+    kernel_log_info("Initializing segmentation");
+
+    kmemset(gdt, 0, sizeof(gdt));
+
+    // Keep the boot loader's descriptors so that selectors already in use
+    // (e.g. in existing IDT gates) stay valid
+    asm volatile("sgdt %0" : "=m"(ptr));
+
+    count = (ptr.limit + 1) / sizeof(gdt_entry_t);
+    if (count > GDT_BOOT_ENTRIES) {
+        kernel_log_warn("gdt: only %d of %d boot descriptors preserved", GDT_BOOT_ENTRIES, count);
+        count = GDT_BOOT_ENTRIES;
+    }
+
+    kmemcpy(gdt[0], (void *)ptr.base, count * sizeof(gdt_entry_t));
+
+    gdt_set(gdt[0], GDT_KERNEL_CS, 0, 0xFFFFF, GDT_ACCESS_KERNEL_CODE, GDT_FLAGS_FLAT);
+    gdt_set(gdt[0], GDT_KERNEL_DS, 0, 0xFFFFF, GDT_ACCESS_KERNEL_DATA, GDT_FLAGS_FLAT);
+    gdt_set(gdt[0], GDT_USER_CS, 0, 0xFFFFF, GDT_ACCESS_USER_CODE, GDT_FLAGS_FLAT);
+    gdt_set(gdt[0], GDT_USER_DS, 0, 0xFFFFF, GDT_ACCESS_USER_DATA, GDT_FLAGS_FLAT);
+
+    gdt_prepare(0);
+    gdt_load_cpu(0);
+}
+
+/**
+ * Builds the descriptor table (a copy of the boot CPU's) and task state
+ * segment of an application processor, before it is started
+ *
+ * This runs on the boot CPU since the memory routines need the per-CPU
+ * data, which the application processor cannot reach until its table is
+ * loaded.
+ * @param cpu - CPU index
+ */
+void gdt_init_cpu(int cpu) {
+    kmemcpy(gdt[cpu], gdt[0], sizeof(gdt[cpu]));
+    gdt_prepare(cpu);
+}
+
+/**
+ * Sets the stack this CPU switches to on a trap from user mode
+ * @param top - initial stack pointer (highest address of the stack)
+ */
+void gdt_set_kernel_stack(char *top) {
+    tss_area[this_cpu()->id].tss.esp0 = (unsigned int)top;
+}
+
+/**
+ * Returns this CPU's task state segment
+ * @return pointer to the TSS
+ */
+void *gdt_tss(void) {
+    return &tss_area[this_cpu()->id].tss;
+}
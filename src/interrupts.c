@@ -7,10 +7,16 @@
 #include <spede/machine/io.h>
 #include <spede/machine/proc_reg.h>
 #include <spede/machine/seg.h>
-#include <spede/string.h>
 
+#include "apic.h"
+#include "bit.h"
+#include "cpustat.h"
 #include "kernel.h"
 #include "interrupts.h"
+#include "kstring.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "spinlock.h"
 
 // Maximum number of ISR handlers
 #define IRQ_MAX      0xf0
@@ -25,6 +31,9 @@
 
 #define PIC_EOI     0x20            // PIC End-of-Interrupt command
 
+#define PIC_IRQ_BASE    0x20        // First interrupt vector used by the PIC
+#define PIC_IRQ_CASCADE 2           // PIC1 IRQ that the PIC2 is chained to
+
 // Interrupt descriptor table
 struct i386_gate *idt = NULL;
 
@@ -33,6 +42,9 @@ struct i386_gate *idt = NULL;
 // the various interrupts to be handled
 void (*irq_handlers[IRQ_MAX])();
 
+// Protects irq_handlers and the IDT; every interrupt reads them
+rwlock_t irq_handlers_lock;
+
 /**
  * Enable interrupts with the CPU
  */
@@ -51,25 +63,69 @@ void interrupts_disable(void) {
 
 /**
  * Handles the specified interrupt by dispatching to the registered function
- * @param interrupt - interrupt number
+ * @param frame - trap frame saved by the ISR entry
+ * @return trap frame to resume (a different process after a switch)
  */
-void interrupts_irq_handler(int irq) {
+trap_frame_t *interrupts_irq_handler(trap_frame_t *frame) {
+    int irq = frame->irq;
+    trap_frame_t *prev_frame;
+    void (*handler)();
+
     if (irq < 0 || irq >= IRQ_MAX) {
         kernel_panic("interrupts: Invalid IRQ %d (0x%02x)", irq, irq);
-        return;
+        return frame;
     }
 
-    if (irq_handlers[irq] == NULL) {
+    rwlock_read_acquire(&irq_handlers_lock);
+    handler = irq_handlers[irq];
+    rwlock_read_release(&irq_handlers_lock);
+
+    if (handler == NULL) {
         kernel_panic("interrupts: No handler registered for IRQ %d (0x%02x)", irq, irq);
-        return;
+        return frame;
     }
 
-    irq_handlers[irq]();
+    // Exceptions may occur while handling an interrupt
+    prev_frame = this_cpu()->frame;
+    this_cpu()->frame = frame;
+
+    if (!prev_frame) {
+        kernel_lock();
+        cpustat_switch(CPUSTAT_IRQ);
+    }
+
+    handler();
+
+    this_cpu()->frame = prev_frame;
 
     /* If the IRQ originates from the PIC, dismiss the IRQ */
     if (irq >= 0x20 && irq <= 0x2F) {
         pic_irq_dismiss(irq - 0x20);
+    } else if (irq >= IRQ_IPI_TICK && irq < IRQ_APIC_SPURIOUS) {
+        // Interrupts from the local APIC (but not spurious ones)
+        apic_eoi();
+    }
+
+    // Processes are only switched when the outermost interrupt returns
+    if (prev_frame) {
+        return frame;
     }
+
+    frame = scheduler_run(frame);
+
+    cpustat_switch(kproc_current() == idle_proc ? CPUSTAT_IDLE : CPUSTAT_TASK);
+
+    kernel_unlock();
+
+    return frame;
+}
+
+/**
+ * Returns the trap frame of the interrupt currently being handled
+ * @return pointer to the trap frame or NULL if not handling an interrupt
+ */
+trap_frame_t *interrupts_get_frame(void) {
+    return this_cpu()->frame;
 }
 
 /*
@@ -81,6 +137,8 @@ void interrupts_irq_handler(int irq) {
  * @param handler - the function to be called to process the the interrupt
  */
 void interrupts_irq_register(int irq, void (*entry)(), void (*handler)()) {
+    unsigned int flags;
+
     if (irq < 0 || irq >= IRQ_MAX) {
         kernel_panic("interrupts: Invalid IRQ %d (0x%02x)", irq, irq);
         return;
@@ -96,12 +154,17 @@ void interrupts_irq_register(int irq, void (*entry)(), void (*handler)()) {
         return;
     }
 
+    flags = rwlock_write_acquire_irqsave(&irq_handlers_lock);
+
     // Add the entry to the IDT
     fill_gate(&idt[irq], (int)entry, get_cs(), ACC_INTR_GATE, 0);
-    kernel_log_debug("interrupts: IRQ %d (0x%02x) IDT entry added", irq, irq);
 
     /* Add the ISR handler to the table */
     irq_handlers[irq] = handler;
+
+    rwlock_write_release_irqrestore(&irq_handlers_lock, flags);
+
+    kernel_log_debug("interrupts: IRQ %d (0x%02x) IDT entry added", irq, irq);
     kernel_log_debug("interrupts: IRQ %d (0x%02x) handler added", irq, irq);
 
     /* If the interrupt originates from the PIC, enable IRQs */
@@ -112,6 +175,44 @@ void interrupts_irq_register(int irq, void (*entry)(), void (*handler)()) {
     kernel_log_info("interrupts: IRQ %d (0x%02x) registered)", irq, irq);
 }
 
+/**
+ * Registers an ISR that user mode may also raise with the INT instruction
+ * @param irq - IRQ number
+ * @param entry - function pointer to be registered in the IDT
+ * @param handler - function pointer to be called when the specified IRQ occurs
+ */
+void interrupts_irq_register_user(int irq, void (*entry)(), void (*handler)()) {
+    unsigned int flags;
+
+    interrupts_irq_register(irq, entry, handler);
+
+    // Software interrupts from user mode need a gate with privilege level 3
+    flags = rwlock_write_acquire_irqsave(&irq_handlers_lock);
+    fill_gate(&idt[irq], (int)entry, get_cs(), ACC_INTR_GATE | ACC_PL_U, 0);
+    rwlock_write_release_irqrestore(&irq_handlers_lock, flags);
+}
+
+/**
+ * Determines the PIC data port and PIC-relative IRQ line for an IRQ
+ *
+ * @param irq - IRQ number (interrupt vectors 0x20-0x2f are remapped)
+ * @param line - receives the IRQ line on the selected PIC
+ * @return the data port for the PIC
+ */
+static unsigned short pic_irq_port(int irq, int *line) {
+    if (irq >= PIC_IRQ_BASE) {
+        irq -= PIC_IRQ_BASE;
+    }
+
+    if (irq >= 8) {
+        *line = irq - 8;
+        return PIC2_DATA;
+    }
+
+    *line = irq;
+    return PIC1_DATA;
+}
+
 /**
  * Enables the specified IRQ on the PIC
  *
@@ -119,10 +220,16 @@ void interrupts_irq_register(int irq, void (*entry)(), void (*handler)()) {
  * @note IRQs > 0xf will be remapped
  */
 void pic_irq_enable(int irq) {
-    // Determine the PIC to be used for the given IRQ number
-    // Read the current mask
+    int line;
+    unsigned short port = pic_irq_port(irq, &line);
+
     // Clear the associated bit in the mask to enable the IRQ
-    // Write the mask out to the PIC
+    outportb(port, bit_clear(inportb(port), line));
+
+    // IRQs on the secondary PIC are only delivered through the cascade
+    if (port == PIC2_DATA) {
+        outportb(PIC1_DATA, bit_clear(inportb(PIC1_DATA), PIC_IRQ_CASCADE));
+    }
 }
 
 /**
@@ -131,10 +238,11 @@ void pic_irq_enable(int irq) {
  * @param irq - IRQ that should be disabled
  */
 void pic_irq_disable(int irq) {
-    // Determine the PIC to be used for the given IRQ number
-    // Read the current mask
+    int line;
+    unsigned short port = pic_irq_port(irq, &line);
+
     // Set the associated bit in the mask to disable the IRQ
-    // Write the mask back to the PIC
+    outportb(port, bit_set(inportb(port), line));
 }
 
 /**
@@ -144,10 +252,11 @@ void pic_irq_disable(int irq) {
  * @return - 1 if enabled, 0 if disabled
  */
 int pic_irq_enabled(int irq) {
-    // Determine the PIC to be used and adjust the irq number
-    // Read the current mask from the data port
-    // check the associated bit and return if the IRQ is enabled
-    return 0;
+    int line;
+    unsigned short port = pic_irq_port(irq, &line);
+
+    // A cleared bit in the mask indicates the IRQ is enabled
+    return !bit_test(inportb(port), line);
 }
 
 /**
@@ -158,8 +267,15 @@ int pic_irq_enabled(int irq) {
  * @param irq - IRQ to be dismissed
  */
 void pic_irq_dismiss(int irq) {
+    int line;
+
     // Send EOI to the secondary PIC, if needed
-    // Send EOI to the primary PIC, if needed
+    if (pic_irq_port(irq, &line) == PIC2_DATA) {
+        outportb(PIC2_CMD, PIC_EOI);
+    }
+
+    // Always send EOI to the primary PIC
+    outportb(PIC1_CMD, PIC_EOI);
 }
 
 /**
@@ -171,6 +287,7 @@ void interrupts_init() {
     // Obtain the IDT base address
     idt = get_idt_base();
 
-    memset(irq_handlers, 0, sizeof(irq_handlers));
+    kmemset(irq_handlers, 0, sizeof(irq_handlers));
+    rwlock_init(&irq_handlers_lock, "irq_handlers");
 }
 
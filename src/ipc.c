@@ -0,0 +1,824 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Message Passing (IPC) Implementation
+ */
+#include "cpu.h"
+#include "interrupts.h"
+#include "ipc.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "pool.h"
+#include "scheduler.h"
+#include "syscall.h"
+#include "vm.h"
+#include "wait.h"
+
+// Returned internally when the running process has to wait
+#define IPC_PENDING         1
+
+// Number of round trips measured by ipc_benchmark
+#define IPC_BENCHMARK_REPS  10000
+
+// Tags used by the benchmark
+#define IPC_BENCHMARK_PING  1
+#define IPC_BENCHMARK_STOP  2
+
+// Port
+typedef struct ipc_port_t {
+    proc_t *owner;                      // Process that receives from the port
+    wait_queue_t senders;               // Processes blocked sending or calling
+    wait_queue_t receivers;             // Owner blocked receiving
+    wait_queue_t callers;               // Callers whose message was received, awaiting the reply
+    ipc_msg_t queue[IPC_QUEUE_SIZE];    // Asynchronous messages
+    int head;                           // Index of the oldest asynchronous message
+    int count;                          // Number of asynchronous messages
+    unsigned int messages;              // Messages delivered
+    unsigned int handoffs;              // Direct switches to a blocked partner
+} ipc_port_t;
+
+// Ports
+POOL_DEFINE(ipc_port_pool, ipc_port_t, IPC_PORTS_MAX);
+
+// Port the benchmark server receives on
+int ipc_benchmark_port = -1;
+
+/**
+ * Looks up a port
+ * @param port - port id
+ * @return pointer to the port or NULL if it does not exist
+ */
+static ipc_port_t *ipc_port_get(int port) {
+    return pool_get(&ipc_port_pool, port);
+}
+
+/**
+ * Loads a message from the registers of a system call
+ * @param frame - trap frame of the system call
+ * @param msg - pointer to the message to fill in
+ */
+static void ipc_frame_load(trap_frame_t *frame, ipc_msg_t *msg) {
+    msg->sender = 0;
+    msg->tag = frame->esi;
+    msg->data[0] = frame->edi;
+    msg->data[1] = frame->ebp;
+}
+
+/**
+ * Stores the result of an operation in the registers of a system call
+ * @param frame - trap frame of the system call
+ * @param status - result of the operation
+ * @param msg - message received (NULL if none)
+ */
+static void ipc_frame_store(trap_frame_t *frame, int status, ipc_msg_t *msg) {
+    frame->eax = status;
+
+    if (msg) {
+        frame->ebx = msg->sender;
+        frame->esi = msg->tag;
+        frame->edi = msg->data[0];
+        frame->ebp = msg->data[1];
+    }
+}
+
+/**
+ * Copies a message to a process, moving the pages it carries into the
+ * process's receive window
+ * @param from - sending process
+ * @param msg - pointer to the message
+ * @param to - receiving process (its ipc_msg is filled in)
+ * @return -1 if the pages could not be moved; 0 on success
+ */
+static int ipc_transfer(proc_t *from, ipc_msg_t *msg, proc_t *to) {
+    ipc_msg_t out = *msg;
+
+    out.sender = from->pid;
+
+    // Kernel threads share an address space; pages only move between two
+    // user processes
+    if ((msg->tag & IPC_TAG_PAGES) && (from->space || to->space)) {
+        if (!from->space || !to->space || (int)msg->data[1] > to->ipc_window_pages
+            || vm_page_move(from->space, msg->data[0], to->space, to->ipc_window,
+                            msg->data[1]) != 0) {
+            return -1;
+        }
+
+        out.data[0] = to->ipc_window;
+    }
+
+    to->ipc_msg = out;
+
+    return 0;
+}
+
+/**
+ * Completes the operation a process is blocked in (it still has to be
+ * woken up or handed the CPU)
+ * @param proc - pointer to the process
+ * @param status - result of the operation
+ */
+static void ipc_finish(proc_t *proc, int status) {
+    bool received = proc->ipc_state == IPC_STATE_RECEIVE || proc->ipc_state == IPC_STATE_REPLY;
+
+    proc->ipc_state = IPC_STATE_NONE;
+    proc->ipc_status = status;
+
+    // A user process blocked in a system call has already returned from
+    // it; the result goes straight into its registers
+    if (proc->space && proc != active_proc) {
+        ipc_frame_store(proc->frame, status, (received && status == 0) ? &proc->ipc_msg : NULL);
+    }
+}
+
+/**
+ * Waits for the operation the running process is blocked in to complete
+ * (called with interrupts disabled)
+ * @param msg - pointer to the message to fill in (NULL if none is expected)
+ * @return result of the operation
+ */
+static int ipc_wait(ipc_msg_t *msg) {
+    proc_t *proc = active_proc;
+
+    while (proc->ipc_state != IPC_STATE_NONE) {
+        scheduler_block();
+
+        // In a system call the process only stops once the call returns,
+        // and ipc_finish stores the result in its registers
+        if (interrupts_get_frame()) {
+            return 0;
+        }
+    }
+
+    if (msg && proc->ipc_status == 0) {
+        *msg = proc->ipc_msg;
+    }
+
+    return proc->ipc_status;
+}
+
+/**
+ * Fails every process blocked on a port and frees it
+ * @param p - pointer to the port
+ */
+static void ipc_port_free(ipc_port_t *p) {
+    wait_queue_t *queues[] = { &p->senders, &p->receivers, &p->callers };
+    proc_t *proc;
+
+    for (int i = 0; i < 3; i++) {
+        while ((proc = queues[i]->head) != NULL) {
+            wait_remove(proc);
+            ipc_finish(proc, -1);
+            scheduler_wakeup(proc);
+        }
+    }
+
+    pool_free(&ipc_port_pool, p);
+}
+
+/**
+ * Sends a message to a port, switching to the receiver if the sender
+ * waits for a reply (called with interrupts disabled)
+ * @param port - port id
+ * @param msg - pointer to the message
+ * @param state - IPC_STATE_SEND or IPC_STATE_CALL
+ * @return -1 on error; 0 if done; IPC_PENDING if the sender must wait
+ */
+static int ipc_send_start(int port, ipc_msg_t *msg, int state) {
+    proc_t *proc = active_proc;
+    ipc_port_t *p = ipc_port_get(port);
+    proc_t *receiver;
+
+    if (!p || !msg) {
+        return -1;
+    }
+
+    proc->ipc_port = port;
+
+    // Without a receiver the message waits with the sender
+    receiver = p->receivers.head;
+    if (!receiver) {
+        proc->ipc_msg = *msg;
+        proc->ipc_state = state;
+        wait_enqueue(&p->senders, proc);
+        return IPC_PENDING;
+    }
+
+    if (ipc_transfer(proc, msg, receiver) != 0) {
+        return -1;
+    }
+
+    wait_remove(receiver);
+    ipc_finish(receiver, 0);
+    p->messages++;
+
+    if (state == IPC_STATE_SEND) {
+        receiver->ipc_client = NULL;
+        scheduler_wakeup(receiver);
+        return 0;
+    }
+
+    // The caller has nothing to do until the reply, so the receiver runs
+    // in its place
+    proc->ipc_state = IPC_STATE_REPLY;
+    wait_enqueue(&p->callers, proc);
+
+    receiver->ipc_client = proc;
+    receiver->ipc_client_pid = proc->pid;
+
+    scheduler_handoff(receiver);
+    p->handoffs++;
+
+    return IPC_PENDING;
+}
+
+/**
+ * Takes the next message sent to a port (called with interrupts disabled)
+ * @param port - port id
+ * @return -1 on error; 0 if a message was taken; IPC_PENDING if the
+ *         receiver must wait
+ */
+static int ipc_receive_start(int port) {
+    proc_t *proc = active_proc;
+    ipc_port_t *p = ipc_port_get(port);
+    proc_t *sender;
+
+    if (!p || p->owner != proc) {
+        return -1;
+    }
+
+    proc->ipc_client = NULL;
+
+    // Asynchronous messages were queued before any blocked sender arrived
+    if (p->count > 0) {
+        proc->ipc_msg = p->queue[p->head];
+        p->head = (p->head + 1) % IPC_QUEUE_SIZE;
+        p->count--;
+        p->messages++;
+        return 0;
+    }
+
+    while ((sender = p->senders.head) != NULL) {
+        wait_remove(sender);
+
+        if (ipc_transfer(sender, &sender->ipc_msg, proc) != 0) {
+            ipc_finish(sender, -1);
+            scheduler_wakeup(sender);
+            continue;
+        }
+
+        p->messages++;
+
+        if (sender->ipc_state == IPC_STATE_CALL) {
+            sender->ipc_state = IPC_STATE_REPLY;
+            wait_enqueue(&p->callers, sender);
+
+            proc->ipc_client = sender;
+            proc->ipc_client_pid = sender->pid;
+        } else {
+            ipc_finish(sender, 0);
+            scheduler_wakeup(sender);
+        }
+
+        return 0;
+    }
+
+    proc->ipc_port = port;
+    proc->ipc_state = IPC_STATE_RECEIVE;
+    wait_enqueue(&p->receivers, proc);
+
+    return IPC_PENDING;
+}
+
+/**
+ * Delivers a reply to the running process's last caller, leaving the
+ * caller to be woken up (called with interrupts disabled)
+ * @param msg - pointer to the reply
+ * @return the caller or NULL on error
+ */
+static proc_t *ipc_reply_start(ipc_msg_t *msg) {
+    proc_t *proc = active_proc;
+    proc_t *client = proc->ipc_client;
+    ipc_port_t *p;
+
+    proc->ipc_client = NULL;
+
+    // The caller may have exited (and its slot been reused) since
+    if (!client || !msg || client->pid != proc->ipc_client_pid
+        || client->ipc_state != IPC_STATE_REPLY) {
+        return NULL;
+    }
+
+    p = ipc_port_get(client->ipc_port);
+    if (!p || p->owner != proc || client->wait_queue != &p->callers) {
+        return NULL;
+    }
+
+    wait_remove(client);
+
+    if (ipc_transfer(proc, msg, client) != 0) {
+        ipc_finish(client, -1);
+        scheduler_wakeup(client);
+        return NULL;
+    }
+
+    ipc_finish(client, 0);
+
+    return client;
+}
+
+/**
+ * Creates a port owned by the running process
+ * @return port id or -1 on error
+ */
+int ipc_port_create(void) {
+    unsigned int flags = interrupts_save();
+    ipc_port_t *p = pool_alloc(&ipc_port_pool);
+    int port;
+
+    if (!p) {
+        interrupts_restore(flags);
+        kernel_log_error("ipc: no free ports");
+        return -1;
+    }
+
+    p->owner = active_proc;
+    wait_queue_init(&p->senders);
+    wait_queue_init(&p->receivers);
+    wait_queue_init(&p->callers);
+    p->head = 0;
+    p->count = 0;
+    p->messages = 0;
+    p->handoffs = 0;
+
+    port = pool_index(&ipc_port_pool, p);
+
+    interrupts_restore(flags);
+
+    return port;
+}
+
+/**
+ * Destroys a port; processes blocked on it fail with -1
+ * @param port - port id
+ * @return -1 on error; 0 on success
+ */
+int ipc_port_destroy(int port) {
+    unsigned int flags = interrupts_save();
+    ipc_port_t *p = ipc_port_get(port);
+
+    if (!p || p->owner != active_proc) {
+        interrupts_restore(flags);
+        return -1;
+    }
+
+    ipc_port_free(p);
+
+    interrupts_restore(flags);
+
+    return 0;
+}
+
+/**
+ * Sets the address range pages sent to the running process are mapped at
+ * @param addr - start of the window (page aligned, in a writable area)
+ * @param pages - size of the window in pages (0 to refuse pages)
+ * @return -1 on error; 0 on success
+ */
+int ipc_window(unsigned int addr, int pages) {
+    proc_t *proc = active_proc;
+
+    if (pages < 0 || (addr & (PAGE_SIZE - 1))) {
+        return -1;
+    }
+
+    // The whole window must be able to take writable pages
+    for (int i = 0; i < pages && proc->space; i++) {
+        vm_area_t *area = vm_area_find(proc->space, addr + i * PAGE_SIZE);
+
+        if (!area || !(area->flags & VM_WRITE)) {
+            return -1;
+        }
+    }
+
+    proc->ipc_window = addr;
+    proc->ipc_window_pages = pages;
+
+    return 0;
+}
+
+/**
+ * Sends a message and blocks until it has been received
+ * @param port - port id
+ * @param msg - pointer to the message
+ * @return -1 on error; 0 on success
+ */
+int ipc_send(int port, ipc_msg_t *msg) {
+    unsigned int flags = interrupts_save();
+    int status = ipc_send_start(port, msg, IPC_STATE_SEND);
+
+    if (status == IPC_PENDING) {
+        status = ipc_wait(NULL);
+    }
+
+    interrupts_restore(flags);
+
+    return status;
+}
+
+/**
+ * Queues a message on a port without blocking
+ * @param port - port id
+ * @param msg - pointer to the message (may not carry pages)
+ * @return -1 on error (including a full queue); 0 on success
+ */
+int ipc_send_async(int port, ipc_msg_t *msg) {
+    unsigned int flags;
+    ipc_port_t *p;
+    proc_t *receiver;
+    ipc_msg_t *slot;
+
+    // Pages cannot be held while the message waits in the queue
+    if (!msg || (msg->tag & IPC_TAG_PAGES)) {
+        return -1;
+    }
+
+    flags = interrupts_save();
+
+    p = ipc_port_get(port);
+    if (!p) {
+        interrupts_restore(flags);
+        return -1;
+    }
+
+    receiver = p->receivers.head;
+    if (receiver) {
+        if (ipc_transfer(active_proc, msg, receiver) != 0) {
+            interrupts_restore(flags);
+            return -1;
+        }
+
+        wait_remove(receiver);
+        ipc_finish(receiver, 0);
+        scheduler_wakeup(receiver);
+        p->messages++;
+    } else if (p->count < IPC_QUEUE_SIZE) {
+        slot = &p->queue[(p->head + p->count) % IPC_QUEUE_SIZE];
+        *slot = *msg;
+        slot->sender = active_proc->pid;
+        p->count++;
+    } else {
+        interrupts_restore(flags);
+        return -1;
+    }
+
+    interrupts_restore(flags);
+
+    return 0;
+}
+
+/**
+ * Sends a message and blocks until the receiver replies
+ * @param port - port id
+ * @param msg - pointer to the message; receives the reply
+ * @return -1 on error; 0 on success
+ */
+int ipc_call(int port, ipc_msg_t *msg) {
+    unsigned int flags = interrupts_save();
+    int status = ipc_send_start(port, msg, IPC_STATE_CALL);
+
+    if (status == IPC_PENDING) {
+        status = ipc_wait(msg);
+    }
+
+    interrupts_restore(flags);
+
+    return status;
+}
+
+/**
+ * Receives the next message sent to a port owned by the running process,
+ * blocking until there is one
+ * @param port - port id
+ * @param msg - pointer to the message to fill in
+ * @return -1 on error; 0 on success
+ */
+int ipc_receive(int port, ipc_msg_t *msg) {
+    unsigned int flags;
+    int status;
+
+    if (!msg) {
+        return -1;
+    }
+
+    flags = interrupts_save();
+
+    status = ipc_receive_start(port);
+    if (status == IPC_PENDING) {
+        status = ipc_wait(msg);
+    } else if (status == 0) {
+        *msg = active_proc->ipc_msg;
+    }
+
+    interrupts_restore(flags);
+
+    return status;
+}
+
+/**
+ * Replies to the caller whose message the running process received last
+ * @param msg - pointer to the reply
+ * @return -1 on error (e.g. the caller is gone); 0 on success
+ */
+int ipc_reply(ipc_msg_t *msg) {
+    unsigned int flags = interrupts_save();
+    proc_t *client = ipc_reply_start(msg);
+
+    if (client) {
+        scheduler_wakeup(client);
+    }
+
+    interrupts_restore(flags);
+
+    return client ? 0 : -1;
+}
+
+/**
+ * Replies to the last caller and receives the next message, switching
+ * straight to the caller if there is no message yet
+ * @param port - port id
+ * @param msg - pointer to the reply; receives the next message
+ * @return -1 on error; 0 on success
+ */
+int ipc_reply_wait(int port, ipc_msg_t *msg) {
+    unsigned int flags;
+    proc_t *client;
+    int status;
+
+    if (!msg) {
+        return -1;
+    }
+
+    flags = interrupts_save();
+
+    // A reply that cannot be delivered does not stop the server receiving
+    client = ipc_reply_start(msg);
+
+    status = ipc_receive_start(port);
+    if (status == IPC_PENDING) {
+        if (client) {
+            scheduler_handoff(client);
+            ipc_port_get(port)->handoffs++;
+        }
+
+        status = ipc_wait(msg);
+    } else {
+        if (client) {
+            scheduler_wakeup(client);
+        }
+
+        if (status == 0) {
+            *msg = active_proc->ipc_msg;
+        }
+    }
+
+    interrupts_restore(flags);
+
+    return status;
+}
+
+/**
+ * Releases the ports and pending operations of a process that is being
+ * destroyed
+ * @param proc - pointer to the process
+ */
+void ipc_proc_exit(proc_t *proc) {
+    unsigned int flags = interrupts_save();
+
+    for (int i = pool_next(&ipc_port_pool, 0); i >= 0; i = pool_next(&ipc_port_pool, i + 1)) {
+        ipc_port_t *p = pool_get(&ipc_port_pool, i);
+
+        if (p->owner == proc) {
+            ipc_port_free(p);
+        }
+    }
+
+    proc->ipc_state = IPC_STATE_NONE;
+    proc->ipc_client = NULL;
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Runs a system call that exchanges a message in registers
+ * @param op - operation to run
+ * @param port - port id
+ * @return result of the operation
+ */
+static int ipc_sys_exchange(int (*op)(int, ipc_msg_t *), unsigned int port) {
+    trap_frame_t *frame = interrupts_get_frame();
+    ipc_msg_t msg;
+    int status;
+
+    ipc_frame_load(frame, &msg);
+
+    status = op((int)port, &msg);
+
+    // An operation that blocked completes through ipc_finish instead
+    if (active_proc->ipc_state == IPC_STATE_NONE) {
+        ipc_frame_store(frame, status, status == 0 ? &msg : NULL);
+    }
+
+    return status;
+}
+
+/**
+ * SYS_IPC_PORT_CREATE: creates a port
+ */
+static int sys_ipc_port_create(unsigned int arg1, unsigned int arg2, unsigned int arg3) {
+    return ipc_port_create();
+}
+
+/**
+ * SYS_IPC_PORT_DESTROY: destroys a port
+ * @param port - port id
+ */
+static int sys_ipc_port_destroy(unsigned int port, unsigned int arg2, unsigned int arg3) {
+    return ipc_port_destroy((int)port);
+}
+
+/**
+ * SYS_IPC_WINDOW: sets the window pages are received in
+ * @param addr - start of the window
+ * @param pages - size of the window in pages
+ */
+static int sys_ipc_window(unsigned int addr, unsigned int pages, unsigned int arg3) {
+    return ipc_window(addr, (int)pages);
+}
+
+/**
+ * SYS_IPC_SEND: sends the message in ESI/EDI/EBP
+ * @param port - port id
+ */
+static int sys_ipc_send(unsigned int port, unsigned int arg2, unsigned int arg3) {
+    ipc_msg_t msg;
+
+    ipc_frame_load(interrupts_get_frame(), &msg);
+
+    return ipc_send((int)port, &msg);
+}
+
+/**
+ * SYS_IPC_SEND_ASYNC: queues the message in ESI/EDI/EBP
+ * @param port - port id
+ */
+static int sys_ipc_send_async(unsigned int port, unsigned int arg2, unsigned int arg3) {
+    ipc_msg_t msg;
+
+    ipc_frame_load(interrupts_get_frame(), &msg);
+
+    return ipc_send_async((int)port, &msg);
+}
+
+/**
+ * SYS_IPC_CALL: sends the message in ESI/EDI/EBP and returns the reply
+ * in EBX/ESI/EDI/EBP
+ * @param port - port id
+ */
+static int sys_ipc_call(unsigned int port, unsigned int arg2, unsigned int arg3) {
+    return ipc_sys_exchange(ipc_call, port);
+}
+
+/**
+ * SYS_IPC_RECEIVE: returns the next message in EBX/ESI/EDI/EBP
+ * @param port - port id
+ */
+static int sys_ipc_receive(unsigned int port, unsigned int arg2, unsigned int arg3) {
+    return ipc_sys_exchange(ipc_receive, port);
+}
+
+/**
+ * SYS_IPC_REPLY: replies with the message in ESI/EDI/EBP
+ */
+static int sys_ipc_reply(unsigned int arg1, unsigned int arg2, unsigned int arg3) {
+    ipc_msg_t msg;
+
+    ipc_frame_load(interrupts_get_frame(), &msg);
+
+    return ipc_reply(&msg);
+}
+
+/**
+ * SYS_IPC_REPLY_WAIT: replies with the message in ESI/EDI/EBP and
+ * returns the next message in EBX/ESI/EDI/EBP
+ * @param port - port id
+ */
+static int sys_ipc_reply_wait(unsigned int port, unsigned int arg2, unsigned int arg3) {
+    return ipc_sys_exchange(ipc_reply_wait, port);
+}
+
+/**
+ * Initializes message passing and registers its system calls
+ */
+void ipc_init(void) {
+    kernel_log_info("Initializing message passing");
+
+    pool_init(&ipc_port_pool);
+
+    syscall_register(SYS_IPC_PORT_CREATE, "port_create", sys_ipc_port_create);
+    syscall_register(SYS_IPC_PORT_DESTROY, "port_destroy", sys_ipc_port_destroy);
+    syscall_register(SYS_IPC_WINDOW, "ipc_window", sys_ipc_window);
+    syscall_register(SYS_IPC_SEND, "ipc_send", sys_ipc_send);
+    syscall_register(SYS_IPC_SEND_ASYNC, "ipc_send_async", sys_ipc_send_async);
+    syscall_register(SYS_IPC_CALL, "ipc_call", sys_ipc_call);
+    syscall_register(SYS_IPC_RECEIVE, "ipc_receive", sys_ipc_receive);
+    syscall_register(SYS_IPC_REPLY, "ipc_reply", sys_ipc_reply);
+    syscall_register(SYS_IPC_REPLY_WAIT, "ipc_reply_wait", sys_ipc_reply_wait);
+}
+
+/**
+ * Benchmark client: times call/reply round trips to the server
+ */
+static void ipc_benchmark_client(void) {
+    unsigned long long cycles;
+    ipc_msg_t msg;
+    int i;
+
+    // Warm up, then time the round trips
+    msg.tag = IPC_BENCHMARK_PING;
+    msg.data[0] = 0;
+    msg.data[1] = 0;
+    ipc_call(ipc_benchmark_port, &msg);
+
+    cycles = cpu_rdtsc();
+    for (i = 0; i < IPC_BENCHMARK_REPS; i++) {
+        msg.tag = IPC_BENCHMARK_PING;
+        if (ipc_call(ipc_benchmark_port, &msg) != 0) {
+            break;
+        }
+    }
+    cycles = cpu_rdtsc() - cycles;
+
+    if (i < IPC_BENCHMARK_REPS) {
+        kernel_log_error("ipc: benchmark call %d failed", i);
+    } else {
+        kernel_log_info("ipc: %u round trips, %u cycles per call/reply", i,
+                        cycles > 0xFFFFFFFFULL ? 0xFFFFFFFF / i : (unsigned int)cycles / i);
+    }
+
+    msg.tag = IPC_BENCHMARK_STOP;
+    ipc_call(ipc_benchmark_port, &msg);
+}
+
+/**
+ * Benchmark server: answers every call until told to stop
+ */
+static void ipc_benchmark_server(void) {
+    ipc_msg_t msg;
+    int status;
+
+    ipc_benchmark_port = ipc_port_create();
+    if (ipc_benchmark_port < 0) {
+        return;
+    }
+
+    if (kproc_create(ipc_benchmark_client, "ipc_client") < 0) {
+        kernel_log_error("ipc: unable to start the benchmark client");
+        ipc_port_destroy(ipc_benchmark_port);
+        return;
+    }
+
+    status = ipc_receive(ipc_benchmark_port, &msg);
+    while (status == 0 && msg.tag != IPC_BENCHMARK_STOP) {
+        msg.data[0]++;
+        status = ipc_reply_wait(ipc_benchmark_port, &msg);
+    }
+
+    ipc_reply(&msg);
+    ipc_port_destroy(ipc_benchmark_port);
+}
+
+/**
+ * Measures the cost of an IPC round trip between two kernel threads and
+ * logs it
+ */
+void ipc_benchmark(void) {
+    // The results are logged once the threads run
+    if (kproc_create(ipc_benchmark_server, "ipc_server") < 0) {
+        kernel_log_error("ipc: unable to start the benchmark");
+    }
+}
+
+/**
+ * Dumps the ports
+ */
+void ipc_dump(void) {
+    kernel_log_info("ipc: %4s %5s %6s %10s %10s", "port", "owner", "queued", "messages", "handoffs");
+
+    for (int i = pool_next(&ipc_port_pool, 0); i >= 0; i = pool_next(&ipc_port_pool, i + 1)) {
+        ipc_port_t *p = pool_get(&ipc_port_pool, i);
+
+        kernel_log_info("ipc: %4d %5d %6d %10u %10u", i, p->owner->pid, p->count, p->messages,
+                        p->handoffs);
+    }
+}
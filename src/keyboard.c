@@ -3,6 +3,7 @@
 
 #include "kernel.h"
 #include "keyboard.h"
+#include "kproc.h"
 #include "tty.h"
 #include "interrupts.h"
 
@@ -235,14 +236,19 @@ static const char keyboard_map_secondary[] = {
 };
 
 
-/*
- *
+/**
+ * Keyboard IRQ handler: queues decoded keys as TTY input, waking any
+ * process blocked in keyboard_getc
  */
 void keyboard_irq_handler(void) {
     unsigned int c = keyboard_poll();
 
     if (c) {
         tty_update(c);
+
+        if (tty_input(c) != 0) {
+            kernel_log_debug("keyboard: input buffer full, dropped 0x%02x", c);
+        }
     }
 }
 
@@ -293,13 +299,24 @@ unsigned int keyboard_poll(void) {
 
 /**
  * Blocks until a keyboard character has been entered
- * @return decoded character entered by the keyboard or KEY_NULL
- *         for any character that cannot be decoded
+ *
+ * The caller sleeps until the keyboard IRQ queues a key in the active
+ * TTY's input buffer; only the idle process polls the keyboard instead.
+ *
+ * @return decoded character entered by the keyboard
  */
 unsigned int keyboard_getc(void) {
     unsigned int c = KEY_NULL;
-    while ((c = keyboard_poll()) == KEY_NULL);
-    return c;
+
+    // The idle process (which runs the boot code) cannot block, and the
+    // keyboard IRQ may not be enabled yet
+    if (kproc_current() == idle_proc) {
+        while ((c = keyboard_poll()) == KEY_NULL);
+        return c;
+    }
+
+    // The keyboard IRQ wakes the reader once a key is queued
+    return (unsigned char)tty_getc();
 }
 
 /**
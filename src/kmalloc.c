@@ -0,0 +1,371 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Memory Allocator
+ */
+#include "interrupts.h"
+#include "kernel.h"
+#include "kmalloc.h"
+#include "kstring.h"
+#include "page.h"
+#include "pool.h"
+
+// Largest slab order considered when sizing a cache
+#define KMEM_ORDER_MAX      3
+
+// Offset of the first object in a slab
+#define KMEM_SLAB_HDR       ((sizeof(slab_t) + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1))
+
+// General purpose size classes
+static const size_t kmalloc_sizes[] = {
+    16, 32, 64, 96, 128, 192, 256, 512, 1024, 2048
+};
+
+static char *kmalloc_names[] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-96", "kmalloc-128",
+    "kmalloc-192", "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+
+#define KMALLOC_CLASSES     (sizeof(kmalloc_sizes) / sizeof(kmalloc_sizes[0]))
+
+// Cache descriptors
+POOL_DEFINE(kmem_cache_pool, kmem_cache_t, KMEM_CACHES_MAX);
+
+// General purpose size-class caches
+kmem_cache_t *kmalloc_caches[KMALLOC_CLASSES];
+
+/**
+ * Adds a slab to the front of a slab list
+ * @param list - pointer to the list head
+ * @param slab - slab to add
+ */
+static void slab_list_push(slab_t **list, slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+
+    if (slab->next) {
+        slab->next->prev = slab;
+    }
+
+    *list = slab;
+}
+
+/**
+ * Removes a slab from a slab list
+ * @param list - pointer to the list head
+ * @param slab - slab to remove
+ */
+static void slab_list_remove(slab_t **list, slab_t *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+/**
+ * Allocates a new slab for the cache and builds its free list
+ * @param cache - pointer to the cache
+ * @return pointer to the slab or NULL if no memory is available
+ */
+static slab_t *slab_create(kmem_cache_t *cache) {
+    slab_t *slab = page_alloc(cache->order);
+    char *obj;
+
+    if (!slab) {
+        return NULL;
+    }
+
+    // Every page of the slab points back to it so kfree can find it
+    for (int i = 0; i < (1 << cache->order); i++) {
+        page_get((char *)slab + i * PAGE_SIZE)->slab = slab;
+    }
+
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->cache = cache;
+    slab->free = NULL;
+    slab->in_use = 0;
+
+    // Chain the objects so the lowest address is handed out first
+    obj = (char *)slab + KMEM_SLAB_HDR + (cache->per_slab - 1) * cache->size;
+    for (int i = 0; i < cache->per_slab; i++, obj -= cache->size) {
+        *(void **)obj = slab->free;
+        slab->free = obj;
+    }
+
+    cache->slabs++;
+
+    return slab;
+}
+
+/**
+ * Returns a slab's pages to the page allocator
+ * @param cache - pointer to the cache
+ * @param slab - slab to destroy
+ */
+static void slab_destroy(kmem_cache_t *cache, slab_t *slab) {
+    for (int i = 0; i < (1 << cache->order); i++) {
+        page_get((char *)slab + i * PAGE_SIZE)->slab = NULL;
+    }
+
+    page_free(slab, cache->order);
+    cache->slabs--;
+}
+
+/**
+ * Returns an object to its slab, updating the slab lists
+ * @param cache - pointer to the cache
+ * @param slab - slab that owns the object
+ * @param obj - pointer to the object
+ */
+static void slab_release(kmem_cache_t *cache, slab_t *slab, void *obj) {
+    int was_full = (slab->in_use == cache->per_slab);
+
+    *(void **)obj = slab->free;
+    slab->free = obj;
+    slab->in_use--;
+
+    if (!was_full && slab->in_use > 0) {
+        return;
+    }
+
+    slab_list_remove(was_full ? &cache->full : &cache->partial, slab);
+
+    if (slab->in_use > 0) {
+        slab_list_push(&cache->partial, slab);
+    } else if (cache->empty_count < KMEM_EMPTY_MAX) {
+        slab_list_push(&cache->empty, slab);
+        cache->empty_count++;
+    } else {
+        slab_destroy(cache, slab);
+    }
+}
+
+/**
+ * Creates a cache for objects of the given size
+ * @param name - name of the cache
+ * @param size - size of each object
+ * @return pointer to the cache or NULL on error
+ */
+kmem_cache_t *kmem_cache_create(char *name, size_t size) {
+    kmem_cache_t *cache;
+    unsigned int flags;
+    int order;
+
+    if (size < sizeof(void *)) {
+        size = sizeof(void *);
+    }
+
+    size = (size + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1);
+
+    // Pick the smallest slab order that wastes no more than 1/8 of the slab
+    for (order = 0; order < KMEM_ORDER_MAX; order++) {
+        size_t bytes = PAGE_SIZE << order;
+        size_t per_slab = (bytes - KMEM_SLAB_HDR) / size;
+
+        if (per_slab > 0 && (bytes - KMEM_SLAB_HDR - per_slab * size) * 8 <= bytes) {
+            break;
+        }
+    }
+
+    if ((PAGE_SIZE << order) - KMEM_SLAB_HDR < size) {
+        kernel_log_error("kmalloc: object size %d too large for cache %s", size, name);
+        return NULL;
+    }
+
+    flags = interrupts_save();
+    cache = pool_alloc(&kmem_cache_pool);
+    interrupts_restore(flags);
+
+    if (!cache) {
+        kernel_log_error("kmalloc: unable to allocate cache %s", name);
+        return NULL;
+    }
+
+    kmemset(cache, 0, sizeof(kmem_cache_t));
+    cache->name = name;
+    cache->size = size;
+    cache->order = order;
+    cache->per_slab = ((PAGE_SIZE << order) - KMEM_SLAB_HDR) / size;
+
+    kernel_log_debug("kmalloc: cache %s: size=%d order=%d per_slab=%d",
+                     name, size, order, cache->per_slab);
+
+    return cache;
+}
+
+/**
+ * Allocates an object from the cache
+ * @param cache - pointer to the cache
+ * @return pointer to the object or NULL if no memory is available
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    unsigned int flags;
+    slab_t *slab;
+    void *obj;
+
+    if (!cache) {
+        return NULL;
+    }
+
+    flags = interrupts_save();
+
+    // Fast path: reuse a recently freed object
+    if (cache->magazine_count > 0) {
+        cache->allocs++;
+        obj = cache->magazine[--cache->magazine_count];
+        interrupts_restore(flags);
+        return obj;
+    }
+
+    slab = cache->partial;
+    if (!slab) {
+        if (cache->empty) {
+            slab = cache->empty;
+            slab_list_remove(&cache->empty, slab);
+            cache->empty_count--;
+        } else {
+            slab = slab_create(cache);
+            if (!slab) {
+                interrupts_restore(flags);
+                return NULL;
+            }
+        }
+
+        slab_list_push(&cache->partial, slab);
+    }
+
+    obj = slab->free;
+    slab->free = *(void **)obj;
+    slab->in_use++;
+
+    if (slab->in_use == cache->per_slab) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+
+    cache->allocs++;
+
+    interrupts_restore(flags);
+
+    return obj;
+}
+
+/**
+ * Returns an object to the cache
+ * @param cache - pointer to the cache
+ * @param obj - pointer to the object
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    page_t *page = page_get(obj);
+    slab_t *slab = page ? page->slab : NULL;
+    unsigned int flags;
+
+    if (!cache || !slab || slab->cache != cache) {
+        kernel_log_error("kmalloc: %p does not belong to cache %s",
+                         obj, cache ? cache->name : "(null)");
+        return;
+    }
+
+    flags = interrupts_save();
+
+    cache->frees++;
+
+    // Fast path: keep the object hot in the magazine
+    if (cache->magazine_count < KMEM_MAGAZINE_SIZE) {
+        cache->magazine[cache->magazine_count++] = obj;
+    } else {
+        slab_release(cache, slab, obj);
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Allocates memory from the kernel heap
+ * @param size - number of bytes to allocate
+ * @return pointer to the memory or NULL if no memory is available
+ */
+void *kmalloc(size_t size) {
+    int order = 0;
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < KMALLOC_CLASSES; i++) {
+        if (size <= kmalloc_sizes[i]) {
+            return kmem_cache_alloc(kmalloc_caches[i]);
+        }
+    }
+
+    // Large allocations come straight from the page allocator
+    while ((size_t)(PAGE_SIZE << order) < size) {
+        order++;
+    }
+
+    return page_alloc(order);
+}
+
+/**
+ * Frees memory allocated by kmalloc or kmem_cache_alloc
+ * @param ptr - pointer to the memory
+ */
+void kfree(void *ptr) {
+    page_t *page;
+
+    if (!ptr) {
+        return;
+    }
+
+    page = page_get(ptr);
+    if (!page) {
+        kernel_log_error("kmalloc: invalid free of %p", ptr);
+        return;
+    }
+
+    if (page->slab) {
+        kmem_cache_free(((slab_t *)page->slab)->cache, ptr);
+    } else {
+        page_free(ptr, page->order);
+    }
+}
+
+/**
+ * Initializes the kernel memory allocator and the general purpose
+ * size-class caches
+ */
+void kmalloc_init(void) {
+    kernel_log_info("Initializing kernel memory allocator");
+
+    pool_init(&kmem_cache_pool);
+
+    for (unsigned int i = 0; i < KMALLOC_CLASSES; i++) {
+        kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i], kmalloc_sizes[i]);
+        if (!kmalloc_caches[i]) {
+            kernel_panic("kmalloc: unable to create cache %s", kmalloc_names[i]);
+        }
+    }
+}
+
+/**
+ * Displays the statistics of every cache on the host console
+ */
+void kmalloc_dump(void) {
+    for (int i = pool_next(&kmem_cache_pool, 0); i >= 0; i = pool_next(&kmem_cache_pool, i + 1)) {
+        kmem_cache_t *cache = pool_get(&kmem_cache_pool, i);
+
+        kernel_log_info("kmalloc: %-14s size=%4d slabs=%d allocs=%u frees=%u magazine=%d",
+                        cache->name, cache->size, cache->slabs,
+                        cache->allocs, cache->frees, cache->magazine_count);
+    }
+}
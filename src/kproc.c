@@ -0,0 +1,466 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Process Implementation
+ */
+#include <spede/string.h>
+
+#include "cpu.h"
+#include "elf.h"
+#include "fpu.h"
+#include "gdt.h"
+#include "ipc.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "pool.h"
+#include "scheduler.h"
+#include "stack.h"
+#include "syscall.h"
+#include "timer.h"
+#include "wait.h"
+
+// Process table
+POOL_DEFINE(proc_pool, proc_t, PROC_MAX);
+
+// Next process id to assign
+int next_pid = 0;
+
+/**
+ * Allocates and initializes a process control block
+ * @param name - name of the process
+ * @return pointer to the process or NULL if the table is full
+ */
+static proc_t *kproc_alloc(char *name) {
+    proc_t *proc = pool_alloc(&proc_pool);
+
+    if (!proc) {
+        kernel_log_error("kproc: process table is full");
+        return NULL;
+    }
+
+    kmemset(proc, 0, sizeof(proc_t));
+
+    proc->pid = next_pid++;
+    strncpy(proc->name, name, PROC_NAME_LEN - 1);
+    proc->state = PROC_STATE_NONE;
+    proc->start_time = timer_get_ticks();
+    proc->stack_id = -1;
+    proc->base_priority = PROC_PRIORITY_DEFAULT;
+    proc->priority = PROC_PRIORITY_DEFAULT;
+    proc->inherited_priority = PROC_PRIORITIES;
+    proc->cpu = this_cpu()->id;
+
+    return proc;
+}
+
+/**
+ * Allocates a process with a kernel stack and an empty trap frame at the
+ * top of it (called with interrupts disabled)
+ * @param name - name of the process
+ * @return pointer to the process or NULL on error
+ */
+static proc_t *kproc_new(char *name) {
+    stack_info_t *stack;
+    proc_t *proc;
+
+    proc = kproc_alloc(name);
+    if (!proc) {
+        return NULL;
+    }
+
+    proc->stack_id = stack_alloc(proc->name, PROC_STACK_SIZE);
+    if (proc->stack_id < 0) {
+        pool_free(&proc_pool, proc);
+        return NULL;
+    }
+
+    // Traps from user mode push their frame at the very top of the stack,
+    // so that is where a process's first frame goes too
+    stack = stack_get(proc->stack_id);
+    proc->kstack_top = stack->base + stack->size;
+    proc->frame = (trap_frame_t *)proc->kstack_top - 1;
+    kmemset(proc->frame, 0, sizeof(trap_frame_t));
+
+    return proc;
+}
+
+/**
+ * Frees a process and everything it owns (called with interrupts
+ * disabled)
+ * @param proc - pointer to the process
+ */
+static void kproc_free(proc_t *proc) {
+    if (proc->space) {
+        vm_space_destroy(proc->space);
+    }
+
+    fpu_release(proc);
+
+    if (proc->stack_id >= 0) {
+        stack_free(proc->stack_id);
+    }
+
+    pool_free(&proc_pool, proc);
+}
+
+/**
+ * First code run by every kernel thread: runs the entry point and
+ * terminates the thread if it returns
+ */
+static void kproc_entry(void) {
+    active_proc->entry();
+    kproc_exit();
+}
+
+/**
+ * General protection fault handler: terminates a user process that
+ * faults (a fault in the kernel is fatal)
+ */
+static void kproc_gpf_handler(void) {
+    trap_frame_t *frame = interrupts_get_frame();
+
+    if (!trap_from_user(frame)) {
+        kernel_panic("kproc: general protection fault (eip=0x%08x error=0x%x)",
+                     frame->eip, frame->error);
+        return;
+    }
+
+    kernel_log_error("kproc: process %d (%s) terminated: general protection fault at 0x%08x",
+                     active_proc->pid, active_proc->name, frame->eip);
+    kproc_destroy(active_proc);
+}
+
+/**
+ * Initializes process management; the code that is currently running
+ * becomes the idle process
+ */
+void kproc_init(void) {
+    kernel_log_info("Initializing process management");
+
+    pool_init(&proc_pool);
+    next_pid = 0;
+
+    // The idle process runs on the boot stack and its trap frame is saved
+    // the first time it is interrupted
+    idle_proc = kproc_alloc("idle");
+    if (!idle_proc) {
+        kernel_panic("kproc: unable to create the idle process");
+        return;
+    }
+
+    idle_proc->state = PROC_STATE_RUNNING;
+    active_proc = idle_proc;
+
+    interrupts_irq_register(IRQ_GPF, isr_entry_gpf, kproc_gpf_handler);
+}
+
+/**
+ * Makes the code running on an application processor its idle process
+ * @param stack_id - stack the code is running on
+ */
+void kproc_init_cpu(int stack_id) {
+    proc_t *proc = kproc_alloc("idle");
+
+    if (!proc) {
+        kernel_panic("kproc: unable to create the idle process for CPU %d", this_cpu()->id);
+        return;
+    }
+
+    proc->stack_id = stack_id;
+    proc->state = PROC_STATE_RUNNING;
+
+    idle_proc = proc;
+    active_proc = proc;
+}
+
+/**
+ * Creates a kernel thread and makes it ready to run
+ * @param entry - function the thread runs
+ * @param name - name of the thread
+ * @return process id or -1 on error
+ */
+int kproc_create(void (*entry)(void), char *name) {
+    unsigned int flags;
+    trap_frame_t *frame;
+    proc_t *proc;
+
+    if (!entry || !name) {
+        return -1;
+    }
+
+    // The process table and allocators are shared with interrupt handlers
+    flags = interrupts_save();
+
+    proc = kproc_new(name);
+    if (!proc) {
+        interrupts_restore(flags);
+        return -1;
+    }
+
+    proc->entry = entry;
+
+    // The first switch to the thread "returns" to its entry point with
+    // interrupts enabled
+    frame = proc->frame;
+    frame->eip = (unsigned int)kproc_entry;
+    frame->cs = GDT_KERNEL_CS;
+    frame->ds = GDT_KERNEL_DS;
+    frame->es = GDT_KERNEL_DS;
+    frame->fs = GDT_PERCPU;
+    frame->gs = GDT_KERNEL_DS;
+    frame->eflags = EFLAGS_RESERVED | EFLAGS_IF;
+
+    kernel_log_debug("kproc: created process %d (%s)", proc->pid, proc->name);
+
+    scheduler_add(proc);
+
+    interrupts_restore(flags);
+
+    return proc->pid;
+}
+
+/**
+ * Creates a user process that starts at the given address
+ * @param space - address space of the process (owned by the process
+ *                once created)
+ * @param entry - user mode entry point
+ * @param name - name of the process
+ * @return process id or -1 on error
+ */
+int kproc_create_user(vm_space_t *space, unsigned int entry, char *name) {
+    unsigned int flags;
+    trap_frame_t *frame;
+    proc_t *proc;
+
+    if (!space || !name) {
+        return -1;
+    }
+
+    flags = interrupts_save();
+
+    proc = kproc_new(name);
+    if (!proc) {
+        interrupts_restore(flags);
+        return -1;
+    }
+
+    proc->space = space;
+
+    // The first switch to the process drops to user mode at its entry
+    // point; EAX tells it which system call entry to use
+    frame = proc->frame;
+    frame->eip = entry;
+    frame->cs = GDT_USER_CS;
+    frame->ds = GDT_USER_DS;
+    frame->es = GDT_USER_DS;
+    frame->fs = GDT_USER_DS;
+    frame->gs = GDT_USER_DS;
+    frame->eflags = EFLAGS_RESERVED | EFLAGS_IF;
+    frame->user_esp = VM_STACK_TOP;
+    frame->user_ss = GDT_USER_DS;
+    frame->eax = syscall_entry_method();
+
+    kernel_log_debug("kproc: created user process %d (%s)", proc->pid, proc->name);
+
+    scheduler_add(proc);
+
+    interrupts_restore(flags);
+
+    return proc->pid;
+}
+
+/**
+ * Creates a user process from an ELF executable
+ * @param image - pointer to the ELF image (must remain in memory)
+ * @param size - size of the image in bytes
+ * @param name - name of the process
+ * @return process id or -1 on error
+ */
+int kproc_create_elf(char *image, size_t size, char *name) {
+    vm_space_t *space = vm_space_create();
+    unsigned int entry;
+    int pid;
+
+    if (!space) {
+        return -1;
+    }
+
+    if (elf_load(space, image, size, &entry) != 0) {
+        vm_space_destroy(space);
+        return -1;
+    }
+
+    pid = kproc_create_user(space, entry, name);
+    if (pid < 0) {
+        vm_space_destroy(space);
+    }
+
+    return pid;
+}
+
+/**
+ * Duplicates the running user process
+ *
+ * The child shares the parent's pages copy-on-write and resumes from a
+ * copy of the parent's trap frame, returning 0 from the system call.
+ *
+ * @param frame - trap frame of the system call made by the parent
+ * @return process id of the child or -1 on error
+ */
+int kproc_fork(trap_frame_t *frame) {
+    proc_t *parent = active_proc;
+    unsigned int flags;
+    proc_t *child;
+
+    // Kernel threads share the kernel stack layout and cannot be copied
+    if (!parent->space || !trap_from_user(frame)) {
+        return -1;
+    }
+
+    flags = interrupts_save();
+
+    child = kproc_new(parent->name);
+    if (!child) {
+        interrupts_restore(flags);
+        return -1;
+    }
+
+    child->space = vm_space_fork(parent->space);
+    if (!child->space || fpu_fork(parent, child) != 0) {
+        kernel_log_error("kproc: unable to fork process %d", parent->pid);
+        kproc_free(child);
+        interrupts_restore(flags);
+        return -1;
+    }
+
+    kmemcpy(child->frame, frame, sizeof(trap_frame_t));
+    child->frame->eax = 0;
+
+    child->base_priority = parent->base_priority;
+    child->priority = parent->priority;
+
+    kernel_log_debug("kproc: forked process %d from %d", child->pid, parent->pid);
+
+    scheduler_add(child);
+
+    interrupts_restore(flags);
+
+    return child->pid;
+}
+
+/**
+ * Destroys a process
+ * @param proc - pointer to the process
+ * @return -1 on error; 0 on success
+ */
+int kproc_destroy(proc_t *proc) {
+    unsigned int flags;
+
+    if (!proc || kproc_is_idle(proc)) {
+        return -1;
+    }
+
+    flags = interrupts_save();
+
+    // A running process is still using its stack (possibly on another
+    // CPU, which frees it once it switches away)
+    if (cpu_table[proc->cpu].current == proc) {
+        proc->state = PROC_STATE_EXITED;
+
+        if (proc == active_proc) {
+            scheduler_resched();
+        } else {
+            scheduler_resched_cpu(proc->cpu);
+        }
+
+        interrupts_restore(flags);
+        return 0;
+    }
+
+    scheduler_remove(proc);
+    wait_remove(proc);
+    ipc_proc_exit(proc);
+
+    kernel_log_debug("kproc: destroyed process %d (%s)", proc->pid, proc->name);
+
+    kproc_free(proc);
+
+    interrupts_restore(flags);
+
+    return 0;
+}
+
+/**
+ * Terminates the running process
+ */
+void kproc_exit(void) {
+    kproc_destroy(active_proc);
+
+    // Switch away; an exited process is never resumed
+    scheduler_yield();
+
+    kernel_panic("kproc: exited process %d resumed", active_proc->pid);
+}
+
+/**
+ * Runs the idle process: halts the CPU until there is work to do
+ */
+void kproc_idle(void) {
+    bool mwait = cpu_has(CPU_FEATURE_MWAIT);
+
+    // Every wakeup arrives as an interrupt, and the scheduler switches
+    // away from the idle process when that interrupt returns
+    while (1) {
+        if (mwait) {
+            cpu_monitor(&active_proc);
+            cpu_mwait(0);
+        } else {
+            cpu_halt();
+        }
+    }
+}
+
+/**
+ * Obtains the process with the given id
+ * @param pid - process id
+ * @return pointer to the process or NULL if it does not exist
+ */
+proc_t *pid_to_proc(int pid) {
+    for (int i = pool_next(&proc_pool, 0); i >= 0; i = pool_next(&proc_pool, i + 1)) {
+        proc_t *proc = pool_get(&proc_pool, i);
+
+        if (proc->pid == pid) {
+            return proc;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Returns the running process
+ * @return pointer to the process
+ */
+proc_t *kproc_current(void) {
+    return active_proc;
+}
+
+/**
+ * Dumps the process table
+ */
+void kproc_dump(void) {
+    static char *states[] = { "none", "ready", "running", "waiting", "exited" };
+
+    kernel_log_info("kproc: %4s %-16s %-8s %4s %3s %8s %8s", "pid", "name", "state", "prio", "cpu",
+                    "start", "time");
+
+    for (int i = pool_next(&proc_pool, 0); i >= 0; i = pool_next(&proc_pool, i + 1)) {
+        proc_t *proc = pool_get(&proc_pool, i);
+
+        kernel_log_info("kproc: %4d %-16s %-8s %4d %3d %8d %8d", proc->pid, proc->name,
+                        states[proc->state], proc->priority, proc->cpu, proc->start_time,
+                        proc->cpu_time);
+    }
+}
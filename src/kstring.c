@@ -0,0 +1,647 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Memory Copy/Fill Implementation
+ */
+#include <spede/string.h>
+
+#include "cpu.h"
+#include "fpu.h"
+#include "kernel.h"
+#include "kstring.h"
+#include "page.h"
+
+// Replicates a byte into each byte of a 32-bit value
+#define KSTRING_BYTES(c)    ((unsigned int)(unsigned char)(c) * 0x01010101U)
+
+/*
+ * String instruction (rep movsd/stosd) implementation
+ */
+
+/**
+ * Copies memory forward a dword at a time
+ */
+static void *kstring_movsd_memcpy(void *dst, const void *src, size_t n) {
+    void *d = dst;
+    size_t words = n >> 2;
+
+    asm volatile("rep movsl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsb"
+                 : "+D"(d), "+S"(src), "+c"(words)
+                 : "r"(n & 3)
+                 : "memory");
+
+    return dst;
+}
+
+/**
+ * Copies memory backward a dword at a time (for overlapping moves)
+ */
+static void *kstring_movsd_memcpy_backward(void *dst, const void *src, size_t n) {
+    void *d = (char *)dst + n - 1;
+    const void *s = (const char *)src + n - 1;
+    size_t bytes = n & 3;
+
+    // The odd bytes at the end are copied first, then the dwords
+    asm volatile("std\n\t"
+                 "rep movsb\n\t"
+                 "sub $3, %%esi\n\t"
+                 "sub $3, %%edi\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsl\n\t"
+                 "cld"
+                 : "+D"(d), "+S"(s), "+c"(bytes)
+                 : "r"(n >> 2)
+                 : "memory");
+
+    return dst;
+}
+
+/**
+ * Copies possibly overlapping memory a dword at a time
+ */
+static void *kstring_movsd_memmove(void *dst, const void *src, size_t n) {
+    if ((char *)dst <= (const char *)src || (char *)dst >= (const char *)src + n) {
+        return kstring_movsd_memcpy(dst, src, n);
+    }
+
+    return kstring_movsd_memcpy_backward(dst, src, n);
+}
+
+/**
+ * Fills memory a dword at a time
+ */
+static void *kstring_movsd_memset(void *dst, int c, size_t n) {
+    void *d = dst;
+    size_t words = n >> 2;
+
+    asm volatile("rep stosl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep stosb"
+                 : "+D"(d), "+c"(words)
+                 : "a"(KSTRING_BYTES(c)), "r"(n & 3)
+                 : "memory");
+
+    return dst;
+}
+
+/**
+ * Fills memory with 16-bit values, a dword (two values) at a time
+ */
+static void *kstring_movsd_memset16(void *dst, unsigned short val, size_t count) {
+    unsigned short *d = dst;
+    size_t words;
+
+    if (count == 0) {
+        return dst;
+    }
+
+    // Align to a dword boundary
+    if ((unsigned int)d & 2) {
+        *d++ = val;
+        count--;
+    }
+
+    words = count >> 1;
+
+    asm volatile("rep stosl"
+                 : "+D"(d), "+c"(words)
+                 : "a"(val | ((unsigned int)val << 16))
+                 : "memory");
+
+    if (count & 1) {
+        *d = val;
+    }
+
+    return dst;
+}
+
+/**
+ * Fills memory with 32-bit values
+ */
+static void *kstring_movsd_memset32(void *dst, unsigned int val, size_t count) {
+    void *d = dst;
+
+    asm volatile("rep stosl"
+                 : "+D"(d), "+c"(count)
+                 : "a"(val)
+                 : "memory");
+
+    return dst;
+}
+
+/*
+ * Enhanced rep movsb/stosb (ERMS) implementation
+ *
+ * The microcode picks the best copy strategy itself, so byte string
+ * instructions are as fast as (or faster than) dword ones at any size.
+ */
+
+/**
+ * Copies memory with rep movsb
+ */
+static void *kstring_erms_memcpy(void *dst, const void *src, size_t n) {
+    void *d = dst;
+
+    asm volatile("rep movsb"
+                 : "+D"(d), "+S"(src), "+c"(n)
+                 :
+                 : "memory");
+
+    return dst;
+}
+
+/**
+ * Copies possibly overlapping memory with rep movsb
+ */
+static void *kstring_erms_memmove(void *dst, const void *src, size_t n) {
+    if ((char *)dst <= (const char *)src || (char *)dst >= (const char *)src + n) {
+        return kstring_erms_memcpy(dst, src, n);
+    }
+
+    // Backward string copies are not enhanced
+    return kstring_movsd_memcpy_backward(dst, src, n);
+}
+
+/**
+ * Fills memory with rep stosb
+ */
+static void *kstring_erms_memset(void *dst, int c, size_t n) {
+    void *d = dst;
+
+    asm volatile("rep stosb"
+                 : "+D"(d), "+c"(n)
+                 : "a"(c)
+                 : "memory");
+
+    return dst;
+}
+
+/*
+ * SSE2 implementation
+ *
+ * Copies and fills 64 bytes per iteration with aligned 16-byte stores,
+ * switching to non-temporal stores for sizes that would only evict the
+ * rest of the cache.
+ *
+ * The kernel is built without SSE code generation, so the compiler never
+ * keeps values in the XMM registers used here (and they cannot be listed
+ * as clobbers). The registers may hold a process's state, so each use is
+ * bracketed by fpu_kernel_begin/fpu_kernel_end.
+ */
+
+/**
+ * Copies 64-byte blocks to a 16-byte aligned destination
+ * @param dst - destination (16-byte aligned)
+ * @param src - source
+ * @param blocks - number of 64-byte blocks
+ */
+static void kstring_sse2_copy_blocks(char *dst, const char *src, size_t blocks) {
+    unsigned int flags;
+
+    if (blocks == 0) {
+        return;
+    }
+
+    flags = fpu_kernel_begin();
+
+    if (blocks * 64 >= KSTRING_NT_MIN) {
+        asm volatile("1:\n\t"
+                     "movdqu (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movntdq %%xmm0, (%0)\n\t"
+                     "movntdq %%xmm1, 16(%0)\n\t"
+                     "movntdq %%xmm2, 32(%0)\n\t"
+                     "movntdq %%xmm3, 48(%0)\n\t"
+                     "add $64, %1\n\t"
+                     "add $64, %0\n\t"
+                     "dec %2\n\t"
+                     "jnz 1b\n\t"
+                     "sfence"
+                     : "+r"(dst), "+r"(src), "+r"(blocks)
+                     :
+                     : "memory");
+    } else {
+        asm volatile("1:\n\t"
+                     "movdqu (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movdqa %%xmm0, (%0)\n\t"
+                     "movdqa %%xmm1, 16(%0)\n\t"
+                     "movdqa %%xmm2, 32(%0)\n\t"
+                     "movdqa %%xmm3, 48(%0)\n\t"
+                     "add $64, %1\n\t"
+                     "add $64, %0\n\t"
+                     "dec %2\n\t"
+                     "jnz 1b"
+                     : "+r"(dst), "+r"(src), "+r"(blocks)
+                     :
+                     : "memory");
+    }
+
+    fpu_kernel_end(flags);
+}
+
+/**
+ * Fills 64-byte blocks at a 16-byte aligned destination
+ * @param dst - destination (16-byte aligned)
+ * @param pattern - 32-bit pattern to replicate
+ * @param blocks - number of 64-byte blocks
+ */
+static void kstring_sse2_fill_blocks(char *dst, unsigned int pattern, size_t blocks) {
+    unsigned int flags;
+
+    if (blocks == 0) {
+        return;
+    }
+
+    flags = fpu_kernel_begin();
+
+    if (blocks * 64 >= KSTRING_NT_MIN) {
+        asm volatile("movd %2, %%xmm0\n\t"
+                     "pshufd $0, %%xmm0, %%xmm0\n\t"
+                     "1:\n\t"
+                     "movntdq %%xmm0, (%0)\n\t"
+                     "movntdq %%xmm0, 16(%0)\n\t"
+                     "movntdq %%xmm0, 32(%0)\n\t"
+                     "movntdq %%xmm0, 48(%0)\n\t"
+                     "add $64, %0\n\t"
+                     "dec %1\n\t"
+                     "jnz 1b\n\t"
+                     "sfence"
+                     : "+r"(dst), "+r"(blocks)
+                     : "r"(pattern)
+                     : "memory");
+    } else {
+        asm volatile("movd %2, %%xmm0\n\t"
+                     "pshufd $0, %%xmm0, %%xmm0\n\t"
+                     "1:\n\t"
+                     "movdqa %%xmm0, (%0)\n\t"
+                     "movdqa %%xmm0, 16(%0)\n\t"
+                     "movdqa %%xmm0, 32(%0)\n\t"
+                     "movdqa %%xmm0, 48(%0)\n\t"
+                     "add $64, %0\n\t"
+                     "dec %1\n\t"
+                     "jnz 1b"
+                     : "+r"(dst), "+r"(blocks)
+                     : "r"(pattern)
+                     : "memory");
+    }
+
+    fpu_kernel_end(flags);
+}
+
+/**
+ * Copies memory with SSE2
+ */
+static void *kstring_sse2_memcpy(void *dst, const void *src, size_t n) {
+    char *d = dst;
+    const char *s = src;
+    size_t head;
+    size_t blocks;
+
+    if (n < KSTRING_SSE2_MIN) {
+        return kstring_movsd_memcpy(dst, src, n);
+    }
+
+    // Align the destination so that the stores are aligned
+    head = -(unsigned int)d & 15;
+    kstring_movsd_memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    blocks = n >> 6;
+    kstring_sse2_copy_blocks(d, s, blocks);
+    d += blocks << 6;
+    s += blocks << 6;
+
+    kstring_movsd_memcpy(d, s, n & 63);
+
+    return dst;
+}
+
+/**
+ * Copies possibly overlapping memory with SSE2
+ */
+static void *kstring_sse2_memmove(void *dst, const void *src, size_t n) {
+    // Each block is loaded before it is stored, so a forward copy is safe
+    // whenever the destination is below the source
+    if ((char *)dst <= (const char *)src || (char *)dst >= (const char *)src + n) {
+        return kstring_sse2_memcpy(dst, src, n);
+    }
+
+    return kstring_movsd_memcpy_backward(dst, src, n);
+}
+
+/**
+ * Fills memory with SSE2
+ */
+static void *kstring_sse2_memset(void *dst, int c, size_t n) {
+    char *d = dst;
+    size_t head;
+    size_t blocks;
+
+    if (n < KSTRING_SSE2_MIN) {
+        return kstring_movsd_memset(dst, c, n);
+    }
+
+    head = -(unsigned int)d & 15;
+    kstring_movsd_memset(d, c, head);
+    d += head;
+    n -= head;
+
+    blocks = n >> 6;
+    kstring_sse2_fill_blocks(d, KSTRING_BYTES(c), blocks);
+    d += blocks << 6;
+
+    kstring_movsd_memset(d, c, n & 63);
+
+    return dst;
+}
+
+/**
+ * Fills memory with 16-bit values with SSE2
+ */
+static void *kstring_sse2_memset16(void *dst, unsigned short val, size_t count) {
+    unsigned short *d = dst;
+    size_t blocks;
+
+    if (count * 2 < KSTRING_SSE2_MIN) {
+        return kstring_movsd_memset16(dst, val, count);
+    }
+
+    // Align to 16 bytes one value at a time
+    while ((unsigned int)d & 15) {
+        *d++ = val;
+        count--;
+    }
+
+    blocks = count >> 5;
+    kstring_sse2_fill_blocks((char *)d, val | ((unsigned int)val << 16), blocks);
+    d += blocks << 5;
+
+    kstring_movsd_memset16(d, val, count & 31);
+
+    return dst;
+}
+
+/**
+ * Fills memory with 32-bit values with SSE2
+ */
+static void *kstring_sse2_memset32(void *dst, unsigned int val, size_t count) {
+    unsigned int *d = dst;
+    size_t blocks;
+
+    if (count * 4 < KSTRING_SSE2_MIN) {
+        return kstring_movsd_memset32(dst, val, count);
+    }
+
+    while ((unsigned int)d & 15) {
+        *d++ = val;
+        count--;
+    }
+
+    blocks = count >> 4;
+    kstring_sse2_fill_blocks((char *)d, val, blocks);
+    d += blocks << 4;
+
+    kstring_movsd_memset32(d, val, count & 15);
+
+    return dst;
+}
+
+/*
+ * SPEDE library implementation (benchmark baseline)
+ */
+
+/**
+ * Copies memory with the SPEDE library
+ */
+static void *kstring_spede_memcpy(void *dst, const void *src, size_t n) {
+    return memcpy(dst, src, n);
+}
+
+/**
+ * Copies possibly overlapping memory with the SPEDE library
+ */
+static void *kstring_spede_memmove(void *dst, const void *src, size_t n) {
+    return memmove(dst, src, n);
+}
+
+/**
+ * Fills memory with the SPEDE library
+ */
+static void *kstring_spede_memset(void *dst, int c, size_t n) {
+    return memset(dst, c, n);
+}
+
+/**
+ * Fills memory with 16-bit values one at a time
+ */
+static void *kstring_spede_memset16(void *dst, unsigned short val, size_t count) {
+    volatile unsigned short *d = dst;
+
+    for (size_t i = 0; i < count; i++) {
+        d[i] = val;
+    }
+
+    return dst;
+}
+
+/**
+ * Fills memory with 32-bit values one at a time
+ */
+static void *kstring_spede_memset32(void *dst, unsigned int val, size_t count) {
+    volatile unsigned int *d = dst;
+
+    for (size_t i = 0; i < count; i++) {
+        d[i] = val;
+    }
+
+    return dst;
+}
+
+// Available implementations, from the least to the most preferred
+kstring_impl_t kstring_impls[] = {
+    {
+        .name = "spede",
+        .supported = true,
+        .memcpy = kstring_spede_memcpy,
+        .memmove = kstring_spede_memmove,
+        .memset = kstring_spede_memset,
+        .memset16 = kstring_spede_memset16,
+        .memset32 = kstring_spede_memset32,
+    },
+    {
+        .name = "movsd",
+        .supported = true,
+        .memcpy = kstring_movsd_memcpy,
+        .memmove = kstring_movsd_memmove,
+        .memset = kstring_movsd_memset,
+        .memset16 = kstring_movsd_memset16,
+        .memset32 = kstring_movsd_memset32,
+    },
+    {
+        .name = "sse2",
+        .supported = false,
+        .memcpy = kstring_sse2_memcpy,
+        .memmove = kstring_sse2_memmove,
+        .memset = kstring_sse2_memset,
+        .memset16 = kstring_sse2_memset16,
+        .memset32 = kstring_sse2_memset32,
+    },
+    {
+        .name = "erms",
+        .supported = false,
+        .memcpy = kstring_erms_memcpy,
+        .memmove = kstring_erms_memmove,
+        .memset = kstring_erms_memset,
+        .memset16 = kstring_movsd_memset16,
+        .memset32 = kstring_movsd_memset32,
+    },
+};
+
+#define KSTRING_IMPL_SPEDE  0
+#define KSTRING_IMPL_MOVSD  1
+#define KSTRING_IMPL_SSE2   2
+#define KSTRING_IMPL_ERMS   3
+#define KSTRING_IMPL_COUNT  (sizeof(kstring_impls) / sizeof(kstring_impls[0]))
+
+// Implementation currently in use
+kstring_impl_t *kstring_impl = &kstring_impls[KSTRING_IMPL_MOVSD];
+
+/**
+ * Detects the supported implementations and selects the fastest
+ */
+void kstring_init(void) {
+    kernel_log_info("Initializing memory routines");
+
+    // SSE instructions fault until the OS declares it saves SSE state
+    if (cpu_has(CPU_FEATURE_SSE2) && cpu_has(CPU_FEATURE_FXSR)) {
+        cpu_set_cr0((cpu_get_cr0() & ~CR0_EM) | CR0_MP);
+        cpu_set_cr4(cpu_get_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+        kstring_impls[KSTRING_IMPL_SSE2].supported = true;
+    }
+
+    kstring_impls[KSTRING_IMPL_ERMS].supported = cpu_has(CPU_FEATURE_ERMS);
+
+    for (int i = KSTRING_IMPL_COUNT - 1; i >= 0; i--) {
+        if (kstring_impls[i].supported) {
+            kstring_impl = &kstring_impls[i];
+            break;
+        }
+    }
+
+    kernel_log_info("kstring: using %s", kstring_impl->name);
+}
+
+/**
+ * Measures the number of cycles taken to run a routine over a buffer
+ * repeatedly
+ * @param impl - implementation to measure
+ * @param op - 0 for memcpy, 1 for memset
+ * @param dst - destination buffer
+ * @param src - source buffer
+ * @param size - size of each operation
+ * @param reps - number of repetitions
+ * @return number of cycles (saturated to 32 bits)
+ */
+static unsigned int kstring_measure(kstring_impl_t *impl, int op, char *dst, char *src,
+                                    size_t size, int reps) {
+    unsigned long long start = cpu_rdtsc();
+
+    for (int i = 0; i < reps; i++) {
+        if (op == 0) {
+            impl->memcpy(dst, src, size);
+        } else {
+            impl->memset(dst, i, size);
+        }
+    }
+
+    start = cpu_rdtsc() - start;
+
+    // The results are only ever divided in 32 bits (libgcc's 64-bit
+    // division is not linked into the kernel)
+    return start > 0xFFFFFFFFULL ? 0xFFFFFFFF : (unsigned int)start;
+}
+
+/**
+ * Measures the throughput of every supported implementation for a range
+ * of sizes and logs it relative to the SPEDE library routines
+ */
+void kstring_benchmark(void) {
+    static const size_t sizes[] = { 64, 512, 4096, 65536 };
+    static char *ops[] = { "memcpy", "memset" };
+    char *dst = page_alloc(4);
+    char *src = page_alloc(4);
+
+    if (!dst || !src) {
+        kernel_log_error("kstring: unable to allocate benchmark buffers");
+        goto out;
+    }
+
+    kmemset(src, 0x5a, 65536);
+
+    kernel_log_info("kstring: %-6s %-6s %6s %12s %8s", "op", "impl", "size", "bytes/kcyc", "speedup");
+
+    for (int op = 0; op < 2; op++) {
+        for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            // Move about 1MB per measurement
+            int reps = (1024 * 1024) / sizes[s];
+            unsigned int base = 0;
+
+            for (unsigned int i = 0; i < KSTRING_IMPL_COUNT; i++) {
+                kstring_impl_t *impl = &kstring_impls[i];
+                unsigned int cycles;
+                unsigned int scaled_base;
+                unsigned int scaled_cycles;
+                unsigned int speedup;
+
+                if (!impl->supported) {
+                    continue;
+                }
+
+                // Warm up the caches, then measure
+                kstring_measure(impl, op, dst, src, sizes[s], 1);
+                cycles = kstring_measure(impl, op, dst, src, sizes[s], reps);
+                if (cycles == 0) {
+                    cycles = 1;
+                }
+
+                if (i == KSTRING_IMPL_SPEDE) {
+                    base = cycles;
+                }
+
+                // Scale down until base * 100 fits in 32 bits
+                scaled_base = base;
+                scaled_cycles = cycles;
+                while (scaled_base > 0xFFFFFF) {
+                    scaled_base >>= 1;
+                    scaled_cycles >>= 1;
+                }
+
+                speedup = scaled_cycles ? scaled_base * 100 / scaled_cycles : 0;
+
+                // reps * size is about 1MB, so the product fits in 32 bits
+                kernel_log_info("kstring: %-6s %-6s %6d %12u %5u.%02ux", ops[op], impl->name,
+                                sizes[s], (unsigned int)(reps * sizes[s]) * 1000 / cycles,
+                                speedup / 100, speedup % 100);
+            }
+        }
+    }
+
+out:
+    if (dst) {
+        page_free(dst, 4);
+    }
+
+    if (src) {
+        page_free(src, 4);
+    }
+}
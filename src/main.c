@@ -5,25 +5,85 @@
  * Operating system entry point
  */
 
+#include "bit.h"
+#include "cpu.h"
+#include "cpustat.h"
+#include "fiber.h"
+#include "fpu.h"
+#include "gdt.h"
 #include "interrupts.h"
+#include "ipc.h"
 #include "kernel.h"
 #include "keyboard.h"
+#include "kmalloc.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "page.h"
+#include "paging.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "stack.h"
+#include "syscall.h"
+#include "task.h"
 #include "timer.h"
 #include "tty.h"
 #include "vga.h"
+#include "vm.h"
+#include "wait.h"
+#include "workqueue.h"
 
 #include "test.h"
 
-int main(void) {
+/**
+ * Initializes the operating system and runs it (on the boot stack)
+ */
+static void main_boot(void) {
     // Always iniialize the kernel
     kernel_init();
 
+    // Initialize stack tracking
+    stack_init();
+
+    // Detect the CPU features
+    cpu_init();
+
+    // Initialize the bit utilities
+    bit_init();
+
+    // Set up the boot CPU's per-CPU data
+    smp_init_bsp();
+
+    // Install the kernel's segments and TSS (the per-CPU data is reached
+    // through them, and the memory routines depend on it)
+    gdt_init();
+
+    // Select the memory copy/fill routines
+    kstring_init();
+
     // Initialize interrupts
     interrupts_init();
 
+    // Initialize lazy FPU/SSE state switching
+    fpu_init();
+
+    // Initialize the physical page allocator
+    page_init();
+
+    // Initialize the kernel memory allocator
+    kmalloc_init();
+
+    // Enable paging
+    paging_init();
+
+    // Initialize virtual memory (page fault handling)
+    vm_init();
+
     // Initialize timers
     timer_init();
 
+    // Initialize wait queues and sleeping
+    wait_init();
+
     // Initialize the TTY
     tty_init();
 
@@ -33,6 +93,33 @@ int main(void) {
     // Initialize the keyboard driver
     keyboard_init();
 
+    // Initialize process management (this becomes the idle process)
+    kproc_init();
+
+    // Initialize the scheduler
+    scheduler_init();
+
+    // Initialize system calls
+    syscall_init();
+
+    // Initialize message passing
+    ipc_init();
+
+    // Initialize CPU utilization accounting
+    cpustat_init();
+
+    // Initialize work queues (starts the system worker)
+    workqueue_init();
+
+    // Initialize fibers
+    fiber_init();
+
+    // Start the application processors
+    smp_init();
+
+    // Initialize the task pool (starts a worker for each CPU)
+    task_init();
+
     // Test initialization
     test_init();
 
@@ -46,11 +133,20 @@ int main(void) {
     // Clear the screen
     vga_clear();
 
+    // Let the application processors run processes
+    smp_start();
+
     // Enable interrupts
     interrupts_enable();
 
-    // Loop in place forever
-    while (1);
+    // Become the idle process, halting whenever there is nothing to run
+    kproc_idle();
+}
+
+int main(void) {
+    // Run on a stack that the kernel owns so that its usage can be measured
+    stack_paint(stack_boot, sizeof(stack_boot));
+    stack_call(stack_boot + sizeof(stack_boot), main_boot);
 
     // Should never get here!
     return 0;
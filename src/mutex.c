@@ -0,0 +1,395 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Mutex, Semaphore and Condition Variable Implementation
+ */
+#include "cpu.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "mutex.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "wait.h"
+
+/**
+ * Returns the process that owns a mutex
+ * @param mutex - pointer to the mutex
+ * @return pointer to the process or NULL if the mutex is free
+ */
+static inline proc_t *mutex_owner(mutex_t *mutex) {
+    return (proc_t *)(mutex->owner & ~MUTEX_WAITERS);
+}
+
+/**
+ * Tests if a process is running on another CPU (and so is likely to
+ * release what it holds soon)
+ * @param proc - pointer to the process
+ * @return true if running elsewhere
+ */
+static bool mutex_owner_running(proc_t *proc) {
+    int cpu = proc->cpu;
+
+    return cpu != this_cpu()->id && cpu_table[cpu].current == proc;
+}
+
+/**
+ * Returns the highest priority process waiting for a mutex (the first
+ * to arrive among equals)
+ * @param mutex - pointer to the mutex
+ * @return pointer to the process or NULL if there are no waiters
+ */
+static proc_t *mutex_top_waiter(mutex_t *mutex) {
+    proc_t *top = mutex->waiters.head;
+
+    for (proc_t *proc = top; proc; proc = proc->wait_next) {
+        if (proc->priority < top->priority) {
+            top = proc;
+        }
+    }
+
+    return top;
+}
+
+/**
+ * Removes a mutex from the list of contended mutexes a process holds
+ * @param proc - pointer to the process
+ * @param mutex - pointer to the mutex
+ */
+static void mutex_held_remove(proc_t *proc, mutex_t *mutex) {
+    mutex_t **link = &proc->mutexes;
+
+    while (*link && *link != mutex) {
+        link = &(*link)->next;
+    }
+
+    if (*link) {
+        *link = mutex->next;
+    }
+
+    mutex->next = NULL;
+}
+
+/**
+ * Recomputes the priority a process inherits from the waiters of the
+ * mutexes it holds (called with interrupts disabled)
+ * @param proc - pointer to the process
+ */
+static void mutex_inherit(proc_t *proc) {
+    int priority = PROC_PRIORITIES;
+
+    for (mutex_t *mutex = proc->mutexes; mutex; mutex = mutex->next) {
+        proc_t *top = mutex_top_waiter(mutex);
+
+        if (top && top->priority < priority) {
+            priority = top->priority;
+        }
+    }
+
+    scheduler_inherit_priority(proc, priority);
+}
+
+/**
+ * Lends a waiter's priority to the owner of a mutex, and on along the
+ * chain of mutexes that owner waits for (called with interrupts disabled)
+ * @param mutex - pointer to the mutex
+ * @param priority - priority of the waiter
+ */
+static void mutex_boost(mutex_t *mutex, int priority) {
+    for (int depth = 0; mutex && depth < MUTEX_CHAIN_MAX; depth++) {
+        proc_t *owner = mutex_owner(mutex);
+
+        if (!owner || owner->priority <= priority) {
+            break;
+        }
+
+        scheduler_inherit_priority(owner, priority);
+        mutex = owner->mutex_wait;
+    }
+}
+
+/**
+ * Waits for a mutex that was found held: spins while the owner runs on
+ * another CPU, then sleeps until the mutex is handed over
+ * @param mutex - pointer to the mutex
+ */
+static void mutex_lock_slow(mutex_t *mutex) {
+    proc_t *proc = active_proc;
+    unsigned int self = (unsigned int)proc;
+    unsigned int flags;
+    unsigned int owner;
+
+    if (mutex_owner(mutex) == proc) {
+        kernel_panic("mutex: process %d locked %s twice", proc->pid, mutex->name);
+        return;
+    }
+
+    // Sleeping waiters are handed the mutex before any spinner could
+    // take it, so only spin while nobody is queued
+    for (int i = 0; i < MUTEX_SPIN_MAX && smp_nr_cpus > 1; i++) {
+        owner = mutex->owner;
+
+        if (!owner) {
+            if (cpu_cmpxchg(&mutex->owner, 0, self) == 0) {
+                mutex->contended++;
+                mutex->spun++;
+                return;
+            }
+            continue;
+        }
+
+        if ((owner & MUTEX_WAITERS) || !mutex_owner_running((proc_t *)owner)) {
+            break;
+        }
+
+        cpu_pause();
+    }
+
+    flags = interrupts_save();
+
+    while (1) {
+        owner = mutex->owner;
+
+        if (!owner) {
+            if (cpu_cmpxchg(&mutex->owner, 0, self) == 0) {
+                break;
+            }
+            continue;
+        }
+
+        // Once the flag is set the owner releases through mutex_unlock's
+        // slow path, which needs the kernel lock held here
+        if (!(owner & MUTEX_WAITERS)) {
+            if (cpu_cmpxchg(&mutex->owner, owner, owner | MUTEX_WAITERS) != owner) {
+                continue;
+            }
+
+            mutex->next = ((proc_t *)owner)->mutexes;
+            ((proc_t *)owner)->mutexes = mutex;
+        }
+
+        proc->mutex_wait = mutex;
+        wait_enqueue(&mutex->waiters, proc);
+        mutex_boost(mutex, proc->priority);
+
+        scheduler_block();
+
+        if (mutex_owner(mutex) == proc) {
+            break;
+        }
+    }
+
+    mutex->contended++;
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Initializes a mutex (unlocked)
+ * @param mutex - pointer to the mutex
+ * @param name - name of the mutex (for diagnostics)
+ */
+void mutex_init(mutex_t *mutex, char *name) {
+    mutex->owner = 0;
+    wait_queue_init(&mutex->waiters);
+    mutex->next = NULL;
+    mutex->name = name;
+    mutex->contended = 0;
+    mutex->spun = 0;
+}
+
+/**
+ * Acquires a mutex, blocking until it is available
+ * @param mutex - pointer to the mutex
+ */
+void mutex_lock(mutex_t *mutex) {
+    if (interrupts_get_frame()) {
+        kernel_panic("mutex: %s locked in an interrupt handler", mutex->name);
+        return;
+    }
+
+    if (cpu_cmpxchg(&mutex->owner, 0, (unsigned int)active_proc) != 0) {
+        mutex_lock_slow(mutex);
+    }
+}
+
+/**
+ * Acquires a mutex if it is available
+ * @param mutex - pointer to the mutex
+ * @return true if the mutex was acquired
+ */
+bool mutex_trylock(mutex_t *mutex) {
+    return cpu_cmpxchg(&mutex->owner, 0, (unsigned int)active_proc) == 0;
+}
+
+/**
+ * Releases a mutex held by the running process
+ * @param mutex - pointer to the mutex
+ */
+void mutex_unlock(mutex_t *mutex) {
+    proc_t *proc = active_proc;
+    unsigned int flags;
+    proc_t *next;
+
+    // Without waiters there is nobody to hand over to
+    if (cpu_cmpxchg(&mutex->owner, (unsigned int)proc, 0) == (unsigned int)proc) {
+        return;
+    }
+
+    if (mutex_owner(mutex) != proc) {
+        kernel_panic("mutex: process %d released %s, which it does not hold", proc->pid,
+                     mutex->name);
+        return;
+    }
+
+    flags = interrupts_save();
+
+    mutex_held_remove(proc, mutex);
+
+    // Hand the mutex straight to the highest priority waiter, which then
+    // inherits from the ones still waiting
+    next = mutex_top_waiter(mutex);
+    if (next) {
+        wait_remove(next);
+        next->mutex_wait = NULL;
+
+        if (mutex->waiters.head) {
+            cpu_xchg(&mutex->owner, (unsigned int)next | MUTEX_WAITERS);
+            mutex->next = next->mutexes;
+            next->mutexes = mutex;
+            mutex_inherit(next);
+        } else {
+            cpu_xchg(&mutex->owner, (unsigned int)next);
+        }
+
+        scheduler_wakeup(next);
+    } else {
+        // The waiters have gone (e.g. exited) since the flag was set
+        cpu_xchg(&mutex->owner, 0);
+    }
+
+    // Give back what the waiters of this mutex lent
+    mutex_inherit(proc);
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Checks whether the running process holds a mutex
+ * @param mutex - pointer to the mutex
+ * @return true if held by the running process
+ */
+bool mutex_held(mutex_t *mutex) {
+    return mutex_owner(mutex) == active_proc;
+}
+
+/**
+ * Initializes a semaphore
+ * @param sem - pointer to the semaphore
+ * @param count - initial number of units
+ */
+void semaphore_init(semaphore_t *sem, int count) {
+    sem->count = count > 0 ? count : 0;
+    wait_queue_init(&sem->waiters);
+}
+
+/**
+ * Takes a unit from a semaphore, blocking until one is available
+ * @param sem - pointer to the semaphore
+ */
+void semaphore_down(semaphore_t *sem) {
+    if (semaphore_try_down(sem)) {
+        return;
+    }
+
+    if (interrupts_get_frame()) {
+        kernel_panic("semaphore: blocking down in an interrupt handler");
+        return;
+    }
+
+    // semaphore_up adds the unit with the kernel lock held, so it cannot
+    // slip in between the check and the sleep
+    wait_event(&sem->waiters, semaphore_try_down(sem));
+}
+
+/**
+ * Takes a unit from a semaphore if one is available
+ * @param sem - pointer to the semaphore
+ * @return true if a unit was taken
+ */
+bool semaphore_try_down(semaphore_t *sem) {
+    unsigned int count;
+
+    while ((count = sem->count) > 0) {
+        if (cpu_cmpxchg(&sem->count, count, count - 1) == count) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Returns a unit to a semaphore, waking a waiter
+ * @param sem - pointer to the semaphore
+ */
+void semaphore_up(semaphore_t *sem) {
+    unsigned int flags = interrupts_save();
+
+    cpu_xadd(&sem->count, 1);
+    wake_up(&sem->waiters);
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Initializes a condition variable
+ * @param cv - pointer to the condition variable
+ */
+void condvar_init(condvar_t *cv) {
+    wait_queue_init(&cv->waiters);
+}
+
+/**
+ * Releases a mutex, waits until the condition variable is signaled and
+ * reacquires the mutex; callers re-check their condition in a loop
+ * @param cv - pointer to the condition variable
+ * @param mutex - pointer to the mutex (held by the running process)
+ */
+void condvar_wait(condvar_t *cv, mutex_t *mutex) {
+    unsigned int flags;
+
+    if (interrupts_get_frame()) {
+        kernel_panic("condvar: wait in an interrupt handler");
+        return;
+    }
+
+    // Queue before releasing the mutex so that a signal sent as soon as
+    // it is released still finds the waiter
+    flags = interrupts_save();
+
+    wait_enqueue(&cv->waiters, active_proc);
+    mutex_unlock(mutex);
+    scheduler_block();
+
+    interrupts_restore(flags);
+
+    mutex_lock(mutex);
+}
+
+/**
+ * Wakes one process waiting on a condition variable
+ * @param cv - pointer to the condition variable
+ */
+void condvar_signal(condvar_t *cv) {
+    wake_up(&cv->waiters);
+}
+
+/**
+ * Wakes every process waiting on a condition variable
+ * @param cv - pointer to the condition variable
+ */
+void condvar_broadcast(condvar_t *cv) {
+    wake_up_all(&cv->waiters);
+}
@@ -0,0 +1,539 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Physical Page Frame Allocator
+ */
+#include <spede/machine/io.h>
+
+#include "bit.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kstring.h"
+#include "page.h"
+
+// Maximum number of usable memory regions that can be registered
+#define PAGE_REGIONS_MAX    16
+
+// CMOS ports and registers used to obtain the installed memory size
+#define CMOS_PORT_ADDR      0x70
+#define CMOS_PORT_DATA      0x71
+#define CMOS_EXT_MEM_LOW    0x30    // KB above 1MB (low byte)
+#define CMOS_EXT_MEM_HIGH   0x31    // KB above 1MB (high byte)
+#define CMOS_EXT16_MEM_LOW  0x34    // 64KB blocks above 16MB (low byte)
+#define CMOS_EXT16_MEM_HIGH 0x35    // 64KB blocks above 16MB (high byte)
+
+#define MB                  (1024 * 1024)
+
+// End of the kernel image (provided by the linker)
+extern char end[];
+
+// Usable memory region
+typedef struct page_region_t {
+    unsigned int base;          // Start address
+    unsigned int end;           // End address (exclusive)
+} page_region_t;
+
+// Usable memory regions
+page_region_t page_regions[PAGE_REGIONS_MAX];
+int page_region_count = 0;
+
+// Page frame descriptors, indexed by page frame number
+page_t *page_table = NULL;
+
+// Number of page frame descriptors
+unsigned int page_count = 0;
+
+// Free lists, one per block order
+page_t *page_free_lists[PAGE_ORDER_MAX + 1];
+
+// Number of free blocks in each free list
+int page_free_blocks[PAGE_ORDER_MAX + 1];
+
+// Bitmap of non-empty free lists; allows finding a block with a bit scan
+unsigned int page_free_orders = 0;
+
+/**
+ * Adds a block to the free list for the given order
+ * @param page - block head
+ * @param order - block order
+ */
+static void page_list_push(page_t *page, int order) {
+    page->flags |= PAGE_FLAG_FREE;
+    page->order = order;
+    page->prev = NULL;
+    page->next = page_free_lists[order];
+
+    if (page->next) {
+        page->next->prev = page;
+    }
+
+    page_free_lists[order] = page;
+    page_free_blocks[order]++;
+    page_free_orders = bit_set(page_free_orders, order);
+}
+
+/**
+ * Removes a block from the free list for the given order
+ * @param page - block head
+ * @param order - block order
+ */
+static void page_list_remove(page_t *page, int order) {
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        page_free_lists[order] = page->next;
+    }
+
+    if (page->next) {
+        page->next->prev = page->prev;
+    }
+
+    page->next = NULL;
+    page->prev = NULL;
+    page->flags &= ~PAGE_FLAG_FREE;
+
+    if (--page_free_blocks[order] == 0) {
+        page_free_orders = bit_clear(page_free_orders, order);
+    }
+}
+
+/**
+ * Returns a block to the free lists, coalescing it with free buddies
+ * @param pfn - page frame number of the block
+ * @param order - block order
+ */
+static void page_free_block(unsigned int pfn, int order) {
+    while (order < PAGE_ORDER_MAX) {
+        unsigned int buddy_pfn = pfn ^ (1U << order);
+        page_t *buddy;
+
+        if (buddy_pfn >= page_count) {
+            break;
+        }
+
+        // The buddy must be a whole free block of the same order
+        buddy = &page_table[buddy_pfn];
+        if ((buddy->flags & PAGE_FLAG_FREE) == 0 || buddy->order != order) {
+            break;
+        }
+
+        // The upper half is no longer the head of a block
+        page_list_remove(buddy, order);
+        page_table[pfn | (1U << order)].order = PAGE_ORDER_NONE;
+        pfn &= ~(1U << order);
+        order++;
+    }
+
+    page_list_push(&page_table[pfn], order);
+}
+
+/**
+ * Adds a region of usable physical memory
+ *
+ * @param base - physical start address of the region
+ * @param size - size of the region in bytes
+ * @return -1 on error; 0 on success
+ */
+int page_region_add(unsigned int base, unsigned int size) {
+    page_region_t *region;
+
+    if (page_table) {
+        kernel_log_error("page: regions must be added before initialization");
+        return -1;
+    }
+
+    if (page_region_count >= PAGE_REGIONS_MAX) {
+        kernel_log_error("page: too many memory regions");
+        return -1;
+    }
+
+    if (size == 0 || base >= PAGE_MEM_LIMIT) {
+        return 0;
+    }
+
+    region = &page_regions[page_region_count++];
+    region->base = base;
+
+    // Clip regions that extend past the memory the kernel can address
+    if (size > PAGE_MEM_LIMIT - base) {
+        region->end = PAGE_MEM_LIMIT;
+    } else {
+        region->end = base + size;
+    }
+
+    kernel_log_debug("page: region 0x%08x-0x%08x", region->base, region->end);
+
+    return 0;
+}
+
+/**
+ * Adds the usable physical memory described by the boot loader
+ * @param mbi - pointer to the multiboot information structure
+ * @return -1 on error; 0 on success
+ */
+int page_region_add_multiboot(multiboot_info_t *mbi) {
+    if (!mbi) {
+        return -1;
+    }
+
+    if (mbi->flags & MULTIBOOT_INFO_MMAP) {
+        char *ptr = (char *)mbi->mmap_addr;
+        char *ptr_end = ptr + mbi->mmap_length;
+
+        while (ptr < ptr_end) {
+            multiboot_mmap_t *entry = (multiboot_mmap_t *)ptr;
+
+            // Only use available memory that is below 4GB
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && entry->addr < 0x100000000ULL) {
+                unsigned long long len = entry->len;
+
+                if (entry->addr + len > 0xFFFFFFFFULL) {
+                    len = 0xFFFFFFFFULL - entry->addr;
+                }
+
+                if (page_region_add(entry->addr, len) != 0) {
+                    return -1;
+                }
+            }
+
+            ptr += entry->size + sizeof(entry->size);
+        }
+
+        return 0;
+    }
+
+    if (mbi->flags & MULTIBOOT_INFO_MEMORY) {
+        unsigned int kb = mbi->mem_upper;
+
+        // Clamp before converting to bytes, which would overflow 32 bits
+        if (kb > (PAGE_MEM_LIMIT - MB) / 1024) {
+            kb = (PAGE_MEM_LIMIT - MB) / 1024;
+        }
+
+        return page_region_add(MB, kb * 1024);
+    }
+
+    return -1;
+}
+
+/**
+ * Reads a CMOS register
+ * @param reg - register number
+ * @return register value
+ */
+static unsigned char page_cmos_read(unsigned char reg) {
+    outportb(CMOS_PORT_ADDR, reg);
+    return inportb(CMOS_PORT_DATA);
+}
+
+/**
+ * Obtains the installed memory size from the BIOS configuration
+ * @return end of extended memory
+ */
+static unsigned int page_cmos_mem_end(void) {
+    unsigned int kb;
+    unsigned int blocks;
+
+    // Memory above 16MB is reported in 64KB blocks (up to almost 4GB);
+    // clamp to what the kernel can address before converting to bytes,
+    // which would overflow 32 bits
+    blocks = page_cmos_read(CMOS_EXT16_MEM_LOW) | (page_cmos_read(CMOS_EXT16_MEM_HIGH) << 8);
+    if (blocks) {
+        if (blocks > (PAGE_MEM_LIMIT - 16 * MB) / (64 * 1024)) {
+            blocks = (PAGE_MEM_LIMIT - 16 * MB) / (64 * 1024);
+        }
+
+        return 16 * MB + blocks * 64 * 1024;
+    }
+
+    kb = page_cmos_read(CMOS_EXT_MEM_LOW) | (page_cmos_read(CMOS_EXT_MEM_HIGH) << 8);
+    if (kb > (PAGE_MEM_LIMIT - MB) / 1024) {
+        kb = (PAGE_MEM_LIMIT - MB) / 1024;
+    }
+
+    return MB + kb * 1024;
+}
+
+/**
+ * Initializes the page allocator
+ *
+ * If no regions have been added, the amount of installed memory is
+ * obtained from the BIOS configuration (CMOS).
+ */
+void page_init(void) {
+    unsigned int mem_end = 0;
+    unsigned int reserved_end;
+
+    kernel_log_info("Initializing page allocator");
+
+    if (page_region_count == 0) {
+        page_region_add(MB, page_cmos_mem_end() - MB);
+    }
+
+    for (int i = 0; i < page_region_count; i++) {
+        if (page_regions[i].end > mem_end) {
+            mem_end = page_regions[i].end;
+        }
+    }
+
+    page_count = mem_end >> PAGE_SHIFT;
+
+    // Place the page descriptors directly after the kernel image; everything
+    // below the end of the descriptors is reserved
+    page_table = (page_t *)PAGE_ALIGN_UP(end);
+    reserved_end = PAGE_ALIGN_UP(&page_table[page_count]);
+
+    if (reserved_end >= mem_end) {
+        kernel_panic("page: not enough memory (end=0x%08x)", mem_end);
+        return;
+    }
+
+    for (unsigned int i = 0; i < page_count; i++) {
+        page_table[i].next = NULL;
+        page_table[i].prev = NULL;
+        page_table[i].flags = PAGE_FLAG_RESERVED;
+        page_table[i].order = PAGE_ORDER_NONE;
+        page_table[i].refcount = 0;
+        page_table[i].slab = NULL;
+    }
+
+    kmemset(page_free_lists, 0, sizeof(page_free_lists));
+    kmemset(page_free_blocks, 0, sizeof(page_free_blocks));
+    page_free_orders = 0;
+
+    for (int i = 0; i < page_region_count; i++) {
+        unsigned int base = PAGE_ALIGN_UP(page_regions[i].base);
+        unsigned int pfn;
+        unsigned int pfn_end;
+
+        if (base < reserved_end) {
+            base = reserved_end;
+        }
+
+        pfn = base >> PAGE_SHIFT;
+        pfn_end = PAGE_ALIGN_DOWN(page_regions[i].end) >> PAGE_SHIFT;
+
+        for (unsigned int p = pfn; p < pfn_end; p++) {
+            page_table[p].flags = 0;
+        }
+
+        // Free the region in the largest naturally aligned blocks possible
+        while (pfn < pfn_end) {
+            int order = PAGE_ORDER_MAX;
+
+            while (order > 0 && ((pfn & ((1U << order) - 1)) != 0 || pfn + (1U << order) > pfn_end)) {
+                order--;
+            }
+
+            page_free_block(pfn, order);
+            pfn += 1U << order;
+        }
+    }
+
+    kernel_log_info("page: %d KB of %d KB free", page_free_pages() * (PAGE_SIZE / 1024), mem_end / 1024);
+}
+
+/**
+ * Allocates a block of 2^order physically contiguous pages
+ * @param order - order of the block to allocate
+ * @return address of the block or NULL if no memory is available
+ */
+void *page_alloc(int order) {
+    unsigned int flags;
+    page_t *page;
+    int k;
+
+    if (order < 0 || order > PAGE_ORDER_MAX) {
+        kernel_log_error("page: invalid order %d", order);
+        return NULL;
+    }
+
+    flags = interrupts_save();
+
+    // Find the smallest non-empty free list that can satisfy the request
+    k = bit_ffs(page_free_orders & (~0U << order));
+    if (k < 0) {
+        interrupts_restore(flags);
+        kernel_log_warn("page: out of memory allocating order %d", order);
+        return NULL;
+    }
+
+    page = page_free_lists[k];
+    page_list_remove(page, k);
+
+    // Split the block, returning the upper halves to the free lists
+    while (k > order) {
+        k--;
+        page_list_push(page + (1 << k), k);
+    }
+
+    page->order = order;
+    page->refcount = 1;
+    page->slab = NULL;
+
+    interrupts_restore(flags);
+
+    return page_addr(page);
+}
+
+/**
+ * Frees a block of 2^order pages
+ * @param addr - address of the block
+ * @param order - order of the block (as passed to page_alloc)
+ */
+void page_free(void *addr, int order) {
+    page_t *page = page_get(addr);
+    unsigned int flags;
+    unsigned int pfn;
+
+    if (!page || order < 0 || order > PAGE_ORDER_MAX) {
+        kernel_log_error("page: invalid free of %p (order %d)", addr, order);
+        return;
+    }
+
+    pfn = page - page_table;
+
+    flags = interrupts_save();
+
+    // Only the head of an allocated block can be freed, with the order it
+    // was allocated with
+    if ((page->flags & (PAGE_FLAG_RESERVED | PAGE_FLAG_FREE)) != 0
+        || (pfn & ((1U << order) - 1)) != 0 || page->order != order) {
+        interrupts_restore(flags);
+        kernel_log_error("page: invalid free of %p (order %d)", addr, order);
+        return;
+    }
+
+    page->refcount = 0;
+    page_free_block(pfn, order);
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Adds a reference to an allocated page
+ * @param addr - address of the page
+ */
+void page_ref(void *addr) {
+    page_t *page = page_get(addr);
+    unsigned int flags = interrupts_save();
+
+    if (!page || (page->flags & (PAGE_FLAG_RESERVED | PAGE_FLAG_FREE)) != 0) {
+        interrupts_restore(flags);
+        kernel_log_error("page: invalid reference to %p", addr);
+        return;
+    }
+
+    page->refcount++;
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Drops a reference to an allocated page, freeing it when the last
+ * reference is dropped
+ * @param addr - address of the page
+ * @return number of references remaining
+ */
+int page_unref(void *addr) {
+    page_t *page = page_get(addr);
+    unsigned int flags = interrupts_save();
+    int refcount;
+
+    if (!page || (page->flags & (PAGE_FLAG_RESERVED | PAGE_FLAG_FREE)) != 0
+        || page->refcount <= 0) {
+        interrupts_restore(flags);
+        kernel_log_error("page: invalid unreference of %p", addr);
+        return 0;
+    }
+
+    refcount = --page->refcount;
+    if (refcount == 0) {
+        page_free(addr, page->order);
+    }
+
+    interrupts_restore(flags);
+
+    return refcount;
+}
+
+/**
+ * Returns the number of references to an allocated page
+ * @param addr - address of the page
+ * @return number of references
+ */
+int page_refcount(void *addr) {
+    page_t *page = page_get(addr);
+
+    return page ? page->refcount : 0;
+}
+
+/**
+ * Obtains the page frame descriptor for the given address
+ * @param addr - physical address
+ * @return pointer to the page descriptor or NULL if not managed
+ */
+page_t *page_get(void *addr) {
+    unsigned int pfn = (unsigned int)addr >> PAGE_SHIFT;
+
+    if (!page_table || pfn >= page_count) {
+        return NULL;
+    }
+
+    return &page_table[pfn];
+}
+
+/**
+ * Obtains the physical address of the given page frame descriptor
+ * @param page - pointer to the page descriptor
+ * @return physical address of the page
+ */
+void *page_addr(page_t *page) {
+    return (void *)((unsigned int)(page - page_table) << PAGE_SHIFT);
+}
+
+/**
+ * Returns the number of free blocks of the given order
+ * @param order - block order
+ * @return number of free blocks
+ */
+int page_free_count(int order) {
+    if (order < 0 || order > PAGE_ORDER_MAX) {
+        return 0;
+    }
+
+    return page_free_blocks[order];
+}
+
+/**
+ * Returns the total number of free pages
+ * @return number of free pages
+ */
+int page_free_pages(void) {
+    int pages = 0;
+
+    for (int order = 0; order <= PAGE_ORDER_MAX; order++) {
+        pages += page_free_blocks[order] << order;
+    }
+
+    return pages;
+}
+
+/**
+ * Returns the address one past the end of physical memory
+ * @return end of physical memory
+ */
+unsigned int page_mem_end(void) {
+    return page_count << PAGE_SHIFT;
+}
+
+/**
+ * Displays the per-order free counts on the host console
+ */
+void page_dump(void) {
+    for (int order = 0; order <= PAGE_ORDER_MAX; order++) {
+        kernel_log_info("page: order %2d (%5d KB): %d free", order,
+                        (PAGE_SIZE << order) / 1024, page_free_blocks[order]);
+    }
+}
@@ -0,0 +1,435 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Paging Implementation
+ */
+#include "cpu.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kstring.h"
+#include "paging.h"
+#include "vga.h"
+
+// Page attribute table memory types
+#define PAT_TYPE_UC         0x00
+#define PAT_TYPE_WC         0x01
+#define PAT_TYPE_WT         0x04
+#define PAT_TYPE_WB         0x06
+#define PAT_TYPE_UC_MINUS   0x07
+
+// Builds the value of a PAT entry at the given index
+#define PAT_ENTRY(index, type) ((unsigned long long)(type) << ((index) * 8))
+
+// The VGA text mode buffer spans 0xB8000-0xBFFFF
+#define VGA_TEXT_SIZE       0x8000
+
+// Kernel page directory
+pde_t *kernel_pd = NULL;
+
+// Set when 4MB pages are supported
+bool paging_pse = false;
+
+// Set when the page attribute table is supported
+bool paging_pat = false;
+
+// Flag applied to kernel mappings (PTE_GLOBAL when supported)
+unsigned int paging_global = 0;
+
+// Page directories other than the kernel's, linked through the free list
+// links of their page frame descriptors (unused while allocated)
+page_t *paging_dirs = NULL;
+
+/**
+ * Allocates a zeroed page for a page directory or page table
+ * @return pointer to the page or NULL if no memory is available
+ */
+static unsigned int *paging_alloc_table(void) {
+    unsigned int *table = page_alloc(0);
+
+    if (table) {
+        kmemset(table, 0, PAGE_SIZE);
+    }
+
+    return table;
+}
+
+/**
+ * Fills a page table with a contiguous identity mapping
+ * @param pt - pointer to the page table
+ * @param base - physical (and virtual) address of the first page
+ * @param flags - page table entry flags
+ */
+static void paging_fill_table(pte_t *pt, unsigned int base, unsigned int flags) {
+    for (int i = 0; i < PTE_ENTRIES; i++) {
+        pt[i] = (base + i * PAGE_SIZE) | flags;
+    }
+}
+
+/**
+ * Sets a kernel page directory entry in the kernel page directory and
+ * every other page directory, which share the kernel mappings
+ * @param index - index of the entry
+ * @param pde - value of the entry
+ */
+static void paging_kernel_pde_set(unsigned int index, pde_t pde) {
+    unsigned int flags = interrupts_save();
+
+    kernel_pd[index] = pde;
+
+    for (page_t *page = paging_dirs; page; page = page->next) {
+        ((pde_t *)page_addr(page))[index] = pde;
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Replaces a 4MB kernel mapping with an equivalent page table so that
+ * individual pages can be given different attributes
+ * @param index - index of the kernel page directory entry
+ * @return -1 on error; 0 on success
+ */
+static int paging_split(unsigned int index) {
+    pde_t pde = kernel_pd[index];
+    pte_t *pt;
+
+    if ((pde & PTE_PS) == 0) {
+        return 0;
+    }
+
+    pt = paging_alloc_table();
+    if (!pt) {
+        return -1;
+    }
+
+    paging_fill_table(pt, PTE_ADDR(pde), pde & PTE_FLAGS_MASK & ~PTE_PS);
+    paging_kernel_pde_set(index, (unsigned int)pt | PTE_PRESENT | PTE_WRITE);
+
+    // The whole 4MB region may be cached in the TLB as one entry
+    for (unsigned int i = 0; i < PTE_ENTRIES; i++) {
+        paging_flush(PTE_ADDR(pt[i]));
+    }
+
+    return 0;
+}
+
+/**
+ * Initializes paging
+ *  - Identity maps physical memory (with 4MB pages when supported)
+ *  - Programs the PAT so that the VGA text buffer is write-combining
+ *  - Enables paging
+ */
+void paging_init(void) {
+    unsigned int mem_end;
+    unsigned int flags;
+    pte_t *pt;
+
+    kernel_log_info("Initializing paging");
+
+    paging_pse = cpu_has(CPU_FEATURE_PSE);
+    paging_pat = cpu_has(CPU_FEATURE_PAT);
+    paging_global = cpu_has(CPU_FEATURE_PGE) ? PTE_GLOBAL : 0;
+
+    kernel_pd = paging_alloc_table();
+    if (!kernel_pd) {
+        kernel_panic("paging: unable to allocate the kernel page directory");
+        return;
+    }
+
+    flags = PTE_PRESENT | PTE_WRITE | paging_global;
+
+    // The first 4MB is always mapped with 4KB pages so that the legacy
+    // VGA memory and BIOS areas can be given their own cache types
+    pt = paging_alloc_table();
+    if (!pt) {
+        kernel_panic("paging: unable to allocate a page table");
+        return;
+    }
+
+    paging_fill_table(pt, 0, flags);
+    kernel_pd[0] = (unsigned int)pt | PTE_PRESENT | PTE_WRITE;
+
+    // Leave the first page unmapped so that NULL pointer dereferences
+    // fault (see acpi.c for the one read of the BIOS data area in it)
+    pt[0] = 0;
+
+    // Identity map the remaining physical memory
+    mem_end = page_mem_end();
+
+    for (unsigned int addr = PDE_SIZE; addr < mem_end; addr += PDE_SIZE) {
+        if (paging_pse) {
+            kernel_pd[PDE_INDEX(addr)] = addr | flags | PTE_PS;
+            continue;
+        }
+
+        pt = paging_alloc_table();
+        if (!pt) {
+            kernel_panic("paging: unable to allocate a page table");
+            return;
+        }
+
+        paging_fill_table(pt, addr, flags);
+        kernel_pd[PDE_INDEX(addr)] = (unsigned int)pt | PTE_PRESENT | PTE_WRITE;
+    }
+
+    // Program the PAT, replacing the write-through entry selected by PWT
+    // with write-combining:
+    //   0: WB  1: WC  2: UC-  3: UC  (entries 4-7 repeat the same)
+    if (paging_pat) {
+        unsigned long long pat = PAT_ENTRY(0, PAT_TYPE_WB) | PAT_ENTRY(1, PAT_TYPE_WC)
+                               | PAT_ENTRY(2, PAT_TYPE_UC_MINUS) | PAT_ENTRY(3, PAT_TYPE_UC);
+
+        cpu_wbinvd();
+        cpu_wrmsr(MSR_PAT, pat | (pat << 32));
+        cpu_wbinvd();
+    }
+
+    if (paging_pse) {
+        cpu_set_cr4(cpu_get_cr4() | CR4_PSE);
+    }
+
+    if (paging_global) {
+        cpu_set_cr4(cpu_get_cr4() | CR4_PGE);
+    }
+
+    // Enable paging
+    cpu_set_cr3((unsigned int)kernel_pd);
+    cpu_set_cr0(cpu_get_cr0() | CR0_PG | CR0_WP);
+
+    // Allow VGA stores to be merged into bursts
+    paging_map_mmio((unsigned int)VGA_BASE, VGA_TEXT_SIZE, true);
+
+    kernel_log_info("paging: enabled (%s pages, %s)", paging_pse ? "4MB" : "4KB",
+                    paging_pat ? "write-combining VGA" : "no PAT");
+}
+
+/**
+ * Creates a new page directory sharing the kernel mappings
+ * @return pointer to the page directory or NULL if no memory is available
+ */
+pde_t *paging_pd_create(void) {
+    pde_t *pd = paging_alloc_table();
+    unsigned int flags;
+    page_t *page;
+
+    if (!pd) {
+        return NULL;
+    }
+
+    flags = interrupts_save();
+
+    // Kernel page tables (and 4MB mappings) are shared by every directory;
+    // entries changed later are updated in each (see paging_kernel_pde_set)
+    for (unsigned int i = 0; i < PDE_INDEX(USER_SPACE_BASE); i++) {
+        pd[i] = kernel_pd[i];
+    }
+
+    for (unsigned int i = PDE_INDEX(MMIO_SPACE_BASE); i < PDE_ENTRIES; i++) {
+        pd[i] = kernel_pd[i];
+    }
+
+    page = page_get(pd);
+    page->prev = NULL;
+    page->next = paging_dirs;
+    if (paging_dirs) {
+        paging_dirs->prev = page;
+    }
+    paging_dirs = page;
+
+    interrupts_restore(flags);
+
+    return pd;
+}
+
+/**
+ * Frees a page directory and its page tables (not the mapped pages)
+ * @param pd - pointer to the page directory
+ */
+void paging_pd_destroy(pde_t *pd) {
+    unsigned int flags;
+    page_t *page;
+
+    if (!pd || pd == kernel_pd) {
+        return;
+    }
+
+    flags = interrupts_save();
+
+    page = page_get(pd);
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        paging_dirs = page->next;
+    }
+    if (page->next) {
+        page->next->prev = page->prev;
+    }
+    page->next = NULL;
+    page->prev = NULL;
+
+    interrupts_restore(flags);
+
+    // Only the user page tables belong to the directory
+    for (unsigned int i = PDE_INDEX(USER_SPACE_BASE); i < PDE_INDEX(USER_SPACE_END); i++) {
+        if ((pd[i] & PTE_PRESENT) && !(pd[i] & PTE_PS)) {
+            page_free((void *)PTE_ADDR(pd[i]), 0);
+        }
+    }
+
+    page_free(pd, 0);
+}
+
+/**
+ * Obtains the page table entry for a virtual address
+ * @param pd - pointer to the page directory
+ * @param vaddr - virtual address
+ * @param create - allocate the page table if it does not exist
+ * @return pointer to the page table entry or NULL
+ */
+pte_t *paging_lookup(pde_t *pd, unsigned int vaddr, bool create) {
+    pde_t *pde;
+    pte_t *pt;
+
+    if (!pd) {
+        return NULL;
+    }
+
+    pde = &pd[PDE_INDEX(vaddr)];
+
+    if ((*pde & PTE_PRESENT) == 0) {
+        if (!create) {
+            return NULL;
+        }
+
+        pt = paging_alloc_table();
+        if (!pt) {
+            return NULL;
+        }
+
+        // Access is controlled by the individual page table entries
+        if (vaddr >= USER_SPACE_BASE && vaddr < USER_SPACE_END) {
+            *pde = (unsigned int)pt | PTE_PRESENT | PTE_WRITE | PTE_USER;
+        } else {
+            // Kernel page tables are shared by every page directory
+            paging_kernel_pde_set(PDE_INDEX(vaddr), (unsigned int)pt | PTE_PRESENT | PTE_WRITE);
+        }
+    }
+
+    // 4MB mappings have no page table entry
+    if (*pde & PTE_PS) {
+        return NULL;
+    }
+
+    pt = (pte_t *)PTE_ADDR(*pde);
+    return &pt[PTE_INDEX(vaddr)];
+}
+
+/**
+ * Maps a 4KB page
+ * @param pd - pointer to the page directory
+ * @param vaddr - virtual address
+ * @param paddr - physical address
+ * @param flags - page table entry flags
+ * @return -1 on error; 0 on success
+ */
+int paging_map(pde_t *pd, unsigned int vaddr, unsigned int paddr, unsigned int flags) {
+    pte_t *pte = paging_lookup(pd, vaddr, true);
+
+    if (!pte) {
+        kernel_log_error("paging: unable to map 0x%08x", vaddr);
+        return -1;
+    }
+
+    *pte = PAGE_ALIGN_DOWN(paddr) | (flags & PTE_FLAGS_MASK) | PTE_PRESENT;
+
+    if (pd == paging_current()) {
+        paging_flush(vaddr);
+    }
+
+    return 0;
+}
+
+/**
+ * Unmaps a 4KB page
+ * @param pd - pointer to the page directory
+ * @param vaddr - virtual address
+ * @return the page table entry that was removed (0 if none)
+ */
+pte_t paging_unmap(pde_t *pd, unsigned int vaddr) {
+    pte_t *pte = paging_lookup(pd, vaddr, false);
+    pte_t old;
+
+    if (!pte) {
+        return 0;
+    }
+
+    old = *pte;
+    *pte = 0;
+
+    if (pd == paging_current()) {
+        paging_flush(vaddr);
+    }
+
+    return old;
+}
+
+/**
+ * Maps device memory into the kernel address space
+ *
+ * @param paddr - physical address
+ * @param size - size of the region in bytes
+ * @param wc - true for write-combining, false for uncacheable
+ * @return virtual address of the region or NULL on error
+ */
+void *paging_map_mmio(unsigned int paddr, unsigned int size, bool wc) {
+    unsigned int start = PAGE_ALIGN_DOWN(paddr);
+    unsigned int end = PAGE_ALIGN_UP(paddr + size);
+    unsigned int cache = (wc && paging_pat) ? PTE_CACHE_WC : PTE_CACHE_UC;
+    unsigned int flags = PTE_PRESENT | PTE_WRITE | paging_global | cache;
+
+    if (end <= start || (start < KERNEL_SPACE_END && end > KERNEL_SPACE_END)
+        || (start >= USER_SPACE_BASE && start < MMIO_SPACE_BASE)) {
+        kernel_log_error("paging: invalid device memory 0x%08x-0x%08x", start, end);
+        return NULL;
+    }
+
+    for (unsigned int addr = start; addr < end; addr += PAGE_SIZE) {
+        // Give identity mapped memory its own cache type
+        if (paging_split(PDE_INDEX(addr)) != 0) {
+            return NULL;
+        }
+
+        if (paging_map(kernel_pd, addr, addr, flags) != 0) {
+            return NULL;
+        }
+    }
+
+    return (void *)paddr;
+}
+
+/**
+ * Switches to the given page directory
+ * @param pd - pointer to the page directory
+ */
+void paging_switch(pde_t *pd) {
+    if (pd && pd != paging_current()) {
+        cpu_set_cr3((unsigned int)pd);
+    }
+}
+
+/**
+ * Returns the current page directory
+ * @return pointer to the page directory
+ */
+pde_t *paging_current(void) {
+    return (pde_t *)PTE_ADDR(cpu_get_cr3());
+}
+
+/**
+ * Flushes the TLB entry for the given address on this CPU
+ * @param vaddr - virtual address
+ */
+void paging_flush(unsigned int vaddr) {
+    cpu_invlpg(vaddr);
+}
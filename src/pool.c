@@ -0,0 +1,228 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Fixed-size object pool allocator
+ */
+#include "bit.h"
+#include "kernel.h"
+#include "kstring.h"
+#include "pool.h"
+
+/**
+ * Resets the pool so that all objects are free
+ * @param pool - pointer to the pool
+ * @return -1 on error; 0 on success
+ */
+int pool_init(pool_t *pool) {
+    if (!pool || !pool->storage || !pool->map) {
+        return -1;
+    }
+
+    bitmap_zero(pool->map, pool->count);
+    pool->free_list = NULL;
+    pool->next_unused = 0;
+
+#if POOL_STATS
+    pool->in_use = 0;
+    pool->peak = 0;
+    pool->allocs = 0;
+    pool->frees = 0;
+    pool->failures = 0;
+#endif
+
+    return 0;
+}
+
+/**
+ * Allocates an object from the pool
+ * @param pool - pointer to the pool
+ * @return pointer to the object or NULL if the pool is exhausted
+ */
+void *pool_alloc(pool_t *pool) {
+    char *obj;
+
+    if (!pool) {
+        return NULL;
+    }
+
+    if (pool->free_list) {
+        // Reuse the most recently freed object (likely still cache-hot)
+        obj = pool->free_list;
+        pool->free_list = *(void **)obj;
+
+#if POOL_DEBUG
+        // Everything past the free list link should still be poisoned
+        for (size_t i = sizeof(void *); i < pool->obj_size; i++) {
+            if ((unsigned char)obj[i] != POOL_POISON_FREE) {
+                kernel_panic("pool: %s object %p modified after free",
+                             pool->name, obj);
+            }
+        }
+#endif
+    } else if (pool->next_unused < pool->count) {
+        // Hand out never-used slots in order; no up-front free list build
+        obj = pool->storage + pool->next_unused * pool->obj_size;
+        pool->next_unused++;
+    } else {
+#if POOL_STATS
+        pool->failures++;
+#endif
+        return NULL;
+    }
+
+    bitmap_set(pool->map, (obj - pool->storage) / pool->obj_size);
+
+#if POOL_DEBUG
+    kmemset(obj, POOL_POISON_ALLOC, pool->obj_size);
+#endif
+
+#if POOL_STATS
+    pool->allocs++;
+    pool->in_use++;
+    if (pool->in_use > pool->peak) {
+        pool->peak = pool->in_use;
+    }
+#endif
+
+    return obj;
+}
+
+/**
+ * Returns an object to the pool
+ * @param pool - pointer to the pool
+ * @param obj - pointer to the object
+ * @return -1 on error; 0 on success
+ */
+int pool_free(pool_t *pool, void *obj) {
+    int index = pool_index(pool, obj);
+
+    if (index < 0) {
+        kernel_log_error("pool: %p does not belong to pool %s",
+                         obj, pool ? pool->name : "(null)");
+        return -1;
+    }
+
+    if (!bitmap_test(pool->map, index)) {
+        kernel_log_error("pool: double free of %p in pool %s", obj, pool->name);
+        return -1;
+    }
+
+    bitmap_clear(pool->map, index);
+
+#if POOL_DEBUG
+    kmemset(obj, POOL_POISON_FREE, pool->obj_size);
+#endif
+
+    *(void **)obj = pool->free_list;
+    pool->free_list = obj;
+
+#if POOL_STATS
+    pool->frees++;
+    pool->in_use--;
+#endif
+
+    return 0;
+}
+
+/**
+ * Obtains the index of an object within the pool
+ * @param pool - pointer to the pool
+ * @param obj - pointer to the object
+ * @return index of the object or -1 if the object is not part of the pool
+ */
+int pool_index(pool_t *pool, void *obj) {
+    size_t offset;
+
+    if (!pool || !obj) {
+        return -1;
+    }
+
+    if ((char *)obj < pool->storage) {
+        return -1;
+    }
+
+    offset = (char *)obj - pool->storage;
+
+    if (offset >= pool->count * pool->obj_size || (offset % pool->obj_size) != 0) {
+        return -1;
+    }
+
+    return offset / pool->obj_size;
+}
+
+/**
+ * Obtains an allocated object by its index within the pool
+ * @param pool - pointer to the pool
+ * @param index - index of the object
+ * @return pointer to the object or NULL if the index is not allocated
+ */
+void *pool_get(pool_t *pool, int index) {
+    if (!pool || index < 0 || index >= pool->count) {
+        return NULL;
+    }
+
+    if (!bitmap_test(pool->map, index)) {
+        return NULL;
+    }
+
+    return pool->storage + index * pool->obj_size;
+}
+
+/**
+ * Finds the next allocated object index at or after the given index
+ *
+ * @param pool - pointer to the pool
+ * @param index - index to start searching from
+ * @return index of the next allocated object or -1 if there are none
+ */
+int pool_next(pool_t *pool, int index) {
+    int word;
+    unsigned int bits;
+
+    if (!pool || index < 0) {
+        return -1;
+    }
+
+    // Nothing past the high-water mark has ever been allocated
+    if (index >= pool->next_unused) {
+        return -1;
+    }
+
+    // Mask off the bits before the index in the first word, then scan
+    word = index / BIT_WORD_BITS;
+    bits = pool->map[word] & (~0U << (index % BIT_WORD_BITS));
+
+    for (;;) {
+        if (bits) {
+            index = word * BIT_WORD_BITS + bit_ffs(bits);
+            return (index < pool->next_unused) ? index : -1;
+        }
+
+        if (++word >= BITMAP_WORDS(pool->next_unused)) {
+            return -1;
+        }
+
+        bits = pool->map[word];
+    }
+}
+
+/**
+ * Displays the pool statistics on the host console
+ * @param pool - pointer to the pool
+ */
+void pool_stats_dump(pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+
+#if POOL_STATS
+    kernel_log_info("pool: %s: size=%u count=%d in_use=%d peak=%d allocs=%u frees=%u failures=%u",
+                    pool->name, pool->obj_size, pool->count, pool->in_use, pool->peak,
+                    pool->allocs, pool->frees, pool->failures);
+#else
+    kernel_log_info("pool: %s: size=%u count=%d in_use=%d",
+                    pool->name, pool->obj_size, pool->count,
+                    bitmap_weight(pool->map, pool->count));
+#endif
+}
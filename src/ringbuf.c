@@ -7,16 +7,52 @@
 
 #include <spede/stdbool.h>      // for bool type
 #include <spede/stddef.h>       // for size_t
+
+#include "kstring.h"
 #include "ringbuf.h"
 
 /**
- * Initializes an empty ring buffer
+ * Initializes an empty ring buffer using the embedded storage
+ * Sets the empty data to 0
+ *
+ * @param  buf - pointer to the fixed-size ring buffer data structure
+ * @return -1 on error; 0 on success
+ */
+int ringbuf_init(ringbuf_fixed_t *buf) {
+    if (!buf) {
+        return -1;
+    }
+
+    return ringbuf_init_mem(&buf->ring, buf->data, sizeof(buf->data));
+}
+
+/**
+ * Initializes an empty ring buffer backed by caller-provided storage
  * Sets the empty data to 0
  *
- * @param  buf - pointer to the ring buffer data structure
+ * @param  buf      - pointer to the ring buffer data structure
+ * @param  mem      - pointer to the storage for the buffer data
+ * @param  capacity - size of the storage in bytes (must be a power of two)
  * @return -1 on error; 0 on success
  */
-int ringbuf_init(ringbuf_t *buf) {
+int ringbuf_init_mem(ringbuf_t *buf, char *mem, size_t capacity) {
+    if (!buf || !mem) {
+        return -1;
+    }
+
+    // The capacity must be a non-zero power of two so indexes can be masked
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return -1;
+    }
+
+    kmemset(mem, 0, capacity);
+
+    buf->head = 0;
+    buf->tail = 0;
+    buf->size = 0;
+    buf->mask = capacity - 1;
+    buf->data = mem;
+
     return 0;
 }
 
@@ -27,6 +63,18 @@ int ringbuf_init(ringbuf_t *buf) {
  * @return -1 on error; 0 on success
  */
 int ringbuf_write(ringbuf_t *buf, char byte) {
+    if (!buf || !buf->data) {
+        return -1;
+    }
+
+    if (buf->size > buf->mask) {
+        return -1;
+    }
+
+    buf->data[buf->tail] = byte;
+    buf->tail = (buf->tail + 1) & buf->mask;
+    buf->size++;
+
     return 0;
 }
 
@@ -37,6 +85,18 @@ int ringbuf_write(ringbuf_t *buf, char byte) {
  * @return -1 on error; 0 on success
  */
 int ringbuf_read(ringbuf_t *buf, char *byte) {
+    if (!buf || !buf->data || !byte) {
+        return -1;
+    }
+
+    if (buf->size == 0) {
+        return -1;
+    }
+
+    *byte = buf->data[buf->head];
+    buf->head = (buf->head + 1) & buf->mask;
+    buf->size--;
+
     return 0;
 }
 
@@ -50,9 +110,65 @@ int ringbuf_read(ringbuf_t *buf, char *byte) {
  *       cannot be copied - i.e. the buffer would overflow
  */
 int ringbuf_write_mem(ringbuf_t *buf, char *mem, size_t size) {
+    size_t chunk;
+
+    if (!buf || !buf->data || !mem) {
+        return -1;
+    }
+
+    if (size > (buf->mask + 1) - buf->size) {
+        return -1;
+    }
+
+    // Copy up to the end of the storage, then wrap around to the start
+    chunk = (buf->mask + 1) - buf->tail;
+    if (chunk > size) {
+        chunk = size;
+    }
+
+    kmemcpy(&buf->data[buf->tail], mem, chunk);
+    kmemcpy(&buf->data[0], mem + chunk, size - chunk);
+
+    buf->tail = (buf->tail + size) & buf->mask;
+    buf->size += size;
+
     return 0;
 }
 
+/**
+ * Copies multiple bytes to the buffer, discarding the oldest data to make
+ * room when the buffer would overflow (e.g. for a trace buffer)
+ * @param buf - pointer to the ring buffer structure
+ * @param mem - pointer to the memory location to copy from
+ * @param size - number of bytes to copy; only the last capacity bytes
+ *               are kept if more are given
+ * @return -1 on error, 0 on success
+ */
+int ringbuf_write_mem_overwrite(ringbuf_t *buf, char *mem, size_t size) {
+    size_t capacity;
+    size_t avail;
+
+    if (!buf || !buf->data || !mem) {
+        return -1;
+    }
+
+    // Only the most recent data fits if more than the capacity is written
+    capacity = buf->mask + 1;
+    if (size > capacity) {
+        mem += size - capacity;
+        size = capacity;
+    }
+
+    // Discard the oldest data to make room
+    avail = capacity - buf->size;
+    if (size > avail) {
+        buf->head = (buf->head + (size - avail)) & buf->mask;
+        buf->size -= size - avail;
+    }
+
+    return ringbuf_write_mem(buf, mem, size);
+}
+
 /**
  * Copies multiple bytes from the buffer to the specified memory
  * @param buf - pointer to the ring buffer structure
@@ -62,7 +178,29 @@ int ringbuf_write_mem(ringbuf_t *buf, char *mem, size_t size) {
  *         copied
  */
 int ringbuf_read_mem(ringbuf_t *buf, char *mem, size_t size) {
-    return 0;
+    size_t chunk;
+
+    if (!buf || !buf->data || !mem) {
+        return -1;
+    }
+
+    if (size > buf->size) {
+        size = buf->size;
+    }
+
+    // Copy up to the end of the storage, then wrap around to the start
+    chunk = (buf->mask + 1) - buf->head;
+    if (chunk > size) {
+        chunk = size;
+    }
+
+    kmemcpy(mem, &buf->data[buf->head], chunk);
+    kmemcpy(mem + chunk, &buf->data[0], size - chunk);
+
+    buf->head = (buf->head + size) & buf->mask;
+    buf->size -= size;
+
+    return size;
 }
 
 /**
@@ -71,16 +209,41 @@ int ringbuf_read_mem(ringbuf_t *buf, char *mem, size_t size) {
  * @return -1 on error, 0 on success
  */
 int ringbuf_flush(ringbuf_t *buf) {
+    if (!buf) {
+        return -1;
+    }
+
+    buf->head = 0;
+    buf->tail = 0;
+    buf->size = 0;
+
     return 0;
 }
 
+/**
+ * Returns the capacity of the buffer
+ * @param buf - pointer to the ring buffer structure
+ * @return number of bytes the buffer can hold
+ */
+size_t ringbuf_capacity(ringbuf_t *buf) {
+    if (!buf || !buf->data) {
+        return 0;
+    }
+
+    return buf->mask + 1;
+}
+
 /**
  * Indicates if the buffer is empty
  * @param buf - pointer to the ring buffer structure
  * @return true if empty, false if not empty
  */
 bool ringbuf_is_empty(ringbuf_t *buf) {
-    return false;
+    if (!buf) {
+        return true;
+    }
+
+    return buf->size == 0;
 }
 
 /**
@@ -89,6 +252,9 @@ bool ringbuf_is_empty(ringbuf_t *buf) {
  * @return true if full, false if not full
  */
 bool ringbuf_is_full(ringbuf_t *buf) {
-    return false;
-}
+    if (!buf || !buf->data) {
+        return true;
+    }
 
+    return buf->size > buf->mask;
+}
@@ -0,0 +1,1103 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Scheduler Implementation
+ */
+#include <spede/stddef.h>
+
+#include "bit.h"
+#include "fpu.h"
+#include "gdt.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "timer.h"
+#include "vm.h"
+
+// Set of ready processes, one FIFO per priority level
+typedef struct sched_array_t {
+    unsigned int bitmap;                // Bit set for each non-empty level
+    int count;                          // Number of processes in the array
+    proc_t *head[PROC_PRIORITIES];      // First process at each level
+    proc_t *tail[PROC_PRIORITIES];      // Last process at each level
+} sched_array_t;
+
+// Run queue of a CPU
+typedef struct sched_rq_t {
+    sched_array_t arrays[2];
+    sched_array_t *active;              // Processes that have not used up their time slice this round
+    sched_array_t *expired;             // Processes that have (run once the active set is empty)
+    bool need_resched;                  // Set when the running process should be switched out
+    proc_t *handoff;                    // Process to switch to next, bypassing the queues
+    proc_t *edf_ready;                  // Ready EDF processes, earliest deadline first
+    proc_t *edf_throttled;              // EDF processes waiting for their next period, earliest first
+    int edf_count;                      // Number of ready EDF processes
+    int edf_nr;                         // Number of EDF processes admitted to the CPU
+    int edf_util;                       // Share of the CPU they reserve (see SCHEDULER_EDF_UTIL_SCALE)
+    unsigned int edf_misses;            // EDF jobs completed after their deadline
+    unsigned int edf_overruns;          // EDF jobs throttled for using up their budget
+    int balance_ticks;                  // Ticks until the next load balancing pass
+    unsigned int migrations;            // Processes pulled from other CPUs
+} sched_rq_t;
+
+// Run queue of each CPU
+sched_rq_t sched_rqs[CPU_MAX];
+
+/**
+ * Returns the run queue of the CPU that is running
+ * @return pointer to the run queue
+ */
+static inline sched_rq_t *sched_this_rq(void) {
+    return &sched_rqs[this_cpu()->id];
+}
+
+/**
+ * Returns the load of a CPU: its ready processes plus the running one
+ * (unless it is idle)
+ * @param cpu - CPU index
+ * @return number of processes
+ */
+static int sched_load(int cpu) {
+    sched_rq_t *rq = &sched_rqs[cpu];
+    proc_t *proc = cpu_table[cpu].current;
+    int load = rq->active->count + rq->expired->count + rq->edf_count;
+
+    if (proc && !kproc_is_idle(proc)) {
+        load++;
+    }
+
+    return load;
+}
+
+/**
+ * Tests if a process is already waiting to run
+ * @param proc - pointer to the process
+ * @return true if the process is queued or about to be handed the CPU
+ */
+static bool sched_queued(proc_t *proc) {
+    return proc->run_array || proc->edf_list || sched_rqs[proc->cpu].handoff == proc;
+}
+
+/**
+ * Tests if a tick comes before another (allowing for wraparound)
+ * @param a - tick
+ * @param b - tick
+ * @return true if a is before b
+ */
+static inline bool sched_tick_before(int a, int b) {
+    return (int)((unsigned int)a - (unsigned int)b) < 0;
+}
+
+/**
+ * Computes the effective priority of a process from its base, boost and
+ * inherited priority
+ * @param proc - pointer to the process
+ */
+static void scheduler_update_priority(proc_t *proc) {
+    int priority = proc->base_priority - proc->boost;
+
+    if (priority < 0) {
+        priority = 0;
+    } else if (priority >= PROC_PRIORITIES) {
+        priority = PROC_PRIORITIES - 1;
+    }
+
+    // A process never runs below the priority lent to it
+    if (proc->inherited_priority < priority) {
+        priority = proc->inherited_priority;
+    }
+
+    proc->priority = priority;
+}
+
+/**
+ * Appends a process to its priority level in an array
+ * @param array - pointer to the array
+ * @param proc - pointer to the process
+ */
+static void sched_array_push(sched_array_t *array, proc_t *proc) {
+    int prio = proc->priority;
+
+    proc->run_next = NULL;
+    proc->run_prev = array->tail[prio];
+    proc->run_array = array;
+
+    if (array->tail[prio]) {
+        array->tail[prio]->run_next = proc;
+    } else {
+        array->head[prio] = proc;
+        array->bitmap = bit_set(array->bitmap, prio);
+    }
+
+    array->tail[prio] = proc;
+    array->count++;
+}
+
+/**
+ * Removes a process from the array that holds it
+ * @param proc - pointer to the process
+ */
+static void sched_array_remove(proc_t *proc) {
+    sched_array_t *array = proc->run_array;
+    int prio = proc->priority;
+
+    if (!array) {
+        return;
+    }
+
+    if (proc->run_prev) {
+        proc->run_prev->run_next = proc->run_next;
+    } else {
+        array->head[prio] = proc->run_next;
+    }
+
+    if (proc->run_next) {
+        proc->run_next->run_prev = proc->run_prev;
+    } else {
+        array->tail[prio] = proc->run_prev;
+    }
+
+    if (!array->head[prio]) {
+        array->bitmap = bit_clear(array->bitmap, prio);
+    }
+
+    proc->run_next = NULL;
+    proc->run_prev = NULL;
+    proc->run_array = NULL;
+    array->count--;
+}
+
+/**
+ * Changes the base and inherited priority of a process, requeueing it if
+ * it is ready and preempting as needed (called with interrupts disabled)
+ * @param proc - pointer to the process
+ * @param base - base priority
+ * @param inherited - inherited priority
+ */
+static void sched_reprioritize(proc_t *proc, int base, int inherited) {
+    sched_array_t *array = proc->run_array;
+    proc_t *running = cpu_table[proc->cpu].current;
+
+    // Requeue a ready process at its new level
+    if (array) {
+        sched_array_remove(proc);
+    }
+
+    proc->base_priority = base;
+    proc->inherited_priority = inherited;
+    scheduler_update_priority(proc);
+
+    if (array) {
+        sched_array_push(array, proc);
+    }
+
+    // A ready process may now outrank the running one, and a running one
+    // whose priority dropped may now rank below a ready one
+    if (running && (proc == running || (array && proc->priority < running->priority))) {
+        scheduler_resched_cpu(proc->cpu);
+    }
+}
+
+/**
+ * Inserts a process into an EDF list after every process with an earlier
+ * or equal key
+ * @param list - pointer to the head of the list
+ * @param proc - pointer to the process
+ * @param by_release - true to sort by release, false by deadline
+ */
+static void sched_edf_insert(proc_t **list, proc_t *proc, bool by_release) {
+    int key = by_release ? proc->edf_release : proc->edf_due;
+    proc_t **link = list;
+
+    while (*link && !sched_tick_before(key, by_release ? (*link)->edf_release : (*link)->edf_due)) {
+        link = &(*link)->edf_next;
+    }
+
+    proc->edf_next = *link;
+    proc->edf_list = list;
+    *link = proc;
+}
+
+/**
+ * Removes a process from the EDF list that holds it
+ * @param proc - pointer to the process
+ */
+static void sched_edf_remove(proc_t *proc) {
+    sched_rq_t *rq = &sched_rqs[proc->cpu];
+    proc_t **link = proc->edf_list;
+
+    if (!link) {
+        return;
+    }
+
+    while (*link && *link != proc) {
+        link = &(*link)->edf_next;
+    }
+
+    if (*link) {
+        *link = proc->edf_next;
+    }
+
+    if (proc->edf_list == &rq->edf_ready) {
+        rq->edf_count--;
+    }
+
+    proc->edf_next = NULL;
+    proc->edf_list = NULL;
+}
+
+/**
+ * Starts a new period of an EDF process with a full budget
+ * @param proc - pointer to the process
+ * @param release - tick the period starts at
+ */
+static void sched_edf_start(proc_t *proc, int release) {
+    proc->edf_release = release;
+    proc->edf_due = release + proc->edf_deadline;
+    proc->edf_budget = proc->edf_runtime;
+}
+
+/**
+ * Queues a ready EDF process on its CPU, preempting the running process
+ * if it is not EDF or is due later
+ * @param proc - pointer to the process
+ */
+static void sched_edf_queue(proc_t *proc) {
+    sched_rq_t *rq = &sched_rqs[proc->cpu];
+    proc_t *running = cpu_table[proc->cpu].current;
+
+    proc->state = PROC_STATE_READY;
+    sched_edf_insert(&rq->edf_ready, proc, false);
+    rq->edf_count++;
+
+    if (running && running != proc
+        && (!running->edf_runtime || sched_tick_before(proc->edf_due, running->edf_due))) {
+        scheduler_resched_cpu(proc->cpu);
+    }
+}
+
+/**
+ * Holds an EDF process back until its next period starts
+ * @param proc - pointer to the process
+ * @param release - tick the next period starts at
+ */
+static void sched_edf_throttle(proc_t *proc, int release) {
+    int now = timer_get_ticks();
+
+    proc->state = PROC_STATE_READY;
+    proc->edf_budget = 0;
+
+    // A period that has already started is joined late
+    if (!sched_tick_before(now, release)) {
+        sched_edf_start(proc, now);
+        sched_edf_queue(proc);
+        return;
+    }
+
+    proc->edf_release = release;
+    sched_edf_insert(&sched_rqs[proc->cpu].edf_throttled, proc, true);
+}
+
+/**
+ * Queues an EDF process that is in no list (just admitted or done
+ * waiting), applying the CBS wakeup rule: it keeps its deadline only if
+ * its remaining budget fits in the time left at its reserved share of
+ * the CPU, and otherwise starts a new period
+ * @param proc - pointer to the process
+ */
+static void sched_edf_wakeup(proc_t *proc) {
+    int now = timer_get_ticks();
+    int left = (int)((unsigned int)proc->edf_due - (unsigned int)now);
+
+    if (left <= 0 || proc->edf_budget * proc->edf_deadline > left * proc->edf_runtime) {
+        sched_edf_start(proc, now);
+    }
+
+    if (proc->edf_budget <= 0) {
+        sched_edf_throttle(proc, proc->edf_release + proc->edf_period);
+    } else {
+        sched_edf_queue(proc);
+    }
+}
+
+/**
+ * Removes and returns the highest priority ready process
+ * @return pointer to the process or NULL if none are ready
+ */
+static proc_t *scheduler_pick(sched_rq_t *rq) {
+    sched_array_t *array;
+    proc_t *proc;
+
+    // Start a new round once every active process has run
+    if (rq->active->count == 0) {
+        array = rq->active;
+        rq->active = rq->expired;
+        rq->expired = array;
+    }
+
+    if (rq->active->count == 0) {
+        return NULL;
+    }
+
+    proc = rq->active->head[bit_ffs(rq->active->bitmap)];
+    sched_array_remove(proc);
+
+    return proc;
+}
+
+/**
+ * Returns the priority of the highest priority ready process
+ * @return priority or PROC_PRIORITIES if none are ready
+ */
+static int scheduler_top_priority(sched_rq_t *rq) {
+    if (rq->active->count > 0) {
+        return bit_ffs(rq->active->bitmap);
+    }
+
+    if (rq->expired->count > 0) {
+        return bit_ffs(rq->expired->bitmap);
+    }
+
+    return PROC_PRIORITIES;
+}
+
+/**
+ * Tests if the running process should keep the CPU: an EDF process only
+ * gives way to one that is due earlier, any other process to a ready EDF
+ * process or a higher priority
+ * @param rq - this CPU's run queue
+ * @param proc - pointer to the running process
+ * @return true if the process keeps running
+ */
+static bool sched_keeps_cpu(sched_rq_t *rq, proc_t *proc) {
+    if (proc->edf_runtime) {
+        return proc->edf_budget > 0
+            && (!rq->edf_ready || !sched_tick_before(rq->edf_ready->edf_due, proc->edf_due));
+    }
+
+    return !rq->edf_ready && proc->quantum > 0 && scheduler_top_priority(rq) > proc->priority;
+}
+
+/**
+ * Removes the lowest priority process that may move to another CPU from
+ * an array
+ * @param array - pointer to the array
+ * @return pointer to the process or NULL if none may move
+ */
+static proc_t *sched_array_steal(sched_array_t *array) {
+    for (int prio = PROC_PRIORITIES - 1; prio >= 0; prio--) {
+        if (!bit_test(array->bitmap, prio)) {
+            continue;
+        }
+
+        // The FPU state of a process may only be in its CPU's registers
+        for (proc_t *proc = array->tail[prio]; proc; proc = proc->run_prev) {
+            if (!fpu_live(proc)) {
+                sched_array_remove(proc);
+                return proc;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Pulls processes from the busiest CPU to this one when the loads differ
+ * by two or more (called with interrupts disabled)
+ * @param rq - this CPU's run queue
+ */
+static void scheduler_balance(sched_rq_t *rq) {
+    int cpu = this_cpu()->id;
+    int load = sched_load(cpu);
+    int busiest = -1;
+    int busiest_load = 0;
+    sched_rq_t *src;
+    proc_t *proc;
+
+    for (int i = 0; i < smp_nr_cpus; i++) {
+        int l = sched_load(i);
+
+        if (i != cpu && cpu_table[i].online && l > busiest_load) {
+            busiest = i;
+            busiest_load = l;
+        }
+    }
+
+    if (busiest < 0 || busiest_load - load < 2) {
+        return;
+    }
+
+    src = &sched_rqs[busiest];
+
+    // Move half the difference, preferring processes that would wait for
+    // the next round and low priorities
+    for (int n = (busiest_load - load) / 2; n > 0; n--) {
+        proc = sched_array_steal(src->expired);
+        if (!proc) {
+            proc = sched_array_steal(src->active);
+        }
+
+        if (!proc) {
+            break;
+        }
+
+        proc->cpu = cpu;
+        sched_array_push(rq->active, proc);
+        rq->migrations++;
+    }
+}
+
+/**
+ * Charges a timer tick to this CPU's running process, preempting it when
+ * its time slice expires
+ */
+void scheduler_tick(void) {
+    sched_rq_t *rq = sched_this_rq();
+    int now = timer_get_ticks();
+    proc_t *proc;
+
+    if (!active_proc) {
+        return;
+    }
+
+    active_proc->cpu_time++;
+
+    // Start the periods of throttled EDF processes that are due
+    while (rq->edf_throttled && !sched_tick_before(now, rq->edf_throttled->edf_release)) {
+        proc = rq->edf_throttled;
+        sched_edf_remove(proc);
+        sched_edf_start(proc, proc->edf_release);
+        sched_edf_queue(proc);
+    }
+
+    // Idle CPUs look for work on every tick
+    if (smp_nr_cpus > 1 && (active_proc == idle_proc || --rq->balance_ticks <= 0)) {
+        rq->balance_ticks = SCHEDULER_BALANCE_INTERVAL;
+        scheduler_balance(rq);
+    }
+
+    if (active_proc == idle_proc) {
+        if (rq->active->count + rq->expired->count + rq->edf_count > 0) {
+            rq->need_resched = true;
+        }
+    } else if (active_proc->edf_runtime) {
+        // EDF processes run until their budget is used up
+        if (--active_proc->edf_budget <= 0) {
+            rq->need_resched = true;
+        }
+    } else if (--active_proc->quantum <= 0) {
+        rq->need_resched = true;
+    }
+}
+
+/**
+ * Reschedule IRQ handler (see scheduler_yield)
+ */
+static void scheduler_yield_handler(void) {
+    sched_this_rq()->need_resched = true;
+}
+
+/**
+ * Initializes the scheduler
+ */
+void scheduler_init(void) {
+    kernel_log_info("Initializing scheduler");
+
+    kmemset(sched_rqs, 0, sizeof(sched_rqs));
+
+    for (int i = 0; i < CPU_MAX; i++) {
+        sched_rqs[i].active = &sched_rqs[i].arrays[0];
+        sched_rqs[i].expired = &sched_rqs[i].arrays[1];
+        sched_rqs[i].balance_ticks = SCHEDULER_BALANCE_INTERVAL;
+    }
+
+    interrupts_irq_register(IRQ_YIELD, isr_entry_yield, scheduler_yield_handler);
+
+    // Charge every tick to the running process (the other CPUs receive
+    // the tick from the boot CPU, see smp.h)
+    timer_callback_register(scheduler_tick, 1, -1);
+}
+
+/**
+ * Adds a process to the run queue
+ * @param proc - pointer to the process
+ */
+void scheduler_add(proc_t *proc) {
+    unsigned int flags;
+    sched_rq_t *rq;
+
+    if (!proc || kproc_is_idle(proc)) {
+        return;
+    }
+
+    flags = interrupts_save();
+
+    if (proc->edf_runtime && !sched_queued(proc)) {
+        // EDF processes stay on the CPU they were admitted to
+        sched_edf_wakeup(proc);
+    } else if (!sched_queued(proc)) {
+        // New processes start on the least loaded CPU; others return to
+        // the CPU they last ran on
+        if (proc->state == PROC_STATE_NONE) {
+            for (int i = 0; i < smp_nr_cpus; i++) {
+                if (cpu_table[i].online && sched_load(i) < sched_load(proc->cpu)) {
+                    proc->cpu = i;
+                }
+            }
+        }
+
+        rq = &sched_rqs[proc->cpu];
+
+        proc->state = PROC_STATE_READY;
+        sched_array_push(rq->active, proc);
+
+        // Stop idling as soon as there is work to do
+        if (cpu_table[proc->cpu].current == cpu_table[proc->cpu].idle) {
+            scheduler_resched_cpu(proc->cpu);
+        }
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Adds a process that has finished waiting to the run queue, boosting
+ * its priority and preempting the running process if it now ranks higher
+ * @param proc - pointer to the process
+ */
+void scheduler_wakeup(proc_t *proc) {
+    unsigned int flags;
+    proc_t *running;
+
+    if (!proc || kproc_is_idle(proc)) {
+        return;
+    }
+
+    flags = interrupts_save();
+
+    // The priority of a queued process cannot change in place, and a
+    // running process has nothing to wake up from
+    if (sched_queued(proc) || proc->state == PROC_STATE_RUNNING || proc->state == PROC_STATE_EXITED) {
+        interrupts_restore(flags);
+        return;
+    }
+
+    // EDF processes rank by deadline instead (see sched_edf_queue)
+    if (proc->edf_runtime) {
+        scheduler_add(proc);
+        interrupts_restore(flags);
+        return;
+    }
+
+    // Waiting instead of computing earns a boost
+    if (proc->boost < SCHEDULER_BOOST_MAX) {
+        proc->boost++;
+    }
+
+    scheduler_update_priority(proc);
+    scheduler_add(proc);
+
+    // Preempt the process running where the woken process was queued
+    running = cpu_table[proc->cpu].current;
+    if (running && !kproc_is_idle(running) && proc->priority < running->priority) {
+        scheduler_resched_cpu(proc->cpu);
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Sets the base priority of a process
+ * @param proc - pointer to the process
+ * @param priority - priority (0 is the highest)
+ * @return -1 on error; 0 on success
+ */
+int scheduler_set_priority(proc_t *proc, int priority) {
+    unsigned int flags;
+
+    if (!proc || priority < 0 || priority >= PROC_PRIORITIES) {
+        return -1;
+    }
+
+    flags = interrupts_save();
+
+    sched_reprioritize(proc, priority, proc->inherited_priority);
+
+    interrupts_restore(flags);
+
+    return 0;
+}
+
+/**
+ * Lends a process a priority (e.g. while it holds a lock that a higher
+ * priority process waits for); the process runs at the higher of its
+ * own and the inherited priority
+ * @param proc - pointer to the process
+ * @param priority - inherited priority (PROC_PRIORITIES for none)
+ */
+void scheduler_inherit_priority(proc_t *proc, int priority) {
+    unsigned int flags;
+
+    if (!proc || priority < 0 || priority > PROC_PRIORITIES) {
+        return;
+    }
+
+    flags = interrupts_save();
+
+    if (priority != proc->inherited_priority) {
+        sched_reprioritize(proc, proc->base_priority, priority);
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Moves a process into the earliest deadline first class, or back to the
+ * priority levels with a runtime of 0
+ *
+ * The process is admitted to its own CPU if there is room, or else (if it
+ * is not running) to the least loaded CPU that has room. Its first period
+ * starts right away.
+ * @param proc - pointer to the process
+ * @param runtime - time it runs in each period in milliseconds (0 to leave the class)
+ * @param period - period in milliseconds
+ * @param deadline - deadline relative to the start of each period in
+ *                   milliseconds (runtime <= deadline <= period)
+ * @return -1 on error or if no CPU can take the process; 0 on success
+ */
+int scheduler_set_edf(proc_t *proc, int runtime, int period, int deadline) {
+    unsigned int flags;
+    sched_rq_t *rq;
+    bool pinned;
+    bool queued;
+    int util = 0;
+    int cpu = -1;
+
+    if (!proc || kproc_is_idle(proc) || runtime < 0) {
+        return -1;
+    }
+
+    if (runtime > 0) {
+        if (runtime > deadline || deadline > period || period > SCHEDULER_EDF_PERIOD_MAX) {
+            return -1;
+        }
+
+        // Round up to whole ticks, which keeps runtime <= deadline <= period
+        runtime = (runtime * TIMER_HZ + 999) / 1000;
+        period = (period * TIMER_HZ + 999) / 1000;
+        deadline = (deadline * TIMER_HZ + 999) / 1000;
+
+        // Admission uses the density, which is exact for deadline = period
+        // and safe for shorter deadlines
+        util = runtime * SCHEDULER_EDF_UTIL_SCALE / deadline;
+    }
+
+    flags = interrupts_save();
+
+    if (proc->state == PROC_STATE_EXITED) {
+        interrupts_restore(flags);
+        return -1;
+    }
+
+    // A running or handed off process, or one whose FPU state is in its
+    // CPU's registers, cannot move to another CPU
+    rq = &sched_rqs[proc->cpu];
+    pinned = cpu_table[proc->cpu].current == proc || rq->handoff == proc || fpu_live(proc);
+
+    // Give back the share reserved so far before admitting the new one
+    if (proc->edf_runtime) {
+        rq->edf_util -= proc->edf_util;
+        rq->edf_nr--;
+    }
+
+    if (runtime > 0) {
+        if (rq->edf_util + util <= SCHEDULER_EDF_UTIL_MAX) {
+            cpu = proc->cpu;
+        } else if (!pinned) {
+            for (int i = 0; i < smp_nr_cpus; i++) {
+                if (cpu_table[i].online && sched_rqs[i].edf_util + util <= SCHEDULER_EDF_UTIL_MAX
+                    && (cpu < 0 || sched_rqs[i].edf_util < sched_rqs[cpu].edf_util)) {
+                    cpu = i;
+                }
+            }
+        }
+
+        if (cpu < 0) {
+            if (proc->edf_runtime) {
+                rq->edf_util += proc->edf_util;
+                rq->edf_nr++;
+            }
+
+            interrupts_restore(flags);
+
+            kernel_log_warn("scheduler: no CPU has room for process %d (EDF utilization %d/%d)",
+                            proc->pid, util, SCHEDULER_EDF_UTIL_SCALE);
+            return -1;
+        }
+    }
+
+    // Take a ready process off its queue while it changes class
+    queued = proc->run_array || proc->edf_list;
+    sched_array_remove(proc);
+    sched_edf_remove(proc);
+
+    proc->edf_runtime = runtime;
+    proc->edf_period = period;
+    proc->edf_deadline = deadline;
+    proc->edf_util = util;
+
+    if (runtime > 0) {
+        proc->cpu = cpu;
+        rq = &sched_rqs[cpu];
+        rq->edf_util += util;
+        rq->edf_nr++;
+
+        sched_edf_start(proc, timer_get_ticks());
+
+        if (queued) {
+            sched_edf_queue(proc);
+        }
+    } else if (queued) {
+        proc->state = PROC_STATE_READY;
+        sched_array_push(rq->active, proc);
+        scheduler_resched_cpu(proc->cpu);
+    }
+
+    // The running process changes class at the next switch
+    if (cpu_table[proc->cpu].current == proc) {
+        scheduler_resched_cpu(proc->cpu);
+    }
+
+    interrupts_restore(flags);
+
+    return 0;
+}
+
+/**
+ * Ends the current job of the running EDF process, which sleeps until
+ * its next period starts (other processes simply yield)
+ */
+void scheduler_edf_yield(void) {
+    proc_t *proc = active_proc;
+    unsigned int flags;
+
+    if (!proc || !proc->edf_runtime) {
+        scheduler_yield();
+        return;
+    }
+
+    flags = interrupts_save();
+
+    if (sched_tick_before(proc->edf_due, timer_get_ticks())) {
+        proc->edf_misses++;
+        sched_this_rq()->edf_misses++;
+    }
+
+    // The process is queued again once its next period starts
+    sched_edf_throttle(proc, proc->edf_release + proc->edf_period);
+
+    // A nested interrupt would not switch processes
+    if (interrupts_get_frame()) {
+        scheduler_resched();
+    } else {
+        scheduler_yield();
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Removes a process from the run queue
+ * @param proc - pointer to the process
+ */
+void scheduler_remove(proc_t *proc) {
+    unsigned int flags;
+
+    if (!proc) {
+        return;
+    }
+
+    flags = interrupts_save();
+
+    sched_array_remove(proc);
+    sched_edf_remove(proc);
+
+    if (sched_rqs[proc->cpu].handoff == proc) {
+        sched_rqs[proc->cpu].handoff = NULL;
+    }
+
+    // Give back the share of the CPU reserved by an EDF process
+    if (proc->edf_runtime) {
+        sched_rqs[proc->cpu].edf_util -= proc->edf_util;
+        sched_rqs[proc->cpu].edf_nr--;
+        proc->edf_runtime = 0;
+    }
+
+    if (proc->state == PROC_STATE_READY) {
+        proc->state = PROC_STATE_NONE;
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Switches directly to a process that was just unblocked once the
+ * current interrupt returns, without going through the run queue
+ *
+ * Meant for a process that is about to block waiting for the one it hands
+ * over to (e.g. an IPC call switching to the server that receives it).
+ * The process runs on this CPU with the rest of its time slice; one that
+ * cannot move here is woken up normally instead.
+ * @param proc - pointer to the process
+ */
+void scheduler_handoff(proc_t *proc) {
+    unsigned int flags;
+    sched_rq_t *rq;
+
+    if (!proc || kproc_is_idle(proc)) {
+        return;
+    }
+
+    flags = interrupts_save();
+
+    rq = sched_this_rq();
+
+    // The FPU state of a process may only be in its CPU's registers, and
+    // EDF processes stay on their CPU and rank by deadline
+    if (sched_queued(proc) || proc->state == PROC_STATE_RUNNING || proc->state == PROC_STATE_EXITED
+        || (proc->cpu != this_cpu()->id && fpu_live(proc)) || proc->edf_runtime) {
+        scheduler_wakeup(proc);
+        interrupts_restore(flags);
+        return;
+    }
+
+    // A previous handoff that was never taken goes back to the queue
+    if (rq->handoff) {
+        sched_array_push(rq->active, rq->handoff);
+    }
+
+    proc->cpu = this_cpu()->id;
+    proc->state = PROC_STATE_READY;
+    rq->handoff = proc;
+    rq->need_resched = true;
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Returns the number of runnable processes (ready or running, excluding
+ * the idle process)
+ * @return number of processes
+ */
+int scheduler_nr_running(void) {
+    int count = 0;
+
+    for (int i = 0; i < smp_nr_cpus; i++) {
+        count += sched_load(i);
+    }
+
+    return count;
+}
+
+/**
+ * Blocks the running process until scheduler_wakeup is called for it
+ *
+ * Callers check their wait condition with interrupts disabled and keep
+ * them disabled until this call, so a wakeup cannot be missed in between.
+ * Inside an interrupt handler (e.g. a system call) the process is only
+ * switched out once the handler returns, so this returns immediately.
+ */
+void scheduler_block(void) {
+    if (!active_proc || active_proc == idle_proc) {
+        kernel_panic("scheduler: the idle process cannot block");
+        return;
+    }
+
+    // A waiting process is not requeued when it is switched out
+    active_proc->state = PROC_STATE_WAITING;
+
+    // A nested interrupt would not switch processes
+    if (interrupts_get_frame()) {
+        scheduler_resched();
+        return;
+    }
+
+    scheduler_yield();
+}
+
+/**
+ * Requests a reschedule when the current interrupt returns
+ */
+void scheduler_resched(void) {
+    sched_this_rq()->need_resched = true;
+}
+
+/**
+ * Requests a reschedule on the given CPU
+ * @param cpu - CPU index
+ */
+void scheduler_resched_cpu(int cpu) {
+    sched_rqs[cpu].need_resched = true;
+
+    // Another CPU only notices once it handles an interrupt
+    if (cpu != this_cpu()->id) {
+        smp_resched_cpu(cpu);
+    }
+}
+
+/**
+ * Gives up the remainder of the running process's time slice
+ */
+void scheduler_yield(void) {
+    asm volatile("int %0" : : "i"(IRQ_YIELD) : "memory");
+}
+
+/**
+ * Selects the process to resume when the outermost interrupt returns
+ *
+ * @param frame - trap frame of the interrupted process
+ * @return trap frame of the process to resume
+ */
+trap_frame_t *scheduler_run(trap_frame_t *frame) {
+    sched_rq_t *rq = sched_this_rq();
+    proc_t *prev = active_proc;
+    proc_t *next;
+
+    if (!prev) {
+        return frame;
+    }
+
+    prev->frame = frame;
+
+    if (!rq->need_resched) {
+        return frame;
+    }
+
+    rq->need_resched = false;
+
+    // A handoff skips the priority checks
+    next = rq->handoff;
+    rq->handoff = NULL;
+
+    // Keep running the current process if nothing ready ranks higher
+    if (!next && prev->state == PROC_STATE_RUNNING && prev != idle_proc && sched_keeps_cpu(rq, prev)) {
+        return frame;
+    }
+
+    // An exited EDF process may still be queued if it ended a job first
+    if (prev->state == PROC_STATE_EXITED) {
+        sched_edf_remove(prev);
+    }
+
+    // Requeue the preempted process
+    if (prev->state == PROC_STATE_RUNNING) {
+        if (prev == idle_proc) {
+            prev->state = PROC_STATE_READY;
+        } else if (prev->edf_runtime) {
+            if (prev->edf_budget > 0) {
+                sched_edf_queue(prev);
+            } else {
+                // The budget is used up: hold the process back until its
+                // next period so it cannot take more than it reserved
+                prev->edf_overruns++;
+                rq->edf_overruns++;
+                sched_edf_throttle(prev, prev->edf_release + prev->edf_period);
+            }
+        } else if (prev->quantum <= 0) {
+            // Using the whole time slice costs boost; CPU-bound processes
+            // wait for the next round unless they are still interactive
+            if (prev->boost > -SCHEDULER_BOOST_MAX) {
+                prev->boost--;
+            }
+
+            scheduler_update_priority(prev);
+            prev->quantum = SCHEDULER_TIMESLICE;
+            prev->state = PROC_STATE_READY;
+
+            sched_array_push(prev->boost >= SCHEDULER_INTERACTIVE ? rq->active : rq->expired, prev);
+        } else {
+            prev->state = PROC_STATE_READY;
+            sched_array_push(rq->active, prev);
+        }
+    }
+
+    // Ready EDF processes run before the priority levels
+    if (!next && rq->edf_ready) {
+        next = rq->edf_ready;
+        sched_edf_remove(next);
+    }
+
+    if (!next) {
+        next = scheduler_pick(rq);
+    }
+
+    // Look for work on the other CPUs before going idle
+    if (!next && smp_nr_cpus > 1) {
+        scheduler_balance(rq);
+        next = scheduler_pick(rq);
+    }
+
+    if (!next) {
+        next = idle_proc;
+    }
+
+    // Resuming the same process needs no switch
+    if (next == prev) {
+        prev->state = PROC_STATE_RUNNING;
+        return frame;
+    }
+
+    // A process that was preempted part way keeps the rest of its slice
+    if (next->quantum <= 0) {
+        next->quantum = SCHEDULER_TIMESLICE;
+    }
+
+    next->state = PROC_STATE_RUNNING;
+    next->cpu = this_cpu()->id;
+    active_proc = next;
+
+    // The kernel lock levels held by each process go with it
+    kernel_lock_switch(prev, next);
+
+    // FPU state is only switched if the next process uses it
+    fpu_switch(next);
+
+    // Traps from user mode enter on the process's own kernel stack
+    if (next->space) {
+        gdt_set_kernel_stack(next->kstack_top);
+    }
+
+    // An exited process can be freed now that its stack is no longer in use
+    if (prev->state == PROC_STATE_EXITED) {
+        kproc_destroy(prev);
+    }
+
+    if (next->space != vm_current()) {
+        vm_switch(next->space);
+    }
+
+    return next->frame;
+}
+
+/**
+ * Dumps the run queue of each CPU
+ */
+void scheduler_dump(void) {
+    for (int i = 0; i < smp_nr_cpus; i++) {
+        sched_rq_t *rq = &sched_rqs[i];
+
+        kernel_log_info("scheduler: CPU %d load %d (%d active, %d expired), %u migrations", i,
+                        sched_load(i), rq->active->count, rq->expired->count, rq->migrations);
+
+        if (rq->edf_nr > 0) {
+            kernel_log_info("scheduler: CPU %d EDF %d processes, utilization %d/%d, %u misses, %u overruns",
+                            i, rq->edf_nr, rq->edf_util, SCHEDULER_EDF_UTIL_SCALE, rq->edf_misses,
+                            rq->edf_overruns);
+        }
+    }
+}
@@ -0,0 +1,412 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Symmetric Multiprocessing Implementation
+ */
+#include <spede/machine/io.h>
+
+#include "acpi.h"
+#include "apic.h"
+#include "cpu.h"
+#include "cpustat.h"
+#include "gdt.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "paging.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "stack.h"
+#include "syscall.h"
+#include "timer.h"
+
+// Port read to wait roughly one microsecond
+#define SMP_DELAY_PORT      0x80
+
+// Microseconds to wait after INIT, after each startup IPI, and for an
+// application processor to come online
+#define SMP_INIT_DELAY      10000
+#define SMP_STARTUP_DELAY   200
+#define SMP_ONLINE_TIMEOUT  100000
+
+// Parameters at the end of the trampoline (see smp_trampoline.S)
+typedef struct smp_boot_t {
+    unsigned int cr0;               // Control registers of the boot CPU
+    unsigned int cr3;
+    unsigned int cr4;
+    unsigned int stack;             // Initial stack pointer
+    unsigned int entry;             // Kernel entry point (smp_ap_entry)
+    unsigned int cpu;               // CPU index passed to the entry point
+    unsigned short pad;
+    unsigned short gdt_limit;       // Descriptor table used to enter protected mode
+    unsigned int gdt_base;
+} __attribute__((packed)) smp_boot_t;
+
+// Operand of SGDT/SIDT/LIDT
+typedef struct smp_desc_ptr_t {
+    unsigned short limit;
+    unsigned int base;
+} __attribute__((packed)) smp_desc_ptr_t;
+
+// Recursive lock protecting kernel data (see smp.h)
+typedef struct kernel_lock_t {
+    volatile unsigned int locked;   // Nonzero while held
+    volatile int owner;             // CPU holding the lock (-1 if none)
+    int depth;                      // Number of times the owner has acquired it
+    unsigned int acquired;          // Number of times it was taken
+    unsigned int contended;         // Number of times a CPU had to wait for it
+} kernel_lock_t;
+
+// Trampoline code and its parameters
+extern char smp_trampoline[];
+extern char smp_trampoline_data[];
+extern char smp_trampoline_end[];
+
+// Data for each CPU
+cpu_t cpu_table[CPU_MAX];
+
+// Number of CPUs that have been started
+int smp_nr_cpus = 1;
+
+// Set once the application processors may run (see smp_start)
+volatile bool smp_active = false;
+
+// The kernel lock
+kernel_lock_t kernel_lock_data = { 0, -1, 0, 0, 0 };
+
+// Interrupt descriptor table and PAT shared with the application processors
+smp_desc_ptr_t smp_idt;
+unsigned long long smp_pat = 0;
+
+// Kernel stack of the application processor being started
+int smp_boot_stack_id = -1;
+
+/**
+ * Waits for roughly the given number of microseconds
+ * @param us - microseconds
+ */
+static void smp_delay(unsigned int us) {
+    while (us-- > 0) {
+        inportb(SMP_DELAY_PORT);
+    }
+}
+
+/**
+ * Timer callback (boot CPU): forwards the tick to the other CPUs
+ */
+static void smp_tick(void) {
+    apic_broadcast_ipi(IRQ_IPI_TICK);
+}
+
+/**
+ * Tick IPI handler (application processors): charges the tick to the
+ * CPU's running process and statistics
+ */
+static void smp_tick_handler(void) {
+    this_cpu()->ipis++;
+
+    scheduler_tick();
+    cpustat_cpu_tick();
+}
+
+/**
+ * Reschedule IPI handler: the sender has already requested the
+ * reschedule, which happens when this interrupt returns
+ */
+static void smp_resched_handler(void) {
+    this_cpu()->ipis++;
+}
+
+/**
+ * Spurious interrupt handler: nothing to do (and no EOI is sent)
+ */
+static void smp_spurious_handler(void) {
+}
+
+/**
+ * Entry point of each application processor, called by the trampoline
+ * @param cpu - CPU index
+ */
+static void smp_ap_entry(int cpu) {
+    cpu_t *this = &cpu_table[cpu];
+
+    // Load this CPU's descriptors; the per-CPU segment (and everything
+    // that uses it, including the memory routines) is usable from here on
+    gdt_load_cpu(cpu);
+
+    asm volatile("lidt %0" : : "m"(smp_idt));
+
+    // Memory types must match the boot CPU's
+    if (cpu_has(CPU_FEATURE_PAT)) {
+        cpu_wrmsr(MSR_PAT, smp_pat);
+    }
+
+    apic_init_cpu(false);
+    syscall_init_cpu();
+    cpustat_init_cpu();
+
+    // The code running now becomes this CPU's idle process
+    kproc_init_cpu(smp_boot_stack_id);
+
+    this->online = true;
+
+    // Wait until the boot CPU has finished initializing the kernel
+    while (!smp_active) {
+        cpu_pause();
+    }
+
+    asm volatile("sti");
+    kproc_idle();
+}
+
+/**
+ * Starts an application processor
+ * @param cpu - CPU index to assign
+ * @param apic_id - APIC id of the processor
+ * @return -1 on error; 0 on success
+ */
+static int smp_boot_cpu(int cpu, int apic_id) {
+    smp_boot_t *boot = (smp_boot_t *)(SMP_TRAMPOLINE + (smp_trampoline_data - smp_trampoline));
+    cpu_t *this = &cpu_table[cpu];
+    stack_info_t *stack;
+    int irq_stack_id;
+
+    kmemset(this, 0, sizeof(cpu_t));
+    this->self = this;
+    this->id = cpu;
+    this->apic_id = apic_id;
+
+    irq_stack_id = stack_alloc("irq", STACK_IRQ_SIZE);
+    if (irq_stack_id < 0) {
+        return -1;
+    }
+
+    smp_boot_stack_id = stack_alloc("idle", PROC_STACK_SIZE);
+    if (smp_boot_stack_id < 0) {
+        stack_free(irq_stack_id);
+        return -1;
+    }
+
+    stack = stack_get(irq_stack_id);
+    this->irq_stack = stack->base;
+    this->irq_stack_top = stack->base + stack->size;
+
+    gdt_init_cpu(cpu);
+
+    stack = stack_get(smp_boot_stack_id);
+    boot->stack = (unsigned int)(stack->base + stack->size);
+    boot->cpu = cpu;
+
+    // INIT, then up to two startup IPIs
+    apic_send_init(apic_id);
+    smp_delay(SMP_INIT_DELAY);
+
+    for (int i = 0; i < 2 && !this->online; i++) {
+        apic_send_startup(apic_id, SMP_TRAMPOLINE);
+        smp_delay(SMP_STARTUP_DELAY);
+    }
+
+    for (int us = 0; us < SMP_ONLINE_TIMEOUT && !this->online; us += SMP_STARTUP_DELAY) {
+        smp_delay(SMP_STARTUP_DELAY);
+    }
+
+    if (!this->online) {
+        kernel_log_error("smp: CPU with APIC id %d did not start", apic_id);
+        stack_free(smp_boot_stack_id);
+        stack_free(irq_stack_id);
+        return -1;
+    }
+
+    kernel_log_info("smp: CPU %d (APIC id %d) online", cpu, apic_id);
+
+    return 0;
+}
+
+/**
+ * Initializes the boot CPU's per-CPU data
+ */
+void smp_init_bsp(void) {
+    cpu_t *this = &cpu_table[0];
+
+    kmemset(cpu_table, 0, sizeof(cpu_table));
+
+    this->self = this;
+    this->id = 0;
+    this->irq_stack = stack_irq;
+    this->irq_stack_top = stack_irq + STACK_IRQ_SIZE;
+    this->online = true;
+
+    smp_nr_cpus = 1;
+    smp_active = false;
+}
+
+/**
+ * Finds and starts the application processors; they wait in their idle
+ * process until smp_start is called
+ */
+void smp_init(void) {
+    acpi_madt_info_t madt;
+    smp_desc_ptr_t gdt;
+    smp_boot_t *boot;
+
+    kernel_log_info("Initializing SMP");
+
+    if (acpi_init() != 0 || acpi_madt_parse(&madt) != 0 || apic_init(madt.lapic_addr) != 0) {
+        kernel_log_warn("smp: running on the boot CPU only");
+        return;
+    }
+
+    cpu_table[0].apic_id = apic_id();
+
+    interrupts_irq_register(IRQ_IPI_TICK, isr_entry_ipi_tick, smp_tick_handler);
+    interrupts_irq_register(IRQ_IPI_RESCHED, isr_entry_ipi_resched, smp_resched_handler);
+    interrupts_irq_register(IRQ_APIC_SPURIOUS, isr_entry_apic_spurious, smp_spurious_handler);
+
+    // Install the trampoline with the boot CPU's paging and descriptor
+    // table settings
+    kmemcpy((void *)SMP_TRAMPOLINE, smp_trampoline, smp_trampoline_end - smp_trampoline);
+
+    boot = (smp_boot_t *)(SMP_TRAMPOLINE + (smp_trampoline_data - smp_trampoline));
+    boot->cr0 = cpu_get_cr0();
+    boot->cr3 = (unsigned int)kernel_pd;
+    boot->cr4 = cpu_get_cr4();
+    boot->entry = (unsigned int)smp_ap_entry;
+
+    asm volatile("sgdt %0" : "=m"(gdt));
+    boot->gdt_limit = gdt.limit;
+    boot->gdt_base = gdt.base;
+
+    asm volatile("sidt %0" : "=m"(smp_idt));
+
+    if (cpu_has(CPU_FEATURE_PAT)) {
+        smp_pat = cpu_rdmsr(MSR_PAT);
+    }
+
+    // Start the processors one at a time, since they share the trampoline
+    for (int i = 0; i < madt.nr_cpus; i++) {
+        if (madt.apic_ids[i] == cpu_table[0].apic_id) {
+            continue;
+        }
+
+        if (smp_nr_cpus >= CPU_MAX) {
+            kernel_log_warn("smp: only %d of %d CPUs used", CPU_MAX, madt.nr_cpus);
+            break;
+        }
+
+        if (smp_boot_cpu(smp_nr_cpus, madt.apic_ids[i]) == 0) {
+            smp_nr_cpus++;
+        }
+    }
+
+    // Only the boot CPU receives timer interrupts
+    if (smp_nr_cpus > 1) {
+        timer_callback_register(smp_tick, 1, -1);
+    }
+
+    kernel_log_info("smp: %d CPUs", smp_nr_cpus);
+}
+
+/**
+ * Lets the application processors begin scheduling processes
+ */
+void smp_start(void) {
+    // From here on, the kernel lock is needed to access kernel data
+    smp_active = smp_nr_cpus > 1;
+}
+
+/**
+ * Acquires the kernel lock (recursively on the same CPU)
+ */
+void kernel_lock(void) {
+    kernel_lock_t *lock = &kernel_lock_data;
+    int cpu;
+
+    if (!smp_active) {
+        return;
+    }
+
+    cpu = this_cpu()->id;
+
+    if (lock->owner == cpu) {
+        lock->depth++;
+        return;
+    }
+
+    if (cpu_xchg(&lock->locked, 1) != 0) {
+        // Spin reading the lock so that waiting does not bounce its cache line
+        do {
+            while (lock->locked) {
+                cpu_pause();
+            }
+        } while (cpu_xchg(&lock->locked, 1) != 0);
+
+        lock->contended++;
+    }
+
+    lock->owner = cpu;
+    lock->depth = 1;
+    lock->acquired++;
+}
+
+/**
+ * Releases one level of the kernel lock
+ */
+void kernel_unlock(void) {
+    kernel_lock_t *lock = &kernel_lock_data;
+
+    if (!smp_active) {
+        return;
+    }
+
+    if (--lock->depth == 0) {
+        lock->owner = -1;
+        cpu_xchg(&lock->locked, 0);
+    }
+}
+
+/**
+ * Hands the CPU's hold on the kernel lock from one process to another
+ * when switching between them
+ * @param prev - process being switched out
+ * @param next - process being switched to
+ */
+void kernel_lock_switch(struct proc_t *prev, struct proc_t *next) {
+    kernel_lock_t *lock = &kernel_lock_data;
+
+    if (!smp_active) {
+        return;
+    }
+
+    // The interrupt being handled holds one level; the rest belongs to
+    // the process that was interrupted
+    prev->lock_depth = lock->depth - 1;
+    lock->depth = next->lock_depth + 1;
+}
+
+/**
+ * Requests that another CPU reschedule
+ * @param cpu - CPU index
+ */
+void smp_resched_cpu(int cpu) {
+    if (cpu != this_cpu()->id && cpu_table[cpu].online) {
+        apic_send_ipi(cpu_table[cpu].apic_id, IRQ_IPI_RESCHED);
+    }
+}
+
+/**
+ * Dumps the state of each CPU
+ */
+void smp_dump(void) {
+    kernel_log_info("smp: kernel lock taken %u times, %u contended",
+                    kernel_lock_data.acquired, kernel_lock_data.contended);
+
+    for (int i = 0; i < smp_nr_cpus; i++) {
+        cpu_t *cpu = &cpu_table[i];
+
+        kernel_log_info("smp: CPU %d APIC id %d running %d (%s), %u IPIs", cpu->id, cpu->apic_id,
+                        cpu->current ? cpu->current->pid : -1,
+                        cpu->current ? cpu->current->name : "-", cpu->ipis);
+    }
+}
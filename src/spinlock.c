@@ -0,0 +1,402 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Spinlock Implementation
+ */
+#include <spede/string.h>
+
+#include "cpu.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "spinlock.h"
+
+#if SPINLOCK_DEBUG
+// Statistics of every initialized lock
+lock_stats_t *lock_registry = NULL;
+
+/**
+ * Adds a lock's statistics to the registry
+ * @param stats - pointer to the statistics
+ * @param name - name of the lock
+ * @param type - kind of lock
+ */
+static void lock_stats_register(lock_stats_t *stats, char *name, char *type) {
+    unsigned int flags;
+
+    stats->name = name;
+    stats->type = type;
+    stats->acquired = 0;
+    stats->contended = 0;
+    stats->spin_cycles = 0;
+    stats->hold_start = 0;
+    stats->max_hold = 0;
+
+    flags = interrupts_save();
+
+    // A lock that is initialized again is already registered
+    for (lock_stats_t *s = lock_registry; s; s = s->next) {
+        if (s == stats) {
+            interrupts_restore(flags);
+            return;
+        }
+    }
+
+    stats->next = lock_registry;
+    lock_registry = stats;
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Reads the time stamp counter if there is one
+ * @return time stamp or 0
+ */
+static inline unsigned long long lock_now(void) {
+    return cpu_has(CPU_FEATURE_TSC) ? cpu_rdtsc() : 0;
+}
+
+/**
+ * Atomically adds to a 64-bit counter
+ * @param counter - pointer to the counter
+ * @param value - value to add
+ */
+static void lock_stats_add(volatile unsigned long long *counter, unsigned long long value) {
+    unsigned long long old = *counter;
+    unsigned long long seen;
+
+    // A torn first read only costs a retry
+    while ((seen = cpu_cmpxchg8b(counter, old, old + value)) != old) {
+        old = seen;
+    }
+}
+
+/**
+ * Records an acquisition
+ *
+ * Readers of a reader-writer lock record theirs concurrently, so the
+ * shared counters are updated atomically.
+ *
+ * @param stats - pointer to the statistics
+ * @param spin_start - time stamp the wait began at (0 if uncontended)
+ * @param exclusive - true if the hold time should be measured
+ */
+static void lock_stats_acquired(lock_stats_t *stats, unsigned long long spin_start, bool exclusive) {
+    unsigned long long now = lock_now();
+
+    cpu_xadd(&stats->acquired, 1);
+
+    if (spin_start) {
+        cpu_xadd(&stats->contended, 1);
+
+        // Without a time stamp counter there are no cycles to add
+        if (now) {
+            lock_stats_add(&stats->spin_cycles, now - spin_start);
+        }
+    }
+
+    if (exclusive) {
+        stats->hold_start = now;
+    }
+}
+
+/**
+ * Records the end of an exclusive hold
+ * @param stats - pointer to the statistics
+ */
+static void lock_stats_released(lock_stats_t *stats) {
+    unsigned long long held = lock_now() - stats->hold_start;
+
+    if (held > stats->max_hold) {
+        stats->max_hold = held;
+    }
+}
+
+/**
+ * Converts a cycle count for printing
+ * @param cycles - number of cycles
+ * @return cycles (saturated to 32 bits)
+ */
+static unsigned int lock_cycles(unsigned long long cycles) {
+    return cycles > 0xFFFFFFFFULL ? 0xFFFFFFFF : (unsigned int)cycles;
+}
+#endif
+
+/**
+ * Disables interrupts on this CPU without taking the kernel lock
+ * @return previous EFLAGS value
+ */
+static inline unsigned int lock_irq_save(void) {
+    unsigned int flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/**
+ * Restores the interrupt state saved by lock_irq_save
+ * @param flags - previous EFLAGS value
+ */
+static inline void lock_irq_restore(unsigned int flags) {
+    if (flags & EFLAGS_IF) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+/**
+ * Initializes a spinlock (unlocked)
+ * @param lock - pointer to the lock
+ * @param name - name of the lock (for statistics)
+ */
+void spinlock_init(spinlock_t *lock, char *name) {
+    lock->next = 0;
+    lock->owner = 0;
+
+#if SPINLOCK_DEBUG
+    lock_stats_register(&lock->stats, name, "spin");
+#endif
+}
+
+/**
+ * Acquires a spinlock, spinning until it is available
+ * @param lock - pointer to the lock
+ */
+void spinlock_acquire(spinlock_t *lock) {
+    unsigned int ticket = cpu_xadd(&lock->next, 1);
+#if SPINLOCK_DEBUG
+    unsigned long long spin_start = 0;
+
+    if (lock->owner != ticket) {
+        spin_start = lock_now() | 1;
+    }
+#endif
+
+    while (lock->owner != ticket) {
+        cpu_pause();
+    }
+
+#if SPINLOCK_DEBUG
+    lock_stats_acquired(&lock->stats, spin_start, true);
+#endif
+}
+
+/**
+ * Releases a spinlock
+ * @param lock - pointer to the lock
+ */
+void spinlock_release(spinlock_t *lock) {
+#if SPINLOCK_DEBUG
+    lock_stats_released(&lock->stats);
+#endif
+
+    // Only the holder writes the owner, so a plain store hands the lock on
+    cpu_barrier();
+    lock->owner = lock->owner + 1;
+}
+
+/**
+ * Disables interrupts on this CPU and acquires a spinlock
+ * @param lock - pointer to the lock
+ * @return previous EFLAGS value (for spinlock_release_irqrestore)
+ */
+unsigned int spinlock_acquire_irqsave(spinlock_t *lock) {
+    unsigned int flags = lock_irq_save();
+
+    spinlock_acquire(lock);
+
+    return flags;
+}
+
+/**
+ * Releases a spinlock and restores the interrupt state
+ * @param lock - pointer to the lock
+ * @param flags - value returned by spinlock_acquire_irqsave
+ */
+void spinlock_release_irqrestore(spinlock_t *lock, unsigned int flags) {
+    spinlock_release(lock);
+    lock_irq_restore(flags);
+}
+
+/**
+ * Checks whether a spinlock is held (by any CPU)
+ * @param lock - pointer to the lock
+ * @return true if held
+ */
+bool spinlock_held(spinlock_t *lock) {
+    return lock->next != lock->owner;
+}
+
+/**
+ * Initializes a reader-writer lock (unlocked)
+ * @param lock - pointer to the lock
+ * @param name - name of the lock (for statistics)
+ */
+void rwlock_init(rwlock_t *lock, char *name) {
+    lock->value = 0;
+
+#if SPINLOCK_DEBUG
+    lock_stats_register(&lock->stats, name, "rw");
+#endif
+}
+
+/**
+ * Acquires a reader-writer lock for reading
+ * @param lock - pointer to the lock
+ */
+void rwlock_read_acquire(rwlock_t *lock) {
+#if SPINLOCK_DEBUG
+    unsigned long long spin_start = 0;
+#endif
+
+    while (1) {
+        unsigned int value = lock->value;
+
+        if (!(value & RWLOCK_WRITER) && cpu_cmpxchg(&lock->value, value, value + 1) == value) {
+            break;
+        }
+
+#if SPINLOCK_DEBUG
+        if (!spin_start) {
+            spin_start = lock_now() | 1;
+        }
+#endif
+
+        cpu_pause();
+    }
+
+#if SPINLOCK_DEBUG
+    lock_stats_acquired(&lock->stats, spin_start, false);
+#endif
+}
+
+/**
+ * Releases a read hold on a reader-writer lock
+ * @param lock - pointer to the lock
+ */
+void rwlock_read_release(rwlock_t *lock) {
+    cpu_xadd(&lock->value, -1);
+}
+
+/**
+ * Acquires a reader-writer lock for writing
+ * @param lock - pointer to the lock
+ */
+void rwlock_write_acquire(rwlock_t *lock) {
+#if SPINLOCK_DEBUG
+    unsigned long long spin_start = 0;
+#endif
+
+    // Claim the writer bit first so that no new readers enter...
+    while (1) {
+        unsigned int value = lock->value;
+
+        if (!(value & RWLOCK_WRITER)
+            && cpu_cmpxchg(&lock->value, value, value | RWLOCK_WRITER) == value) {
+            break;
+        }
+
+#if SPINLOCK_DEBUG
+        if (!spin_start) {
+            spin_start = lock_now() | 1;
+        }
+#endif
+
+        cpu_pause();
+    }
+
+    // ...then wait for the readers already inside to leave
+    while (lock->value != RWLOCK_WRITER) {
+#if SPINLOCK_DEBUG
+        if (!spin_start) {
+            spin_start = lock_now() | 1;
+        }
+#endif
+
+        cpu_pause();
+    }
+
+#if SPINLOCK_DEBUG
+    lock_stats_acquired(&lock->stats, spin_start, true);
+#endif
+}
+
+/**
+ * Releases a write hold on a reader-writer lock
+ * @param lock - pointer to the lock
+ */
+void rwlock_write_release(rwlock_t *lock) {
+#if SPINLOCK_DEBUG
+    lock_stats_released(&lock->stats);
+#endif
+
+    cpu_xchg(&lock->value, 0);
+}
+
+/**
+ * Disables interrupts on this CPU and acquires a reader-writer lock for
+ * reading
+ * @param lock - pointer to the lock
+ * @return previous EFLAGS value (for rwlock_read_release_irqrestore)
+ */
+unsigned int rwlock_read_acquire_irqsave(rwlock_t *lock) {
+    unsigned int flags = lock_irq_save();
+
+    rwlock_read_acquire(lock);
+
+    return flags;
+}
+
+/**
+ * Releases a read hold and restores the interrupt state
+ * @param lock - pointer to the lock
+ * @param flags - value returned by rwlock_read_acquire_irqsave
+ */
+void rwlock_read_release_irqrestore(rwlock_t *lock, unsigned int flags) {
+    rwlock_read_release(lock);
+    lock_irq_restore(flags);
+}
+
+/**
+ * Disables interrupts on this CPU and acquires a reader-writer lock for
+ * writing
+ * @param lock - pointer to the lock
+ * @return previous EFLAGS value (for rwlock_write_release_irqrestore)
+ */
+unsigned int rwlock_write_acquire_irqsave(rwlock_t *lock) {
+    unsigned int flags = lock_irq_save();
+
+    rwlock_write_acquire(lock);
+
+    return flags;
+}
+
+/**
+ * Releases a write hold and restores the interrupt state
+ * @param lock - pointer to the lock
+ * @param flags - value returned by rwlock_write_acquire_irqsave
+ */
+void rwlock_write_release_irqrestore(rwlock_t *lock, unsigned int flags) {
+    rwlock_write_release(lock);
+    lock_irq_restore(flags);
+}
+
+/**
+ * Dumps the statistics of the locks with the given name
+ * @param name - lock name (NULL for every lock)
+ */
+void spinlock_dump(char *name) {
+#if SPINLOCK_DEBUG
+    kernel_log_info("spinlock: %-16s %-4s %10s %10s %12s %12s", "name", "type", "acquired",
+                    "contended", "spin cycles", "max hold");
+
+    for (lock_stats_t *s = lock_registry; s; s = s->next) {
+        if (name && strncmp(s->name, name, strlen(name) + 1) != 0) {
+            continue;
+        }
+
+        kernel_log_info("spinlock: %-16s %-4s %10u %10u %12u %12u", s->name, s->type, s->acquired,
+                        s->contended, lock_cycles(s->spin_cycles), lock_cycles(s->max_hold));
+    }
+#else
+    kernel_log_info("spinlock: statistics are disabled (SPINLOCK_DEBUG)");
+#endif
+}
@@ -0,0 +1,217 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Stack Usage Measurement Implementation
+ */
+#include "interrupts.h"
+#include "kernel.h"
+#include "kmalloc.h"
+#include "kstring.h"
+#include "pool.h"
+#include "stack.h"
+
+// Stack the kernel boots on
+char stack_boot[STACK_BOOT_SIZE] __attribute__((aligned(16)));
+
+// Stack interrupt handlers run on
+char stack_irq[STACK_IRQ_SIZE] __attribute__((aligned(16)));
+
+// Tracked stacks
+POOL_DEFINE(stack_pool, stack_info_t, STACKS_MAX);
+
+/**
+ * Initializes stack tracking and registers the boot and interrupt stacks
+ */
+void stack_init(void) {
+    kernel_log_info("Initializing stack tracking");
+
+    pool_init(&stack_pool);
+
+    // The boot stack is painted before the kernel switches to it
+    stack_register("boot", stack_boot, sizeof(stack_boot));
+
+    // Interrupts are not enabled yet, so the interrupt stack is unused
+    stack_paint(stack_irq, sizeof(stack_irq));
+    stack_register("irq", stack_irq, sizeof(stack_irq));
+}
+
+/**
+ * Paints a stack with the fill pattern
+ * @param base - lowest address of the stack
+ * @param size - size of the stack in bytes
+ */
+void stack_paint(char *base, size_t size) {
+    unsigned int *word = (unsigned int *)base;
+
+    for (size_t i = 0; i < size / sizeof(unsigned int); i++) {
+        word[i] = STACK_PAINT;
+    }
+}
+
+/**
+ * Registers a stack so that its usage is tracked
+ * @param name - name of the stack
+ * @param base - lowest address of the stack
+ * @param size - size of the stack in bytes
+ * @return stack id or -1 on error
+ */
+int stack_register(char *name, char *base, size_t size) {
+    stack_info_t *stack;
+    unsigned int flags;
+    int id;
+
+    if (!base || size < sizeof(unsigned int)) {
+        kernel_log_error("stack: invalid stack %p (%d bytes)", base, size);
+        return -1;
+    }
+
+    // Stacks are registered and freed from preemptible code on any CPU
+    flags = interrupts_save();
+
+    stack = pool_alloc(&stack_pool);
+    if (!stack) {
+        interrupts_restore(flags);
+        kernel_log_error("stack: unable to track stack %s", name);
+        return -1;
+    }
+
+    stack->name = name;
+    stack->base = base;
+    stack->size = size;
+    stack->owned = false;
+    id = pool_index(&stack_pool, stack);
+
+    interrupts_restore(flags);
+
+    return id;
+}
+
+/**
+ * Stops tracking a stack
+ * @param id - stack id
+ */
+void stack_unregister(int id) {
+    unsigned int flags = interrupts_save();
+    stack_info_t *stack = stack_get(id);
+
+    if (!stack) {
+        interrupts_restore(flags);
+        kernel_log_error("stack: invalid stack id %d", id);
+        return;
+    }
+
+    pool_free(&stack_pool, stack);
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Allocates, paints and registers a new stack
+ * @param name - name of the stack
+ * @param size - size of the stack in bytes
+ * @return stack id or -1 on error
+ */
+int stack_alloc(char *name, size_t size) {
+    char *base = kmalloc(size);
+    int id;
+
+    if (!base) {
+        kernel_log_error("stack: unable to allocate stack %s (%d bytes)", name, size);
+        return -1;
+    }
+
+    stack_paint(base, size);
+
+    id = stack_register(name, base, size);
+    if (id < 0) {
+        kfree(base);
+        return -1;
+    }
+
+    stack_get(id)->owned = true;
+
+    return id;
+}
+
+/**
+ * Unregisters a stack, freeing it if it was allocated by stack_alloc
+ * @param id - stack id
+ */
+void stack_free(int id) {
+    unsigned int flags = interrupts_save();
+    stack_info_t *stack = stack_get(id);
+    char *base = NULL;
+
+    if (!stack) {
+        interrupts_restore(flags);
+        kernel_log_error("stack: invalid stack id %d", id);
+        return;
+    }
+
+    if (stack->owned) {
+        base = stack->base;
+    }
+
+    pool_free(&stack_pool, stack);
+
+    interrupts_restore(flags);
+
+    if (base) {
+        kfree(base);
+    }
+}
+
+/**
+ * Returns the tracked stack for the given id
+ * @param id - stack id
+ * @return pointer to the stack or NULL if the id is invalid
+ */
+stack_info_t *stack_get(int id) {
+    return pool_get(&stack_pool, id);
+}
+
+/**
+ * Returns the deepest usage of a stack since it was painted
+ * @param id - stack id
+ * @return number of bytes used or -1 if the id is invalid
+ */
+int stack_high_water(int id) {
+    stack_info_t *stack = stack_get(id);
+    unsigned int *word;
+    size_t count;
+    size_t i;
+
+    if (!stack) {
+        return -1;
+    }
+
+    // Stacks grow down, so the untouched words are at the bottom
+    word = (unsigned int *)stack->base;
+    count = stack->size / sizeof(unsigned int);
+
+    for (i = 0; i < count && word[i] == STACK_PAINT; i++);
+
+    return stack->size - i * sizeof(unsigned int);
+}
+
+/**
+ * Dumps the size and deepest usage of every tracked stack
+ */
+void stack_dump(void) {
+    kernel_log_info("stack: %-16s %10s %8s %8s %4s", "name", "base", "size", "used", "%");
+
+    for (int id = pool_next(&stack_pool, 0); id >= 0; id = pool_next(&stack_pool, id + 1)) {
+        stack_info_t *stack = stack_get(id);
+        int used = stack_high_water(id);
+
+        kernel_log_info("stack: %-16s 0x%08x %8d %8d %3d%%", stack->name,
+                        (unsigned int)stack->base, stack->size, used,
+                        (int)(used * 100 / stack->size));
+
+        // A clobbered bottom word means the stack ran past its end
+        if ((size_t)used == stack->size) {
+            kernel_log_warn("stack: %s may have overflowed", stack->name);
+        }
+    }
+}
@@ -0,0 +1,271 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * System Call Implementation
+ */
+#include <spede/stdbool.h>
+
+#include "cpu.h"
+#include "gdt.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "page.h"
+#include "scheduler.h"
+#include "syscall.h"
+#include "timer.h"
+#include "vga.h"
+#include "vm.h"
+#include "wait.h"
+
+// System call table
+syscall_t syscall_table[SYSCALL_MAX];
+char *syscall_names[SYSCALL_MAX];
+
+// Statistics
+unsigned int syscall_counts[SYSCALL_MAX];   // Calls made to each system call
+unsigned int syscall_entries[2];            // Calls made through each entry method
+unsigned int syscall_invalid = 0;           // Calls to unknown system calls
+
+// Set when the SYSENTER entry is enabled
+bool syscall_sysenter = false;
+
+// User mode code of the benchmark (see syscall_bench.S)
+extern char syscall_bench_user[];
+extern char syscall_bench_user_end[];
+
+/**
+ * System call handler (both entries): dispatches on EAX
+ */
+static void syscall_handler(void) {
+    trap_frame_t *frame = interrupts_get_frame();
+    unsigned int nr = frame->eax;
+
+    syscall_entries[frame->error == TRAP_ERROR_SYSENTER]++;
+
+    if (nr >= SYSCALL_MAX || !syscall_table[nr]) {
+        syscall_invalid++;
+        frame->eax = -1;
+        return;
+    }
+
+    syscall_counts[nr]++;
+    frame->eax = syscall_table[nr](frame->ebx, frame->esi, frame->edi);
+}
+
+/**
+ * Debug exception handler: nothing single-steps processes, so a trap flag
+ * left set is cleared and the trap is not raised again
+ */
+static void syscall_debug_handler(void) {
+    trap_frame_t *frame = interrupts_get_frame();
+
+    if (!trap_from_user(frame)) {
+        kernel_log_warn("syscall: debug trap in the kernel at 0x%08x", frame->eip);
+    }
+
+    frame->eflags &= ~EFLAGS_TF;
+}
+
+/**
+ * SYS_NULL: does nothing
+ */
+static int sys_null(unsigned int arg1, unsigned int arg2, unsigned int arg3) {
+    return 0;
+}
+
+/**
+ * SYS_EXIT: terminates the process
+ * @param status - exit status
+ */
+static int sys_exit(unsigned int status, unsigned int arg2, unsigned int arg3) {
+    kernel_log_debug("syscall: process %d exited with status %d", active_proc->pid, status);
+
+    // The process is switched away from (and freed) when the call returns
+    kproc_destroy(active_proc);
+
+    return 0;
+}
+
+/**
+ * SYS_GETPID: returns the process id
+ */
+static int sys_getpid(unsigned int arg1, unsigned int arg2, unsigned int arg3) {
+    return active_proc->pid;
+}
+
+/**
+ * SYS_YIELD: gives up the rest of the time slice
+ */
+static int sys_yield(unsigned int arg1, unsigned int arg2, unsigned int arg3) {
+    scheduler_resched();
+    return 0;
+}
+
+/**
+ * SYS_PUTC: writes a character to the console
+ * @param c - character
+ */
+static int sys_putc(unsigned int c, unsigned int arg2, unsigned int arg3) {
+    vga_putc((char)c);
+    return 0;
+}
+
+/**
+ * SYS_FORK: duplicates the process
+ * @return child's process id in the parent; 0 in the child
+ */
+static int sys_fork(unsigned int arg1, unsigned int arg2, unsigned int arg3) {
+    return kproc_fork(interrupts_get_frame());
+}
+
+/**
+ * SYS_TICKS: returns the number of timer ticks since boot
+ */
+static int sys_ticks(unsigned int arg1, unsigned int arg2, unsigned int arg3) {
+    return timer_get_ticks();
+}
+
+/**
+ * SYS_SLEEP: sleeps for a number of milliseconds
+ * @param ms - time in milliseconds
+ */
+static int sys_sleep(unsigned int ms, unsigned int arg2, unsigned int arg3) {
+    // The process stops running once the call returns
+    sleep_ms(ms);
+    return 0;
+}
+
+/**
+ * SYS_BENCHMARK: reports a benchmark result
+ * @param method - entry method that was timed
+ * @param cycles - cycles taken (low 32 bits)
+ * @param calls - number of calls timed
+ */
+static int sys_benchmark(unsigned int method, unsigned int cycles, unsigned int calls) {
+    if (calls == 0) {
+        return -1;
+    }
+
+    kernel_log_info("syscall: null system call via %s: %u cycles",
+                    method == SYSCALL_ENTRY_SYSENTER ? "sysenter" : "int 0x80", cycles / calls);
+
+    return 0;
+}
+
+/**
+ * Initializes the system call table and entry points
+ */
+void syscall_init(void) {
+    kernel_log_info("Initializing system calls");
+
+    kmemset(syscall_table, 0, sizeof(syscall_table));
+    kmemset(syscall_names, 0, sizeof(syscall_names));
+    kmemset(syscall_counts, 0, sizeof(syscall_counts));
+    kmemset(syscall_entries, 0, sizeof(syscall_entries));
+    syscall_invalid = 0;
+
+    syscall_register(SYS_NULL, "null", sys_null);
+    syscall_register(SYS_EXIT, "exit", sys_exit);
+    syscall_register(SYS_GETPID, "getpid", sys_getpid);
+    syscall_register(SYS_YIELD, "yield", sys_yield);
+    syscall_register(SYS_PUTC, "putc", sys_putc);
+    syscall_register(SYS_FORK, "fork", sys_fork);
+    syscall_register(SYS_TICKS, "ticks", sys_ticks);
+    syscall_register(SYS_BENCHMARK, "benchmark", sys_benchmark);
+    syscall_register(SYS_SLEEP, "sleep", sys_sleep);
+
+    interrupts_irq_register_user(IRQ_SYSCALL, isr_entry_syscall, syscall_handler);
+    interrupts_irq_register(IRQ_DEBUG, isr_entry_debug, syscall_debug_handler);
+
+    syscall_sysenter = cpu_has(CPU_FEATURE_SYSENTER);
+    syscall_init_cpu();
+
+    kernel_log_info("syscall: entry via %s", syscall_sysenter ? "sysenter" : "int 0x80");
+}
+
+/**
+ * Sets up the SYSENTER entry point on the CPU that is running
+ */
+void syscall_init_cpu(void) {
+    // SYSENTER enters with the stack pointer at this CPU's TSS; the entry
+    // code loads the process's kernel stack from it
+    if (syscall_sysenter) {
+        cpu_wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CS);
+        cpu_wrmsr(MSR_SYSENTER_ESP, (unsigned int)gdt_tss());
+        cpu_wrmsr(MSR_SYSENTER_EIP, (unsigned int)sysenter_entry);
+    }
+}
+
+/**
+ * Adds a system call to the table
+ * @param nr - system call number
+ * @param name - name of the system call (for statistics)
+ * @param handler - function implementing the system call
+ * @return -1 on error; 0 on success
+ */
+int syscall_register(int nr, char *name, syscall_t handler) {
+    if (nr < 0 || nr >= SYSCALL_MAX || !handler) {
+        kernel_log_error("syscall: invalid system call %d", nr);
+        return -1;
+    }
+
+    if (syscall_table[nr]) {
+        kernel_log_error("syscall: system call %d is already registered", nr);
+        return -1;
+    }
+
+    syscall_table[nr] = handler;
+    syscall_names[nr] = name;
+
+    return 0;
+}
+
+/**
+ * Returns the entry method user processes should use
+ * @return SYSCALL_ENTRY_SYSENTER or SYSCALL_ENTRY_INT
+ */
+int syscall_entry_method(void) {
+    return syscall_sysenter ? SYSCALL_ENTRY_SYSENTER : SYSCALL_ENTRY_INT;
+}
+
+/**
+ * Starts a user process that times null system calls through each
+ * supported entry method; the results are logged when it runs
+ */
+void syscall_benchmark(void) {
+    unsigned int size = syscall_bench_user_end - syscall_bench_user;
+    vm_space_t *space = vm_space_create();
+
+    if (!space) {
+        kernel_log_error("syscall: unable to create the benchmark address space");
+        return;
+    }
+
+    // The code is position independent and paged in from the kernel image
+    if (vm_area_add(space, USER_SPACE_BASE, USER_SPACE_BASE + size, VM_READ | VM_EXEC,
+                    syscall_bench_user, USER_SPACE_BASE, USER_SPACE_BASE + size) != 0
+        || vm_area_add(space, VM_STACK_TOP - VM_STACK_SIZE, VM_STACK_TOP,
+                       VM_READ | VM_WRITE, NULL, 0, 0) != 0
+        || kproc_create_user(space, USER_SPACE_BASE, "syscall_bench") < 0) {
+        kernel_log_error("syscall: unable to start the benchmark");
+        vm_space_destroy(space);
+    }
+}
+
+/**
+ * Dumps the number of calls made to each system call
+ */
+void syscall_dump(void) {
+    kernel_log_info("syscall: %u via int 0x80, %u via sysenter, %u invalid",
+                    syscall_entries[SYSCALL_ENTRY_INT], syscall_entries[SYSCALL_ENTRY_SYSENTER],
+                    syscall_invalid);
+
+    for (int i = 0; i < SYSCALL_MAX; i++) {
+        if (syscall_table[i]) {
+            kernel_log_info("syscall: %3d %-12s %10u", i, syscall_names[i], syscall_counts[i]);
+        }
+    }
+}
@@ -0,0 +1,428 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Task Pool (Parallel For) Implementation
+ */
+#include "cpu.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "page.h"
+#include "smp.h"
+#include "task.h"
+#include "wait.h"
+
+// Order of the buffer cleared by task_benchmark (1MB)
+#define TASK_BENCHMARK_ORDER 8
+
+// Pages cleared by each chunk in task_benchmark
+#define TASK_BENCHMARK_GRAIN 16
+
+// parallel_for call
+typedef struct task_job_t {
+    parallel_fn_t fn;               // Function run on each chunk
+    void *ctx;                      // Context passed to fn
+    int grain;                      // Largest chunk to run without splitting it
+    volatile unsigned int remaining; // Indexes that have not been run yet
+    wait_queue_t done;              // Caller waiting for the last chunk to finish
+} task_job_t;
+
+// Deques of the workers (one per CPU), then those lent to callers
+task_deque_t task_deques[TASK_DEQUES];
+
+// Deques lent to callers (bit i for task_deques[CPU_MAX + i])
+unsigned int task_callers_used = 0;
+
+// Number of workers that have started
+volatile unsigned int task_nr_workers = 0;
+
+// Number of workers sleeping for lack of work
+volatile unsigned int task_idle = 0;
+
+// Workers sleeping for lack of work
+wait_queue_t task_waiters;
+
+/**
+ * Pushes a task at the bottom of the running process's deque
+ * @param dq - pointer to the deque (owned by the running process)
+ * @param task - pointer to the task
+ * @return false if the deque is full
+ */
+static bool task_push(task_deque_t *dq, task_t *task) {
+    unsigned int b = dq->bottom;
+
+    if (b - dq->top >= TASK_DEQUE_SIZE) {
+        return false;
+    }
+
+    dq->tasks[b & (TASK_DEQUE_SIZE - 1)] = *task;
+
+    // The task must be in place before thieves can see it (stores are
+    // not reordered with each other)
+    cpu_barrier();
+    dq->bottom = b + 1;
+
+    return true;
+}
+
+/**
+ * Pops the task at the bottom of the running process's deque
+ * @param dq - pointer to the deque (owned by the running process)
+ * @param task - pointer to the task to fill in
+ * @return false if the deque is empty (or a thief took the last task)
+ */
+static bool task_pop(task_deque_t *dq, task_t *task) {
+    unsigned int b = dq->bottom - 1;
+    unsigned int t;
+    bool taken;
+
+    // Claim the slot before reading top; the locked exchange keeps the
+    // store from passing the load
+    cpu_xchg(&dq->bottom, b);
+    t = dq->top;
+
+    if ((int)(b - t) < 0) {
+        dq->bottom = b + 1;
+        return false;
+    }
+
+    *task = dq->tasks[b & (TASK_DEQUE_SIZE - 1)];
+
+    if (b != t) {
+        return true;
+    }
+
+    // The last task may also be claimed by a thief
+    taken = cpu_cmpxchg(&dq->top, t, t + 1) == t;
+    dq->bottom = b + 1;
+
+    return taken;
+}
+
+/**
+ * Steals the task at the top of another process's deque
+ * @param dq - pointer to the deque
+ * @param task - pointer to the task to fill in
+ * @return false if the deque is empty or another thief got there first
+ */
+static bool task_steal_from(task_deque_t *dq, task_t *task) {
+    unsigned int t = dq->top;
+    unsigned int b;
+
+    // Loads are not reordered with each other
+    cpu_barrier();
+    b = dq->bottom;
+
+    if ((int)(b - t) <= 0) {
+        return false;
+    }
+
+    *task = dq->tasks[t & (TASK_DEQUE_SIZE - 1)];
+
+    return cpu_cmpxchg(&dq->top, t, t + 1) == t;
+}
+
+/**
+ * Steals a task from any deque other than the given one
+ * @param dq - pointer to the thief's own deque
+ * @param task - pointer to the task to fill in
+ * @return false if nothing could be stolen
+ */
+static bool task_steal(task_deque_t *dq, task_t *task) {
+    int self = dq - task_deques;
+
+    // Start after our own deque so that thieves spread over the victims
+    for (int i = 1; i < TASK_DEQUES; i++) {
+        if (task_steal_from(&task_deques[(self + i) % TASK_DEQUES], task)) {
+            dq->stolen++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Tests if any deque holds a task
+ * @return true if there is work to steal
+ */
+static bool task_available(void) {
+    for (int i = 0; i < TASK_DEQUES; i++) {
+        if ((int)(task_deques[i].bottom - task_deques[i].top) > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Runs a task: forks off its upper half until it is no larger than the
+ * grain, then runs what is left
+ * @param dq - deque of the running process
+ * @param task - task to run
+ */
+static void task_run(task_deque_t *dq, task_t task) {
+    task_job_t *job = task.job;
+    unsigned int size;
+    unsigned int flags;
+    task_t half;
+
+    while (task.end - task.begin > job->grain) {
+        half.job = job;
+        half.begin = task.begin + (task.end - task.begin) / 2;
+        half.end = task.end;
+
+        if (!task_push(dq, &half)) {
+            break;
+        }
+
+        task.end = half.begin;
+
+        // Wake a worker to take the other half (the locked read keeps it
+        // from passing the push)
+        if (cpu_xadd(&task_idle, 0)) {
+            wake_up(&task_waiters);
+        }
+    }
+
+    job->fn(task.begin, task.end, job->ctx);
+    dq->executed++;
+
+    // The caller checks remaining under the kernel lock, so the job (on
+    // its stack) stays valid until the last chunk has woken it up
+    size = task.end - task.begin;
+    flags = interrupts_save();
+
+    if (cpu_xadd(&job->remaining, -size) == size) {
+        wake_up_all(&job->done);
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Worker process: runs and steals tasks, sleeping while there are none
+ */
+static void task_worker(void) {
+    task_deque_t *dq = &task_deques[cpu_xadd(&task_nr_workers, 1)];
+    task_t task;
+
+    active_proc->task_deque = dq;
+
+    while (1) {
+        if (task_pop(dq, &task) || task_steal(dq, &task)) {
+            task_run(dq, task);
+            continue;
+        }
+
+        cpu_xadd(&task_idle, 1);
+        wait_event(&task_waiters, task_available());
+        cpu_xadd(&task_idle, -1);
+    }
+}
+
+/**
+ * Lends a deque to a caller that is not a worker
+ * @return index of the deque in the callers' range or -1 if none is free
+ */
+static int task_caller_get(void) {
+    unsigned int flags = interrupts_save();
+    int caller = -1;
+
+    for (int i = 0; i < TASK_CALLERS_MAX; i++) {
+        if (!(task_callers_used & (1 << i))) {
+            task_callers_used |= 1 << i;
+            caller = i;
+            break;
+        }
+    }
+
+    interrupts_restore(flags);
+
+    return caller;
+}
+
+/**
+ * Returns a deque lent by task_caller_get
+ * @param caller - index of the deque in the callers' range
+ */
+static void task_caller_put(int caller) {
+    unsigned int flags = interrupts_save();
+
+    task_callers_used &= ~(1 << caller);
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Initializes the task pool and starts a worker for each CPU
+ */
+void task_init(void) {
+    kernel_log_info("Initializing task pool");
+
+    kmemset(task_deques, 0, sizeof(task_deques));
+    task_callers_used = 0;
+    task_nr_workers = 0;
+    task_idle = 0;
+    wait_queue_init(&task_waiters);
+
+    // New processes start on the least loaded CPU, so the workers spread
+    // out over the CPUs
+    for (int i = 0; i < smp_nr_cpus; i++) {
+        if (kproc_create(task_worker, "task_worker") < 0) {
+            kernel_log_error("task: unable to start worker %d", i);
+        }
+    }
+}
+
+/**
+ * Runs fn over [begin, end) in chunks of at most grain indexes, spread
+ * over every CPU, and returns once all of them are done
+ * @param begin - first index
+ * @param end - end index (exclusive)
+ * @param grain - largest chunk to run without splitting it (at least 1)
+ * @param fn - function run on each chunk
+ * @param ctx - context passed to fn
+ */
+void parallel_for(int begin, int end, int grain, parallel_fn_t fn, void *ctx) {
+    proc_t *proc = active_proc;
+    task_deque_t *dq;
+    task_job_t job;
+    task_t task;
+    int caller = -1;
+
+    if (!fn || end <= begin) {
+        return;
+    }
+
+    if (grain < 1) {
+        grain = 1;
+    }
+
+    // Run everything here if no worker is running yet, if the range is
+    // too small to split, with interrupts disabled (the workers would
+    // need the kernel lock the caller holds) or in the idle process
+    // (which cannot sleep while it joins)
+    if (!proc || kproc_is_idle(proc) || task_nr_workers == 0 || end - begin <= grain
+        || !(cpu_get_eflags() & EFLAGS_IF)) {
+        fn(begin, end, ctx);
+        return;
+    }
+
+    dq = proc->task_deque;
+    if (!dq) {
+        caller = task_caller_get();
+        if (caller < 0) {
+            fn(begin, end, ctx);
+            return;
+        }
+
+        dq = &task_deques[CPU_MAX + caller];
+        proc->task_deque = dq;
+    }
+
+    job.fn = fn;
+    job.ctx = ctx;
+    job.grain = grain;
+    job.remaining = end - begin;
+    wait_queue_init(&job.done);
+
+    task.job = &job;
+    task.begin = begin;
+    task.end = end;
+    task_run(dq, task);
+
+    // Join: run what is left in our deque (which may include tasks of
+    // other calls forked by stolen tasks) and help with the rest. Once
+    // there is nothing left to take, the chunks still running belong to
+    // other processes, so sleep until the last of them finishes
+    while (task_pop(dq, &task) || (job.remaining != 0 && task_steal(dq, &task))) {
+        task_run(dq, task);
+    }
+
+    wait_event(&job.done, job.remaining == 0);
+
+    if (caller >= 0) {
+        proc->task_deque = NULL;
+        task_caller_put(caller);
+    }
+}
+
+/**
+ * Benchmark chunk: clears pages of the buffer
+ * @param begin - first page
+ * @param end - end page (exclusive)
+ * @param ctx - buffer
+ */
+static void task_benchmark_clear(int begin, int end, void *ctx) {
+    kmemset((char *)ctx + begin * PAGE_SIZE, 0, (end - begin) * PAGE_SIZE);
+}
+
+/**
+ * Benchmark process: clears a buffer on one CPU and then with parallel_for
+ */
+static void task_benchmark_run(void) {
+    int pages = 1 << TASK_BENCHMARK_ORDER;
+    char *buf = page_alloc(TASK_BENCHMARK_ORDER);
+    unsigned long long serial;
+    unsigned long long parallel;
+
+    if (!buf) {
+        kernel_log_error("task: unable to allocate the benchmark buffer");
+        return;
+    }
+
+    // Wait for every worker to be ready
+    while (task_nr_workers < (unsigned int)smp_nr_cpus) {
+        sleep_ms(10);
+    }
+
+    // Warm up (fault in the cache and TLB entries), then time each way
+    task_benchmark_clear(0, pages, buf);
+
+    serial = cpu_rdtsc();
+    task_benchmark_clear(0, pages, buf);
+    serial = cpu_rdtsc() - serial;
+
+    parallel = cpu_rdtsc();
+    parallel_for(0, pages, TASK_BENCHMARK_GRAIN, task_benchmark_clear, buf);
+    parallel = cpu_rdtsc() - parallel;
+
+    kernel_log_info("task: clearing %d pages on %d CPUs: %u cycles serial, %u cycles parallel",
+                    pages, smp_nr_cpus, serial > 0xFFFFFFFFULL ? 0xFFFFFFFF : (unsigned int)serial,
+                    parallel > 0xFFFFFFFFULL ? 0xFFFFFFFF : (unsigned int)parallel);
+
+    page_free(buf, TASK_BENCHMARK_ORDER);
+}
+
+/**
+ * Measures how fast a large buffer is cleared with parallel_for compared
+ * to a single CPU and logs it
+ */
+void task_benchmark(void) {
+    // The results are logged once the process runs
+    if (kproc_create(task_benchmark_run, "task_bench") < 0) {
+        kernel_log_error("task: unable to start the benchmark");
+    }
+}
+
+/**
+ * Dumps the state of each deque
+ */
+void task_dump(void) {
+    kernel_log_info("task: %u workers, %u idle", task_nr_workers, task_idle);
+
+    for (int i = 0; i < TASK_DEQUES; i++) {
+        task_deque_t *dq = &task_deques[i];
+
+        if (dq->executed == 0 && dq->bottom == dq->top) {
+            continue;
+        }
+
+        kernel_log_info("task: deque %2d %3d queued %10u executed %10u stolen", i,
+                        (int)(dq->bottom - dq->top), dq->executed, dq->stolen);
+    }
+}
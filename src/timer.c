@@ -4,11 +4,12 @@
  *
  * Timer Implementation
  */
-#include <spede/string.h>
-
+#include "cpustat.h"
 #include "interrupts.h"
 #include "kernel.h"
-#include "queue.h"
+#include "kstring.h"
+#include "pool.h"
+#include "spinlock.h"
 #include "timer.h"
 
 /**
@@ -28,11 +29,22 @@ typedef struct timer_t {
 // Number of timer ticks that have occured
 int timer_ticks;
 
-// Timers table; each item in the array is a timer_t struct
-timer_t timers[TIMERS_MAX];
+// Timers pool; timer ids are indexes into the pool
+POOL_DEFINE(timer_pool, timer_t, TIMERS_MAX);
+
+// Protects the timers pool (taken by the timer interrupt)
+spinlock_t timer_lock;
 
-// Timer allocator; used to allocate indexes into the timers table
-queue_t timer_allocator;
+/**
+ * Frees a timer (called with timer_lock held)
+ * @param timer - pointer to the timer
+ * @return 0 on success, -1 on error
+ */
+static int timer_free(timer_t *timer) {
+    kmemset(timer, 0, sizeof(timer_t));
+
+    return pool_free(&timer_pool, timer);
+}
 
 
 /**
@@ -44,24 +56,38 @@ queue_t timer_allocator;
  * @return the allocated timer id or -1 for errors
  */
 int timer_callback_register(void (*func_ptr)(), int interval, int repeat) {
-    int timer_id = -1;
+    unsigned int flags;
+    timer_t *timer;
+    int id;
 
     if (!func_ptr) {
         kernel_log_error("timer: invalid function pointer");
         return -1;
     }
 
-    // Obtain a timer id
-    if (queue_out(&timer_allocator, &timer_id) != 0) {
+    if (interval <= 0) {
+        kernel_log_error("timer: invalid interval: %d", interval);
+        return -1;
+    }
+
+    flags = spinlock_acquire_irqsave(&timer_lock);
+
+    // Obtain a timer
+    timer = pool_alloc(&timer_pool);
+    if (!timer) {
+        spinlock_release_irqrestore(&timer_lock, flags);
         kernel_log_error("timer: unable to allocate a timer");
         return -1;
     }
 
-    // Set the callback function for the timer
-    // Set the interval value for the timer
-    // Set the repeat value for the timer
+    timer->callback = func_ptr;
+    timer->interval = interval;
+    timer->repeat = repeat;
+    id = pool_index(&timer_pool, timer);
+
+    spinlock_release_irqrestore(&timer_lock, flags);
 
-    return timer_id;
+    return id;
 }
 
 /**
@@ -71,22 +97,29 @@ int timer_callback_register(void (*func_ptr)(), int interval, int repeat) {
  * @return 0 on success, -1 on error
  */
 int timer_callback_unregister(int id) {
+    unsigned int flags;
     timer_t *timer;
+    int rc;
 
     if (id < 0 || id >= TIMERS_MAX) {
         kernel_log_error("timer: callback id out of range: %d", id);
         return -1;
     }
 
-    timer = &timers[id];
-    memset(timer, 0, sizeof(timer_t));
+    flags = spinlock_acquire_irqsave(&timer_lock);
 
-    if (queue_in(&timer_allocator, id) != 0) {
-        kernel_log_error("timer: unable to queue timer entry back to allocator");
+    timer = pool_get(&timer_pool, id);
+    if (!timer) {
+        spinlock_release_irqrestore(&timer_lock, flags);
+        kernel_log_error("timer: callback id not registered: %d", id);
         return -1;
     }
 
-    return 0;
+    rc = timer_free(timer);
+
+    spinlock_release_irqrestore(&timer_lock, flags);
+
+    return rc;
 }
 
 /**
@@ -108,16 +141,45 @@ int timer_get_ticks() {
  *     - Handle timer repeats
  */
 void timer_irq_handler(void) {
+    cpustat_state_t prev_state;
+    void (*callback)();
+    timer_t *timer;
+
     // Increment the timer_ticks value
     timer_ticks++;
 
-    // Iterate through the timers table
-        // If we have a valid callback, check if it needs to be called
-            // If the timer interval is hit, run the callback function
+    // Callbacks are accounted as deferred work rather than interrupt time
+    prev_state = cpustat_switch(CPUSTAT_SOFTIRQ);
+
+    // Iterate through the allocated timers (interrupts are already
+    // disabled here)
+    spinlock_acquire(&timer_lock);
+
+    for (int id = pool_next(&timer_pool, 0); id >= 0; id = pool_next(&timer_pool, id + 1)) {
+        timer = pool_get(&timer_pool, id);
+
+        // If the timer interval is hit, run the callback function
+        if ((timer_ticks % timer->interval) != 0) {
+            continue;
+        }
+
+        callback = timer->callback;
 
-            // If the timer repeat is greater than 0, decrement
-            // If the timer repeat is equal to 0, unregister the timer
-            // If the timer repeat is less than 0, do nothing
+        if (timer->repeat > 0) {
+            timer->repeat--;
+        } else if (timer->repeat == 0) {
+            timer_free(timer);
+        }
+
+        // Callbacks may register or unregister timers themselves
+        spinlock_release(&timer_lock);
+        callback();
+        spinlock_acquire(&timer_lock);
+    }
+
+    spinlock_release(&timer_lock);
+
+    cpustat_switch(prev_state);
 }
 
 /**
@@ -127,13 +189,13 @@ void timer_init(void) {
     kernel_log_info("Initializing timer");
 
     // Set the starting tick value
+    timer_ticks = 0;
 
-    // Initialize the timers data structures
-
-    // Initialize the timer callback allocator queue
-
-    // Populate items into the allocator queue
+    // Initialize the timers pool
+    pool_init(&timer_pool);
+    spinlock_init(&timer_lock, "timers");
 
     // Register the Timer IRQ with the isr_entry_timer and timer_irq_handler
+    interrupts_irq_register(IRQ_TIMER, isr_entry_timer, timer_irq_handler);
 }
 
@@ -5,26 +5,105 @@
  * TTY Definitions
  */
 
-#include <spede/string.h>
-
 #include "kernel.h"
+#include "kmalloc.h"
+#include "kstring.h"
+#include "spinlock.h"
 #include "timer.h"
 #include "tty.h"
 #include "vga.h"
+#include "wait.h"
+
+// TTY Table; TTYs are allocated the first time they are selected
+struct tty_t *tty_table[TTY_MAX];
 
-// TTY Table
-struct tty_t tty_table[TTY_MAX];
+// Cache for TTY allocations
+kmem_cache_t *tty_cache;
 
 // Current Active TTY
 struct tty_t *active_tty;
 
+// Protects tty_table, active_tty and the input buffers
+spinlock_t tty_lock;
+
+/**
+ * Obtains the given TTY, allocating it if it does not yet exist (called
+ * without tty_lock held, since the allocator takes the kernel lock)
+ * @param n - TTY number
+ * @return pointer to the TTY or NULL on error
+ */
+static struct tty_t *tty_get(int n) {
+    struct tty_t *tty;
+    unsigned int flags;
+
+    if (n < 0 || n >= TTY_MAX) {
+        kernel_log_error("tty: invalid tty %d", n);
+        return NULL;
+    }
+
+    if (tty_table[n]) {
+        return tty_table[n];
+    }
+
+    tty = kmem_cache_alloc(tty_cache);
+    if (!tty) {
+        kernel_log_error("tty: unable to allocate tty %d", n);
+        return NULL;
+    }
+
+    kmemset(tty, 0, sizeof(struct tty_t));
+    tty->id = n;
+
+    // Each TTY buffers its keyboard input in its own small ring
+    if (ringbuf_init_mem(&tty->input, tty->input_data, sizeof(tty->input_data)) != 0) {
+        kernel_panic("tty: unable to initialize input buffer for tty %d", n);
+    }
+
+    wait_queue_init(&tty->input_wait);
+
+    // Another CPU may have allocated the same TTY in the meantime
+    flags = spinlock_acquire_irqsave(&tty_lock);
+
+    if (tty_table[n]) {
+        spinlock_release_irqrestore(&tty_lock, flags);
+        kmem_cache_free(tty_cache, tty);
+        return tty_table[n];
+    }
+
+    tty_table[n] = tty;
+
+    spinlock_release_irqrestore(&tty_lock, flags);
+
+    kernel_log_debug("tty: allocated tty %d", n);
+
+    return tty;
+}
+
 /**
  * Sets the active TTY to the selected TTY number
  * @param tty - TTY number
  */
 void tty_select(int n) {
+    struct tty_t *tty = tty_get(n);
+    unsigned int flags;
+
+    if (!tty) {
+        return;
+    }
+
+    flags = spinlock_acquire_irqsave(&tty_lock);
+
+    if (tty == active_tty) {
+        spinlock_release_irqrestore(&tty_lock, flags);
+        return;
+    }
+
     // Set the active tty to point to the entry in the tty table
     // if a new tty is selected, the tty should trigger a refresh
+    active_tty = tty;
+    active_tty->refresh = 1;
+
+    spinlock_release_irqrestore(&tty_lock, flags);
 }
 
 /**
@@ -63,6 +142,60 @@ void tty_update(char c) {
     // to trigger the the VGA update via the tty_refresh callback
 }
 
+/**
+ * Adds a character to the active TTY's input buffer, waking a reader
+ * @param c - character
+ * @return -1 if the buffer is full or no TTY is active; 0 on success
+ */
+int tty_input(char c) {
+    unsigned int flags = spinlock_acquire_irqsave(&tty_lock);
+    struct tty_t *tty = active_tty;
+
+    if (!tty || ringbuf_write(&tty->input, c) != 0) {
+        spinlock_release_irqrestore(&tty_lock, flags);
+        return -1;
+    }
+
+    spinlock_release_irqrestore(&tty_lock, flags);
+
+    wake_up(&tty->input_wait);
+
+    return 0;
+}
+
+/**
+ * Reads one character from a TTY's input buffer
+ * @param tty - pointer to the TTY
+ * @param c - receives the character
+ * @return -1 if the buffer is empty; 0 on success
+ */
+static int tty_read(struct tty_t *tty, char *c) {
+    unsigned int flags = spinlock_acquire_irqsave(&tty_lock);
+    int rc = ringbuf_read(&tty->input, c);
+
+    spinlock_release_irqrestore(&tty_lock, flags);
+
+    return rc;
+}
+
+/**
+ * Blocks until the active TTY has input and reads one character
+ * @return character read
+ */
+char tty_getc(void) {
+    struct tty_t *tty = active_tty;
+    char c = 0;
+
+    if (!tty) {
+        kernel_panic("No TTY is selected!");
+        return 0;
+    }
+
+    wait_event(&tty->input_wait, tty_read(tty, &c) == 0);
+
+    return c;
+}
+
 /**
  * Initializes all TTY data structures and memory
  * Selects TTY 0 to be the default
@@ -70,9 +203,19 @@ void tty_update(char c) {
 void tty_init(void) {
     kernel_log_info("tty: Initializing TTY driver");
 
-    // Initialize the tty_table
+    // Initialize the tty_table; TTYs are allocated when first selected
+    kmemset(tty_table, 0, sizeof(tty_table));
+    active_tty = NULL;
+    spinlock_init(&tty_lock, "tty_table");
+
+    tty_cache = kmem_cache_create("tty", sizeof(struct tty_t));
+    if (!tty_cache) {
+        kernel_panic("tty: unable to create the tty cache");
+        return;
+    }
 
     // Select tty 0 to start with
+    tty_select(0);
 
     // Register a timer callback to update the screen on a regular interval
 }
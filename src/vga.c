@@ -8,6 +8,8 @@
 #include <spede/stdio.h>
 
 #include "kernel.h"
+#include "kstring.h"
+#include "spinlock.h"
 #include "tty.h"
 #include "vga.h"
 
@@ -35,6 +37,115 @@ int vga_cursor = 0;
 // Optionally enable/disable scrolling
 int vga_scroll = 0;
 
+// Protects the position, colors and cursor state above (and the screen)
+spinlock_t vga_lock;
+
+/**
+ * Moves the hardware cursor to the current position if the cursor is
+ * enabled (called with vga_lock held)
+ */
+static void vga_cursor_move(void) {
+    if (vga_cursor) {
+        unsigned short pos = vga_pos_x + vga_pos_y * VGA_WIDTH;
+
+        outportb(VGA_PORT_ADDR, 0x0F);
+        outportb(VGA_PORT_DATA, (unsigned char) (pos & 0xFF));
+        outportb(VGA_PORT_ADDR, 0x0E);
+        outportb(VGA_PORT_DATA, (unsigned char) ((pos >> 8) & 0xFF));
+    }
+}
+
+/**
+ * Sets the current position, clamped to the screen (called with
+ * vga_lock held)
+ * @param x - x position
+ * @param y - y position
+ */
+static void vga_move_xy(int x, int y) {
+    if (x < 0) {
+        vga_pos_x = 0;
+    } else if (x >= VGA_WIDTH) {
+        vga_pos_x = VGA_WIDTH - 1;
+    } else {
+        vga_pos_x = x;
+    }
+
+    if (y < 0) {
+        vga_pos_y = 0;
+    } else if (y >= VGA_HEIGHT) {
+        vga_pos_y = VGA_HEIGHT- 1;
+    } else {
+        vga_pos_y = y;
+    }
+
+    vga_cursor_move();
+}
+
+/**
+ * Prints a character at the current position (called with vga_lock
+ * held; see vga_putc)
+ * @param c - character to print
+ */
+static void vga_putc_locked(char c) {
+    unsigned short *vga_buf = VGA_BASE;
+
+    // Handle scecial characters
+    switch (c) {
+        case '\b':
+            if (vga_pos_x != 0) {
+                vga_pos_x--;
+            } else if (vga_pos_y != 0) {
+                vga_pos_y--;
+                vga_pos_x = VGA_WIDTH-1;
+            }
+
+            vga_buf[vga_pos_x + vga_pos_y * VGA_WIDTH] = VGA_CHAR(vga_color_bg, vga_color_fg, 0x00);
+            break;
+
+        case '\t':
+            vga_pos_x += 4 - vga_pos_x % 4;
+            break;
+
+        case '\r':
+            vga_pos_x = 0;
+            break;
+
+        case '\n':
+            vga_pos_x = 0;
+            vga_pos_y++;
+            break;
+
+        default:
+            vga_buf[vga_pos_x + vga_pos_y * VGA_WIDTH] = VGA_CHAR(vga_color_bg, vga_color_fg, c);
+            vga_pos_x++;
+            break;
+    }
+
+    // Handle end of lines
+    if (vga_pos_x >= VGA_WIDTH) {
+        vga_pos_x = 0;
+        vga_pos_y++;
+    }
+
+    if (vga_scroll) {
+        // Handle end of rows
+        if (vga_pos_y >= VGA_HEIGHT) {
+            // Scroll the screen up (copy each row to the previous)
+            kmemmove(vga_buf, vga_buf + VGA_WIDTH,
+                     VGA_WIDTH * (VGA_HEIGHT - 1) * sizeof(unsigned short));
+
+            // Clear the last line
+            kmemset16(vga_buf + VGA_WIDTH * (VGA_HEIGHT - 1),
+                      VGA_CHAR(vga_color_bg, vga_color_fg, ' '), VGA_WIDTH);
+
+            vga_pos_y = VGA_HEIGHT - 1;
+        }
+
+    }
+
+    vga_cursor_move();
+}
+
 /**
  * Initializes the VGA driver and configuration
  *  - Defaults variables
@@ -43,6 +154,8 @@ int vga_scroll = 0;
 void vga_init(void) {
     kernel_log_info("Initializing VGA driver");
 
+    spinlock_init(&vga_lock, "vga");
+
     if (vga_cursor) {
         // Enable the cursor
         vga_cursor_enable();
@@ -60,27 +173,23 @@ void vga_init(void) {
  * position if the cursor is enabled.
  */
 void vga_cursor_update(void) {
-    if (vga_cursor) {
-        unsigned short pos = vga_pos_x + vga_pos_y * VGA_WIDTH;
+    unsigned int flags = spinlock_acquire_irqsave(&vga_lock);
 
-        outportb(VGA_PORT_ADDR, 0x0F);
-        outportb(VGA_PORT_DATA, (unsigned char) (pos & 0xFF));
-        outportb(VGA_PORT_ADDR, 0x0E);
-        outportb(VGA_PORT_DATA, (unsigned char) ((pos >> 8) & 0xFF));
-    }
+    vga_cursor_move();
+
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
 /**
  * Clears the VGA output and sets the background and foreground colors
  */
 void vga_clear(void) {
-    unsigned short *vga_buf = VGA_BASE;
+    unsigned int flags = spinlock_acquire_irqsave(&vga_lock);
 
-    for (unsigned int i = 0; i < (VGA_WIDTH * VGA_HEIGHT); i++) {
-        vga_buf[i] = VGA_CHAR(vga_color_bg, vga_color_fg, 0x00);
-    }
+    kmemset16(VGA_BASE, VGA_CHAR(vga_color_bg, vga_color_fg, 0x00), VGA_WIDTH * VGA_HEIGHT);
+    vga_move_xy(0, 0);
 
-    vga_set_xy(0, 0);
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
 /**
@@ -92,23 +201,11 @@ void vga_clear(void) {
  *        will be set to the range boundary (min or max)
  */
 void vga_set_xy(int x, int y) {
-    if (x < 0) {
-        vga_pos_x = 0;
-    } else if (x >= VGA_WIDTH) {
-        vga_pos_x = VGA_WIDTH - 1;
-    } else {
-        vga_pos_x = x;
-    }
+    unsigned int flags = spinlock_acquire_irqsave(&vga_lock);
 
-    if (y < 0) {
-        vga_pos_y = 0;
-    } else if (y >= VGA_HEIGHT) {
-        vga_pos_y = VGA_HEIGHT- 1;
-    } else {
-        vga_pos_y = y;
-    }
+    vga_move_xy(x, y);
 
-    vga_cursor_update();
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
 /**
@@ -174,7 +271,11 @@ int vga_get_fg(void) {
  */
 void vga_setc(char c) {
     unsigned short *vga_buf = VGA_BASE;
+    unsigned int flags = spinlock_acquire_irqsave(&vga_lock);
+
     vga_buf[vga_pos_x + vga_pos_y * VGA_WIDTH] = VGA_CHAR(vga_color_bg, vga_color_fg, c);
+
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
 /**
@@ -194,65 +295,11 @@ void vga_setc(char c) {
  * @param c - character to print
  */
 void vga_putc(char c) {
-    unsigned short *vga_buf = VGA_BASE;
-
-    // Handle scecial characters
-    switch (c) {
-        case '\b':
-            if (vga_pos_x != 0) {
-                vga_pos_x--;
-            } else if (vga_pos_y != 0) {
-                vga_pos_y--;
-                vga_pos_x = VGA_WIDTH-1;
-            }
+    unsigned int flags = spinlock_acquire_irqsave(&vga_lock);
 
-            vga_buf[vga_pos_x + vga_pos_y * VGA_WIDTH] = VGA_CHAR(vga_color_bg, vga_color_fg, 0x00);
-            break;
-
-        case '\t':
-            vga_pos_x += 4 - vga_pos_x % 4;
-            break;
+    vga_putc_locked(c);
 
-        case '\r':
-            vga_pos_x = 0;
-            break;
-
-        case '\n':
-            vga_pos_x = 0;
-            vga_pos_y++;
-            break;
-
-        default:
-            vga_buf[vga_pos_x + vga_pos_y * VGA_WIDTH] = VGA_CHAR(vga_color_bg, vga_color_fg, c);
-            vga_pos_x++;
-            break;
-    }
-
-    // Handle end of lines
-    if (vga_pos_x >= VGA_WIDTH) {
-        vga_pos_x = 0;
-        vga_pos_y++;
-    }
-
-    if (vga_scroll) {
-        // Handle end of rows
-        if (vga_pos_y >= VGA_HEIGHT) {
-            // Scroll the screen up (copy each row to the previous)
-            for (unsigned int i = 0; i < VGA_WIDTH * (VGA_HEIGHT - 1); i++) {
-                vga_buf[i] = vga_buf[VGA_WIDTH + i];
-            }
-
-            // Clear the last line
-            for (unsigned int i = 0; i < VGA_WIDTH; i++) {
-                vga_buf[i + (VGA_WIDTH * (VGA_HEIGHT-1))] = VGA_CHAR(vga_color_bg, vga_color_fg, ' ');
-            }
-
-            vga_pos_y = VGA_HEIGHT - 1;
-        }
-
-    }
-
-    vga_cursor_update();
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
 /**
@@ -261,15 +308,22 @@ void vga_putc(char c) {
  * @param s - string to print
  */
 void vga_puts(char *s) {
+    unsigned int flags;
+
     /* Handle a null pointer */
     if (s == NULL) {
         return;
     }
 
+    // Strings printed from different CPUs are not interleaved
+    flags = spinlock_acquire_irqsave(&vga_lock);
+
     while (*s != '\0') {
-        vga_putc(*s);
+        vga_putc_locked(*s);
         s++;
     }
+
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
 /**
@@ -286,6 +340,7 @@ void vga_puts(char *s) {
  * @param c - character to print
  */
 void vga_putc_at(int x, int y, int bg, int fg, char c) {
+    unsigned int flags = spinlock_acquire_irqsave(&vga_lock);
     int cur_x = vga_pos_x;
     int cur_y = vga_pos_y;
     int cur_bg = vga_color_bg;
@@ -314,13 +369,15 @@ void vga_putc_at(int x, int y, int bg, int fg, char c) {
     vga_color_fg = fg & 0xf;
     vga_cursor = 0;
 
-    vga_putc(c);
+    vga_putc_locked(c);
 
     vga_pos_x = cur_x;
     vga_pos_y = cur_y;
     vga_color_bg = cur_bg;
     vga_color_fg = cur_fg;
     vga_cursor = cur_cursor;
+
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
 /**
@@ -336,6 +393,7 @@ void vga_putc_at(int x, int y, int bg, int fg, char c) {
  * @param c - character to print
  */
 void vga_puts_at(int x, int y, int bg, int fg, char *s) {
+    unsigned int flags = spinlock_acquire_irqsave(&vga_lock);
     int cur_x = vga_pos_x;
     int cur_y = vga_pos_y;
     int cur_bg = vga_color_bg;
@@ -365,7 +423,7 @@ void vga_puts_at(int x, int y, int bg, int fg, char *s) {
     vga_cursor = 0;
 
     while (*s != '\0') {
-        vga_putc(*s);
+        vga_putc_locked(*s);
         s++;
     }
 
@@ -374,12 +432,16 @@ void vga_puts_at(int x, int y, int bg, int fg, char *s) {
     vga_color_bg = cur_bg;
     vga_color_fg = cur_fg;
     vga_cursor = cur_cursor;
+
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
 /**
  * Enables the VGA text mode cursor
  */
 void vga_cursor_enable(void) {
+    unsigned int flags = spinlock_acquire_irqsave(&vga_lock);
+
     vga_cursor = 1;
 
     // The cursor will be drawn between the scanlines defined
@@ -398,16 +460,22 @@ void vga_cursor_enable(void) {
     // Ensure that bit 5 is not set so the cursor will be enabled
     outportb(VGA_PORT_ADDR, 0x0B);
     outportb(VGA_PORT_DATA, (inportb(VGA_PORT_DATA) & 0xE0) | 0xF);
+
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
 /**
  * Disables the VGA text mode cursor
  */
 void vga_cursor_disable(void) {
+    unsigned int flags = spinlock_acquire_irqsave(&vga_lock);
+
     vga_cursor = 0;
 
     // The cursor can be disabled by setting bit 5 in the "Cursor Start Register" (0xA)
     outportb(VGA_PORT_ADDR, 0x0A);
     outportb(VGA_PORT_DATA, 0x20);
+
+    spinlock_release_irqrestore(&vga_lock, flags);
 }
 
@@ -0,0 +1,469 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Virtual Memory (Address Space) Implementation
+ */
+#include "cpu.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kmalloc.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "smp.h"
+#include "vm.h"
+
+// Address space that is active on each CPU (NULL for the kernel)
+vm_space_t *vm_current_space[CPU_MAX];
+
+/**
+ * Fills a newly allocated page with the contents described by an area
+ * @param area - area containing the page
+ * @param vaddr - virtual address of the page
+ * @param mem - kernel address of the new page
+ */
+static void vm_fill(vm_area_t *area, unsigned int vaddr, char *mem) {
+    unsigned int from = vaddr;
+    unsigned int to = vaddr;
+
+    // Determine the part of the page that is backed by data
+    if (area->data && vaddr + PAGE_SIZE > area->data_start && vaddr < area->data_end) {
+        from = (vaddr > area->data_start) ? vaddr : area->data_start;
+        to = (vaddr + PAGE_SIZE < area->data_end) ? vaddr + PAGE_SIZE : area->data_end;
+    }
+
+    // Zero only what is not copied from the backing data
+    kmemset(mem, 0, from - vaddr);
+    kmemcpy(mem + (from - vaddr), area->data + (from - area->data_start), to - from);
+    kmemset(mem + (to - vaddr), 0, vaddr + PAGE_SIZE - to);
+}
+
+/**
+ * Resolves a write fault on a copy-on-write page
+ * @param space - pointer to the address space
+ * @param vaddr - virtual address of the page
+ * @param pte - pointer to the page table entry
+ * @return -1 on error; 0 on success
+ */
+static int vm_cow(vm_space_t *space, unsigned int vaddr, pte_t *pte) {
+    char *old = (char *)PTE_ADDR(*pte);
+    char *mem;
+
+    // The last reference can take the page over without copying it
+    if (page_refcount(old) == 1) {
+        *pte = (*pte & ~PTE_COW) | PTE_WRITE;
+    } else {
+        mem = page_alloc(0);
+        if (!mem) {
+            kernel_log_error("vm: out of memory copying 0x%08x", vaddr);
+            return -1;
+        }
+
+        kmemcpy(mem, old, PAGE_SIZE);
+        *pte = (unsigned int)mem | (*pte & PTE_FLAGS_MASK & ~PTE_COW) | PTE_WRITE;
+        page_unref(old);
+    }
+
+    if (space->pd == paging_current()) {
+        paging_flush(vaddr);
+    }
+
+    space->cow_faults++;
+
+    return 0;
+}
+
+/**
+ * Page fault handler
+ */
+static void vm_page_fault_handler(void) {
+    trap_frame_t *frame = interrupts_get_frame();
+    unsigned int addr = cpu_get_cr2();
+
+    if (addr >= USER_SPACE_BASE && addr < USER_SPACE_END && vm_current()) {
+        if (vm_fault(vm_current(), addr, frame->error) == 0) {
+            return;
+        }
+    }
+
+    // An invalid access from user mode only terminates the process
+    if (frame->error & VM_FAULT_USER) {
+        kernel_log_error("vm: process %d (%s) terminated: page fault at 0x%08x (eip=0x%08x error=0x%x)",
+                         active_proc->pid, active_proc->name, addr, frame->eip, frame->error);
+        kproc_destroy(active_proc);
+        return;
+    }
+
+    kernel_panic("vm: page fault at 0x%08x (eip=0x%08x error=0x%x)",
+                 addr, frame->eip, frame->error);
+}
+
+/**
+ * Initializes the virtual memory subsystem and registers the page fault
+ * handler
+ */
+void vm_init(void) {
+    kernel_log_info("Initializing virtual memory");
+
+    kmemset(vm_current_space, 0, sizeof(vm_current_space));
+
+    interrupts_irq_register(IRQ_PAGE_FAULT, isr_entry_page_fault, vm_page_fault_handler);
+}
+
+/**
+ * Creates an empty address space
+ * @return pointer to the address space or NULL if no memory is available
+ */
+vm_space_t *vm_space_create(void) {
+    vm_space_t *space = kmalloc(sizeof(vm_space_t));
+
+    if (!space) {
+        return NULL;
+    }
+
+    kmemset(space, 0, sizeof(vm_space_t));
+
+    space->pd = paging_pd_create();
+    if (!space->pd) {
+        kfree(space);
+        return NULL;
+    }
+
+    return space;
+}
+
+/**
+ * Creates a copy-on-write duplicate of an address space
+ * @param parent - pointer to the address space to duplicate
+ * @return pointer to the new address space or NULL if no memory is available
+ */
+vm_space_t *vm_space_fork(vm_space_t *parent) {
+    vm_space_t *child;
+    vm_area_t **tail;
+
+    if (!parent) {
+        return NULL;
+    }
+
+    child = vm_space_create();
+    if (!child) {
+        return NULL;
+    }
+
+    // Duplicate the area list, preserving its order
+    tail = &child->areas;
+
+    for (vm_area_t *area = parent->areas; area; area = area->next) {
+        vm_area_t *copy = kmalloc(sizeof(vm_area_t));
+
+        if (!copy) {
+            vm_space_destroy(child);
+            return NULL;
+        }
+
+        *copy = *area;
+        copy->next = NULL;
+        *tail = copy;
+        tail = &copy->next;
+    }
+
+    // Share every resident page, skipping page tables that do not exist
+    for (unsigned int i = PDE_INDEX(USER_SPACE_BASE); i < PDE_INDEX(USER_SPACE_END); i++) {
+        pte_t *pt;
+        pte_t *child_pt;
+
+        if ((parent->pd[i] & PTE_PRESENT) == 0) {
+            continue;
+        }
+
+        pt = (pte_t *)PTE_ADDR(parent->pd[i]);
+        child_pt = NULL;
+
+        for (unsigned int j = 0; j < PTE_ENTRIES; j++) {
+            if ((pt[j] & PTE_PRESENT) == 0) {
+                continue;
+            }
+
+            if (!child_pt) {
+                child_pt = paging_lookup(child->pd, i * PDE_SIZE, true);
+                if (!child_pt) {
+                    vm_space_destroy(child);
+                    return NULL;
+                }
+            }
+
+            if (pt[j] & PTE_WRITE) {
+                pt[j] = (pt[j] & ~PTE_WRITE) | PTE_COW;
+            }
+
+            page_ref((void *)PTE_ADDR(pt[j]));
+            child_pt[j] = pt[j];
+            child->resident++;
+        }
+    }
+
+    // Drop the parent's stale writable translations in one go
+    if (parent->pd == paging_current()) {
+        cpu_set_cr3(cpu_get_cr3());
+    }
+
+    return child;
+}
+
+/**
+ * Destroys an address space, freeing all of its resident pages
+ * @param space - pointer to the address space
+ */
+void vm_space_destroy(vm_space_t *space) {
+    vm_area_t *area;
+
+    if (!space) {
+        return;
+    }
+
+    // Only the CPU that ran the process last can still be using it
+    if (space == vm_current()) {
+        vm_switch(NULL);
+    }
+
+    while ((area = space->areas) != NULL) {
+        for (unsigned int addr = area->start; addr < area->end; addr += PAGE_SIZE) {
+            pte_t *pte = paging_lookup(space->pd, addr, false);
+
+            // Pages may still be shared with a forked address space
+            if (pte && (*pte & PTE_PRESENT)) {
+                page_unref((void *)PTE_ADDR(*pte));
+            }
+        }
+
+        space->areas = area->next;
+        kfree(area);
+    }
+
+    paging_pd_destroy(space->pd);
+    kfree(space);
+}
+
+/**
+ * Adds an area to the address space
+ * @param space - pointer to the address space
+ * @param start - start address
+ * @param end - end address (exclusive)
+ * @param flags - permission flags
+ * @param data - backing data for data_start (NULL for zero-filled)
+ * @param data_start - first address backed by data
+ * @param data_end - end of the addresses backed by data
+ * @return -1 on error; 0 on success
+ */
+int vm_area_add(vm_space_t *space, unsigned int start, unsigned int end, unsigned int flags,
+                char *data, unsigned int data_start, unsigned int data_end) {
+    vm_area_t *area;
+
+    if (!space) {
+        return -1;
+    }
+
+    start = PAGE_ALIGN_DOWN(start);
+    end = PAGE_ALIGN_UP(end);
+
+    if (start < USER_SPACE_BASE || end > USER_SPACE_END || end <= start) {
+        kernel_log_error("vm: invalid area 0x%08x-0x%08x", start, end);
+        return -1;
+    }
+
+    if (data && (data_start < start || data_end > end || data_end < data_start)) {
+        kernel_log_error("vm: invalid backing data 0x%08x-0x%08x", data_start, data_end);
+        return -1;
+    }
+
+    for (area = space->areas; area; area = area->next) {
+        if (start < area->end && end > area->start) {
+            kernel_log_error("vm: area 0x%08x-0x%08x overlaps 0x%08x-0x%08x",
+                             start, end, area->start, area->end);
+            return -1;
+        }
+    }
+
+    area = kmalloc(sizeof(vm_area_t));
+    if (!area) {
+        return -1;
+    }
+
+    area->start = start;
+    area->end = end;
+    area->flags = flags;
+    area->data = data;
+    area->data_start = data_start;
+    area->data_end = data ? data_end : data_start;
+
+    area->next = space->areas;
+    space->areas = area;
+
+    return 0;
+}
+
+/**
+ * Finds the area containing the given address
+ * @param space - pointer to the address space
+ * @param addr - virtual address
+ * @return pointer to the area or NULL if the address is not mapped
+ */
+vm_area_t *vm_area_find(vm_space_t *space, unsigned int addr) {
+    if (!space) {
+        return NULL;
+    }
+
+    for (vm_area_t *area = space->areas; area; area = area->next) {
+        if (addr >= area->start && addr < area->end) {
+            return area;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Handles a page fault in the given address space
+ * @param space - pointer to the address space
+ * @param addr - faulting address
+ * @param error - page fault error code
+ * @return -1 if the access is invalid; 0 if the fault was resolved
+ */
+int vm_fault(vm_space_t *space, unsigned int addr, unsigned int error) {
+    unsigned int vaddr = PAGE_ALIGN_DOWN(addr);
+    unsigned int flags = PTE_USER;
+    vm_area_t *area;
+    pte_t *pte;
+    char *mem;
+
+    area = vm_area_find(space, addr);
+    if (!area) {
+        return -1;
+    }
+
+    if ((error & VM_FAULT_WRITE) && (area->flags & VM_WRITE) == 0) {
+        return -1;
+    }
+
+    // Present pages only fault on protection violations, which are valid
+    // for writes to pages shared copy-on-write
+    pte = paging_lookup(space->pd, vaddr, false);
+    if (pte && (*pte & PTE_PRESENT)) {
+        if ((error & VM_FAULT_WRITE) && (*pte & PTE_COW)) {
+            return vm_cow(space, vaddr, pte);
+        }
+
+        return -1;
+    }
+
+    mem = page_alloc(0);
+    if (!mem) {
+        kernel_log_error("vm: out of memory populating 0x%08x", vaddr);
+        return -1;
+    }
+
+    vm_fill(area, vaddr, mem);
+
+    if (area->flags & VM_WRITE) {
+        flags |= PTE_WRITE;
+    }
+
+    if (paging_map(space->pd, vaddr, (unsigned int)mem, flags) != 0) {
+        page_free(mem, 0);
+        return -1;
+    }
+
+    space->resident++;
+    space->faults++;
+
+    return 0;
+}
+
+/**
+ * Moves pages from one address space to another without copying them
+ *
+ * Each source page is populated (and made private if it is shared
+ * copy-on-write), unmapped and mapped writable at the destination in
+ * place of whatever was there. The source range reads as freshly filled
+ * pages afterwards. Both ranges must lie in writable areas.
+ * @param src - pointer to the source address space
+ * @param saddr - first source address (page aligned)
+ * @param dst - pointer to the destination address space
+ * @param daddr - first destination address (page aligned)
+ * @param pages - number of pages
+ * @return -1 on error; 0 on success
+ */
+int vm_page_move(vm_space_t *src, unsigned int saddr, vm_space_t *dst, unsigned int daddr, int pages) {
+    if (!src || !dst || src == dst || pages <= 0
+        || (saddr & (PAGE_SIZE - 1)) || (daddr & (PAGE_SIZE - 1))) {
+        return -1;
+    }
+
+    // Check every page first so that nothing moves unless everything can
+    for (int i = 0; i < pages; i++) {
+        vm_area_t *from = vm_area_find(src, saddr + i * PAGE_SIZE);
+        vm_area_t *to = vm_area_find(dst, daddr + i * PAGE_SIZE);
+
+        if (!from || !to || !(from->flags & VM_WRITE) || !(to->flags & VM_WRITE)) {
+            return -1;
+        }
+    }
+
+    // Do everything that may fail before moving anything: populate the
+    // source pages (resolving copy-on-write), which leaves the source's
+    // contents as they were, and create the destination page tables
+    for (int i = 0; i < pages; i++) {
+        unsigned int from = saddr + i * PAGE_SIZE;
+        pte_t *pte = paging_lookup(src->pd, from, false);
+
+        if (!pte || !(*pte & PTE_PRESENT) || (*pte & PTE_COW)) {
+            if (vm_fault(src, from, VM_FAULT_WRITE) != 0) {
+                return -1;
+            }
+        }
+
+        if (!paging_lookup(dst->pd, daddr + i * PAGE_SIZE, true)) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < pages; i++) {
+        unsigned int to = daddr + i * PAGE_SIZE;
+        pte_t old = paging_unmap(src->pd, saddr + i * PAGE_SIZE);
+        pte_t *pte = paging_lookup(dst->pd, to, false);
+
+        src->resident--;
+
+        if (*pte & PTE_PRESENT) {
+            page_unref((void *)PTE_ADDR(*pte));
+            dst->resident--;
+        }
+
+        *pte = PTE_ADDR(old) | PTE_USER | PTE_WRITE | PTE_PRESENT;
+
+        if (dst->pd == paging_current()) {
+            paging_flush(to);
+        }
+
+        dst->resident++;
+    }
+
+    return 0;
+}
+
+/**
+ * Switches to the given address space
+ * @param space - pointer to the address space (NULL for the kernel)
+ */
+void vm_switch(vm_space_t *space) {
+    vm_current_space[this_cpu()->id] = space;
+    paging_switch(space ? space->pd : kernel_pd);
+}
+
+/**
+ * Returns the current address space
+ * @return pointer to the address space or NULL for the kernel
+ */
+vm_space_t *vm_current(void) {
+    return vm_current_space[this_cpu()->id];
+}
@@ -0,0 +1,240 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Wait Queue Implementation
+ */
+#include "kernel.h"
+#include "kproc.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "wait.h"
+
+// Sleeping processes, ordered by wakeup tick
+wait_queue_t wait_sleepers;
+
+/**
+ * Tests if a tick has been reached (allowing for the counter wrapping)
+ * @param tick - timer tick
+ * @return true if the tick is now or in the past
+ */
+static bool wait_tick_reached(int tick) {
+    return (int)((unsigned int)timer_get_ticks() - (unsigned int)tick) >= 0;
+}
+
+/**
+ * Inserts a process into a wait queue after the given process
+ * @param wq - pointer to the wait queue
+ * @param prev - process to insert after (NULL for the head)
+ * @param proc - pointer to the process
+ */
+static void wait_insert(wait_queue_t *wq, proc_t *prev, proc_t *proc) {
+    if (prev) {
+        proc->wait_next = prev->wait_next;
+        prev->wait_next = proc;
+    } else {
+        proc->wait_next = wq->head;
+        wq->head = proc;
+    }
+
+    if (wq->tail == prev) {
+        wq->tail = proc;
+    }
+
+    proc->wait_queue = wq;
+}
+
+/**
+ * Removes and returns the first process in a wait queue
+ * @param wq - pointer to the wait queue
+ * @return pointer to the process or NULL if the queue is empty
+ */
+static proc_t *wait_pop(wait_queue_t *wq) {
+    proc_t *proc = wq->head;
+
+    if (!proc) {
+        return NULL;
+    }
+
+    wq->head = proc->wait_next;
+    if (!wq->head) {
+        wq->tail = NULL;
+    }
+
+    proc->wait_next = NULL;
+    proc->wait_queue = NULL;
+
+    return proc;
+}
+
+/**
+ * Timer callback: wakes the sleepers whose tick has been reached
+ */
+static void wait_tick(void) {
+    while (wait_sleepers.head && wait_tick_reached(wait_sleepers.head->wake_tick)) {
+        scheduler_wakeup(wait_pop(&wait_sleepers));
+    }
+}
+
+/**
+ * Initializes wait queues and the sleep timer
+ */
+void wait_init(void) {
+    kernel_log_info("Initializing wait queues");
+
+    wait_queue_init(&wait_sleepers);
+
+    // Only the head of the sleep list is checked each tick
+    timer_callback_register(wait_tick, 1, -1);
+}
+
+/**
+ * Initializes a wait queue
+ * @param wq - pointer to the wait queue
+ */
+void wait_queue_init(wait_queue_t *wq) {
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+/**
+ * Blocks the running process on a wait queue until it is woken up
+ * (must be called with interrupts disabled)
+ * @param wq - pointer to the wait queue
+ */
+void wait_sleep(wait_queue_t *wq) {
+    wait_enqueue(wq, active_proc);
+    scheduler_block();
+}
+
+/**
+ * Adds a blocked process to the end of a wait queue without blocking the
+ * running process (must be called with interrupts disabled)
+ * @param wq - pointer to the wait queue
+ * @param proc - pointer to the process
+ */
+void wait_enqueue(wait_queue_t *wq, proc_t *proc) {
+    // A process that is already queued (e.g. from a system call that has
+    // not returned yet) keeps its place
+    if (proc->wait_queue != wq) {
+        wait_remove(proc);
+        wait_insert(wq, wq->tail, proc);
+    }
+}
+
+/**
+ * Wakes the process that has waited longest on a wait queue
+ * @param wq - pointer to the wait queue
+ * @return number of processes woken
+ */
+int wake_up(wait_queue_t *wq) {
+    unsigned int flags = interrupts_save();
+    proc_t *proc = wait_pop(wq);
+
+    if (proc) {
+        scheduler_wakeup(proc);
+    }
+
+    interrupts_restore(flags);
+
+    return proc ? 1 : 0;
+}
+
+/**
+ * Wakes every process waiting on a wait queue
+ * @param wq - pointer to the wait queue
+ * @return number of processes woken
+ */
+int wake_up_all(wait_queue_t *wq) {
+    unsigned int flags = interrupts_save();
+    proc_t *proc;
+    int count = 0;
+
+    while ((proc = wait_pop(wq)) != NULL) {
+        scheduler_wakeup(proc);
+        count++;
+    }
+
+    interrupts_restore(flags);
+
+    return count;
+}
+
+/**
+ * Removes a process from the wait queue or sleep list holding it
+ * @param proc - pointer to the process
+ */
+void wait_remove(proc_t *proc) {
+    unsigned int flags = interrupts_save();
+    wait_queue_t *wq = proc->wait_queue;
+    proc_t *prev = NULL;
+
+    if (wq) {
+        for (proc_t *p = wq->head; p && p != proc; p = p->wait_next) {
+            prev = p;
+        }
+
+        if (prev) {
+            prev->wait_next = proc->wait_next;
+        } else {
+            wq->head = proc->wait_next;
+        }
+
+        if (wq->tail == proc) {
+            wq->tail = prev;
+        }
+
+        proc->wait_next = NULL;
+        proc->wait_queue = NULL;
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Blocks the running process until the given tick
+ * @param tick - timer tick to wake up at
+ */
+void sleep_until(int tick) {
+    unsigned int flags = interrupts_save();
+    proc_t *proc = active_proc;
+    proc_t *prev;
+
+    while (!wait_tick_reached(tick)) {
+        if (proc->wait_queue != &wait_sleepers) {
+            wait_remove(proc);
+
+            // Keep the list ordered; equal ticks wake in arrival order
+            proc->wake_tick = tick;
+            prev = NULL;
+            for (proc_t *p = wait_sleepers.head; p; p = p->wait_next) {
+                if ((int)((unsigned int)p->wake_tick - (unsigned int)tick) > 0) {
+                    break;
+                }
+                prev = p;
+            }
+
+            wait_insert(&wait_sleepers, prev, proc);
+        }
+
+        scheduler_block();
+
+        // A system call blocks once it returns, not here
+        if (interrupts_get_frame()) {
+            break;
+        }
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Blocks the running process for at least the given time
+ * @param ms - time in milliseconds (rounded up to whole ticks)
+ */
+void sleep_ms(unsigned int ms) {
+    unsigned int ticks = (ms * TIMER_HZ + 999) / 1000;
+
+    // The current tick has already partly passed
+    sleep_until(timer_get_ticks() + ticks + 1);
+}
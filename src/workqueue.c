@@ -0,0 +1,341 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Work Queue Implementation
+ */
+#include <spede/stdio.h>
+#include <spede/string.h>
+
+#include "interrupts.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "kstring.h"
+#include "pool.h"
+#include "scheduler.h"
+#include "workqueue.h"
+
+// Work queue table
+POOL_DEFINE(workqueue_pool, workqueue_t, WORKQUEUE_MAX);
+
+// General purpose queue for jobs that do not need their own workers
+workqueue_t *system_wq = NULL;
+
+/**
+ * Compares two sequence numbers, allowing for wraparound
+ * @param a - sequence number
+ * @param b - sequence number
+ * @return true if a comes before b
+ */
+static inline bool workqueue_before(unsigned int a, unsigned int b) {
+    return (int)(a - b) < 0;
+}
+
+/**
+ * Returns the sequence number of the oldest item that has not completed
+ * @param wq - pointer to the queue
+ * @return sequence number (next_seq if every item has completed)
+ */
+static unsigned int workqueue_oldest(workqueue_t *wq) {
+    unsigned int oldest = wq->head ? wq->head->seq : wq->next_seq;
+
+    for (int i = 0; i < wq->nr_workers; i++) {
+        if (wq->running[i] && workqueue_before(wq->running[i], oldest)) {
+            oldest = wq->running[i];
+        }
+    }
+
+    return oldest;
+}
+
+/**
+ * Wakes the flushers whose items have all completed
+ * (called with interrupts disabled)
+ * @param wq - pointer to the queue
+ */
+static void workqueue_wake_flushers(workqueue_t *wq) {
+    unsigned int oldest = workqueue_oldest(wq);
+    int i = 0;
+
+    while (i < wq->nr_flushers) {
+        if (workqueue_before(oldest, wq->flush_seq[i])) {
+            i++;
+            continue;
+        }
+
+        scheduler_wakeup(wq->flushers[i]);
+
+        // Fill the gap with the last flusher
+        wq->nr_flushers--;
+        wq->flushers[i] = wq->flushers[wq->nr_flushers];
+        wq->flush_seq[i] = wq->flush_seq[wq->nr_flushers];
+    }
+}
+
+/**
+ * Finds the queue served by a worker
+ * @param proc - pointer to the worker process
+ * @param id - receives the worker's index in the queue
+ * @return pointer to the queue or NULL if the process is not a worker
+ */
+static workqueue_t *workqueue_find(proc_t *proc, int *id) {
+    for (int i = pool_next(&workqueue_pool, 0); i >= 0; i = pool_next(&workqueue_pool, i + 1)) {
+        workqueue_t *wq = pool_get(&workqueue_pool, i);
+
+        for (int j = 0; j < wq->nr_workers; j++) {
+            if (wq->workers[j] == proc) {
+                *id = j;
+                return wq;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Worker thread: runs queued items, sleeping while the queue is empty
+ */
+static void workqueue_worker(void) {
+    unsigned int flags;
+    workqueue_t *wq;
+    work_t *work;
+    int id = 0;
+
+    wq = workqueue_find(active_proc, &id);
+    if (!wq) {
+        kernel_panic("workqueue: process %d is not a worker", active_proc->pid);
+        return;
+    }
+
+    while (1) {
+        flags = interrupts_save();
+
+        // queue_work wakes a waiting worker
+        while (!wq->head) {
+            scheduler_block();
+        }
+
+        work = wq->head;
+        wq->head = work->next;
+        if (!wq->head) {
+            wq->tail = NULL;
+        }
+
+        // The item may be queued again (or freed) once it starts running
+        work->next = NULL;
+        work->pending = false;
+        wq->running[id] = work->seq;
+
+        interrupts_restore(flags);
+
+        work->func(work);
+
+        flags = interrupts_save();
+
+        wq->running[id] = 0;
+        wq->completed++;
+        workqueue_wake_flushers(wq);
+
+        interrupts_restore(flags);
+    }
+}
+
+/**
+ * Initializes work queues and creates the system work queue
+ */
+void workqueue_init(void) {
+    kernel_log_info("Initializing work queues");
+
+    pool_init(&workqueue_pool);
+
+    system_wq = workqueue_create("events", 1);
+    if (!system_wq) {
+        kernel_panic("workqueue: unable to create the system work queue");
+    }
+}
+
+/**
+ * Initializes a work item
+ * @param work - pointer to the work item
+ * @param func - function to run
+ * @param data - caller data for the function
+ */
+void work_init(work_t *work, work_func_t func, void *data) {
+    kmemset(work, 0, sizeof(work_t));
+    work->func = func;
+    work->data = data;
+}
+
+/**
+ * Creates a work queue and its workers
+ * @param name - name of the queue
+ * @param nr_workers - number of workers (1 runs items strictly in order)
+ * @return pointer to the queue or NULL on error
+ */
+workqueue_t *workqueue_create(char *name, int nr_workers) {
+    char worker_name[PROC_NAME_LEN];
+    unsigned int flags;
+    workqueue_t *wq;
+
+    if (!name || nr_workers < 1 || nr_workers > WORKQUEUE_WORKERS_MAX) {
+        kernel_log_error("workqueue: invalid queue parameters");
+        return NULL;
+    }
+
+    // Workers cannot run until they are all recorded in the queue
+    flags = interrupts_save();
+
+    wq = pool_alloc(&workqueue_pool);
+    if (!wq) {
+        kernel_log_error("workqueue: unable to allocate a work queue");
+        interrupts_restore(flags);
+        return NULL;
+    }
+
+    kmemset(wq, 0, sizeof(workqueue_t));
+    strncpy(wq->name, name, WORKQUEUE_NAME_LEN - 1);
+    wq->next_seq = 1;
+
+    for (int i = 0; i < nr_workers; i++) {
+        int pid;
+
+        snprintf(worker_name, sizeof(worker_name), "%s/%d", wq->name, i);
+
+        pid = kproc_create(workqueue_worker, worker_name);
+        if (pid < 0) {
+            kernel_log_error("workqueue: unable to create worker %s", worker_name);
+            break;
+        }
+
+        wq->workers[wq->nr_workers++] = pid_to_proc(pid);
+    }
+
+    // A queue without workers would never run anything
+    if (wq->nr_workers == 0) {
+        pool_free(&workqueue_pool, wq);
+        interrupts_restore(flags);
+        return NULL;
+    }
+
+    interrupts_restore(flags);
+
+    kernel_log_debug("workqueue: created %s with %d workers", wq->name, wq->nr_workers);
+
+    return wq;
+}
+
+/**
+ * Queues a work item to run in a worker
+ * @param wq - pointer to the queue
+ * @param work - pointer to the work item
+ * @return 1 if queued; 0 if it was already pending; -1 on error
+ */
+int queue_work(workqueue_t *wq, work_t *work) {
+    unsigned int flags;
+
+    if (!wq || !work || !work->func) {
+        return -1;
+    }
+
+    // Work may be queued from interrupt handlers
+    flags = interrupts_save();
+
+    if (work->pending) {
+        interrupts_restore(flags);
+        return 0;
+    }
+
+    work->pending = true;
+    work->next = NULL;
+    work->seq = wq->next_seq++;
+
+    if (wq->tail) {
+        wq->tail->next = work;
+    } else {
+        wq->head = work;
+    }
+    wq->tail = work;
+    wq->queued++;
+
+    // Wake one idle worker; busy workers pick the item up when they finish.
+    // A worker running an item may be blocked inside it (sleeping, on a
+    // mutex or in IPC), so only workers without an item count as idle
+    for (int i = 0; i < wq->nr_workers; i++) {
+        if (wq->running[i] == 0 && wq->workers[i]->state == PROC_STATE_WAITING) {
+            scheduler_wakeup(wq->workers[i]);
+            break;
+        }
+    }
+
+    interrupts_restore(flags);
+
+    return 1;
+}
+
+/**
+ * Queues a work item on the system work queue
+ * @param work - pointer to the work item
+ * @return 1 if queued; 0 if it was already pending; -1 on error
+ */
+int schedule_work(work_t *work) {
+    return queue_work(system_wq, work);
+}
+
+/**
+ * Waits until every item queued before the call has run
+ * @param wq - pointer to the queue
+ * @return -1 on error; 0 on success
+ */
+int flush_workqueue(workqueue_t *wq) {
+    unsigned int flags;
+    unsigned int target;
+    int id;
+
+    if (!wq) {
+        return -1;
+    }
+
+    // The idle process cannot block, and a worker would wait for itself
+    if (active_proc == idle_proc || workqueue_find(active_proc, &id) == wq) {
+        kernel_log_error("workqueue: %s cannot be flushed from process %d", wq->name, active_proc->pid);
+        return -1;
+    }
+
+    flags = interrupts_save();
+
+    target = wq->next_seq;
+
+    while (workqueue_before(workqueue_oldest(wq), target)) {
+        if (wq->nr_flushers >= WORKQUEUE_FLUSHERS_MAX) {
+            kernel_log_error("workqueue: too many processes flushing %s", wq->name);
+            interrupts_restore(flags);
+            return -1;
+        }
+
+        // Completing workers remove and wake the flusher
+        wq->flushers[wq->nr_flushers] = active_proc;
+        wq->flush_seq[wq->nr_flushers] = target;
+        wq->nr_flushers++;
+
+        scheduler_block();
+    }
+
+    interrupts_restore(flags);
+
+    return 0;
+}
+
+/**
+ * Dumps the work queue statistics
+ */
+void workqueue_dump(void) {
+    kernel_log_info("workqueue: %-16s %7s %10s %10s %7s", "name", "workers", "queued", "completed", "pending");
+
+    for (int i = pool_next(&workqueue_pool, 0); i >= 0; i = pool_next(&workqueue_pool, i + 1)) {
+        workqueue_t *wq = pool_get(&workqueue_pool, i);
+
+        kernel_log_info("workqueue: %-16s %7d %10u %10u %7u", wq->name, wq->nr_workers,
+                        wq->queued, wq->completed, wq->next_seq - workqueue_oldest(wq));
+    }
+}